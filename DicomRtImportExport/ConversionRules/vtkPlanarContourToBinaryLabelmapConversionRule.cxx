@@ -0,0 +1,480 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkVariant.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+// SegmentationCore includes
+#include <vtkSegment.h>
+#endif
+
+//----------------------------------------------------------------------------
+// Maximum difference of the slice coordinates of the points of a contour, in voxels.
+// Contours with larger difference are not parallel to the slices
+static const double CONTOUR_SLICE_TOLERANCE = 0.05;
+
+//----------------------------------------------------------------------------
+// Squared distance transform along one row of values with the given stride (Felzenszwalb and Huttenlocher).
+// The values are squared distances (zero for feature voxels and a large value elsewhere), and are replaced by the
+// squared distances including the distance along the row
+static void SquaredDistanceTransform1D(float* values, int numberOfValues, int stride, double spacing,
+  std::vector<double>& rowValues, std::vector<int>& parabolaVertices, std::vector<double>& parabolaBoundaries)
+{
+  rowValues.resize(numberOfValues);
+  parabolaVertices.resize(numberOfValues);
+  parabolaBoundaries.resize(numberOfValues + 1);
+  for (int index = 0; index < numberOfValues; ++index)
+  {
+    rowValues[index] = values[index * stride];
+  }
+
+  // Lower envelope of the parabolas rooted at each value
+  int numberOfParabolas = 0;
+  parabolaVertices[0] = 0;
+  parabolaBoundaries[0] = -std::numeric_limits<double>::infinity();
+  parabolaBoundaries[1] = std::numeric_limits<double>::infinity();
+  for (int index = 1; index < numberOfValues; ++index)
+  {
+    double position = index * spacing;
+    double intersection = 0.0;
+    while (true)
+    {
+      int vertex = parabolaVertices[numberOfParabolas];
+      double vertexPosition = vertex * spacing;
+      intersection = ( (rowValues[index] + position * position) - (rowValues[vertex] + vertexPosition * vertexPosition) )
+        / (2.0 * (position - vertexPosition));
+      if (intersection > parabolaBoundaries[numberOfParabolas] || numberOfParabolas == 0)
+      {
+        break;
+      }
+      --numberOfParabolas;
+    }
+    ++numberOfParabolas;
+    parabolaVertices[numberOfParabolas] = index;
+    parabolaBoundaries[numberOfParabolas] = intersection;
+    parabolaBoundaries[numberOfParabolas + 1] = std::numeric_limits<double>::infinity();
+  }
+
+  // Sample the lower envelope
+  int parabolaIndex = 0;
+  for (int index = 0; index < numberOfValues; ++index)
+  {
+    double position = index * spacing;
+    while (parabolaBoundaries[parabolaIndex + 1] < position)
+    {
+      ++parabolaIndex;
+    }
+    double distance = position - parabolaVertices[parabolaIndex] * spacing;
+    values[index * stride] = static_cast<float>(distance * distance + rowValues[parabolaVertices[parabolaIndex]]);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToBinaryLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+  // Parameters of the planar contour to closed surface conversion, used by ConvertThroughClosedSurface
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  closedSurfaceRule->GetRuleConversionParameters(this->ConversionParameters);
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::~vtkPlanarContourToBinaryLabelmapConversionRule() = default;
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToBinaryLabelmapConversionRule::GetConversionCost(
+  vtkDataObject* vtkNotUsed(sourceRepresentation)/*=nullptr*/,
+  vtkDataObject* vtkNotUsed(targetRepresentation)/*=nullptr*/)
+{
+  // Rough input-independent guess (ms)
+  // Less than the path through closed surface (planar contour to closed surface and closed surface to binary labelmap),
+  // so that labelmaps are created directly from planar contours by default
+  return 500;
+}
+
+//----------------------------------------------------------------------------
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+bool vtkPlanarContourToBinaryLabelmapConversionRule::Convert(vtkSegment* segment)
+{
+  this->CreateTargetRepresentation(segment);
+#else
+bool vtkPlanarContourToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+#endif
+  // Check validity of source and target representation objects
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(segment->GetRepresentation(this->GetSourceRepresentationName()));
+#else
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+#endif
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(segment->GetRepresentation(this->GetTargetRepresentationName()));
+#else
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+#endif
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+  if (planarContourPolyData->GetNumberOfPoints() == 0 || planarContourPolyData->GetNumberOfLines() == 0)
+  {
+    // Empty contours result in empty labelmap
+    int emptyExtent[6] = { 0, -1, 0, -1, 0, -1 };
+    binaryLabelmap->SetExtent(emptyExtent);
+    binaryLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    return true;
+  }
+
+  // Compute output geometry from the reference image geometry and the bounds of the contours
+  if (!this->CalculateOutputGeometry(planarContourPolyData, binaryLabelmap))
+  {
+    vtkErrorMacro("Convert: Failed to calculate output image geometry!");
+    return false;
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  binaryLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(imageToWorldMatrix, worldToImageMatrix);
+
+  // Transform the contours to IJK and collect them by plane (slice coordinate of the contour)
+  std::multimap<double, std::vector<std::array<double, 2> > > contoursBySliceCoordinate;
+  vtkPoints* contourPoints = planarContourPolyData->GetPoints();
+  vtkCellArray* contourLines = planarContourPolyData->GetLines();
+  vtkSmartPointer<vtkIdList> contourPointIds = vtkSmartPointer<vtkIdList>::New();
+  contourLines->InitTraversal();
+  while (contourLines->GetNextCell(contourPointIds))
+  {
+    if (contourPointIds->GetNumberOfIds() < 3)
+    {
+      continue;
+    }
+    std::vector<std::array<double, 2> > contour(contourPointIds->GetNumberOfIds());
+    double minimumSliceCoordinate = VTK_DOUBLE_MAX;
+    double maximumSliceCoordinate = VTK_DOUBLE_MIN;
+    for (vtkIdType pointIndex = 0; pointIndex < contourPointIds->GetNumberOfIds(); ++pointIndex)
+    {
+      double pointWorld[4] = { 0.0, 0.0, 0.0, 1.0 };
+      contourPoints->GetPoint(contourPointIds->GetId(pointIndex), pointWorld);
+      double pointIjk[4] = { 0.0, 0.0, 0.0, 1.0 };
+      worldToImageMatrix->MultiplyPoint(pointWorld, pointIjk);
+      contour[pointIndex] = { pointIjk[0], pointIjk[1] };
+      minimumSliceCoordinate = std::min(minimumSliceCoordinate, pointIjk[2]);
+      maximumSliceCoordinate = std::max(maximumSliceCoordinate, pointIjk[2]);
+    }
+    if (maximumSliceCoordinate - minimumSliceCoordinate > CONTOUR_SLICE_TOLERANCE)
+    {
+      // Scan conversion is only possible on the slices
+      return this->ConvertThroughClosedSurface(planarContourPolyData, binaryLabelmap);
+    }
+    contoursBySliceCoordinate.insert(std::make_pair(0.5 * (minimumSliceCoordinate + maximumSliceCoordinate), contour));
+  }
+  if (contoursBySliceCoordinate.empty())
+  {
+    vtkErrorMacro("Convert: No closed contours found in planar contour representation!");
+    return false;
+  }
+
+  // Group the contours into planes
+  std::vector<double> planeSliceCoordinates;
+  std::vector<std::vector<std::vector<std::array<double, 2> > > > planeContours;
+  for (std::multimap<double, std::vector<std::array<double, 2> > >::iterator contourIt = contoursBySliceCoordinate.begin();
+    contourIt != contoursBySliceCoordinate.end(); ++contourIt)
+  {
+    if (planeSliceCoordinates.empty() || contourIt->first - planeSliceCoordinates.back() > CONTOUR_SLICE_TOLERANCE)
+    {
+      planeSliceCoordinates.push_back(contourIt->first);
+      planeContours.push_back(std::vector<std::vector<std::array<double, 2> > >());
+    }
+    planeContours.back().push_back(contourIt->second);
+  }
+  int numberOfPlanes = static_cast<int>(planeSliceCoordinates.size());
+  double spacing[3] = { 1.0, 1.0, 1.0 };
+  binaryLabelmap->GetSpacing(spacing);
+
+  // The first and last planes are extended by half of the spacing to their neighbor plane. A single plane is extended
+  // by half of the default slice thickness, or only fills the closest slice if it is not set. Like the rows and columns
+  // in FillContours, the slices are filled in the half-open range [first plane - extension, last plane + extension)
+  double defaultSliceThickness = vtkVariant(this->GetConversionParameter(
+    vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName())).ToDouble();
+  double singlePlaneExtension = (defaultSliceThickness > 0.0 ? 0.5 * defaultSliceThickness / spacing[2] : 0.5);
+  double firstPlaneExtension = (numberOfPlanes > 1 ? 0.5 * (planeSliceCoordinates[1] - planeSliceCoordinates[0]) : singlePlaneExtension);
+  double lastPlaneExtension = (numberOfPlanes > 1 ? 0.5 * (planeSliceCoordinates[numberOfPlanes - 1] - planeSliceCoordinates[numberOfPlanes - 2]) : singlePlaneExtension);
+
+  // Extend the slice extent to the extended planes. The output geometry is computed from the bounds of the contours,
+  // so the extension may be outside of it. It is only kept within the reference image geometry if the output is cropped to it
+  int extent[6] = { 0, -1, 0, -1, 0, -1 };
+  binaryLabelmap->GetExtent(extent);
+  extent[4] = std::min(extent[4], static_cast<int>(std::ceil(planeSliceCoordinates[0] - firstPlaneExtension)));
+  extent[5] = std::max(extent[5], static_cast<int>(std::ceil(planeSliceCoordinates[numberOfPlanes - 1] + lastPlaneExtension)) - 1);
+  vtkSmartPointer<vtkMatrix4x4> referenceGeometryMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  int referenceExtent[6] = { 0, -1, 0, -1, 0, -1 };
+  if ( vtkVariant(this->GetConversionParameter(this->GetCropToReferenceImageGeometryParameterName())).ToInt() != 0
+    && vtkSegmentationConverter::DeserializeImageGeometry(this->GetConversionParameter(
+      vtkSegmentationConverter::GetReferenceImageGeometryParameterName()), referenceGeometryMatrix, referenceExtent) )
+  {
+    extent[4] = std::max(extent[4], referenceExtent[4]);
+    extent[5] = std::min(extent[5], referenceExtent[5]);
+  }
+  binaryLabelmap->SetExtent(extent);
+  binaryLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+
+  int dimensions[2] = { extent[1] - extent[0] + 1, extent[3] - extent[2] + 1 };
+  vtkIdType numberOfSliceVoxels = static_cast<vtkIdType>(dimensions[0]) * dimensions[1];
+  if (extent[4] > extent[5] || numberOfSliceVoxels <= 0)
+  {
+    // Contours are outside of the reference image geometry
+    return true;
+  }
+  unsigned char* labelmapPtr = static_cast<unsigned char*>(binaryLabelmap->GetScalarPointer());
+  if (!labelmapPtr)
+  {
+    vtkErrorMacro("Convert: Failed to allocate memory for output labelmap image!");
+    return false;
+  }
+
+  // Masks and signed distance maps are only computed for the planes needed by the current slice
+  std::map<int, std::vector<unsigned char> > planeMasks;
+  std::map<int, std::vector<float> > planeSignedDistances;
+  auto getPlaneMask = [&](int planeIndex) -> const std::vector<unsigned char>&
+  {
+    std::vector<unsigned char>& planeMask = planeMasks[planeIndex];
+    if (planeMask.empty())
+    {
+      this->FillContours(planeContours[planeIndex], extent, planeMask);
+    }
+    return planeMask;
+  };
+  auto getPlaneSignedDistances = [&](int planeIndex) -> const std::vector<float>&
+  {
+    std::vector<float>& signedDistances = planeSignedDistances[planeIndex];
+    if (signedDistances.empty())
+    {
+      this->ComputeSignedDistances(getPlaneMask(planeIndex), dimensions, spacing, signedDistances);
+    }
+    return signedDistances;
+  };
+
+  int nextPlaneIndex = 0; // First plane that is not below the current slice
+  for (int k = extent[4]; k <= extent[5]; ++k)
+  {
+    unsigned char* slicePtr = labelmapPtr + (k - extent[4]) * numberOfSliceVoxels;
+    while (nextPlaneIndex < numberOfPlanes && planeSliceCoordinates[nextPlaneIndex] < k)
+    {
+      ++nextPlaneIndex;
+    }
+    int previousPlaneIndex = nextPlaneIndex - 1;
+
+    // Release the planes that are not needed by the following slices
+    planeMasks.erase(planeMasks.begin(), planeMasks.lower_bound(previousPlaneIndex));
+    planeSignedDistances.erase(planeSignedDistances.begin(), planeSignedDistances.lower_bound(previousPlaneIndex));
+
+    // Use the contours of the closest plane if the slice is on it
+    int closestPlaneIndex = -1;
+    double closestPlaneDistance = VTK_DOUBLE_MAX;
+    for (int planeIndex : { previousPlaneIndex, nextPlaneIndex })
+    {
+      if (planeIndex >= 0 && planeIndex < numberOfPlanes && std::abs(planeSliceCoordinates[planeIndex] - k) < closestPlaneDistance)
+      {
+        closestPlaneIndex = planeIndex;
+        closestPlaneDistance = std::abs(planeSliceCoordinates[planeIndex] - k);
+      }
+    }
+    bool onFirstPlaneExtension = (previousPlaneIndex < 0 && planeSliceCoordinates[0] - k <= firstPlaneExtension);
+    bool onLastPlaneExtension = (nextPlaneIndex >= numberOfPlanes && k - planeSliceCoordinates[numberOfPlanes - 1] < lastPlaneExtension);
+    bool betweenPlanes = (previousPlaneIndex >= 0 && nextPlaneIndex < numberOfPlanes);
+    if (onFirstPlaneExtension || onLastPlaneExtension || (betweenPlanes && closestPlaneDistance < 0.5))
+    {
+      const std::vector<unsigned char>& planeMask = getPlaneMask(closestPlaneIndex);
+      memcpy(slicePtr, planeMask.data(), numberOfSliceVoxels);
+    }
+    else if (betweenPlanes)
+    {
+      // Interpolate between the planes below and above the slice
+      double weight = (k - planeSliceCoordinates[previousPlaneIndex]) / (planeSliceCoordinates[nextPlaneIndex] - planeSliceCoordinates[previousPlaneIndex]);
+      const std::vector<float>& previousSignedDistances = getPlaneSignedDistances(previousPlaneIndex);
+      const std::vector<float>& nextSignedDistances = getPlaneSignedDistances(nextPlaneIndex);
+      for (vtkIdType voxelIndex = 0; voxelIndex < numberOfSliceVoxels; ++voxelIndex)
+      {
+        double signedDistance = (1.0 - weight) * previousSignedDistances[voxelIndex] + weight * nextSignedDistances[voxelIndex];
+        slicePtr[voxelIndex] = (signedDistance < 0.0 ? 1 : 0);
+      }
+    }
+    else
+    {
+      memset(slicePtr, 0, numberOfSliceVoxels);
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToBinaryLabelmapConversionRule::FillContours(const std::vector<std::vector<std::array<double, 2> > >& contours, const int extent[6], std::vector<unsigned char>& sliceMask)
+{
+  int dimensions[2] = { extent[1] - extent[0] + 1, extent[3] - extent[2] + 1 };
+  sliceMask.assign(static_cast<size_t>(dimensions[0]) * dimensions[1], 0);
+
+  // Collect the positions where the edges cross the rows of voxel centers.
+  // An edge crosses a row if one end is on or above the row and the other is below, so vertices on a row are counted once
+  std::vector<std::vector<double> > rowCrossings(dimensions[1]);
+  for (const std::vector<std::array<double, 2> >& contour : contours)
+  {
+    size_t numberOfPoints = contour.size();
+    if (numberOfPoints > 1 && contour[0] == contour[numberOfPoints - 1])
+    {
+      --numberOfPoints;
+    }
+    for (size_t pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+    {
+      const std::array<double, 2>& edgeStart = contour[pointIndex];
+      const std::array<double, 2>& edgeEnd = contour[(pointIndex + 1) % numberOfPoints];
+      if (edgeStart[1] == edgeEnd[1])
+      {
+        continue;
+      }
+      int firstRow = std::max(extent[2], static_cast<int>(std::ceil(std::min(edgeStart[1], edgeEnd[1]))));
+      int lastRow = std::min(extent[3], static_cast<int>(std::ceil(std::max(edgeStart[1], edgeEnd[1]))) - 1);
+      double slope = (edgeEnd[0] - edgeStart[0]) / (edgeEnd[1] - edgeStart[1]);
+      for (int row = firstRow; row <= lastRow; ++row)
+      {
+        rowCrossings[row - extent[2]].push_back(edgeStart[0] + (row - edgeStart[1]) * slope);
+      }
+    }
+  }
+
+  // Fill the voxels with center between each pair of crossings (even-odd rule)
+  for (int rowIndex = 0; rowIndex < dimensions[1]; ++rowIndex)
+  {
+    std::vector<double>& crossings = rowCrossings[rowIndex];
+    std::sort(crossings.begin(), crossings.end());
+    unsigned char* rowPtr = sliceMask.data() + static_cast<size_t>(rowIndex) * dimensions[0];
+    for (size_t crossingIndex = 0; crossingIndex + 1 < crossings.size(); crossingIndex += 2)
+    {
+      int firstColumn = std::max(extent[0], static_cast<int>(std::ceil(crossings[crossingIndex])));
+      int lastColumn = std::min(extent[1], static_cast<int>(std::ceil(crossings[crossingIndex + 1])) - 1);
+      for (int column = firstColumn; column <= lastColumn; ++column)
+      {
+        rowPtr[column - extent[0]] = 1;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToBinaryLabelmapConversionRule::ComputeSignedDistances(const std::vector<unsigned char>& sliceMask, const int dimensions[2], const double spacing[2], std::vector<float>& signedDistances)
+{
+  // Squared distances are stored as float, so the value for no feature voxel only needs to exceed any distance in the slice
+  const float noFeatureValue = 1.0e20f;
+  size_t numberOfVoxels = sliceMask.size();
+  std::vector<float> distancesToInside(numberOfVoxels);
+  std::vector<float> distancesToOutside(numberOfVoxels);
+  for (size_t voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    distancesToInside[voxelIndex] = (sliceMask[voxelIndex] ? 0.0f : noFeatureValue);
+    distancesToOutside[voxelIndex] = (sliceMask[voxelIndex] ? noFeatureValue : 0.0f);
+  }
+
+  // Separable exact Euclidean distance transform: rows first, then columns
+  std::vector<double> rowValues;
+  std::vector<int> parabolaVertices;
+  std::vector<double> parabolaBoundaries;
+  for (std::vector<float>* distances : { &distancesToInside, &distancesToOutside })
+  {
+    for (int row = 0; row < dimensions[1]; ++row)
+    {
+      SquaredDistanceTransform1D(distances->data() + static_cast<size_t>(row) * dimensions[0], dimensions[0], 1, spacing[0],
+        rowValues, parabolaVertices, parabolaBoundaries);
+    }
+    for (int column = 0; column < dimensions[0]; ++column)
+    {
+      SquaredDistanceTransform1D(distances->data() + column, dimensions[1], dimensions[0], spacing[1],
+        rowValues, parabolaVertices, parabolaBoundaries);
+    }
+  }
+
+  signedDistances.resize(numberOfVoxels);
+  for (size_t voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    signedDistances[voxelIndex] = std::sqrt(distancesToInside[voxelIndex]) - std::sqrt(distancesToOutside[voxelIndex]);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkOrientedImageData* binaryLabelmap)
+{
+  vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+  vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule> binaryLabelmapRule = vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule>::New();
+  // This rule has the parameters of both rules (such as end capping and reference image geometry)
+  for (ConversionParameterListType::iterator parameterIt = this->ConversionParameters.begin(); parameterIt != this->ConversionParameters.end(); ++parameterIt)
+  {
+    closedSurfaceRule->SetConversionParameter(parameterIt->first, parameterIt->second.first);
+    binaryLabelmapRule->SetConversionParameter(parameterIt->first, parameterIt->second.first);
+  }
+
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+  segment->AddRepresentation(this->GetSourceRepresentationName(), planarContourPolyData);
+  if (!closedSurfaceRule->Convert(segment) || !binaryLabelmapRule->Convert(segment))
+  {
+    vtkErrorMacro("ConvertThroughClosedSurface: Failed to convert planar contours through closed surface");
+    return false;
+  }
+  binaryLabelmap->DeepCopy(segment->GetRepresentation(this->GetTargetRepresentationName()));
+#else
+  vtkSmartPointer<vtkPolyData> closedSurfacePolyData = vtkSmartPointer<vtkPolyData>::New();
+  if ( !closedSurfaceRule->Convert(planarContourPolyData, closedSurfacePolyData)
+    || !binaryLabelmapRule->Convert(closedSurfacePolyData, binaryLabelmap) )
+  {
+    vtkErrorMacro("ConvertThroughClosedSurface: Failed to convert planar contours through closed surface");
+    return false;
+  }
+#endif
+  return true;
+}
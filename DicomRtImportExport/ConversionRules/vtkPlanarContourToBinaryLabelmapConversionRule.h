@@ -0,0 +1,108 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToBinaryLabelmapConversionRule_h
+#define __vtkPlanarContourToBinaryLabelmapConversionRule_h
+
+// Slicer include
+#include <vtkSlicerVersionConfigure.h>
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkSegmentationConverter.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+// STD includes
+#include <array>
+#include <vector>
+
+class vtkOrientedImageData;
+class vtkPolyData;
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to binary
+///   labelmap representation (vtkOrientedImageData type), without reconstructing the closed surface.
+///   The contours of each plane are scan converted onto the image slices using the even-odd rule, so
+///   contours inside other contours are holes. Slices between two contour planes are filled by interpolating
+///   the signed distance maps of the two planes, and the first and last planes are extended by half of
+///   the contour spacing (a single plane by half of the default slice thickness conversion parameter).
+///   The output geometry is determined the same way as in the base class
+///   \sa vtkClosedSurfaceToBinaryLabelmapConversionRule (reference image geometry conversion parameter),
+///   and the extended planes are cropped to the reference image geometry if the crop parameter is set.
+///   Contours that are not parallel to the slices of the output geometry are converted through closed surface,
+///   using the parameters of \sa vtkPlanarContourToClosedSurfaceConversionRule that this rule also has.
+///   The conversion cost is lower than that of the path through closed surface, so this rule is used by default
+///   to create binary labelmaps from planar contours.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToBinaryLabelmapConversionRule
+  : public vtkClosedSurfaceToBinaryLabelmapConversionRule
+{
+public:
+  static vtkPlanarContourToBinaryLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToBinaryLabelmapConversionRule, vtkClosedSurfaceToBinaryLabelmapConversionRule);
+  vtkSegmentationConverterRule* CreateRuleInstance() override;
+
+  /// Update the target representation based on the source representation
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  bool Convert(vtkSegment* segment) override;
+#else
+  bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) override;
+#endif
+
+  /// Get the cost of the conversion.
+  unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=nullptr, vtkDataObject* targetRepresentation=nullptr) override;
+
+  /// Human-readable name of the converter rule
+  const char* GetName() override { return "Planar contour to binary labelmap"; };
+
+  /// Human-readable name of the source representation
+  const char* GetSourceRepresentationName() override { return vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(); };
+
+  /// Human-readable name of the target representation
+  const char* GetTargetRepresentationName() override { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
+
+protected:
+  /// Scan convert contours lying on one image slice using the even-odd rule
+  /// \param contours Closed contours with points in the IJK coordinate system of the labelmap (repeated closing point is optional)
+  /// \param extent Extent of the labelmap. Only the IJ extent is used
+  /// \param sliceMask Output mask with one value (0 or 1) per voxel of the IJ extent
+  void FillContours(const std::vector<std::vector<std::array<double, 2> > >& contours, const int extent[6], std::vector<unsigned char>& sliceMask);
+
+  /// Compute signed distance map of a slice mask (negative inside, positive outside)
+  /// \param sliceMask Mask with one value per voxel of the IJ extent
+  /// \param dimensions Number of voxels along I and J
+  /// \param spacing Voxel size along I and J, in mm
+  /// \param signedDistances Output distances in mm
+  void ComputeSignedDistances(const std::vector<unsigned char>& sliceMask, const int dimensions[2], const double spacing[2], std::vector<float>& signedDistances);
+
+  /// Convert contours that are not parallel to the slices through closed surface representation.
+  /// All conversion parameters of this rule are passed to both conversion rules
+  bool ConvertThroughClosedSurface(vtkPolyData* planarContourPolyData, vtkOrientedImageData* binaryLabelmap);
+
+protected:
+  vtkPlanarContourToBinaryLabelmapConversionRule();
+  ~vtkPlanarContourToBinaryLabelmapConversionRule() override;
+
+private:
+  vtkPlanarContourToBinaryLabelmapConversionRule(const vtkPlanarContourToBinaryLabelmapConversionRule&) = delete;
+  void operator=(const vtkPlanarContourToBinaryLabelmapConversionRule&) = delete;
+};
+
+#endif // __vtkPlanarContourToBinaryLabelmapConversionRule_h
@@ -41,8 +41,13 @@
 // vtkAddon includes
 #include <vtkAddonMathUtilities.h>
 
+// SlicerRtCommon includes
+#include "vtkSlicerRtCommon.h"
+
 // STD includes
 #include <algorithm>
+#include <array>
+#include <cmath>
 
 // SegmentationCore includes
 #if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
@@ -63,6 +68,150 @@ enum CappingDirection
 };
 static const CappingDirection CappingDirections[] = { CAPPING_BELOW, CAPPING_ABOVE };
 
+//----------------------------------------------------------------------------
+// Buffers of the dynamic programming in TriangulateBetweenContours. Each thread reuses its buffers for all contour pairs,
+// so that the tables are not allocated again for every pair
+struct TriangulationWorkspace
+{
+  std::vector<int> ClosestPointFromLine1ToLine2Ids;
+  std::vector<int> ClosestPointFromLine2ToLine1Ids;
+  // First and last column of the band that is filled in each row
+  std::vector<int> BandStart;
+  std::vector<int> BandEnd;
+  // Index of the first band cell of each row in the backtrack table
+  std::vector<vtkIdType> RowOffsets;
+  std::vector<unsigned char> BacktrackTable;
+  std::vector<double> PreviousRowScores;
+  std::vector<double> CurrentRowScores;
+  std::vector<double> FirstColumnScores;
+};
+static thread_local TriangulationWorkspace ThreadTriangulationWorkspace;
+
+//----------------------------------------------------------------------------
+// Location on a line after the given number of steps of GetNextLocation (that skips the repeated point of closed loops)
+static vtkIdType AdvanceLocation(vtkIdType location, vtkIdType steps, int numberOfPoints, bool loopClosed)
+{
+  if (steps == 0)
+  {
+    return location;
+  }
+  vtkIdType firstLocation = (loopClosed ? 1 : 0);
+  location = (location + 1 == numberOfPoints ? firstLocation : location + 1);
+  vtkIdType period = numberOfPoints - firstLocation;
+  if (period < 1)
+  {
+    return location;
+  }
+  return firstLocation + (location - firstLocation + steps - 1) % period;
+}
+
+//----------------------------------------------------------------------------
+// Uniform grid over the XY bounding boxes of the lines on a plane. Each grid cell lists the lines whose bounding box
+// intersects the cell, so the lines that may overlap a bounding box are found without checking all lines on the plane
+class LineBoundsGrid
+{
+public:
+  LineBoundsGrid(const std::vector<std::array<double, 4> >& lineBounds, vtkIdType firstLineIndex, int numberOfLines)
+  {
+    this->Bounds = { VTK_DOUBLE_MAX, VTK_DOUBLE_MIN, VTK_DOUBLE_MAX, VTK_DOUBLE_MIN };
+    for (vtkIdType lineIndex = firstLineIndex; lineIndex < firstLineIndex + numberOfLines; ++lineIndex)
+    {
+      for (int axis = 0; axis < 2; ++axis)
+      {
+        this->Bounds[2 * axis] = std::min(this->Bounds[2 * axis], lineBounds[lineIndex][2 * axis]);
+        this->Bounds[2 * axis + 1] = std::max(this->Bounds[2 * axis + 1], lineBounds[lineIndex][2 * axis + 1]);
+      }
+    }
+
+    // About one line per cell if the lines are evenly distributed
+    this->Resolution = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(numberOfLines)))));
+    for (int axis = 0; axis < 2; ++axis)
+    {
+      double size = this->Bounds[2 * axis + 1] - this->Bounds[2 * axis];
+      this->CellSize[axis] = (size > 0.0 ? size / this->Resolution : 1.0);
+    }
+
+    this->Cells.resize(this->Resolution * this->Resolution);
+    for (vtkIdType lineIndex = firstLineIndex; lineIndex < firstLineIndex + numberOfLines; ++lineIndex)
+    {
+      int cellRange[4] = { 0, 0, 0, 0 };
+      this->GetCellRange(lineBounds[lineIndex].data(), cellRange);
+      for (int y = cellRange[2]; y <= cellRange[3]; ++y)
+      {
+        for (int x = cellRange[0]; x <= cellRange[1]; ++x)
+        {
+          this->Cells[y * this->Resolution + x].push_back(lineIndex);
+        }
+      }
+    }
+  }
+
+  /// Get the lines in the cells intersecting the bounds. A line spanning multiple cells may be returned more than once
+  template <class LineVisitor>
+  void VisitCandidateLines(const double bounds[4], LineVisitor visitLine) const
+  {
+    if ( bounds[1] < this->Bounds[0] || bounds[0] > this->Bounds[1]
+      || bounds[3] < this->Bounds[2] || bounds[2] > this->Bounds[3] )
+    {
+      return;
+    }
+    int cellRange[4] = { 0, 0, 0, 0 };
+    this->GetCellRange(bounds, cellRange);
+    for (int y = cellRange[2]; y <= cellRange[3]; ++y)
+    {
+      for (int x = cellRange[0]; x <= cellRange[1]; ++x)
+      {
+        for (vtkIdType lineIndex : this->Cells[y * this->Resolution + x])
+        {
+          visitLine(lineIndex);
+        }
+      }
+    }
+  }
+
+protected:
+  void GetCellRange(const double bounds[4], int cellRange[4]) const
+  {
+    for (int axis = 0; axis < 2; ++axis)
+    {
+      for (int side = 0; side < 2; ++side)
+      {
+        int cell = static_cast<int>(std::floor((bounds[2 * axis + side] - this->Bounds[2 * axis]) / this->CellSize[axis]));
+        cellRange[2 * axis + side] = std::max(0, std::min(cell, this->Resolution - 1));
+      }
+    }
+  }
+
+  std::array<double, 4> Bounds;
+  double CellSize[2];
+  int Resolution;
+  std::vector<std::vector<vtkIdType> > Cells;
+};
+
+//----------------------------------------------------------------------------
+// Orientation of the point c relative to the directed line from a to b in the XY plane (positive if on the left)
+static double GetOrientation2D(const double a[2], const double b[2], const double c[2])
+{
+  return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+//----------------------------------------------------------------------------
+// Determine if the segments ab and cd intersect (including touching) in the XY plane
+static bool DoSegmentsIntersect2D(const double a[2], const double b[2], const double c[2], const double d[2])
+{
+  if ( std::max(a[0], b[0]) < std::min(c[0], d[0]) || std::max(c[0], d[0]) < std::min(a[0], b[0])
+    || std::max(a[1], b[1]) < std::min(c[1], d[1]) || std::max(c[1], d[1]) < std::min(a[1], b[1]) )
+  {
+    return false;
+  }
+  double abc = GetOrientation2D(a, b, c);
+  double abd = GetOrientation2D(a, b, d);
+  double cda = GetOrientation2D(c, d, a);
+  double cdb = GetOrientation2D(c, d, b);
+  // Bounding boxes overlap, so collinear segments also overlap
+  return (abc * abd <= 0.0 && cda * cdb <= 0.0);
+}
+
 //----------------------------------------------------------------------------
 vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToClosedSurfaceConversionRule);
 
@@ -80,6 +229,10 @@ vtkPlanarContourToClosedSurfaceConversionRule::vtkPlanarContourToClosedSurfaceCo
   this->ImagePadding[1] = 4;
   this->ImagePadding[2] = 0;
 
+  this->NumberOfThreads = 0;
+  this->MaximumTriangulationTableSize = 1000000;
+  this->GeometricEndCapping = true;
+
   this->ConversionParameters[this->GetDefaultSliceThicknessParameterName()] = std::make_pair("0.0",
     "Default thickness for contours if slice spacing cannot be calculated.");
   this->ConversionParameters[this->GetEndCappingParameterName()] = std::make_pair("1",
@@ -192,12 +345,19 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
 
   double spacing = this->GetSpacingBetweenLines(inputContoursCopy);
 
+  // Lines, their point locators and XY bounds are created once and shared by all plane pairs
+  std::vector<vtkSmartPointer<vtkLine> > lines(numberOfLines);
+  std::vector<std::array<double, 4> > lineBounds(numberOfLines);
   std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators(numberOfLines);
   std::vector<vtkSmartPointer<vtkIdList> > linePointIdLists(numberOfLines);
   for (int lineIndex = 0; lineIndex < numberOfLines; ++lineIndex)
   {
     vtkSmartPointer<vtkLine> currentLine = vtkSmartPointer<vtkLine>::New();
     currentLine->DeepCopy(inputContoursCopy->GetCell(lineIndex));
+    lines[lineIndex] = currentLine;
+    double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    currentLine->GetBounds(bounds);
+    lineBounds[lineIndex] = { bounds[0], bounds[1], bounds[2], bounds[3] };
     linePointIdLists[lineIndex] = currentLine->GetPointIds();
     vtkSmartPointer<vtkPolyData> linePolyData = vtkSmartPointer<vtkPolyData>::New();
     linePolyData->SetPoints(currentLine->GetPoints());
@@ -215,105 +375,117 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::Convert(vtkDataObject* sourc
     lineTriganulatedToBelow[i] = false;
   }
 
-  // Get two consecutive planes.
-  vtkIdType firstLineOnPlane1Index = 0; // pointer to first line on plane 1.
-  int numberOfLinesInPlane1 = this->GetNumberOfLinesOnPlane(inputContoursCopy, 0, spacing);
+  // Get the planes of the contours. Each plane is given by the index of its first line and its number of lines
+  std::vector<std::pair<vtkIdType, int> > planes;
+  for (vtkIdType firstLineOnPlaneIndex = 0; firstLineOnPlaneIndex < numberOfLines; )
+  {
+    int numberOfLinesOnPlane = this->GetNumberOfLinesOnPlane(inputContoursCopy, firstLineOnPlaneIndex, spacing);
+    planes.push_back(std::make_pair(firstLineOnPlaneIndex, numberOfLinesOnPlane));
+    firstLineOnPlaneIndex += numberOfLinesOnPlane;
+  }
 
-  // Loop through all of the contours in the polydata
-  while (firstLineOnPlane1Index + numberOfLinesInPlane1 < numberOfLines)
+  // Triangles between two consecutive planes, and the line pairs they connect (line on the lower plane first)
+  struct PlanePairTriangulation
   {
-    vtkIdType firstLineOnPlane2Index = firstLineOnPlane1Index + numberOfLinesInPlane1; // pointer to first line on plane 2
-    int numberOfLinesInPlane2 = this->GetNumberOfLinesOnPlane(inputContoursCopy, firstLineOnPlane2Index, spacing); // number of lines on plane 2
+    vtkSmartPointer<vtkCellArray> Polygons;
+    std::vector<std::pair<vtkIdType, vtkIdType> > TriangulatedLinePairs;
+  };
+  size_t numberOfPlanePairs = (planes.size() > 1 ? planes.size() - 1 : 0);
+  std::vector<PlanePairTriangulation> planePairTriangulations(numberOfPlanePairs);
+
+  // Triangulate the plane pairs concurrently. The contours, lines and point locators are only read by the workers,
+  // and each plane pair is triangulated into its own cell array
+  unsigned int numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->NumberOfThreads, numberOfPlanePairs);
+  vtkSlicerRtCommon::RunOnWorkerThreads(numberOfPlanePairs, numberOfThreads,
+    [&](size_t planePairIndex)
+    {
+      vtkIdType firstLineOnPlane1Index = planes[planePairIndex].first; // pointer to first line on plane 1
+      int numberOfLinesInPlane1 = planes[planePairIndex].second; // number of lines on plane 1
+      vtkIdType firstLineOnPlane2Index = planes[planePairIndex + 1].first; // pointer to first line on plane 2
+      int numberOfLinesInPlane2 = planes[planePairIndex + 1].second; // number of lines on plane 2
 
-    // initialize overlaps lists. - list of list
-    // Each internal list represents a line from the plane and will store the pointers to the overlap lines
+      PlanePairTriangulation& triangulation = planePairTriangulations[planePairIndex];
+      triangulation.Polygons = vtkSmartPointer<vtkCellArray>::New();
 
-    // List of Overlaps for lines that overlap with other lines from plane 1 and 2
-    std::vector< std::vector< vtkIdType > > plane1Overlaps(numberOfLinesInPlane1);
-    std::vector< std::vector< vtkIdType > > plane2Overlaps(numberOfLinesInPlane2);
+      // initialize overlaps lists. - list of list
+      // Each internal list represents a line from the plane and will store the pointers to the overlap lines
 
-    // Loop through the lines in the first plane
-    for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
-    {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane1Index + line1Index));
+      // List of Overlaps for lines that overlap with other lines from plane 1 and 2
+      std::vector< std::vector< vtkIdType > > plane1Overlaps;
+      std::vector< std::vector< vtkIdType > > plane2Overlaps;
+      this->FindOverlappingLines(lineBounds, firstLineOnPlane1Index, numberOfLinesInPlane1, firstLineOnPlane2Index, numberOfLinesInPlane2,
+        plane1Overlaps, plane2Overlaps);
 
-      // Loop through the lines in the second plane
-      for (int line2Index = 0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      // Loop through all of the lines in the first plane
+      for (int line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index + numberOfLinesInPlane1; ++line1Index)
       {
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(firstLineOnPlane2Index + line2Index));
+        vtkLine* line1 = lines[line1Index];
+
+        std::vector<vtkSmartPointer<vtkPointLocator> > overlap1PointLocators(plane1Overlaps[line1Index - firstLineOnPlane1Index].size());
+        std::vector<vtkSmartPointer<vtkIdList> > overlap1PointIds(plane1Overlaps[line1Index - firstLineOnPlane1Index].size());
 
-        // If the two lines overlap, then add them to the lists
-        if (this->DoLinesOverlap(line1, line2))
+        // Loop through all of the lines in the second plane that overlap with the current line in the first plane
+        for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index - firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
         {
-          // line from plane 1 overlaps with line from plane 2
-          plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index + line2Index);
-          plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index + line1Index);
+          vtkIdType j = plane1Overlaps[line1Index - firstLineOnPlane1Index][overlapIndex];
+          overlap1PointLocators[overlapIndex] = pointLocators[j];
+          overlap1PointIds[overlapIndex] = linePointIdLists[j];
         }
-      }
-    }
-
-    // Loop through all of the lines in the first plane
-    for (int line1Index = firstLineOnPlane1Index; line1Index < firstLineOnPlane1Index + numberOfLinesInPlane1; ++line1Index)
-    {
-      vtkSmartPointer<vtkLine> line1 = vtkSmartPointer<vtkLine>::New();
-      line1->DeepCopy(inputContoursCopy->GetCell(line1Index));
-
-      std::vector<vtkSmartPointer<vtkPointLocator> > overlap1PointLocators(plane1Overlaps[line1Index - firstLineOnPlane1Index].size());
-      std::vector<vtkSmartPointer<vtkIdList> > overlap1PointIds(plane1Overlaps[line1Index - firstLineOnPlane1Index].size());
 
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index - firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-      {
-        vtkIdType j = plane1Overlaps[line1Index - firstLineOnPlane1Index][overlapIndex];
-        overlap1PointLocators[overlapIndex] = pointLocators[j];
-        overlap1PointIds[overlapIndex] = linePointIdLists[j];
-      }
+        // Loop through all of the lines in the second plane that overlap with the current line in the first plane
+        for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index - firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
+        {
+          vtkIdType line2Index = plane1Overlaps[line1Index - firstLineOnPlane1Index][overlapIndex];
 
-      // Loop through all of the lines in the second plane that overlap with the current line in the first plane
-      for (size_t overlapIndex = 0; overlapIndex < plane1Overlaps[line1Index - firstLineOnPlane1Index].size(); ++overlapIndex) // lines on plane 2 that overlap with line 1
-      {
-        vtkIdType line2Index = plane1Overlaps[line1Index - firstLineOnPlane1Index][overlapIndex];
+          vtkLine* line2 = lines[line2Index];
 
-        vtkSmartPointer<vtkLine> line2 = vtkSmartPointer<vtkLine>::New();
-        line2->DeepCopy(inputContoursCopy->GetCell(line2Index));
+          std::vector<vtkSmartPointer<vtkPointLocator> > overlap2PointLocators(plane2Overlaps[line2Index - firstLineOnPlane2Index].size());
+          std::vector<vtkSmartPointer<vtkIdList> > overlap2PointIds(plane2Overlaps[line2Index - firstLineOnPlane2Index].size());
 
-        std::vector<vtkSmartPointer<vtkPointLocator> > overlap2PointLocators(plane2Overlaps[line2Index - firstLineOnPlane2Index].size());
-        std::vector<vtkSmartPointer<vtkIdList> > overlap2PointIds(plane2Overlaps[line2Index - firstLineOnPlane2Index].size());
+          for (size_t i = 0; i < plane2Overlaps[line2Index - firstLineOnPlane2Index].size(); ++i)
+          {
+            int j = plane2Overlaps[line2Index - firstLineOnPlane2Index][i];
+            overlap2PointLocators[i] = pointLocators[j];
+            overlap2PointIds[i] = linePointIdLists[j];
+          }
 
-        for (size_t i = 0; i < plane2Overlaps[line2Index - firstLineOnPlane2Index].size(); ++i)
-        {
-          int j = plane2Overlaps[line2Index - firstLineOnPlane2Index][i];
-          overlap2PointLocators[i] = pointLocators[j];
-          overlap2PointIds[i] = linePointIdLists[j];
-        }
+          // Get the portion of line 1 that is close to line 2,
+          vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
+          this->Branch(inputContoursCopy, line1, line2Index, plane1Overlaps[line1Index - firstLineOnPlane1Index], overlap1PointLocators, overlap1PointIds, dividedLine1);
+          vtkSmartPointer<vtkIdList> dividedPointsInLine1 = dividedLine1->GetPointIds();
+          int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
 
-        // Get the portion of line 1 that is close to line 2,
-        vtkSmartPointer<vtkLine> dividedLine1 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line1, line2Index, plane1Overlaps[line1Index - firstLineOnPlane1Index], overlap1PointLocators, overlap1PointIds, dividedLine1);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine1 = dividedLine1->GetPointIds();
-        int numberOfdividedPointsInLine1 = dividedLine1->GetNumberOfPoints();
+          // Get the portion of line 2 that is close to line 1.
+          vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
+          this->Branch(inputContoursCopy, line2, line1Index, plane2Overlaps[line2Index - firstLineOnPlane2Index], overlap2PointLocators, overlap2PointIds, dividedLine2);
+          vtkSmartPointer<vtkIdList> dividedPointsInLine2 = dividedLine2->GetPointIds();
+          int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
 
-        // Get the portion of line 2 that is close to line 1.
-        vtkSmartPointer<vtkLine> dividedLine2 = vtkSmartPointer<vtkLine>::New();
-        this->Branch(inputContoursCopy, line2, line1Index, plane2Overlaps[line2Index - firstLineOnPlane2Index], overlap2PointLocators, overlap2PointIds, dividedLine2);
-        vtkSmartPointer<vtkIdList> dividedPointsInLine2 = dividedLine2->GetPointIds();
-        int numberOfdividedPointsInLine2 = dividedLine2->GetNumberOfPoints();
+          if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
+          {
+            triangulation.TriangulatedLinePairs.push_back(std::make_pair(static_cast<vtkIdType>(line1Index), line2Index));
+            this->TriangulateBetweenContours(inputContoursCopy, dividedPointsInLine1, dividedPointsInLine2, triangulation.Polygons);
+          }
 
-        if (numberOfdividedPointsInLine1 > 1 && numberOfdividedPointsInLine2 > 1)
-        {
-          lineTriganulatedToAbove[line1Index] = true;
-          lineTriganulatedToBelow[line2Index] = true;
-          this->TriangulateBetweenContours(inputContoursCopy, dividedPointsInLine1, dividedPointsInLine2, outputPolygons);
         }
-
       }
-    }
+    },
+    [](size_t) {});
 
-    // Advance the points
-    firstLineOnPlane1Index = firstLineOnPlane2Index;
-    numberOfLinesInPlane1 = numberOfLinesInPlane2;
+  // Add the triangles in the order of the planes, so that the output does not depend on the number of threads
+  vtkSmartPointer<vtkIdList> trianglePointIds = vtkSmartPointer<vtkIdList>::New();
+  for (const PlanePairTriangulation& triangulation : planePairTriangulations)
+  {
+    triangulation.Polygons->InitTraversal();
+    while (triangulation.Polygons->GetNextCell(trianglePointIds))
+    {
+      outputPolygons->InsertNextCell(trianglePointIds);
+    }
+    for (const std::pair<vtkIdType, vtkIdType>& linePair : triangulation.TriangulatedLinePairs)
+    {
+      lineTriganulatedToAbove[linePair.first] = true;
+      lineTriganulatedToBelow[linePair.second] = true;
+    }
   }
 
   // Triangulate all contours which are exposed.
@@ -369,10 +541,13 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
   int numberOfPointsInLine1 = pointsInLine1->GetNumberOfIds();
   int numberOfPointsInLine2 = pointsInLine2->GetNumberOfIds();
 
+  TriangulationWorkspace& workspace = ThreadTriangulationWorkspace;
+
   // Pre-calculate and store the closest points.
 
   // Closest point from line 1 to line 2
-  std::vector< int > closestPointFromLine1ToLine2Ids(numberOfPointsInLine1);
+  std::vector<int>& closestPointFromLine1ToLine2Ids = workspace.ClosestPointFromLine1ToLine2Ids;
+  closestPointFromLine1ToLine2Ids.resize(numberOfPointsInLine1);
   for (int line1PointIndex = 0; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
   {
     double line1Point[3] = { 0,0,0 };
@@ -381,7 +556,8 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
   }
 
   // Closest from line 2 to line 1
-  std::vector< int > closestPointFromLine2ToLine1Ids(numberOfPointsInLine2);
+  std::vector<int>& closestPointFromLine2ToLine1Ids = workspace.ClosestPointFromLine2ToLine1Ids;
+  closestPointFromLine2ToLine1Ids.resize(numberOfPointsInLine2);
   for (int line2PointIndex = 0; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
   {
     double line2Point[3] = { 0,0,0 };
@@ -411,17 +587,41 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
 
   // Initialize the Dynamic Programming table.
   // Rows represent line 1. Columns represent line 2.
-
-  // Initialize the score table.
-  std::vector< std::vector< double > > scoreTable(numberOfPointsInLine1, std::vector< double >(numberOfPointsInLine2));
-  scoreTable[0][0] = vtkMath::Distance2BetweenPoints(firstPointLine1, firstPointLine2);
-
-  std::vector< std::vector< BacktrackDirection > > backtrackTable(numberOfPointsInLine1, std::vector< BacktrackDirection >(numberOfPointsInLine2));
-  backtrackTable[0][0] = DYNAMIC_BACKTRACK_UP;
+  // Backtrack directions are stored in one flat table, and scores only for the previous and the current row.
+
+  // Large tables are only filled in a band around the diagonal, which connects the aligned start points and the end points.
+  // The band is wider than the slope of the diagonal so that the bands of consecutive rows are connected
+  int bandHalfWidth = numberOfPointsInLine2;
+  if ( this->MaximumTriangulationTableSize > 0 && numberOfPointsInLine1 > 1 && numberOfPointsInLine2 > 1
+    && static_cast<vtkIdType>(numberOfPointsInLine1) * numberOfPointsInLine2 > this->MaximumTriangulationTableSize )
+  {
+    double diagonalSlope = static_cast<double>(numberOfPointsInLine2 - 1) / (numberOfPointsInLine1 - 1);
+    bandHalfWidth = std::max(static_cast<int>(std::ceil(diagonalSlope)) + 1,
+      static_cast<int>(this->MaximumTriangulationTableSize / (2 * static_cast<vtkIdType>(numberOfPointsInLine1))));
+  }
+  workspace.BandStart.resize(numberOfPointsInLine1);
+  workspace.BandEnd.resize(numberOfPointsInLine1);
+  workspace.RowOffsets.resize(numberOfPointsInLine1 + 1);
+  workspace.RowOffsets[0] = 0;
+  for (int line1PointIndex = 0; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
+  {
+    double diagonalColumn = (numberOfPointsInLine1 > 1
+      ? static_cast<double>(line1PointIndex) * (numberOfPointsInLine2 - 1) / (numberOfPointsInLine1 - 1) : 0.0);
+    workspace.BandStart[line1PointIndex] = std::max(0, static_cast<int>(std::floor(diagonalColumn)) - bandHalfWidth);
+    workspace.BandEnd[line1PointIndex] = std::min(numberOfPointsInLine2 - 1, static_cast<int>(std::ceil(diagonalColumn)) + bandHalfWidth);
+    workspace.RowOffsets[line1PointIndex + 1] = workspace.RowOffsets[line1PointIndex]
+      + workspace.BandEnd[line1PointIndex] - workspace.BandStart[line1PointIndex] + 1;
+  }
+  workspace.BacktrackTable.resize(workspace.RowOffsets[numberOfPointsInLine1]);
+  workspace.PreviousRowScores.resize(numberOfPointsInLine2);
+  workspace.CurrentRowScores.resize(numberOfPointsInLine2);
+  workspace.FirstColumnScores.resize(numberOfPointsInLine1);
 
   // Initialize the first row in the table.
+  workspace.CurrentRowScores[0] = vtkMath::Distance2BetweenPoints(firstPointLine1, firstPointLine2);
+  workspace.BacktrackTable[0] = DYNAMIC_BACKTRACK_UP;
   vtkIdType currentPointIdLine2 = this->GetNextLocation(startLine2PointId, numberOfPointsInLine2, line2Closed);
-  for (int line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
+  for (int line2PointIndex = 1; line2PointIndex <= workspace.BandEnd[0]; ++line2PointIndex)
   {
     double currentPointLine2[3] = { 0,0,0 }; // current point on line 2
     inputROIPoints->GetPoint(pointsInLine2->GetId(currentPointIdLine2), currentPointLine2);
@@ -429,13 +629,14 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
     // Use the distance between first point on line 1 and current point on line 2.
     double distance = vtkMath::Distance2BetweenPoints(firstPointLine1, currentPointLine2);
 
-    scoreTable[0][line2PointIndex] = scoreTable[0][line2PointIndex - 1] + distance;
-    backtrackTable[0][line2PointIndex] = DYNAMIC_BACKTRACK_LEFT;
+    workspace.CurrentRowScores[line2PointIndex] = workspace.CurrentRowScores[line2PointIndex - 1] + distance;
+    workspace.BacktrackTable[line2PointIndex] = DYNAMIC_BACKTRACK_LEFT;
 
     currentPointIdLine2 = this->GetNextLocation(currentPointIdLine2, numberOfPointsInLine2, line2Closed);
   }
 
   // Initialize the first column in the table.
+  workspace.FirstColumnScores[0] = workspace.CurrentRowScores[0];
   vtkIdType currentPointIdLine1 = this->GetNextLocation(startLine1PointId, numberOfPointsInLine2, line1Closed);
   for (int line1PointIndex = 1; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
   {
@@ -445,59 +646,75 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
     // Use the distance between first point on line 2 and current point on line 1.
     double distance = vtkMath::Distance2BetweenPoints(currentPointLine1, firstPointLine2);
 
-    scoreTable[line1PointIndex][0] = scoreTable[line1PointIndex - 1][0] + distance;
-    backtrackTable[line1PointIndex][0] = DYNAMIC_BACKTRACK_UP;
-    for (int line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
-    {
-      scoreTable[line1PointIndex][line2PointIndex] = 0;
-      backtrackTable[line1PointIndex][line2PointIndex] = DYNAMIC_BACKTRACK_UP;
-    }
+    workspace.FirstColumnScores[line1PointIndex] = workspace.FirstColumnScores[line1PointIndex - 1] + distance;
 
     currentPointIdLine1 = this->GetNextLocation(currentPointIdLine1, numberOfPointsInLine1, line1Closed);
   }
 
   // Fill the rest of the table.
   vtkIdType previousLine1 = startLine1PointId;
-  vtkIdType previousLine2 = startLine2PointId;
-
   currentPointIdLine1 = this->GetNextLocation(startLine1PointId, numberOfPointsInLine1, line1Closed);
-  currentPointIdLine2 = this->GetNextLocation(startLine2PointId, numberOfPointsInLine2, line2Closed);
-
-  vtkIdType line1PointIndex = 1;
-  vtkIdType line2PointIndex = 1;
-  for (line1PointIndex = 1; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
+  for (int line1PointIndex = 1; line1PointIndex < numberOfPointsInLine1; ++line1PointIndex)
   {
+    std::swap(workspace.PreviousRowScores, workspace.CurrentRowScores);
+    std::vector<double>& previousRowScores = workspace.PreviousRowScores;
+    std::vector<double>& currentRowScores = workspace.CurrentRowScores;
+    int bandStart = workspace.BandStart[line1PointIndex];
+    int bandEnd = workspace.BandEnd[line1PointIndex];
+    int previousBandEnd = workspace.BandEnd[line1PointIndex - 1];
+    unsigned char* backtrackRow = &workspace.BacktrackTable[workspace.RowOffsets[line1PointIndex]];
+
+    int firstColumn = bandStart;
+    if (bandStart == 0)
+    {
+      currentRowScores[0] = workspace.FirstColumnScores[line1PointIndex];
+      backtrackRow[0] = DYNAMIC_BACKTRACK_UP;
+      firstColumn = 1;
+    }
+
     double pointOnLine1[3] = { 0,0,0 };
     inputROIPoints->GetPoint(pointsInLine1->GetId(currentPointIdLine1), pointOnLine1);
 
-    for (line2PointIndex = 1; line2PointIndex < numberOfPointsInLine2; ++line2PointIndex)
+    // Points on line 2 are visited in the same order as if the whole table was filled row by row
+    vtkIdType columnStep = static_cast<vtkIdType>(line1PointIndex - 1) * (numberOfPointsInLine2 - 1) + firstColumn;
+    vtkIdType previousLine2 = AdvanceLocation(startLine2PointId, columnStep - 1, numberOfPointsInLine2, line2Closed);
+    currentPointIdLine2 = AdvanceLocation(startLine2PointId, columnStep, numberOfPointsInLine2, line2Closed);
+
+    for (int line2PointIndex = firstColumn; line2PointIndex <= bandEnd; ++line2PointIndex)
     {
       double pointOnLine2[3] = { 0,0,0 };
       inputROIPoints->GetPoint(pointsInLine2->GetId(currentPointIdLine2), pointOnLine2);
 
       double distance = vtkMath::Distance2BetweenPoints(pointOnLine1, pointOnLine2);
 
+      // Cells outside the band cannot be stepped from
+      bool leftInBand = (line2PointIndex > bandStart);
+      bool upInBand = (line2PointIndex <= previousBandEnd);
+
       // Use the pre-calculated closest point.
-      if (currentPointIdLine1 == closestPointFromLine2ToLine1Ids[previousLine2])
+      BacktrackDirection direction = DYNAMIC_BACKTRACK_UP;
+      if (leftInBand && (!upInBand || currentPointIdLine1 == closestPointFromLine2ToLine1Ids[previousLine2]))
+      {
+        direction = DYNAMIC_BACKTRACK_LEFT;
+      }
+      else if (upInBand && (!leftInBand || currentPointIdLine2 == closestPointFromLine1ToLine2Ids[previousLine1]))
       {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex][line2PointIndex - 1] + distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = DYNAMIC_BACKTRACK_LEFT;
+        direction = DYNAMIC_BACKTRACK_UP;
       }
-      else if (currentPointIdLine2 == closestPointFromLine1ToLine2Ids[previousLine1])
+      else if (currentRowScores[line2PointIndex - 1] <= previousRowScores[line2PointIndex])
       {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex - 1][line2PointIndex] + distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = DYNAMIC_BACKTRACK_UP;
+        direction = DYNAMIC_BACKTRACK_LEFT;
       }
-      else if (scoreTable[line1PointIndex][line2PointIndex - 1] <= scoreTable[line1PointIndex - 1][line2PointIndex])
+
+      if (direction == DYNAMIC_BACKTRACK_LEFT)
       {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex][line2PointIndex - 1] + distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = DYNAMIC_BACKTRACK_LEFT;
+        currentRowScores[line2PointIndex] = currentRowScores[line2PointIndex - 1] + distance;
       }
       else
       {
-        scoreTable[line1PointIndex][line2PointIndex] = scoreTable[line1PointIndex - 1][line2PointIndex] + distance;
-        backtrackTable[line1PointIndex][line2PointIndex] = DYNAMIC_BACKTRACK_UP;
+        currentRowScores[line2PointIndex] = previousRowScores[line2PointIndex] + distance;
       }
+      backtrackRow[line2PointIndex - bandStart] = direction;
 
       // Advance the pointers
       previousLine2 = currentPointIdLine2;
@@ -508,10 +725,11 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
   }
 
   // Backtrack.
+  // The table is only traversed if line 1 has more than one point
   currentPointIdLine1 = line1EndPoint;
   currentPointIdLine2 = line2EndPoint;
-  --line1PointIndex;
-  --line2PointIndex;
+  vtkIdType line1PointIndex = numberOfPointsInLine1 - 1;
+  vtkIdType line2PointIndex = (numberOfPointsInLine1 > 1 ? numberOfPointsInLine2 - 1 : 0);
   while (line1PointIndex > 0 || line2PointIndex > 0)
   {
     double line1Point[3] = { 0,0,0 }; // current point on line 1
@@ -523,7 +741,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::TriangulateBetweenContours(v
     vtkIdType currentTriangle[3] = { 0,0,0 };
     currentTriangle[0] = pointsInLine1->GetId(currentPointIdLine1);
     currentTriangle[1] = pointsInLine2->GetId(currentPointIdLine2);
-    if (backtrackTable[line1PointIndex][line2PointIndex] == DYNAMIC_BACKTRACK_LEFT)
+    if (workspace.BacktrackTable[workspace.RowOffsets[line1PointIndex] + line2PointIndex - workspace.BandStart[line1PointIndex]] == DYNAMIC_BACKTRACK_LEFT)
     {
       vtkIdType previousPointIndexLine2 = this->GetPreviousLocation(currentPointIdLine2, numberOfPointsInLine2, line2Closed);
       currentTriangle[2] = pointsInLine2->GetId(previousPointIndexLine2);
@@ -971,15 +1189,64 @@ bool vtkPlanarContourToClosedSurfaceConversionRule::DoLinesOverlap(vtkLine* line
   double bounds2[6];
   line2->GetBounds(bounds2);
 
+  return DoLineBoundsOverlap(bounds1, bounds2);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToClosedSurfaceConversionRule::DoLineBoundsOverlap(const double bounds1[4], const double bounds2[4])
+{
   return bounds1[0] < bounds2[1] &&
     bounds1[1] > bounds2[0] &&
     bounds1[2] < bounds2[3] &&
     bounds1[3] > bounds2[2];
 }
 
+//----------------------------------------------------------------------------
+void vtkPlanarContourToClosedSurfaceConversionRule::FindOverlappingLines(const std::vector<std::array<double, 4> >& lineBounds,
+  vtkIdType firstLineOnPlane1Index, int numberOfLinesInPlane1, vtkIdType firstLineOnPlane2Index, int numberOfLinesInPlane2,
+  std::vector<std::vector<vtkIdType> >& plane1Overlaps, std::vector<std::vector<vtkIdType> >& plane2Overlaps)
+{
+  plane1Overlaps.assign(numberOfLinesInPlane1, std::vector<vtkIdType>());
+  plane2Overlaps.assign(numberOfLinesInPlane2, std::vector<vtkIdType>());
+
+  // Only the lines on the second plane that share a grid cell with a line on the first plane are checked for overlap
+  LineBoundsGrid plane2Grid(lineBounds, firstLineOnPlane2Index, numberOfLinesInPlane2);
+  std::vector<int> plane2LastCheckedLine1Index(numberOfLinesInPlane2, -1); // Each pair is checked only once
+
+  // Loop through the lines in the first plane
+  for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
+  {
+    const double* bounds1 = lineBounds[firstLineOnPlane1Index + line1Index].data();
+    std::vector< vtkIdType >& line1Overlaps = plane1Overlaps[line1Index];
+
+    // Loop through the candidate lines in the second plane
+    plane2Grid.VisitCandidateLines(bounds1, [&](vtkIdType line2Id)
+    {
+      vtkIdType line2Index = line2Id - firstLineOnPlane2Index;
+      if (plane2LastCheckedLine1Index[line2Index] == line1Index)
+      {
+        return;
+      }
+      plane2LastCheckedLine1Index[line2Index] = line1Index;
+
+      // If the two lines overlap, then add them to the lists
+      if (DoLineBoundsOverlap(bounds1, lineBounds[line2Id].data()))
+      {
+        // line from plane 1 overlaps with line from plane 2
+        line1Overlaps.push_back(line2Id);
+        plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index + line1Index);
+      }
+    });
+
+    // Keep the overlapping lines in index order, as the branching depends on the order of the lines.
+    // The lists of the second plane are filled in the order of the first plane lines, so they are already sorted
+    std::sort(line1Overlaps.begin(), line1Overlaps.end());
+  }
+}
+
 // TODO: It may be possible to speed up this function by only calling the branch function once. -- need to look into this
 //----------------------------------------------------------------------------
-void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine)
+void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine)
 {
   if (!inputROIPoints)
   {
@@ -1044,7 +1311,7 @@ void vtkPlanarContourToClosedSurfaceConversionRule::Branch(vtkPolyData* inputROI
 }
 
 //----------------------------------------------------------------------------
-int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists)
+int vtkPlanarContourToClosedSurfaceConversionRule::GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists)
 {
   if (!inputROIPoints)
   {
@@ -1286,7 +1553,11 @@ void vtkPlanarContourToClosedSurfaceConversionRule::CreateEndCapContour(vtkPolyD
 
   if (vtkVariant(this->GetConversionParameter(this->GetEndCappingParameterName())).ToInt() == EndCappingModes::Smooth)
   {
-    this->CreateSmoothEndCapContour(inputROIPoints, inputLine, outputLines, lineSpacing);
+    // The raster based method is used if the contour cannot be offset geometrically
+    if (!this->GeometricEndCapping || !this->CreateGeometricEndCapContour(inputROIPoints, inputLine, outputLines, lineSpacing))
+    {
+      this->CreateSmoothEndCapContour(inputROIPoints, inputLine, outputLines, lineSpacing);
+    }
   }
   else if (vtkVariant(this->GetConversionParameter(this->GetEndCappingParameterName())).ToInt() == EndCappingModes::Straight)
   {
@@ -1326,6 +1597,167 @@ void vtkPlanarContourToClosedSurfaceConversionRule::CreateStraightEndCapContour(
   outputLines->InsertNextCell(endCapLine);
 }
 
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToClosedSurfaceConversionRule::CreateGeometricEndCapContour(vtkPolyData* inputROIPoints, vtkLine* inputLine, vtkCellArray* outputLines, double lineSpacing)
+{
+  if (!inputROIPoints)
+  {
+    vtkErrorMacro("CreateGeometricEndCapContour: invalid vtkPolyData");
+    return false;
+  }
+
+  if (!inputLine)
+  {
+    vtkErrorMacro("CreateGeometricEndCapContour: invalid vtkLine");
+    return false;
+  }
+
+  if (!outputLines)
+  {
+    vtkErrorMacro("CreateGeometricEndCapContour: invalid vtkCellArray");
+    return false;
+  }
+
+  // Get the points of the contour without the repeated closing point
+  int numberOfPoints = inputLine->GetNumberOfPoints();
+  if (numberOfPoints > 1 && inputLine->GetPointId(0) == inputLine->GetPointId(numberOfPoints - 1))
+  {
+    --numberOfPoints;
+  }
+  if (numberOfPoints < 3)
+  {
+    return false;
+  }
+  std::vector<std::array<double, 3> > contourPoints(numberOfPoints);
+  for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+  {
+    inputROIPoints->GetPoint(inputLine->GetPointId(pointIndex), contourPoints[pointIndex].data());
+  }
+
+  // Calculate the area, the perimeter and the inward normals of the edges (edge i connects point i and i+1)
+  double signedArea = 0.0;
+  double perimeter = 0.0;
+  std::vector<std::array<double, 2> > edgeNormals(numberOfPoints);
+  for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+  {
+    const double* point = contourPoints[pointIndex].data();
+    const double* nextPoint = contourPoints[(pointIndex + 1) % numberOfPoints].data();
+    signedArea += 0.5 * (point[0] * nextPoint[1] - nextPoint[0] * point[1]);
+    double edgeLength = std::sqrt((nextPoint[0] - point[0]) * (nextPoint[0] - point[0]) + (nextPoint[1] - point[1]) * (nextPoint[1] - point[1]));
+    if (edgeLength <= 0.0)
+    {
+      return false;
+    }
+    perimeter += edgeLength;
+    edgeNormals[pointIndex] = { -(nextPoint[1] - point[1]) / edgeLength, (nextPoint[0] - point[0]) / edgeLength };
+  }
+  if (signedArea == 0.0)
+  {
+    return false;
+  }
+  // The inside is on the left of the edges of counter-clockwise contours
+  double orientation = (signedArea > 0.0 ? 1.0 : -1.0);
+  double area = std::abs(signedArea);
+
+  // Offset distance that leaves half of the area of a convex contour (the area decreases by perimeter*offset - pi*offset^2),
+  // similarly to the raster based method that erodes the contour until half of its area is left
+  double offset = (perimeter - std::sqrt(std::max(0.0, perimeter * perimeter - 2.0 * vtkMath::Pi() * area))) / (2.0 * vtkMath::Pi());
+
+  // Move each point to the intersection of its offset edges, limited to twice the offset distance at sharp corners
+  std::vector<std::array<double, 2> > offsetPoints(numberOfPoints);
+  for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+  {
+    const std::array<double, 2>& previousNormal = edgeNormals[(pointIndex + numberOfPoints - 1) % numberOfPoints];
+    const std::array<double, 2>& nextNormal = edgeNormals[pointIndex];
+    double bisector[2] = { previousNormal[0] + nextNormal[0], previousNormal[1] + nextNormal[1] };
+    double bisectorLength = std::sqrt(bisector[0] * bisector[0] + bisector[1] * bisector[1]);
+    if (bisectorLength < 1.0e-6)
+    {
+      return false; // Contour turns back on itself
+    }
+    double miterLength = std::min(2.0 * offset / bisectorLength, 2.0 * offset);
+    for (int axis = 0; axis < 2; ++axis)
+    {
+      offsetPoints[pointIndex][axis] = contourPoints[pointIndex][axis] + orientation * miterLength * bisector[axis] / bisectorLength;
+    }
+  }
+
+  // The offset contour must keep the orientation, and must not intersect itself or the original contour.
+  // Otherwise the contour is too narrow somewhere for a single offset contour
+  double offsetSignedArea = 0.0;
+  for (int pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+  {
+    const double* point = offsetPoints[pointIndex].data();
+    const double* nextPoint = offsetPoints[(pointIndex + 1) % numberOfPoints].data();
+    offsetSignedArea += 0.5 * (point[0] * nextPoint[1] - nextPoint[0] * point[1]);
+  }
+  if (offsetSignedArea * orientation <= 0.0)
+  {
+    return false;
+  }
+
+  // Only the edges sharing a cell of a grid over the edge bounding boxes are checked for intersection.
+  // Edge i of the original contour has index i in the grid, edge i of the offset contour has index numberOfPoints + i
+  std::vector<std::array<double, 4> > edgeBounds(2 * numberOfPoints);
+  for (int edgeIndex = 0; edgeIndex < numberOfPoints; ++edgeIndex)
+  {
+    int edgeEndIndex = (edgeIndex + 1) % numberOfPoints;
+    const double* edgeStart = contourPoints[edgeIndex].data();
+    const double* edgeEnd = contourPoints[edgeEndIndex].data();
+    edgeBounds[edgeIndex] = { std::min(edgeStart[0], edgeEnd[0]), std::max(edgeStart[0], edgeEnd[0]),
+      std::min(edgeStart[1], edgeEnd[1]), std::max(edgeStart[1], edgeEnd[1]) };
+    edgeStart = offsetPoints[edgeIndex].data();
+    edgeEnd = offsetPoints[edgeEndIndex].data();
+    edgeBounds[numberOfPoints + edgeIndex] = { std::min(edgeStart[0], edgeEnd[0]), std::max(edgeStart[0], edgeEnd[0]),
+      std::min(edgeStart[1], edgeEnd[1]), std::max(edgeStart[1], edgeEnd[1]) };
+  }
+  LineBoundsGrid edgeGrid(edgeBounds, 0, 2 * numberOfPoints);
+  std::vector<int> lastCheckedEdgeIndex(2 * numberOfPoints, -1); // Each pair is checked only once
+  for (int edgeIndex = 0; edgeIndex < numberOfPoints; ++edgeIndex)
+  {
+    const double* edgeStart = offsetPoints[edgeIndex].data();
+    const double* edgeEnd = offsetPoints[(edgeIndex + 1) % numberOfPoints].data();
+    bool intersectionFound = false;
+    edgeGrid.VisitCandidateLines(edgeBounds[numberOfPoints + edgeIndex].data(), [&](vtkIdType otherEdgeId)
+    {
+      if (intersectionFound || lastCheckedEdgeIndex[otherEdgeId] == edgeIndex)
+      {
+        return;
+      }
+      lastCheckedEdgeIndex[otherEdgeId] = edgeIndex;
+
+      bool otherEdgeIsOffset = (otherEdgeId >= numberOfPoints);
+      int otherEdgeIndex = static_cast<int>(otherEdgeIsOffset ? otherEdgeId - numberOfPoints : otherEdgeId);
+      int otherEdgeEndIndex = (otherEdgeIndex + 1) % numberOfPoints;
+      if (!otherEdgeIsOffset)
+      {
+        intersectionFound = DoSegmentsIntersect2D(edgeStart, edgeEnd, contourPoints[otherEdgeIndex].data(), contourPoints[otherEdgeEndIndex].data());
+      }
+      else if (otherEdgeIndex > edgeIndex + 1 && otherEdgeEndIndex != edgeIndex) // Neighbor edges share a point
+      {
+        intersectionFound = DoSegmentsIntersect2D(edgeStart, edgeEnd, offsetPoints[otherEdgeIndex].data(), offsetPoints[otherEdgeEndIndex].data());
+      }
+    });
+    if (intersectionFound)
+    {
+      return false;
+    }
+  }
+
+  // Add the offset contour 1/2 slice thickness away, in counter-clockwise order
+  vtkPoints* inputPoints = inputROIPoints->GetPoints();
+  vtkNew<vtkIdList> endCapLine;
+  for (int index = 0; index < numberOfPoints; ++index)
+  {
+    int pointIndex = (orientation > 0.0 ? index : numberOfPoints - 1 - index);
+    double endCapPoint[3] = { offsetPoints[pointIndex][0], offsetPoints[pointIndex][1], contourPoints[pointIndex][2] + lineSpacing / 2.0 };
+    endCapLine->InsertNextId(inputPoints->InsertNextPoint(endCapPoint));
+  }
+  endCapLine->InsertNextId(endCapLine->GetId(0));
+  outputLines->InsertNextCell(endCapLine);
+  return true;
+}
+
 //----------------------------------------------------------------------------
 void vtkPlanarContourToClosedSurfaceConversionRule::CreateSmoothEndCapContour(vtkPolyData* inputROIPoints, vtkLine* inputLine, vtkCellArray* outputLines, double lineSpacing)
 {
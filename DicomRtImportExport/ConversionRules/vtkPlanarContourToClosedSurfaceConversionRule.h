@@ -33,6 +33,10 @@
 // VTK includes
 #include "vtkPointLocator.h"
 
+// STD includes
+#include <array>
+#include <vector>
+
 class vtkPolyData;
 class vtkIdList;
 class vtkCellArray;
@@ -94,6 +98,24 @@ public:
   /// Human-readable name of the target representation
   const char* GetTargetRepresentationName() override { return vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(); };
 
+  /// Number of threads used for triangulating between the contour planes. 0 by default, meaning the number of
+  /// threads of the vtkSMPTools backend (see vtkSlicerRtCommon::GetNumberOfWorkerThreads). The output does not depend on the number of threads
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Maximum number of cells in the dynamic programming table of triangulating between two contours.
+  /// For larger contour pairs only a band around the diagonal of the table is searched, which is wide enough
+  /// to keep the table near this size. If not positive, then the whole table is always searched. Default is 1000000
+  vtkSetMacro(MaximumTriangulationTableSize, vtkIdType);
+  vtkGetMacro(MaximumTriangulationTableSize, vtkIdType);
+
+  /// If on (default), then smooth end cap contours are created by offsetting the contours inwards geometrically.
+  /// Contours that are too narrow for a single offset contour, and all contours if off, are capped using a
+  /// rasterized and eroded image of the contour
+  vtkSetMacro(GeometricEndCapping, bool);
+  vtkGetMacro(GeometricEndCapping, bool);
+  vtkBooleanMacro(GeometricEndCapping, bool);
+
 protected:
   vtkPlanarContourToClosedSurfaceConversionRule();
   ~vtkPlanarContourToClosedSurfaceConversionRule() override;
@@ -155,6 +177,25 @@ protected:
   /// \param The second line
   bool DoLinesOverlap(vtkLine* line1, vtkLine* line2);
 
+  /// Determine if the XY bounding boxes of two contours overlap.
+  /// \param bounds1 Bounds of the first line (xmin, xmax, ymin, ymax)
+  /// \param bounds2 Bounds of the second line (xmin, xmax, ymin, ymax)
+  static bool DoLineBoundsOverlap(const double bounds1[4], const double bounds2[4]);
+
+  /// Find the pairs of lines on two neighboring planes whose XY bounding boxes overlap (\sa DoLineBoundsOverlap).
+  /// Only the lines sharing a cell of a uniform grid over the bounding boxes of the second plane are compared.
+  /// Called concurrently for different plane pairs.
+  /// \param lineBounds Bounds of all lines (xmin, xmax, ymin, ymax)
+  /// \param firstLineOnPlane1Index Index of the first line on the first plane
+  /// \param numberOfLinesInPlane1 Number of lines on the first plane
+  /// \param firstLineOnPlane2Index Index of the first line on the second plane
+  /// \param numberOfLinesInPlane2 Number of lines on the second plane
+  /// \param plane1Overlaps Output list for each line on the first plane with the overlapping lines of the second plane, in index order
+  /// \param plane2Overlaps Output list for each line on the second plane with the overlapping lines of the first plane, in index order
+  virtual void FindOverlappingLines(const std::vector<std::array<double, 4> >& lineBounds,
+    vtkIdType firstLineOnPlane1Index, int numberOfLinesInPlane1, vtkIdType firstLineOnPlane2Index, int numberOfLinesInPlane2,
+    std::vector<std::vector<vtkIdType> >& plane1Overlaps, std::vector<std::vector<vtkIdType> >& plane2Overlaps);
+
   /// Create a branching pattern for overlapping contours.
   /// \param inputROIPoints Polydata containing all of the points and contours
   /// \param branchingLine The orignal line that is being divided
@@ -163,7 +204,7 @@ protected:
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
   /// \param outputLine The output branched line
-  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists, vtkLine* outputLine);
+  void Branch(vtkPolyData* inputROIPoints, vtkLine* branchingLine, vtkIdType currentLineId, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists, vtkLine* outputLine);
 
   /// Find the branch closest from the point on the trunk
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -171,7 +212,7 @@ protected:
   /// \param overlappingLineIds List of line IDs for lines that overlap with the current line
   /// \param pointLocators List of point locators for lines in the overlap list
   /// \param lineIdLists List of vtkIdLists for all of the lines in the overlap list
-  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, std::vector< vtkIdType > overlappingLineIds, std::vector<vtkSmartPointer<vtkPointLocator> > pointLocators, std::vector<vtkSmartPointer<vtkIdList> > lineIdLists);
+  int GetClosestBranch(vtkPolyData* inputROIPoints, double* originalPoint, const std::vector< vtkIdType >& overlappingLineIds, const std::vector<vtkSmartPointer<vtkPointLocator> >& pointLocators, const std::vector<vtkSmartPointer<vtkIdList> >& lineIdLists);
 
   /// Seal the exterior contours of the mesh.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -203,6 +244,15 @@ protected:
   /// \param The size of the spacing between the contours. Contours created by this function will be offset by 1/2 of this amount
   void CreateSmoothEndCapContour(vtkPolyData* inputROIPoints, vtkLine* inputLine, vtkCellArray* outputLines, double lineSpacing);
 
+  /// Create a smooth end cap contour by offsetting the contour inwards so that about half of its area is left,
+  /// without rasterizing it. Called by CreateEndCapContour before falling back to \sa CreateSmoothEndCapContour.
+  /// \param inputROIPoints Polydata containing all of the points and contours
+  /// \param inputLine The original line that needs to be extended
+  /// \param outputLines Cell array that the end cap contour is added to
+  /// \param The size of the spacing between the contours. Contours created by this function will be offset by 1/2 of this amount
+  /// \return False if the offset contour would intersect itself or the original contour (nothing is added in this case)
+  bool CreateGeometricEndCapContour(vtkPolyData* inputROIPoints, vtkLine* inputLine, vtkCellArray* outputLines, double lineSpacing);
+
   /// Create straight extruded end cap contours on the exterior of the surface.
   /// Called by CreateEndCapContour based on the "End capping" conversion parameter.
   /// \param inputROIPoints Polydata containing all of the points and contours
@@ -287,6 +337,15 @@ protected:
   // Image padding size that is used in the end-capping process
   int ImagePadding[3];
 
+  // Number of threads used for triangulating between the contour planes
+  int NumberOfThreads;
+
+  // Maximum number of cells in the dynamic programming table before it is restricted to a band
+  vtkIdType MaximumTriangulationTableSize;
+
+  // Flag determining whether smooth end caps are created geometrically if possible
+  bool GeometricEndCapping;
+
 private:
   vtkPlanarContourToClosedSurfaceConversionRule(const vtkPlanarContourToClosedSurfaceConversionRule&) = delete;
   void operator=(const vtkPlanarContourToClosedSurfaceConversionRule&) = delete;
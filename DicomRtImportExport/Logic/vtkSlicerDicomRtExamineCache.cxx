@@ -0,0 +1,236 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSlicerDicomRtExamineCache.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <fstream>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+// First line of the cache file. Files with a different first line are ignored
+static const char* EXAMINE_CACHE_FILE_HEADER = "# SlicerRT DICOM-RT examine cache v2";
+static const char EXAMINE_CACHE_FIELD_SEPARATOR = '\t';
+static const char EXAMINE_CACHE_UID_SEPARATOR = '\\';
+
+//----------------------------------------------------------------------------
+// Replace characters that would break the line structure of the cache file
+static std::string SanitizeField(const std::string& field)
+{
+  std::string sanitizedField(field);
+  for (std::string::iterator charIt = sanitizedField.begin(); charIt != sanitizedField.end(); ++charIt)
+  {
+    if (*charIt == EXAMINE_CACHE_FIELD_SEPARATOR || *charIt == '\n' || *charIt == '\r')
+    {
+      *charIt = ' ';
+    }
+  }
+  return sanitizedField;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerDicomRtExamineCache);
+
+//----------------------------------------------------------------------------
+vtkSlicerDicomRtExamineCache::vtkSlicerDicomRtExamineCache() = default;
+
+//----------------------------------------------------------------------------
+vtkSlicerDicomRtExamineCache::~vtkSlicerDicomRtExamineCache() = default;
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtExamineCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "CacheFilePath: " << this->CacheFilePath << "\n";
+  os << indent << "NumberOfEntries: " << this->Entries.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtExamineCache::SetCacheFilePath(const std::string& cacheFilePath)
+{
+  if (cacheFilePath == this->CacheFilePath)
+  {
+    return;
+  }
+
+  this->CacheFilePath = cacheFilePath;
+  this->Load();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtExamineCache::GetEntry(const std::string& filePath, bool headerOnly, Entry& entry)
+{
+  std::map<std::pair<std::string, bool>, FileEntry>::iterator entryIt = this->Entries.find(std::make_pair(filePath, headerOnly));
+  if (entryIt == this->Entries.end())
+  {
+    return false;
+  }
+
+  // Invalidate entry if the file has changed since it was examined
+  if ( !vtksys::SystemTools::FileExists(filePath, true)
+    || entryIt->second.FileSize != vtksys::SystemTools::FileLength(filePath)
+    || entryIt->second.ModifiedTime != vtksys::SystemTools::ModifiedTime(filePath) )
+  {
+    this->Entries.erase(entryIt);
+    this->EntriesChanged = true;
+    return false;
+  }
+
+  entry = entryIt->second.ExamineResult;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtExamineCache::SetEntry(const std::string& filePath, bool headerOnly, const Entry& entry)
+{
+  if (!vtksys::SystemTools::FileExists(filePath, true))
+  {
+    return;
+  }
+
+  FileEntry& fileEntry = this->Entries[std::make_pair(filePath, headerOnly)];
+  fileEntry.FileSize = vtksys::SystemTools::FileLength(filePath);
+  fileEntry.ModifiedTime = vtksys::SystemTools::ModifiedTime(filePath);
+  fileEntry.ExamineResult = entry;
+  this->EntriesChanged = true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtExamineCache::RemoveAllEntries()
+{
+  this->Entries.clear();
+  this->EntriesChanged = true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtExamineCache::Load()
+{
+  this->Entries.clear();
+  this->EntriesChanged = false;
+  if (this->CacheFilePath.empty() || !vtksys::SystemTools::FileExists(this->CacheFilePath, true))
+  {
+    return false;
+  }
+
+  std::ifstream cacheFile(this->CacheFilePath.c_str());
+  std::string line;
+  if (!std::getline(cacheFile, line) || line != EXAMINE_CACHE_FILE_HEADER)
+  {
+    vtkWarningMacro("Load: Ignoring examine cache file '" << this->CacheFilePath << "' with unknown format");
+    return false;
+  }
+
+  // Fields: file path, header only flag, file size, modification time, SOP class UID, SOP instance UID, name, referenced UIDs
+  while (std::getline(cacheFile, line))
+  {
+    std::vector<std::string> fields;
+    vtksys::SystemTools::Split(line, fields, EXAMINE_CACHE_FIELD_SEPARATOR);
+    if (fields.size() == 7)
+    {
+      fields.push_back(""); // Split omits the trailing empty field if there are no referenced UIDs
+    }
+    if (fields.size() != 8 || (fields[1] != "0" && fields[1] != "1"))
+    {
+      continue; // Incomplete line, the file will be examined again
+    }
+
+    FileEntry fileEntry;
+    std::stringstream fileSizeStream(fields[2]);
+    std::stringstream modifiedTimeStream(fields[3]);
+    fileSizeStream >> fileEntry.FileSize;
+    modifiedTimeStream >> fileEntry.ModifiedTime;
+    if (fileSizeStream.fail() || modifiedTimeStream.fail())
+    {
+      continue;
+    }
+    fileEntry.ExamineResult.SOPClassUID = fields[4];
+    fileEntry.ExamineResult.SOPInstanceUID = fields[5];
+    fileEntry.ExamineResult.Name = fields[6];
+    if (!fields[7].empty())
+    {
+      vtksys::SystemTools::Split(fields[7], fileEntry.ExamineResult.ReferencedSOPInstanceUIDs, EXAMINE_CACHE_UID_SEPARATOR);
+    }
+    this->Entries[std::make_pair(fields[0], fields[1] == "1")] = fileEntry;
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtExamineCache::Save()
+{
+  if (!this->EntriesChanged || this->CacheFilePath.empty())
+  {
+    return true;
+  }
+
+  // Write to a temporary file first so that an interrupted write does not leave a truncated cache behind
+  std::string temporaryFilePath = this->CacheFilePath + ".tmp";
+  {
+    std::ofstream cacheFile(temporaryFilePath.c_str(), std::ios::out | std::ios::trunc);
+    if (!cacheFile.is_open())
+    {
+      vtkErrorMacro("Save: Failed to open examine cache file '" << temporaryFilePath << "' for writing");
+      return false;
+    }
+
+    cacheFile << EXAMINE_CACHE_FILE_HEADER << "\n";
+    for (std::map<std::pair<std::string, bool>, FileEntry>::iterator entryIt = this->Entries.begin(); entryIt != this->Entries.end(); ++entryIt)
+    {
+      const Entry& examineResult = entryIt->second.ExamineResult;
+      cacheFile << SanitizeField(entryIt->first.first) << EXAMINE_CACHE_FIELD_SEPARATOR
+        << (entryIt->first.second ? "1" : "0") << EXAMINE_CACHE_FIELD_SEPARATOR
+        << entryIt->second.FileSize << EXAMINE_CACHE_FIELD_SEPARATOR
+        << entryIt->second.ModifiedTime << EXAMINE_CACHE_FIELD_SEPARATOR
+        << SanitizeField(examineResult.SOPClassUID) << EXAMINE_CACHE_FIELD_SEPARATOR
+        << SanitizeField(examineResult.SOPInstanceUID) << EXAMINE_CACHE_FIELD_SEPARATOR
+        << SanitizeField(examineResult.Name) << EXAMINE_CACHE_FIELD_SEPARATOR;
+      for (std::vector<std::string>::const_iterator uidIt = examineResult.ReferencedSOPInstanceUIDs.begin();
+        uidIt != examineResult.ReferencedSOPInstanceUIDs.end(); ++uidIt)
+      {
+        cacheFile << (uidIt != examineResult.ReferencedSOPInstanceUIDs.begin() ? std::string(1, EXAMINE_CACHE_UID_SEPARATOR) : std::string())
+          << SanitizeField(*uidIt);
+      }
+      cacheFile << "\n";
+    }
+    if (!cacheFile.good())
+    {
+      vtkErrorMacro("Save: Failed to write examine cache file '" << temporaryFilePath << "'");
+      return false;
+    }
+  }
+
+  if (!vtksys::SystemTools::RenameFile(temporaryFilePath, this->CacheFilePath))
+  {
+    vtkErrorMacro("Save: Failed to replace examine cache file '" << this->CacheFilePath << "'");
+    vtksys::SystemTools::RemoveFile(temporaryFilePath);
+    return false;
+  }
+
+  this->EntriesChanged = false;
+  return true;
+}
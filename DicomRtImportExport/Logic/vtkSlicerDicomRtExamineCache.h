@@ -0,0 +1,120 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkSlicerDicomRtExamineCache - Persistent cache of DICOM-RT examination results
+// .SECTION Description
+
+#ifndef __vtkSlicerDicomRtExamineCache_h
+#define __vtkSlicerDicomRtExamineCache_h
+
+#include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// \ingroup SlicerRt_QtModules_DicomRtImport
+/// \brief Persistent cache of the results of examining DICOM files for loading as RT objects.
+///
+/// The entries are keyed by file path and by whether only the header part of the file was parsed (as that may
+/// change the result), and each entry also stores the size and modification time of the file when it was examined. An entry is only returned if the file still has the same size and modification time,
+/// so the entries of changed files are invalidated automatically. Files that are not RT objects are also stored
+/// (with empty name) so that they are not parsed again either.
+///
+/// The cache is stored in a tab separated text file, one line per examined file.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerDicomRtExamineCache : public vtkObject
+{
+public:
+  /// Examination result of one file
+  struct Entry
+  {
+    /// SOP class UID of the examined file. Empty if the file could not be parsed
+    std::string SOPClassUID;
+    /// SOP instance UID of the examined file
+    std::string SOPInstanceUID;
+    /// Loadable name assembled from the file (without elements that depend on other files)
+    std::string Name;
+    /// Referenced SOP instance UIDs of the loadable
+    std::vector<std::string> ReferencedSOPInstanceUIDs;
+  };
+
+public:
+  static vtkSlicerDicomRtExamineCache *New();
+  vtkTypeMacro(vtkSlicerDicomRtExamineCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  /// Set path of the file storing the cache. The entries are read from the file if the path changes
+  void SetCacheFilePath(const std::string& cacheFilePath);
+  /// Get path of the file storing the cache
+  std::string GetCacheFilePath() { return this->CacheFilePath; };
+
+  /// Get cached examination result of a file
+  /// \param headerOnly Whether the file is examined by parsing only its header part
+  /// \return True if a valid entry was found (file has not changed since it was examined)
+  bool GetEntry(const std::string& filePath, bool headerOnly, Entry& entry);
+
+  /// Store examination result of a file. Size and modification time of the file are stored with the entry
+  /// \param headerOnly Whether the file was examined by parsing only its header part
+  void SetEntry(const std::string& filePath, bool headerOnly, const Entry& entry);
+
+  /// Remove all entries (also from the cache file on the next \sa Save)
+  void RemoveAllEntries();
+
+  /// Write entries to the cache file if changed since the last read or write
+  /// \return Success flag
+  bool Save();
+
+protected:
+  /// Read entries from the cache file
+  /// \return Success flag
+  bool Load();
+
+protected:
+  struct FileEntry
+  {
+    unsigned long FileSize{0};
+    long ModifiedTime{0};
+    Entry ExamineResult;
+  };
+
+  /// Path of the cache file
+  std::string CacheFilePath;
+
+  /// Cached entries by file path and header only flag
+  std::map<std::pair<std::string, bool>, FileEntry> Entries;
+
+  /// Flag indicating that entries have changed since the last read or write
+  bool EntriesChanged{false};
+
+protected:
+  vtkSlicerDicomRtExamineCache();
+  ~vtkSlicerDicomRtExamineCache() override;
+
+private:
+  vtkSlicerDicomRtExamineCache(const vtkSlicerDicomRtExamineCache&) = delete;
+  void operator=(const vtkSlicerDicomRtExamineCache&) = delete;
+};
+
+#endif
@@ -25,11 +25,13 @@
 
 // DicomRtImportExport includes
 #include "vtkSlicerDicomRtImportExportModuleLogic.h"
+#include "vtkSlicerDicomRtExamineCache.h"
 #include "vtkSlicerDicomRtReader.h"
 #include "vtkSlicerDicomRtWriter.h"
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
 #include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
 #include "vtkFractionalLabelmapToClosedSurfaceConversionRule.h"
 
@@ -105,11 +107,18 @@
 #include <vtkMRMLMarkupsDisplayNode.h>
 
 // VTK includes
+#include <vtkAbstractArray.h>
+#include <vtkAppendPolyData.h>
+#include <vtkCallbackCommand.h>
 #include <vtkCutter.h>
 #include <vtkGeneralTransform.h>
 #include <vtkImageCast.h>
+#include <vtkImageClip.h>
+#include <vtkIdList.h>
 #include <vtkImageData.h>
 #include <vtkLookupTable.h>
+#include <vtkMath.h>
+#include <vtkMultiThreader.h>
 #include <vtkObjectFactory.h>
 #include <vtkPlane.h>
 #include <vtkPolyData.h>
@@ -118,8 +127,15 @@
 #include <vtkStripper.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkTable.h>
+#include <vtkDataSetAttributes.h>
 #include <vtkDoubleArray.h>
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <set>
+
 // ITK includes
 #include <itkImage.h>
 
@@ -130,6 +146,12 @@
 #include "vtkSlicerDICOMLoadable.h"
 #include "vtkSlicerDICOMExportable.h"
 
+//----------------------------------------------------------------------------
+const std::string vtkSlicerDicomRtImportExportModuleLogic::EXAMINE_CACHE_FILE_NAME = "SlicerRtExamineCache.txt";
+const std::string vtkSlicerDicomRtImportExportModuleLogic::CONTROL_POINT_TABLE_REFERENCE_ROLE = "controlPointTableRef";
+const std::string vtkSlicerDicomRtImportExportModuleLogic::SCAN_SPOT_CONTROL_POINT_TABLE_REFERENCE_ROLE = "scanSpotControlPointTableRef";
+const std::string vtkSlicerDicomRtImportExportModuleLogic::CONTROL_POINT_INDEX_ATTRIBUTE_NAME = "DicomRtImport.ControlPointIndex";
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDicomRtImportExportModuleLogic);
 vtkCxxSetObjectMacro(vtkSlicerDicomRtImportExportModuleLogic, IsodoseLogic, vtkSlicerIsodoseModuleLogic);
@@ -142,6 +164,17 @@ namespace
   {
     return ptr ? ptr : "";
   }
+
+  /// Set the voxels of a binary labelmap to 1 where the (possibly shared) labelmap has the label value, 0 elsewhere.
+  /// Only reads the input labelmap, so it can be called on worker threads for the segments of the same labelmap
+  template <class T>
+  void ExtractLabelValue(const T* labelmapVoxels, vtkIdType numberOfVoxels, double labelValue, unsigned char* binaryLabelmapVoxels)
+  {
+    for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+    {
+      binaryLabelmapVoxels[voxelIndex] = (labelmapVoxels[voxelIndex] == labelValue ? 1 : 0);
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -151,6 +184,23 @@ public:
   vtkInternal(vtkSlicerDicomRtImportExportModuleLogic* external);
   ~vtkInternal() = default;
 
+  /// Load the part of a DICOM file that is needed for examining it for loading
+  /// \param headerOnly If true, then parsing is stopped before the bulky elements not used in examination
+  ///   (ROI and contour sequences of structure sets, pixel data of doses and images)
+  OFCondition LoadFileForExamine(DcmFileFormat& fileformat, const char* fileName, bool headerOnly);
+
+  /// Examine a file for loading, either by parsing it or from the examine cache
+  /// \return False if the file cannot be parsed
+  bool ExamineFile(const char* fileName, vtkSlicerDicomRtExamineCache::Entry& examineResult);
+
+  /// Append the label of the RT plan referenced by an RT dose to the loadable name. The label is looked up in
+  /// the DICOM database, so it is not stored in the examine cache (the plan may be imported after the dose)
+  void AppendReferencedRtPlanLabel(OFString &name, const OFString& referencedRtPlanSOPInstanceUID);
+
+  /// Get path of the examine cache file (in the DICOM database directory)
+  /// \return Empty string if there is no DICOM database directory
+  std::string GetExamineCacheFilePath();
+
   /// Examine RT Dose dataset and assemble name and referenced SOP instances
   void ExamineRtDoseDataset(DcmDataset* dataset, OFString &name, std::vector<OFString> &referencedSOPInstanceUIDs);
 
@@ -189,6 +239,10 @@ public:
     vtkMRMLLinearTransformNode* proxyTransformNode, 
     vtkMRMLTableNode* mlcTableNode, vtkMRMLTableNode* scanSpotTableNode);
 
+  /// Load dynamic beam as one beam node and a table of its control points (called from \sa LoadExternalBeamPlan
+  /// if \sa LoadDynamicBeamsCompact is on). The geometry of the current control point is set by \sa SetBeamControlPointIndex
+  bool LoadCompactDynamicBeam(vtkSlicerDicomRtReader* rtReader, vtkMRMLRTPlanNode* planNode, int beamIndex);
+
   /// Load brachytherapy plan (called from \sa LoadRtPlan)
   bool LoadBrachyPlan(vtkSlicerDicomRtReader* rtReader, const char* seriesName, vtkMRMLRTPlanNode* planNode);
 
@@ -200,6 +254,15 @@ public:
   /// \return Success flag
   bool LoadRtImage(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable);
 
+  /// Create the closed surface of placeholder segments of a structure set loaded with \sa LoadRoiContoursOnDemand
+  /// \param segmentIDs Segments to load. If empty, then all segments that have not been loaded are loaded
+  /// \param shownOnly If true, then only the segments that are visible are loaded
+  /// \return Number of loaded segments
+  int LoadDeferredRoiContours(vtkMRMLSegmentationNode* segmentationNode, const std::vector<std::string>& segmentIDs, bool shownOnly);
+
+  /// Stop tracking the placeholder segments of a segmentation node
+  void RemoveDeferredRoiContours(vtkMRMLSegmentationNode* segmentationNode);
+
   /// Add an ROI point to the scene
   vtkMRMLMarkupsFiducialNode* AddRoiPoint(double* roiPosition, std::string baseName, double* roiColor);
 
@@ -227,17 +290,165 @@ public:
   /// \param roiReferencedSeriesUid Uid of the input series for which slice spacing is to be calculated.
   double CalculateSliceSpacing(vtkSlicerDicomRtReader* rtReader, const char* roiReferencedSeriesUid);
 
+  /// Errors and warnings of a conversion rule (event ID and message). The conversion rule may invoke
+  /// the events from multiple threads, so the messages are guarded by a mutex
+  struct ConversionMessages
+  {
+    std::mutex Mutex;
+    std::vector<std::pair<unsigned long, std::string> > Messages;
+  };
+  /// Callback storing the error and warning events of a conversion rule in the \sa ConversionMessages
+  /// given as client data, so that conversion rules running on worker threads do not log directly
+  static void CollectConversionMessage(vtkObject* caller, unsigned long eid, void* clientData, void* callData);
+
 public:
   vtkSlicerDicomRtImportExportModuleLogic* External;
+
+  /// Cache of examination results persisted between sessions
+  vtkSmartPointer<vtkSlicerDicomRtExamineCache> ExamineCache;
+
+  /// IDs of the placeholder segments whose closed surface has not been created yet, by segmentation node ID
+  std::map<std::string, std::set<std::string> > DeferredRoiContoursBySegmentationNodeID;
 };
 
 //----------------------------------------------------------------------------
 // vtkInternal methods
 
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::CollectConversionMessage(
+  vtkObject* vtkNotUsed(caller), unsigned long eid, void* clientData, void* callData)
+{
+  ConversionMessages* conversionMessages = reinterpret_cast<ConversionMessages*>(clientData);
+  const char* message = reinterpret_cast<const char*>(callData);
+  if (conversionMessages)
+  {
+    std::lock_guard<std::mutex> lock(conversionMessages->Mutex);
+    conversionMessages->Messages.push_back(std::make_pair(eid, std::string(message ? message : "")));
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::vtkInternal(vtkSlicerDicomRtImportExportModuleLogic* external)
   : External(external)
 {
+  this->ExamineCache = vtkSmartPointer<vtkSlicerDicomRtExamineCache>::New();
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineFile(const char* fileName, vtkSlicerDicomRtExamineCache::Entry& examineResult)
+{
+  DcmFileFormat fileformat;
+  OFCondition result = this->LoadFileForExamine(fileformat, fileName, this->External->ExamineHeaderOnly);
+  if (!result.good())
+  {
+    return false; // Failed to parse this file
+  }
+
+  // Check SOP Class UID for one of the supported RT objects
+  DcmDataset *dataset = fileformat.getDataset();
+  OFString sopClass;
+  if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
+  {
+    return false; // Failed to parse this file
+  }
+  examineResult.SOPClassUID = sopClass.c_str();
+  OFString sopInstanceUid;
+  dataset->findAndGetOFString(DCM_SOPInstanceUID, sopInstanceUid);
+  examineResult.SOPInstanceUID = sopInstanceUid.c_str();
+
+  // DICOM parsing is successful, now check if the object is loadable
+  OFString name("");
+  OFString seriesNumber("");
+  std::vector<OFString> referencedSOPInstanceUIDs;
+  dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
+  if (!seriesNumber.empty())
+  {
+    name += seriesNumber + ": ";
+  }
+
+  // RTDose
+  if (sopClass == UID_RTDoseStorage)
+  {
+    this->ExamineRtDoseDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  // RTPlan
+  else if (sopClass == UID_RTPlanStorage)
+  {
+    this->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  // RTIonPlan
+  else if (sopClass == UID_RTIonPlanStorage)
+  {
+    this->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  // RTStructureSet
+  else if (sopClass == UID_RTStructureSetStorage)
+  {
+    this->ExamineRtStructureSetDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  // RTImage
+  else if (sopClass == UID_RTImageStorage)
+  {
+    this->ExamineRtImageDataset(dataset, name, referencedSOPInstanceUIDs);
+  }
+  /* Not yet supported
+  else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
+  else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
+  */
+  else
+  {
+    return true; // Not an RT file, no loadable name
+  }
+
+  examineResult.Name = name.c_str();
+  for (std::vector<OFString>::iterator uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+  {
+    examineResult.ReferencedSOPInstanceUIDs.push_back(uidIt->c_str());
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+std::string vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::GetExamineCacheFilePath()
+{
+  QSettings settings;
+  QString databaseDirectory = settings.value("DatabaseDirectory").toString();
+  if (databaseDirectory.isEmpty())
+  {
+    return "";
+  }
+  return std::string(databaseDirectory.toUtf8().constData()) + "/" + vtkSlicerDicomRtImportExportModuleLogic::EXAMINE_CACHE_FILE_NAME;
+}
+
+//-----------------------------------------------------------------------------
+OFCondition vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadFileForExamine(DcmFileFormat& fileformat, const char* fileName, bool headerOnly)
+{
+  if (!headerOnly)
+  {
+    return fileformat.loadFile(fileName, EXS_Unknown);
+  }
+
+  // All examined structure set elements precede the structure set ROI sequence, and the ROI contour sequence
+  // (containing all the contour points) follows it. Non-RT files are also rejected based on this part
+  OFCondition result = fileformat.loadFileUntilTag(fileName, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect,
+    DCM_StructureSetROISequence);
+  if (!result.good())
+  {
+    return result;
+  }
+
+  // The examined elements of the other RT objects (plan label and name, referenced RT plan sequence) have higher
+  // tags than the structure set ROI sequence, so read these files again until the pixel data
+  OFString sopClass;
+  if ( fileformat.getDataset()->findAndGetOFString(DCM_SOPClassUID, sopClass).good()
+    && ( sopClass == UID_RTDoseStorage || sopClass == UID_RTPlanStorage
+      || sopClass == UID_RTIonPlanStorage || sopClass == UID_RTImageStorage ) )
+  {
+    result = fileformat.loadFileUntilTag(fileName, EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect,
+      DCM_PixelData);
+  }
+
+  return result;
 }
 
 //-----------------------------------------------------------------------------
@@ -263,7 +474,7 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtDoseDataset(
     name += " [" + instanceNumber + "]";
   }
 
-  // Find RTPlan name for RTDose series
+  // Find referenced RTPlan for RTDose series (its label is added to the name in \sa AppendReferencedRtPlanLabel)
   OFString referencedSOPInstanceUID("");
   DRTDoseIOD rtDoseObject;
   if (rtDoseObject.read(*dataset).good())
@@ -281,7 +492,11 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtDoseDataset(
       }
     }
   }
+}
 
+//-----------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::AppendReferencedRtPlanLabel(OFString &name, const OFString& referencedSOPInstanceUID)
+{
   // Create and open DICOM database to perform database operations for getting RTPlan name
   QSettings settings;
   QString databaseDirectory = settings.value("DatabaseDirectory").toString();
@@ -359,88 +574,47 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtStructureSet
   }
 
   // Get referenced image instance UIDs
-  OFString referencedSOPInstanceUID("");
   DRTStructureSetIOD rtStructureSetObject;
   if (rtStructureSetObject.read(*dataset).good())
   {
-    DRTROIContourSequence &rtROIContourSequenceObject = rtStructureSetObject.getROIContourSequence();
-    if (rtROIContourSequenceObject.gotoFirstItem().good())
+    // The referenced image instances are read from the referenced frame of reference sequence. The ROI contour
+    // sequence is not parsed when examining, as it contains all the contour points
+    DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
+    if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
     {
-      do // For all ROIs
+      DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
+      if (currentReferencedFrameOfReferenceSequenceItem.isValid())
       {
-        DRTROIContourSequence::Item &currentRoiObject = rtROIContourSequenceObject.getCurrentItem();
-        if (currentRoiObject.isValid())
+        DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
+        if (rtReferencedStudySequenceObject.gotoFirstItem().good())
         {
-          DRTContourSequence &rtContourSequenceObject = currentRoiObject.getContourSequence();
-          if (rtContourSequenceObject.gotoFirstItem().good())
+          DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
+          if (rtReferencedStudySequenceItem.isValid())
           {
-            do // For all contours
+            DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
+            if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
             {
-              DRTContourSequence::Item &contourItem = rtContourSequenceObject.getCurrentItem();
-              if (!contourItem.isValid())
-              {
-                DRTContourImageSequence &rtContourImageSequenceObject = contourItem.getContourImageSequence();
-                if (rtContourImageSequenceObject.gotoFirstItem().good())
-                {
-                  DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                  if (rtContourImageSequenceItem.isValid())
-                  {
-                    OFString referencedSOPInstanceUID("");
-                    if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                    {
-                      referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                    }
-                  }
-                }
-              }
-            } // For all contours
-            while (rtContourSequenceObject.gotoNextItem().good());
-          }
-        }
-      } // For all ROIs
-      while (rtROIContourSequenceObject.gotoNextItem().good());
-    } // End ROIContourSequence
-
-    // If the above tags do not store the referenced instance UIDs, then look at the other possible place
-    if (referencedSOPInstanceUIDs.empty())
-    {
-      DRTReferencedFrameOfReferenceSequence &rtReferencedFrameOfReferenceSequenceObject = rtStructureSetObject.getReferencedFrameOfReferenceSequence();
-      if (rtReferencedFrameOfReferenceSequenceObject.gotoFirstItem().good())
-      {
-        DRTReferencedFrameOfReferenceSequence::Item &currentReferencedFrameOfReferenceSequenceItem = rtReferencedFrameOfReferenceSequenceObject.getCurrentItem();
-        if (currentReferencedFrameOfReferenceSequenceItem.isValid())
-        {
-          DRTRTReferencedStudySequence &rtReferencedStudySequenceObject = currentReferencedFrameOfReferenceSequenceItem.getRTReferencedStudySequence();
-          if (rtReferencedStudySequenceObject.gotoFirstItem().good())
-          {
-            DRTRTReferencedStudySequence::Item &rtReferencedStudySequenceItem = rtReferencedStudySequenceObject.getCurrentItem();
-            if (rtReferencedStudySequenceItem.isValid())
-            {
-              DRTRTReferencedSeriesSequence &rtReferencedSeriesSequenceObject = rtReferencedStudySequenceItem.getRTReferencedSeriesSequence();
               if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
               {
-                if (rtReferencedSeriesSequenceObject.gotoFirstItem().good())
+                DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
+                if (rtReferencedSeriesSequenceItem.isValid())
                 {
-                  DRTRTReferencedSeriesSequence::Item &rtReferencedSeriesSequenceItem = rtReferencedSeriesSequenceObject.getCurrentItem();
-                  if (rtReferencedSeriesSequenceItem.isValid())
+                  DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
+                  if (rtContourImageSequenceObject.gotoFirstItem().good())
                   {
-                    DRTContourImageSequence &rtContourImageSequenceObject = rtReferencedSeriesSequenceItem.getContourImageSequence();
-                    if (rtContourImageSequenceObject.gotoFirstItem().good())
+                    do
                     {
-                      do
+                      DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
+                      if (rtContourImageSequenceItem.isValid())
                       {
-                        DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequenceObject.getCurrentItem();
-                        if (rtContourImageSequenceItem.isValid())
+                        OFString referencedSOPInstanceUID("");
+                        if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
                         {
-                          OFString referencedSOPInstanceUID("");
-                          if (rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID).good())
-                          {
-                            referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
-                          }
+                          referencedSOPInstanceUIDs.push_back(referencedSOPInstanceUID);
                         }
-                      } // For all contours
-                      while (rtContourImageSequenceObject.gotoNextItem().good());
-                    }
+                      }
+                    } // For all contours
+                    while (rtContourImageSequenceObject.gotoNextItem().good());
                   }
                 }
               }
@@ -448,7 +622,7 @@ void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::ExamineRtStructureSet
           }
         }
       }
-    } // End DRTReferencedFrameOfReferenceSequence
+    }
   } // End finding referenced instance UIDs
 }
 
@@ -499,57 +673,63 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtDose(vtkSlicerD
   const char* fileName = loadable->GetFiles()->GetValue(0);
   const char* seriesName = loadable->GetName();
 
-  // Load Volume
-  vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
   vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  volumeStorageNode->SetFileName(fileName);
-  volumeStorageNode->ResetFileNameList();
-  volumeStorageNode->SetSingleFile(1);
-
-  // Read volume from disk
-  if (!volumeStorageNode->ReadData(volumeNode))
-  {
-    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
-    return false;
-  }
-
-  volumeNode->SetScene(this->External->GetMRMLScene());
-  std::string volumeNodeName = scene->GenerateUniqueName(seriesName);
-  volumeNode->SetName(volumeNodeName.c_str());
-
-  // Set new spacing
-  double* initialSpacing = volumeNode->GetSpacing();
-  double* correctSpacing = rtReader->GetPixelSpacing();
-  volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
-  volumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
-  scene->AddNode(volumeNode);
-
-  // Apply dose grid scaling
   if (!rtReader->GetDoseGridScaling())
   {
-    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Empty dose unit value found for dose volume " << volumeNode->GetName());
+    vtkErrorWithObjectMacro(this->External, "LoadRtDose: Empty dose unit value found for dose volume '" << fileName << "'");
   }
   double doseGridScaling = vtkVariant(rtReader->GetDoseGridScaling()).ToDouble();
 
+  // Read the dose frame by frame directly into a float volume, applying the dose grid scaling in the same pass
   vtkSmartPointer<vtkImageData> floatVolumeData = vtkSmartPointer<vtkImageData>::New();
-
-  vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
-  imageCast->SetInputData(volumeNode->GetImageData());
-  imageCast->SetOutputScalarTypeToFloat();
-  imageCast->Update();
-  floatVolumeData->DeepCopy(imageCast->GetOutput());
-
-  float value = 0.0;
-  float* floatPtr = (float*)floatVolumeData->GetScalarPointer();
-  for (long i=0; i<floatVolumeData->GetNumberOfPoints(); ++i)
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (rtReader->ReadDoseImageData(floatVolumeData, ijkToRasMatrix))
   {
-    value = (*floatPtr) * doseGridScaling;
-    (*floatPtr) = value;
-    ++floatPtr;
+    volumeNode->SetIJKToRASMatrix(ijkToRasMatrix);
   }
+  else
+  {
+    // Pixel data that cannot be streamed (e.g. compressed) is read by the volume archetype storage node
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> volumeStorageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    volumeStorageNode->SetFileName(fileName);
+    volumeStorageNode->ResetFileNameList();
+    volumeStorageNode->SetSingleFile(1);
+
+    // Read volume from disk
+    if (!volumeStorageNode->ReadData(volumeNode))
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadRtDose: Failed to load dose volume file '" << fileName << "' (series name '" << seriesName << "')");
+      return false;
+    }
+
+    // Set new spacing
+    double* initialSpacing = volumeNode->GetSpacing();
+    double* correctSpacing = rtReader->GetPixelSpacing();
+    volumeNode->SetSpacing(correctSpacing[0], correctSpacing[1], initialSpacing[2]);
+
+    // Apply dose grid scaling
+    vtkSmartPointer<vtkImageCast> imageCast = vtkSmartPointer<vtkImageCast>::New();
+    imageCast->SetInputData(volumeNode->GetImageData());
+    imageCast->SetOutputScalarTypeToFloat();
+    imageCast->Update();
+    // Shallow copy, so that the cast pipeline and the volume read from file are not kept alive with the dose
+    floatVolumeData->ShallowCopy(imageCast->GetOutput());
 
+    float* floatPtr = (float*)floatVolumeData->GetScalarPointer();
+    for (vtkIdType i=0; i<floatVolumeData->GetNumberOfPoints(); ++i)
+    {
+      (*floatPtr) *= doseGridScaling;
+      ++floatPtr;
+    }
+  }
   volumeNode->SetAndObserveImageData(floatVolumeData);
 
+  volumeNode->SetScene(this->External->GetMRMLScene());
+  std::string volumeNodeName = scene->GenerateUniqueName(seriesName);
+  volumeNode->SetName(volumeNodeName.c_str());
+  volumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+  scene->AddNode(volumeNode);
+
   // Get default isodose color table and default dose color table
   vtkMRMLColorTableNode* defaultIsodoseColorTable = vtkSlicerIsodoseModuleLogic::GetDefaultIsodoseColorTable(scene);
   vtkMRMLColorTableNode* defaultDoseColorTable = vtkSlicerIsodoseModuleLogic::CreateDefaultDoseColorTable(scene);
@@ -822,6 +1002,13 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadExternalBeamPlan(
     {
       ionBeamNode = vtkMRMLRTIonBeamNode::SafeDownCast(beamNode);
     }
+    else if (!singleBeam && this->External->LoadDynamicBeamsCompact)
+    {
+      if (!this->LoadCompactDynamicBeam(rtReader, planNode, beamIndex))
+      {
+        return false;
+      }
+    }
     else if (!singleBeam && this->LoadDynamicBeamSequence( rtReader, seriesName, 
       planNode, beamIndex, beamNode, beamTransformNode, mlcTableNode, scanSpotTableNode))
     {
@@ -1055,6 +1242,15 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadDynamicBeamSequen
   const char* beamType = rtReader->GetBeamType(dicomBeamNumber);
   const char* treatmentDeliveryType = rtReader->GetBeamTreatmentDeliveryType(dicomBeamNumber);
 
+  // Get geometry of all control points at once instead of looking up the beam for each parameter of each control point
+  vtkSlicerDicomRtReader::BeamControlPointArrays controlPointArrays;
+  if (!rtReader->GetBeamControlPointArrays(dicomBeamNumber, controlPointArrays)
+    || controlPointArrays.GantryAngles.size() < nofControlPoints)
+  {
+    vtkErrorWithObjectMacro(this->External, "LoadDynamicBeamSequence: Failed to get control points of beam " << dicomBeamNumber);
+    return false;
+  }
+
   // Create sequence node for RTBeam, transformation, table
   vtkNew<vtkMRMLSequenceNode> beamSequenceNode;
   beamSequenceNode->SetName(beamName);
@@ -1149,18 +1345,15 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadDynamicBeamSequen
     beamNode->SetName(newBeamName.c_str());
 
     // Set beam geometry parameters from DICOM
-    double jawPositions[2][2] = {{0.0, 0.0},{0.0, 0.0}};
-    if (rtReader->GetBeamControlPointJawPositions( dicomBeamNumber, controlPointIndex, jawPositions))
-    {
-      beamNode->SetX1Jaw(jawPositions[0][0]);
-      beamNode->SetX2Jaw(jawPositions[0][1]);
-      beamNode->SetY1Jaw(jawPositions[1][0]);
-      beamNode->SetY2Jaw(jawPositions[1][1]);
-    }
+    const double* jawPositions = &controlPointArrays.JawPositions[controlPointIndex * 4];
+    beamNode->SetX1Jaw(jawPositions[0]);
+    beamNode->SetX2Jaw(jawPositions[1]);
+    beamNode->SetY1Jaw(jawPositions[2]);
+    beamNode->SetY2Jaw(jawPositions[3]);
 
-    beamNode->SetGantryAngle(rtReader->GetBeamControlPointGantryAngle( dicomBeamNumber, controlPointIndex));
-    beamNode->SetCollimatorAngle(rtReader->GetBeamControlPointBeamLimitingDeviceAngle( dicomBeamNumber, controlPointIndex));
-    beamNode->SetCouchAngle(rtReader->GetBeamControlPointPatientSupportAngle( dicomBeamNumber, controlPointIndex));
+    beamNode->SetGantryAngle(controlPointArrays.GantryAngles[controlPointIndex]);
+    beamNode->SetCollimatorAngle(controlPointArrays.BeamLimitingDeviceAngles[controlPointIndex]);
+    beamNode->SetCouchAngle(controlPointArrays.PatientSupportAngles[controlPointIndex]);
 
     // SAD for RTPlan, source to beam limiting devices (Jaws, MLC)
     if (beamNode && !ionBeamNode)
@@ -1256,11 +1449,7 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadDynamicBeamSequen
     {
       if (this->External->BeamsLogic)
       {
-        double* isocenter = rtReader->GetBeamControlPointIsocenterPositionRas( dicomBeamNumber, controlPointIndex);
-        if (!isocenter)
-        {
-          isocenter = rtReader->GetBeamControlPointIsocenterPositionRas( dicomBeamNumber, 0);
-        }
+        double* isocenter = &controlPointArrays.IsocenterPositionsRas[controlPointIndex * 3];
 
         // Update beam transform without translation to isocenter
         this->External->BeamsLogic->UpdateTransformForBeam( beamSequenceNode->GetSequenceScene(), beamNode, transformNode, isocenter);
@@ -1367,69 +1556,361 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadDynamicBeamSequen
 }
 
 //---------------------------------------------------------------------------
-bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadBrachyPlan(
-  vtkSlicerDicomRtReader* rtReader, const char* seriesName, vtkMRMLRTPlanNode* planNode)
+bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadCompactDynamicBeam(
+  vtkSlicerDicomRtReader* rtReader, vtkMRMLRTPlanNode* planNode, int beamIndex)
 {
-  if (!rtReader || !seriesName || !planNode)
+  vtkMRMLScene* scene = planNode->GetScene();
+
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(scene);
+  if (!shNode)
   {
-    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Invalid inputs");
+    vtkErrorWithObjectMacro(this->External, "LoadCompactDynamicBeam: Failed to access subject hierarchy node");
     return false;
   }
-  vtkMRMLScene* scene = planNode->GetScene();
-  if (!scene)
+
+  unsigned int dicomBeamNumber = rtReader->GetBeamNumberForIndex(beamIndex);
+  const char* beamName = rtReader->GetBeamName(dicomBeamNumber);
+  unsigned int nofControlPoints = rtReader->GetBeamNumberOfControlPoints(dicomBeamNumber);
+  const char* treatmentDeliveryType = rtReader->GetBeamTreatmentDeliveryType(dicomBeamNumber);
+
+  vtkSlicerDicomRtReader::BeamControlPointArrays controlPointArrays;
+  if (!rtReader->GetBeamControlPointArrays(dicomBeamNumber, controlPointArrays)
+    || nofControlPoints == 0 || controlPointArrays.GantryAngles.size() < nofControlPoints)
   {
-    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Invalid MRML scene");
+    vtkErrorWithObjectMacro(this->External, "LoadCompactDynamicBeam: Failed to get control points of beam " << dicomBeamNumber);
     return false;
   }
-  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->External->GetMRMLScene());
-  if (!shNode)
+
+  // Create the beam node
+  vtkSmartPointer<vtkMRMLRTBeamNode> beamNode; // for RTPlan
+  vtkSmartPointer<vtkMRMLRTIonBeamNode> ionBeamNode; // for RTIonPlan
+  if (rtReader->GetLoadRTPlanSuccessful())
   {
-    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Failed to access subject hierarchy node");
+    beamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  }
+  else if (rtReader->GetLoadRTIonPlanSuccessful())
+  {
+    beamNode = ionBeamNode = vtkSmartPointer<vtkMRMLRTIonBeamNode>::New();
+  }
+  else
+  {
+    vtkErrorWithObjectMacro(this->External, "LoadCompactDynamicBeam: No plan has been loaded");
     return false;
   }
-  vtkIdType planShItemID = planNode->GetPlanSubjectHierarchyItemID();
 
-  for (int channelIndex = 1; channelIndex <= rtReader->GetNumberOfChannels(); ++channelIndex)
+  std::string name = beamName;
+  if (treatmentDeliveryType)
   {
-    std::stringstream channelNameStream;
-    channelNameStream << seriesName << "_" << channelIndex;
+    name += std::string(" [") + treatmentDeliveryType + "]";
+  }
+  beamNode->SetName(name.c_str());
 
-    std::string fiducialNodeName = this->External->GetMRMLScene()->GenerateUniqueName(channelNameStream.str());
-    vtkNew<vtkMRMLMarkupsCurveNode> markupsNode;
-    this->External->GetMRMLScene()->AddNode(markupsNode);
-    markupsNode->SetName(fiducialNodeName.c_str());
-    int numberOfControlPoints = rtReader->GetChannelNumberOfControlPoints(channelIndex);
-    for (int controlPointIndex = 0; controlPointIndex < numberOfControlPoints; ++controlPointIndex)
+  // SAD for RTPlan, source to beam limiting devices (Jaws, MLC)
+  if (!ionBeamNode)
+  {
+    beamNode->SetSAD(rtReader->GetBeamSourceAxisDistance(dicomBeamNumber));
+    beamNode->SetSourceToJawsDistanceX(rtReader->GetBeamSourceToJawsDistanceX(dicomBeamNumber));
+    beamNode->SetSourceToJawsDistanceY(rtReader->GetBeamSourceToJawsDistanceY(dicomBeamNumber));
+    beamNode->SetSourceToMultiLeafCollimatorDistance(rtReader->GetBeamSourceToMultiLeafCollimatorDistance(dicomBeamNumber));
+  }
+  // VSAD for RTIonPlan, isocenter to beam limiting devices (Jaws, MLC)
+  else
+  {
+    ionBeamNode->SetVSAD(rtReader->GetBeamVirtualSourceAxisDistance(dicomBeamNumber));
+    ionBeamNode->SetIsocenterToJawsDistanceX(rtReader->GetBeamIsocenterToJawsDistanceX(dicomBeamNumber));
+    ionBeamNode->SetIsocenterToJawsDistanceY(rtReader->GetBeamIsocenterToJawsDistanceY(dicomBeamNumber));
+    ionBeamNode->SetIsocenterToMultiLeafCollimatorDistance(rtReader->GetBeamIsocenterToMultiLeafCollimatorDistance(dicomBeamNumber));
+  }
+
+  // Set isocenter to parent plan
+  double* isocenter = &controlPointArrays.IsocenterPositionsRas[0];
+  planNode->SetIsocenterSpecification(vtkMRMLRTPlanNode::ArbitraryPoint);
+  if (beamIndex == 0)
+  {
+    if (!planNode->SetIsocenterPosition(isocenter))
     {
-      double controlPointPosition[3] = { 0.0, 0.0, 0.0 };
-      if (!rtReader->GetChannelControlPoint(channelIndex, controlPointIndex, controlPointPosition))
+      vtkErrorWithObjectMacro(this->External, "LoadCompactDynamicBeam: Failed to set isocenter position");
+      return false;
+    }
+  }
+  else
+  {
+    double planIsocenter[3] = {};
+    if (!planNode->GetIsocenterPosition(planIsocenter))
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadCompactDynamicBeam: Failed to get plan isocenter position");
+      return false;
+    }
+    if ( !vtkSlicerRtCommon::AreEqualWithTolerance(planIsocenter[0], isocenter[0])
+      || !vtkSlicerRtCommon::AreEqualWithTolerance(planIsocenter[1], isocenter[1])
+      || !vtkSlicerRtCommon::AreEqualWithTolerance(planIsocenter[2], isocenter[2]) )
+    {
+      vtkErrorWithObjectMacro( this->External, "LoadCompactDynamicBeam: Different isocenters for each beam are not yet supported! The first isocenter will be used for the whole plan " << planNode->GetName() << ": (" << planIsocenter[0] << ", " << planIsocenter[1] << ", " << planIsocenter[2] << ")");
+    }
+  }
+
+  // Create control point table, one row for each control point
+  vtkSmartPointer<vtkMRMLTableNode> controlPointTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  scene->AddNode(controlPointTableNode);
+  name = std::string(beamName) + "_ControlPoints";
+  controlPointTableNode->SetName(name.c_str());
+  controlPointTableNode->SetUseColumnNameAsColumnHeader(true);
+  vtkTable* controlPointTable = controlPointTableNode->GetTable();
+  auto addControlPointColumn = [&](const char* columnName, const char* description)
+  {
+    vtkNew<vtkDoubleArray> column;
+    column->SetName(columnName);
+    column->SetNumberOfValues(nofControlPoints);
+    controlPointTable->AddColumn(column);
+    controlPointTableNode->SetColumnDescription(columnName, description);
+    return column.GetPointer();
+  };
+
+  vtkDoubleArray* gantryAngleColumn = addControlPointColumn("GantryAngle", "Gantry angle");
+  vtkDoubleArray* collimatorAngleColumn = addControlPointColumn("CollimatorAngle", "Beam limiting device angle");
+  vtkDoubleArray* couchAngleColumn = addControlPointColumn("CouchAngle", "Patient support angle");
+  vtkDoubleArray* jawColumns[4] = {
+    addControlPointColumn("X1Jaw", "Jaw position X1"),
+    addControlPointColumn("X2Jaw", "Jaw position X2"),
+    addControlPointColumn("Y1Jaw", "Jaw position Y1"),
+    addControlPointColumn("Y2Jaw", "Jaw position Y2") };
+  vtkDoubleArray* isocenterColumns[3] = {
+    addControlPointColumn("IsocenterR", "Isocenter position R"),
+    addControlPointColumn("IsocenterA", "Isocenter position A"),
+    addControlPointColumn("IsocenterS", "Isocenter position S") };
+  vtkDoubleArray* metersetWeightColumn = addControlPointColumn("CumulativeMetersetWeight", "Cumulative meterset weight");
+  vtkDoubleArray* energyColumn = addControlPointColumn("NominalBeamEnergy", "Nominal beam energy");
+  for (unsigned int controlPointIndex = 0; controlPointIndex < nofControlPoints; ++controlPointIndex)
+  {
+    gantryAngleColumn->SetValue(controlPointIndex, controlPointArrays.GantryAngles[controlPointIndex]);
+    collimatorAngleColumn->SetValue(controlPointIndex, controlPointArrays.BeamLimitingDeviceAngles[controlPointIndex]);
+    couchAngleColumn->SetValue(controlPointIndex, controlPointArrays.PatientSupportAngles[controlPointIndex]);
+    for (int jawIndex = 0; jawIndex < 4; ++jawIndex)
+    {
+      jawColumns[jawIndex]->SetValue(controlPointIndex, controlPointArrays.JawPositions[controlPointIndex * 4 + jawIndex]);
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      isocenterColumns[axis]->SetValue(controlPointIndex, controlPointArrays.IsocenterPositionsRas[controlPointIndex * 3 + axis]);
+    }
+    metersetWeightColumn->SetValue(controlPointIndex, controlPointArrays.CumulativeMetersetWeights[controlPointIndex]);
+    energyColumn->SetValue(controlPointIndex, controlPointArrays.NominalBeamEnergies[controlPointIndex]);
+  }
+
+  // MLC leaf positions: one column for each leaf. The leaf pair boundaries are the same for all control points,
+  // so they are only stored in the MLC table of the current control point. Leaf positions of control points
+  // without valid MLC data are NaN in the control point arrays, and are not applied
+  vtkMRMLTableNode* mlcTableNode = nullptr;
+  std::vector<double>::const_iterator firstValidLeafPosition = std::find_if(
+    controlPointArrays.LeafPositions.begin(), controlPointArrays.LeafPositions.end(),
+    [](double position) { return !std::isnan(position); } );
+  if (!controlPointArrays.MultiLeafCollimatorType.empty() && firstValidLeafPosition != controlPointArrays.LeafPositions.end())
+  {
+    size_t numberOfLeaves = 2 * (controlPointArrays.LeafPositionBoundaries.size() - 1);
+    size_t numberOfLeafPairs = numberOfLeaves / 2;
+    std::vector<vtkDoubleArray*> leafColumns;
+    for (size_t leafIndex = 0; leafIndex < numberOfLeaves; ++leafIndex)
+    {
+      std::string columnName = std::string(leafIndex < numberOfLeafPairs ? "Leaf1_" : "Leaf2_")
+        + std::to_string(leafIndex % numberOfLeafPairs);
+      leafColumns.push_back(addControlPointColumn(columnName.c_str(), "MLC leaf position"));
+    }
+    for (unsigned int controlPointIndex = 0; controlPointIndex < nofControlPoints; ++controlPointIndex)
+    {
+      const double* leafPositions = &controlPointArrays.LeafPositions[controlPointIndex * numberOfLeaves];
+      for (size_t leafIndex = 0; leafIndex < numberOfLeaves; ++leafIndex)
       {
-        vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Failed to get control point "
-          << controlPointIndex << " from channel " << channelIndex);
-        continue;
+        leafColumns[leafIndex]->SetValue(controlPointIndex, leafPositions[leafIndex]);
       }
-      vtkVector3d controlPointPosVector(controlPointPosition);
-      markupsNode->AddControlPoint(controlPointPosVector);
     }
-    markupsNode->SetLocked(1);
 
-    vtkNew<vtkMRMLMarkupsDisplayNode> markupsDisplayNode;
-    this->External->GetMRMLScene()->AddNode(markupsDisplayNode);
-    markupsDisplayNode->SetGlyphType(vtkMRMLMarkupsDisplayNode::Sphere3D);
-    markupsNode->SetAndObserveDisplayNodeID(markupsDisplayNode->GetID());
+    // Initial MLC positions are those of the first control point that has valid leaf positions
+    size_t firstValidControlPointOffset = numberOfLeaves
+      * ((firstValidLeafPosition - controlPointArrays.LeafPositions.begin()) / numberOfLeaves);
+    std::vector<double> positions(controlPointArrays.LeafPositions.begin() + firstValidControlPointOffset,
+      controlPointArrays.LeafPositions.begin() + firstValidControlPointOffset + numberOfLeaves);
+    name = controlPointArrays.MultiLeafCollimatorType + "_BoundaryAndPosition" + ": " + beamName;
+    mlcTableNode = this->CreateMultiLeafCollimatorTableNode(name.c_str(), controlPointArrays.LeafPositionBoundaries, positions);
+  }
+  else
+  {
+    vtkDebugWithObjectMacro( this->External, "LoadCompactDynamicBeam: MLC data unavailable");
+  }
 
-    // Hide the fiducial by default
-    //markupsNode->SetDisplayVisibility(0);
+  // Scan spots of modulated ion beam: the spots of all control points are stored in one table,
+  // and the control point table contains the range of rows for each control point
+  vtkSmartPointer<vtkMRMLTableNode> scanSpotControlPointTableNode;
+  vtkMRMLTableNode* scanSpotTableNode = nullptr;
+  if (ionBeamNode)
+  {
+    vtkDoubleArray* spotSizeColumns[2] = {
+      addControlPointColumn("ScanningSpotSizeX", "Scanning spot size X"),
+      addControlPointColumn("ScanningSpotSizeY", "Scanning spot size Y") };
+    vtkDoubleArray* firstScanSpotColumn = addControlPointColumn("FirstScanSpot", "Index of the first scan spot of the control point");
+    vtkDoubleArray* numberOfScanSpotsColumn = addControlPointColumn("NumberOfScanSpots", "Number of scan spots of the control point");
+
+    vtkNew<vtkDoubleArray> spotPositionX;
+    spotPositionX->SetName("X");
+    vtkNew<vtkDoubleArray> spotPositionY;
+    spotPositionY->SetName("Y");
+    vtkNew<vtkDoubleArray> spotWeights;
+    spotWeights->SetName("Weight");
+
+    const std::vector<size_t>& spotOffsets = controlPointArrays.ScanSpotOffsets;
+    size_t numberOfSpots = spotOffsets[nofControlPoints];
+    spotPositionX->SetNumberOfValues(numberOfSpots);
+    spotPositionY->SetNumberOfValues(numberOfSpots);
+    spotWeights->SetNumberOfValues(numberOfSpots);
+    for (size_t spotIndex = 0; spotIndex < numberOfSpots; ++spotIndex)
+    {
+      spotPositionX->SetValue(spotIndex, controlPointArrays.ScanSpotPositionMap[2 * spotIndex]);
+      spotPositionY->SetValue(spotIndex, controlPointArrays.ScanSpotPositionMap[2 * spotIndex + 1]);
+      spotWeights->SetValue(spotIndex, controlPointArrays.ScanSpotMetersetWeights[spotIndex]);
+    }
+    for (unsigned int controlPointIndex = 0; controlPointIndex < nofControlPoints; ++controlPointIndex)
+    {
+      spotSizeColumns[0]->SetValue(controlPointIndex, controlPointArrays.ScanningSpotSizes[2 * controlPointIndex]);
+      spotSizeColumns[1]->SetValue(controlPointIndex, controlPointArrays.ScanningSpotSizes[2 * controlPointIndex + 1]);
+      firstScanSpotColumn->SetValue(controlPointIndex, spotOffsets[controlPointIndex]);
+      numberOfScanSpotsColumn->SetValue(controlPointIndex, spotOffsets[controlPointIndex + 1] - spotOffsets[controlPointIndex]);
+    }
+    std::vector<float> firstSpotPositions(controlPointArrays.ScanSpotPositionMap.begin(),
+      controlPointArrays.ScanSpotPositionMap.begin() + 2 * spotOffsets[1]);
+    std::vector<float> firstSpotWeights(controlPointArrays.ScanSpotMetersetWeights.begin(),
+      controlPointArrays.ScanSpotMetersetWeights.begin() + spotOffsets[1]);
+
+    if (spotWeights->GetNumberOfValues() > 0)
+    {
+      scanSpotControlPointTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+      scene->AddNode(scanSpotControlPointTableNode);
+      name = std::string("ScanSpot_ControlPoints") + ": " + beamName;
+      scanSpotControlPointTableNode->SetName(name.c_str());
+      scanSpotControlPointTableNode->GetTable()->AddColumn(spotPositionX);
+      scanSpotControlPointTableNode->GetTable()->AddColumn(spotPositionY);
+      scanSpotControlPointTableNode->GetTable()->AddColumn(spotWeights);
+      scanSpotControlPointTableNode->SetUseColumnNameAsColumnHeader(true);
+      scanSpotControlPointTableNode->SetColumnDescription( "X", "Scan spot positions X");
+      scanSpotControlPointTableNode->SetColumnDescription( "Y", "Scan spot positions Y");
+      scanSpotControlPointTableNode->SetColumnDescription( "Weight", "Scan spot meterset weights");
+
+      scanSpotTableNode = this->CreateScanSpotTableNode( "ScanSpot_PositionMap_MetersetWeights",
+        firstSpotPositions, firstSpotWeights);
+    }
+  }
+
+  // Add beam to scene and link it to the tables
+  scene->AddNode(beamNode);
+  beamNode->SetNodeReferenceID(vtkSlicerDicomRtImportExportModuleLogic::CONTROL_POINT_TABLE_REFERENCE_ROLE.c_str(),
+    controlPointTableNode->GetID());
+  if (scanSpotTableNode)
+  {
+    beamNode->SetNodeReferenceID(vtkSlicerDicomRtImportExportModuleLogic::SCAN_SPOT_CONTROL_POINT_TABLE_REFERENCE_ROLE.c_str(),
+      scanSpotControlPointTableNode->GetID());
+    ionBeamNode->SetAndObserveScanSpotTableNode(scanSpotTableNode);
+  }
+  else if (mlcTableNode)
+  {
+    beamNode->SetAndObserveMultiLeafCollimatorTableNode(mlcTableNode);
+  }
 
-    // Add channel markups fiducial node under plan in SH
-    vtkIdType channelMarkupsShItemID = shNode->GetItemByDataNode(markupsNode);
-    if (channelMarkupsShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
-    {
-      shNode->SetItemParent(channelMarkupsShItemID, planShItemID);
-    }
+  // Set geometry of the first control point
+  if (!this->External->SetBeamControlPointIndex(beamNode, 0))
+  {
+    return false;
   }
 
-  return true;
+  // Add beam to plan (triggers poly data and transform creation and update)
+  planNode->AddBeam(beamNode);
+
+  // Hide beam polydata
+  vtkMRMLModelDisplayNode* displayNode = vtkMRMLModelDisplayNode::SafeDownCast(beamNode->GetDisplayNode());
+  if (displayNode)
+  {
+    displayNode->VisibilityOff();
+  }
+
+  // Put tables under the beam in subject hierarchy
+  vtkIdType beamShId = shNode->GetItemByDataNode(beamNode);
+  if (beamShId != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    vtkMRMLTableNode* tableNodes[4] = { controlPointTableNode, mlcTableNode, scanSpotControlPointTableNode, scanSpotTableNode };
+    for (vtkMRMLTableNode* tableNode : tableNodes)
+    {
+      vtkIdType tableShId = (tableNode ? shNode->GetItemByDataNode(tableNode) : vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID);
+      if (tableShId != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+      {
+        shNode->SetItemParent(tableShId, beamShId);
+      }
+    }
+  }
+
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadBrachyPlan(
+  vtkSlicerDicomRtReader* rtReader, const char* seriesName, vtkMRMLRTPlanNode* planNode)
+{
+  if (!rtReader || !seriesName || !planNode)
+  {
+    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Invalid inputs");
+    return false;
+  }
+  vtkMRMLScene* scene = planNode->GetScene();
+  if (!scene)
+  {
+    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Invalid MRML scene");
+    return false;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->External->GetMRMLScene());
+  if (!shNode)
+  {
+    vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Failed to access subject hierarchy node");
+    return false;
+  }
+  vtkIdType planShItemID = planNode->GetPlanSubjectHierarchyItemID();
+
+  for (int channelIndex = 1; channelIndex <= rtReader->GetNumberOfChannels(); ++channelIndex)
+  {
+    std::stringstream channelNameStream;
+    channelNameStream << seriesName << "_" << channelIndex;
+
+    std::string fiducialNodeName = this->External->GetMRMLScene()->GenerateUniqueName(channelNameStream.str());
+    vtkNew<vtkMRMLMarkupsCurveNode> markupsNode;
+    this->External->GetMRMLScene()->AddNode(markupsNode);
+    markupsNode->SetName(fiducialNodeName.c_str());
+    int numberOfControlPoints = rtReader->GetChannelNumberOfControlPoints(channelIndex);
+    for (int controlPointIndex = 0; controlPointIndex < numberOfControlPoints; ++controlPointIndex)
+    {
+      double controlPointPosition[3] = { 0.0, 0.0, 0.0 };
+      if (!rtReader->GetChannelControlPoint(channelIndex, controlPointIndex, controlPointPosition))
+      {
+        vtkErrorWithObjectMacro(this->External, "LoadBrachyPlan: Failed to get control point "
+          << controlPointIndex << " from channel " << channelIndex);
+        continue;
+      }
+      vtkVector3d controlPointPosVector(controlPointPosition);
+      markupsNode->AddControlPoint(controlPointPosVector);
+    }
+    markupsNode->SetLocked(1);
+
+    vtkNew<vtkMRMLMarkupsDisplayNode> markupsDisplayNode;
+    this->External->GetMRMLScene()->AddNode(markupsDisplayNode);
+    markupsDisplayNode->SetGlyphType(vtkMRMLMarkupsDisplayNode::Sphere3D);
+    markupsNode->SetAndObserveDisplayNodeID(markupsDisplayNode->GetID());
+
+    // Hide the fiducial by default
+    //markupsNode->SetDisplayVisibility(0);
+
+    // Add channel markups fiducial node under plan in SH
+    vtkIdType channelMarkupsShItemID = shNode->GetItemByDataNode(markupsNode);
+    if (channelMarkupsShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+    {
+      shNode->SetItemParent(channelMarkupsShItemID, planShItemID);
+    }
+  }
+
+  return true;
 }
 
 //---------------------------------------------------------------------------
@@ -1462,6 +1943,8 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
   // Number of loaded points. Used to prevent unreasonably long loading times with the downside of a less nice initial representation
   long maximumNumberOfPoints = -1;
   long totalNumberOfPoints = 0;
+  // Segments created for the contour ROIs. They are added to the segmentation in one batch after all ROIs are processed
+  std::vector<vtkSmartPointer<vtkSegment> > contourSegments;
 
   // Add ROIs
   int numberOfRois = rtReader->GetNumberOfRois();
@@ -1480,18 +1963,19 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
         << "' (internal ROI index: " << internalROIIndex << ")");
       continue;
     }
-    if (roiPolyData->GetNumberOfPoints() == 0)
+    vtkIdType numberOfRoiPoints = roiPolyData->GetNumberOfPoints();
+    if (numberOfRoiPoints == 0)
     {
       vtkWarningWithObjectMacro(this->External, "LoadRtStructureSet: Structure ROI data does not contain any points for ROI named '"
         << (roiLabel?roiLabel:"Unnamed") << "' in file '" << fileName
         << "' (internal ROI index: " << internalROIIndex << ")");
       continue;
     }
-    if (maximumNumberOfPoints < roiPolyData->GetNumberOfPoints())
+    if (maximumNumberOfPoints < numberOfRoiPoints)
     {
-      maximumNumberOfPoints = roiPolyData->GetNumberOfPoints();
+      maximumNumberOfPoints = numberOfRoiPoints;
     }
-    totalNumberOfPoints += roiPolyData->GetNumberOfPoints();
+    totalNumberOfPoints += numberOfRoiPoints;
 
     // Get referenced series UID
     const char* roiReferencedSeriesUid = rtReader->GetRoiReferencedSeriesUid(internalROIIndex);
@@ -1507,7 +1991,7 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
     //
     // Point ROI (fiducial)
     //
-    if (roiPolyData->GetNumberOfPoints() == 1)
+    if (numberOfRoiPoints == 1)
     {
       // Set up subject hierarchy item for the series, if it has not been done yet.
       // Only create it for fiducials, as all structures are stored in a single segmentation node
@@ -1593,27 +2077,145 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
         segmentationNode->GetSegmentation()->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(), defaultSliceThicknessStream.str());
       }
 
-      // Add segment for current structure
+      // Create segment for current structure
       vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
       segment->SetName(roiLabel);
       segment->SetColor(roiColor[0], roiColor[1], roiColor[2]);
       segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(), roiPolyData);
-      segmentationNode->GetSegmentation()->AddSegment(segment);
+      contourSegments.push_back(segment);
 
       // Add DICOM ROI number as tag to the segment
       std::stringstream roiNumberStream;
       roiNumberStream << rtReader->GetRoiNumber(internalROIIndex);
       segment->SetTag(vtkSlicerRtCommon::DICOMRTIMPORT_ROI_NUMBER_SEGMENT_TAG_NAME, roiNumberStream.str());
+
+      // Add number of contours and bounds as tags, so that they are available without converting the representations
+      std::stringstream roiNumberOfContoursStream;
+      roiNumberOfContoursStream << rtReader->GetRoiNumberOfContours(internalROIIndex);
+      segment->SetTag(vtkSlicerRtCommon::DICOMRTIMPORT_ROI_NUMBER_OF_CONTOURS_SEGMENT_TAG_NAME, roiNumberOfContoursStream.str());
+      double roiBounds[6] = { 0.0, -1.0, 0.0, -1.0, 0.0, -1.0 };
+      if (rtReader->GetRoiBounds(internalROIIndex, roiBounds))
+      {
+        std::stringstream roiBoundsStream;
+        roiBoundsStream << roiBounds[0] << " " << roiBounds[1] << " " << roiBounds[2] << " "
+          << roiBounds[3] << " " << roiBounds[4] << " " << roiBounds[5];
+        segment->SetTag(vtkSlicerRtCommon::DICOMRTIMPORT_ROI_BOUNDS_SEGMENT_TAG_NAME, roiBoundsStream.str());
+      }
     }
   } // for all ROIs
 
+  // Closed surface is shown instead of contour points, except in case of extremely large structures,
+  // to prevent unreasonably long load times (arbitrary thresholds, can revisit)
+  vtkDebugWithObjectMacro(this->External, "LoadRtStructureSet: Maximum number of points in a segment = " << maximumNumberOfPoints << ", Total number of points in segmentation = " << totalNumberOfPoints);
+  bool showClosedSurface = (maximumNumberOfPoints < 800000 && totalNumberOfPoints < 3000000);
+
+  // If the ROIs are loaded on demand, then the segments are hidden placeholders with the complete planar contours.
+  // Their closed surfaces are empty placeholders too (so that adding the segments does not convert them),
+  // which are filled when the segment is shown or \sa LoadDeferredRoiContours is called
+  bool deferClosedSurface = (this->External->LoadRoiContoursOnDemand && showClosedSurface);
+  if (deferClosedSurface)
+  {
+    for (std::vector<vtkSmartPointer<vtkSegment> >::iterator segmentIt = contourSegments.begin(); segmentIt != contourSegments.end(); ++segmentIt)
+    {
+      (*segmentIt)->AddRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(), vtkSmartPointer<vtkPolyData>::New());
+    }
+  }
+
+  // Create closed surface representation of the segments concurrently before they are added to the segmentation,
+  // so that showing closed surface does not convert the segments one by one. Each segment is converted by its own
+  // conversion rule instance, and the segments are not observed by anything yet. The errors and warnings of the
+  // conversion rules are collected on the worker threads and reported on this thread
+  if (showClosedSurface && !deferClosedSurface && !contourSegments.empty())
+  {
+    std::string defaultSliceThickness = segmentationNode->GetSegmentation()->GetConversionParameter(
+      vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName() );
+    unsigned int totalNumberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->External->NumberOfThreads, 0);
+    unsigned int numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->External->NumberOfThreads, contourSegments.size());
+    // Threads not needed for the segments are used for triangulating the planes within the segments
+    unsigned int numberOfThreadsPerSegment = std::max(1u, totalNumberOfThreads / numberOfThreads);
+    std::vector<ConversionMessages> segmentConversionMessages(contourSegments.size());
+    vtkSlicerRtCommon::RunOnWorkerThreads(contourSegments.size(), numberOfThreads,
+      [&contourSegments, &defaultSliceThickness, &segmentConversionMessages, numberOfThreadsPerSegment](size_t segmentIndex)
+      {
+        vtkSegment* segment = contourSegments[segmentIndex];
+        vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> conversionRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+        conversionRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(), defaultSliceThickness);
+        conversionRule->SetNumberOfThreads(numberOfThreadsPerSegment);
+        vtkSmartPointer<vtkCallbackCommand> messageCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+        messageCallback->SetCallback(vtkInternal::CollectConversionMessage);
+        messageCallback->SetClientData(&segmentConversionMessages[segmentIndex]);
+        conversionRule->AddObserver(vtkCommand::ErrorEvent, messageCallback);
+        conversionRule->AddObserver(vtkCommand::WarningEvent, messageCallback);
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+        conversionRule->Convert(segment);
+#else
+        vtkSmartPointer<vtkDataObject> closedSurface = vtkSmartPointer<vtkDataObject>::Take(
+          conversionRule->ConstructRepresentationObjectByRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()) );
+        if (conversionRule->Convert(segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName()), closedSurface))
+        {
+          segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(), closedSurface);
+        }
+#endif
+      },
+      [this, &contourSegments](size_t numberOfFinishedSegments)
+      {
+        double progress = static_cast<double>(numberOfFinishedSegments) / contourSegments.size();
+        this->External->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+      });
+    for (size_t segmentIndex = 0; segmentIndex < contourSegments.size(); ++segmentIndex)
+    {
+      const std::vector<std::pair<unsigned long, std::string> >& conversionMessages = segmentConversionMessages[segmentIndex].Messages;
+      for (std::vector<std::pair<unsigned long, std::string> >::const_iterator messageIt = conversionMessages.begin(); messageIt != conversionMessages.end(); ++messageIt)
+      {
+        if (messageIt->first == vtkCommand::ErrorEvent)
+        {
+          vtkErrorWithObjectMacro(this->External, "LoadRtStructureSet: Failed to create closed surface of segment '"
+            << contourSegments[segmentIndex]->GetName() << "': " << messageIt->second);
+        }
+        else
+        {
+          vtkWarningWithObjectMacro(this->External, "LoadRtStructureSet: Warning when creating closed surface of segment '"
+            << contourSegments[segmentIndex]->GetName() << "': " << messageIt->second);
+        }
+      }
+    }
+  }
+
+  // Add segments to the segmentation in one batch
+  if (segmentationNode.GetPointer())
+  {
+    std::set<std::string> deferredSegmentIDs;
+    int wasModified = segmentationNode->StartModify();
+    for (size_t segmentIndex = 0; segmentIndex < contourSegments.size(); ++segmentIndex)
+    {
+      segmentationNode->GetSegmentation()->AddSegment(contourSegments[segmentIndex]);
+      if (deferClosedSurface)
+      {
+        // Placeholder segments are hidden, and loaded when shown
+        std::string segmentID = segmentationNode->GetSegmentation()->GetSegmentIdBySegment(contourSegments[segmentIndex]);
+        deferredSegmentIDs.insert(segmentID);
+        if (segmentationDisplayNode.GetPointer())
+        {
+          segmentationDisplayNode->SetSegmentVisibility(segmentID, false);
+        }
+      }
+    }
+    segmentationNode->EndModify(wasModified);
+
+    // Load the placeholder segments when they are shown
+    if (!deferredSegmentIDs.empty())
+    {
+      this->DeferredRoiContoursBySegmentationNodeID[segmentationNode->GetID()] = deferredSegmentIDs;
+      vtkSmartPointer<vtkIntArray> events = vtkSmartPointer<vtkIntArray>::New();
+      events->InsertNextValue(vtkMRMLDisplayableNode::DisplayModifiedEvent);
+      this->External->GetMRMLNodesObserverManager()->AddObjectEvents(segmentationNode, events);
+    }
+  }
+
   // Force showing closed surface model instead of contour points and calculate auto opacity values for segments
-  // Do not set closed surface display in case of extremely large structures, to prevent unreasonably long load times
   if (segmentationDisplayNode.GetPointer())
   {
-    // Arbitrary thresholds, can revisit
-    vtkDebugWithObjectMacro(this->External, "LoadRtStructureSet: Maximum number of points in a segment = " << maximumNumberOfPoints << ", Total number of points in segmentation = " << totalNumberOfPoints);
-    if (maximumNumberOfPoints < 800000 && totalNumberOfPoints < 3000000)
+    if (showClosedSurface)
     {
       segmentationDisplayNode->SetPreferredDisplayRepresentationName3D(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
       segmentationDisplayNode->SetPreferredDisplayRepresentationName2D(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
@@ -1635,6 +2237,98 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtStructureSet(vt
   return true;
 }
 
+//---------------------------------------------------------------------------
+int vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadDeferredRoiContours(
+  vtkMRMLSegmentationNode* segmentationNode, const std::vector<std::string>& segmentIDs, bool shownOnly)
+{
+  if (!segmentationNode || !segmentationNode->GetID())
+  {
+    return 0;
+  }
+  std::map<std::string, std::set<std::string> >::iterator deferredIt = this->DeferredRoiContoursBySegmentationNodeID.find(segmentationNode->GetID());
+  if (deferredIt == this->DeferredRoiContoursBySegmentationNodeID.end())
+  {
+    return 0;
+  }
+  vtkMRMLSegmentationDisplayNode* displayNode = vtkMRMLSegmentationDisplayNode::SafeDownCast(segmentationNode->GetDisplayNode());
+
+  // Collect the segments to load and remove them from the deferred segments first,
+  // as loading a segment invokes events that would start loading again
+  std::vector<std::string> segmentIDsToLoad;
+  std::set<std::string>& deferredSegmentIDs = deferredIt->second;
+  for (std::set<std::string>::iterator segmentIt = deferredSegmentIDs.begin(); segmentIt != deferredSegmentIDs.end(); )
+  {
+    if ( (!segmentIDs.empty() && std::find(segmentIDs.begin(), segmentIDs.end(), *segmentIt) == segmentIDs.end())
+      || (shownOnly && (!displayNode || !displayNode->GetSegmentVisibility(*segmentIt))) )
+    {
+      ++segmentIt;
+      continue;
+    }
+    segmentIDsToLoad.push_back(*segmentIt);
+    deferredSegmentIDs.erase(segmentIt++);
+  }
+  if (segmentIDsToLoad.empty())
+  {
+    return 0;
+  }
+  if (deferredSegmentIDs.empty())
+  {
+    this->RemoveDeferredRoiContours(segmentationNode);
+  }
+
+  // Create the closed surfaces from the planar contours, the same way as when the structure set is loaded completely
+  std::string defaultSliceThickness = segmentationNode->GetSegmentation()->GetConversionParameter(
+    vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName() );
+  int numberOfLoadedSegments = 0;
+  for (std::vector<std::string>::iterator segmentIt = segmentIDsToLoad.begin(); segmentIt != segmentIDsToLoad.end(); ++segmentIt)
+  {
+    vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIt);
+    if (!segment)
+    {
+      continue; // Segment has been removed
+    }
+    vtkPolyData* placeholderPolyData = vtkPolyData::SafeDownCast(
+      segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()) );
+    vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(
+      segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName()) );
+    if (!placeholderPolyData || !planarContourPolyData)
+    {
+      continue; // Representations have been replaced since loading
+    }
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule> conversionRule = vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New();
+    conversionRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(), defaultSliceThickness);
+    conversionRule->SetNumberOfThreads(this->External->NumberOfThreads);
+
+    // The placeholder is filled instead of replaced, so that the segmentation keeps the same representation objects
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+    bool converted = conversionRule->Convert(segment);
+#else
+    bool converted = conversionRule->Convert(planarContourPolyData, placeholderPolyData);
+#endif
+    if (!converted)
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadDeferredRoiContours: Failed to create closed surface of segment " << (*segmentIt)
+        << " in segmentation " << segmentationNode->GetName());
+      continue;
+    }
+    placeholderPolyData->Modified();
+    ++numberOfLoadedSegments;
+  }
+
+  return numberOfLoadedSegments;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::RemoveDeferredRoiContours(vtkMRMLSegmentationNode* segmentationNode)
+{
+  if (!segmentationNode || !segmentationNode->GetID()
+    || this->DeferredRoiContoursBySegmentationNodeID.erase(segmentationNode->GetID()) == 0)
+  {
+    return;
+  }
+  this->External->GetMRMLNodesObserverManager()->RemoveObjectEvents(segmentationNode);
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtImage(vtkSlicerDicomRtReader* rtReader, vtkSlicerDICOMLoadable* loadable)
 {
@@ -2196,6 +2890,12 @@ vtkSlicerDicomRtImportExportModuleLogic::vtkSlicerDicomRtImportExportModuleLogic
   this->BeamsLogic = nullptr;
 
   this->BeamModelsInSeparateBranch = true;
+  this->ExamineHeaderOnly = true;
+  this->UseExamineCache = true;
+  this->NumberOfThreads = 0;
+  this->LoadRoiContoursOnDemand = false;
+  this->LoadDynamicBeamsCompact = false;
+  this->ExportDoseAndContoursDirectly = false;
 }
 
 //----------------------------------------------------------------------------
@@ -2216,6 +2916,14 @@ vtkSlicerDicomRtImportExportModuleLogic::~vtkSlicerDicomRtImportExportModuleLogi
 void vtkSlicerDicomRtImportExportModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "BeamModelsInSeparateBranch: " << (this->BeamModelsInSeparateBranch ? "true" : "false") << "\n";
+  os << indent << "ExamineHeaderOnly: " << (this->ExamineHeaderOnly ? "true" : "false") << "\n";
+  os << indent << "UseExamineCache: " << (this->UseExamineCache ? "true" : "false") << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "LoadRoiContoursOnDemand: " << (this->LoadRoiContoursOnDemand ? "true" : "false") << "\n";
+  os << indent << "LoadDynamicBeamsCompact: " << (this->LoadDynamicBeamsCompact ? "true" : "false") << "\n";
+  os << indent << "ExportDoseAndContoursDirectly: " << (this->ExportDoseAndContoursDirectly ? "true" : "false") << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -2223,6 +2931,7 @@ void vtkSlicerDicomRtImportExportModuleLogic::SetMRMLSceneInternal(vtkMRMLScene
 {
   vtkSmartPointer<vtkIntArray> events = vtkSmartPointer<vtkIntArray>::New();
   events->InsertNextValue(vtkMRMLScene::EndCloseEvent);
+  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
   this->SetAndObserveMRMLSceneEvents(newScene, events.GetPointer());
 }
 
@@ -2234,6 +2943,164 @@ void vtkSlicerDicomRtImportExportModuleLogic::OnMRMLSceneEndClose()
     vtkErrorMacro("OnMRMLSceneEndClose: Invalid MRML scene");
     return;
   }
+
+  this->Internal->DeferredRoiContoursBySegmentationNodeID.clear();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
+{
+  // Stop tracking the placeholder segments of the removed segmentation
+  vtkMRMLSegmentationNode* segmentationNode = vtkMRMLSegmentationNode::SafeDownCast(node);
+  if (segmentationNode)
+  {
+    this->Internal->RemoveDeferredRoiContours(segmentationNode);
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
+{
+  Superclass::ProcessMRMLNodesEvents(caller, event, callData);
+
+  // Load the contour points of placeholder segments when they are shown
+  vtkMRMLSegmentationNode* segmentationNode = vtkMRMLSegmentationNode::SafeDownCast(caller);
+  if (event == vtkMRMLDisplayableNode::DisplayModifiedEvent && segmentationNode)
+  {
+    this->Internal->LoadDeferredRoiContours(segmentationNode, std::vector<std::string>(), true);
+  }
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerDicomRtImportExportModuleLogic::LoadDeferredRoiContours(vtkMRMLSegmentationNode* segmentationNode, vtkStringArray* segmentIDs/*=nullptr*/)
+{
+  std::vector<std::string> segmentIDsVector;
+  if (segmentIDs)
+  {
+    for (vtkIdType index = 0; index < segmentIDs->GetNumberOfValues(); ++index)
+    {
+      segmentIDsVector.push_back(segmentIDs->GetValue(index));
+    }
+  }
+  return this->Internal->LoadDeferredRoiContours(segmentationNode, segmentIDsVector, false);
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerDicomRtImportExportModuleLogic::GetBeamNumberOfControlPoints(vtkMRMLRTBeamNode* beamNode)
+{
+  vtkMRMLTableNode* controlPointTableNode = (beamNode ? vtkMRMLTableNode::SafeDownCast(
+    beamNode->GetNodeReference(CONTROL_POINT_TABLE_REFERENCE_ROLE.c_str())) : nullptr);
+  if (!controlPointTableNode)
+  {
+    return 0;
+  }
+  return controlPointTableNode->GetNumberOfRows();
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDicomRtImportExportModuleLogic::SetBeamControlPointIndex(vtkMRMLRTBeamNode* beamNode, int controlPointIndex)
+{
+  vtkMRMLTableNode* controlPointTableNode = (beamNode ? vtkMRMLTableNode::SafeDownCast(
+    beamNode->GetNodeReference(CONTROL_POINT_TABLE_REFERENCE_ROLE.c_str())) : nullptr);
+  if (!controlPointTableNode)
+  {
+    vtkErrorMacro("SetBeamControlPointIndex: Beam has no control point table");
+    return false;
+  }
+  vtkTable* controlPointTable = controlPointTableNode->GetTable();
+  if (controlPointIndex < 0 || controlPointIndex >= controlPointTable->GetNumberOfRows())
+  {
+    vtkErrorMacro("SetBeamControlPointIndex: Invalid control point index " << controlPointIndex
+      << " for beam " << beamNode->GetName());
+    return false;
+  }
+  auto getValue = [&](const char* columnName)
+  {
+    vtkAbstractArray* column = controlPointTable->GetColumnByName(columnName);
+    return (column ? column->GetVariantValue(controlPointIndex).ToDouble() : 0.0);
+  };
+
+  // Set all parameters before the beam geometry and transform are updated
+  int wasModified = beamNode->StartModify();
+
+  beamNode->SetGantryAngle(getValue("GantryAngle"));
+  beamNode->SetCollimatorAngle(getValue("CollimatorAngle"));
+  beamNode->SetCouchAngle(getValue("CouchAngle"));
+  beamNode->SetX1Jaw(getValue("X1Jaw"));
+  beamNode->SetX2Jaw(getValue("X2Jaw"));
+  beamNode->SetY1Jaw(getValue("Y1Jaw"));
+  beamNode->SetY2Jaw(getValue("Y2Jaw"));
+
+  // Leaf positions of the control point (the MLC table has the leaf pair boundaries in the first column).
+  // The leaf columns are added to the control point table in order (Leaf1_0, Leaf1_1, ..., Leaf2_0, ...),
+  // so only the first one is looked up by name
+  vtkMRMLTableNode* mlcTableNode = beamNode->GetMultiLeafCollimatorTableNode();
+  int firstLeafColumnIndex = -1;
+  vtkDataArray* firstLeafColumn = vtkDataArray::SafeDownCast(
+    controlPointTable->GetRowData()->GetAbstractArray("Leaf1_0", firstLeafColumnIndex) );
+  if (mlcTableNode && mlcTableNode->GetNumberOfRows() > 1
+    && firstLeafColumn && !vtkMath::IsNan(firstLeafColumn->GetTuple1(controlPointIndex)))
+  {
+    vtkTable* mlcTable = mlcTableNode->GetTable();
+    vtkIdType numberOfLeafPairs = mlcTable->GetNumberOfRows() - 1;
+    vtkDataArray* mlcLeafColumns[2] = {
+      vtkDataArray::SafeDownCast(mlcTable->GetColumn(1)),
+      vtkDataArray::SafeDownCast(mlcTable->GetColumn(2)) };
+    std::vector<vtkDataArray*> leafColumns(2 * numberOfLeafPairs, nullptr);
+    for (vtkIdType leafIndex = 0; leafIndex < 2 * numberOfLeafPairs; ++leafIndex)
+    {
+      leafColumns[leafIndex] = vtkDataArray::SafeDownCast(controlPointTable->GetColumn(firstLeafColumnIndex + leafIndex));
+    }
+    if ( !mlcLeafColumns[0] || !mlcLeafColumns[1]
+      || std::find(leafColumns.begin(), leafColumns.end(), nullptr) != leafColumns.end()
+      || !leafColumns[numberOfLeafPairs]->GetName() || std::string(leafColumns[numberOfLeafPairs]->GetName()) != "Leaf2_0" )
+    {
+      vtkErrorMacro("SetBeamControlPointIndex: Leaf columns of the control point table do not match the MLC table of beam " << beamNode->GetName());
+    }
+    else
+    {
+      for (vtkIdType leafPairIndex = 0; leafPairIndex < numberOfLeafPairs; ++leafPairIndex)
+      {
+        mlcLeafColumns[0]->SetTuple1(leafPairIndex, leafColumns[leafPairIndex]->GetTuple1(controlPointIndex));
+        mlcLeafColumns[1]->SetTuple1(leafPairIndex, leafColumns[numberOfLeafPairs + leafPairIndex]->GetTuple1(controlPointIndex));
+      }
+      mlcTable->Modified();
+      mlcTableNode->Modified();
+    }
+  }
+
+  // Scanning spot size and scan spots of ion beams
+  vtkMRMLRTIonBeamNode* ionBeamNode = vtkMRMLRTIonBeamNode::SafeDownCast(beamNode);
+  if (ionBeamNode && controlPointTable->GetColumnByName("ScanningSpotSizeX"))
+  {
+    std::array< float, 2 > scanSpotSize = {{ static_cast<float>(getValue("ScanningSpotSizeX")),
+      static_cast<float>(getValue("ScanningSpotSizeY")) }};
+    ionBeamNode->SetScanningSpotSize(scanSpotSize);
+  }
+  vtkMRMLTableNode* scanSpotControlPointTableNode = vtkMRMLTableNode::SafeDownCast(
+    beamNode->GetNodeReference(SCAN_SPOT_CONTROL_POINT_TABLE_REFERENCE_ROLE.c_str()));
+  vtkMRMLTableNode* scanSpotTableNode = (ionBeamNode ? ionBeamNode->GetScanSpotTableNode() : nullptr);
+  if (scanSpotControlPointTableNode && scanSpotTableNode)
+  {
+    vtkTable* allSpotsTable = scanSpotControlPointTableNode->GetTable();
+    vtkTable* spotTable = scanSpotTableNode->GetTable();
+    vtkIdType firstSpot = static_cast<vtkIdType>(getValue("FirstScanSpot"));
+    vtkIdType numberOfSpots = static_cast<vtkIdType>(getValue("NumberOfScanSpots"));
+    spotTable->SetNumberOfRows(numberOfSpots);
+    for (vtkIdType spotIndex = 0; spotIndex < numberOfSpots; ++spotIndex)
+    {
+      for (vtkIdType column = 0; column < 3; ++column)
+      {
+        spotTable->SetValue(spotIndex, column, allSpotsTable->GetValue(firstSpot + spotIndex, column));
+      }
+    }
+    spotTable->Modified();
+    scanSpotTableNode->Modified();
+  }
+
+  beamNode->SetAttribute(CONTROL_POINT_INDEX_ATTRIBUTE_NAME.c_str(), std::to_string(controlPointIndex).c_str());
+  beamNode->EndModify(wasModified);
+  return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2252,6 +3119,8 @@ void vtkSlicerDicomRtImportExportModuleLogic::RegisterNodes()
     vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New() );
   vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
     vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New() );
 
 }
 
@@ -2264,82 +3133,76 @@ void vtkSlicerDicomRtImportExportModuleLogic::ExamineForLoad(vtkStringArray* fil
   }
   loadables->RemoveAllItems();
 
-  for (int fileIndex=0; fileIndex<fileList->GetNumberOfValues(); ++fileIndex)
+  // Use the examine cache in the DICOM database directory if enabled
+  bool useExamineCache = false;
+  if (this->UseExamineCache)
   {
-    // Load file in DCMTK
-    DcmFileFormat fileformat;
-    vtkStdString fileName = fileList->GetValue(fileIndex);
-    OFCondition result = fileformat.loadFile(fileName.c_str(), EXS_Unknown);
-    if (!result.good())
-    {
-      continue; // Failed to parse this file, skip it
-    }
-
-    // Check SOP Class UID for one of the supported RT objects
-    DcmDataset *dataset = fileformat.getDataset();
-    OFString sopClass;
-    if (!dataset->findAndGetOFString(DCM_SOPClassUID, sopClass).good() || sopClass.empty())
+    std::string examineCacheFilePath = this->Internal->GetExamineCacheFilePath();
+    if (!examineCacheFilePath.empty())
     {
-      continue; // Failed to parse this file, skip it
-    }
-
-    // DICOM parsing is successful, now check if the object is loadable
-    OFString name("");
-    OFString seriesNumber("");
-    std::vector<OFString> referencedSOPInstanceUIDs;
-    dataset->findAndGetOFString(DCM_SeriesNumber, seriesNumber);
-    if (!seriesNumber.empty())
-    {
-      name += seriesNumber + ": ";
+      this->Internal->ExamineCache->SetCacheFilePath(examineCacheFilePath);
+      useExamineCache = true;
     }
+  }
 
-    // RTDose
-    if (sopClass == UID_RTDoseStorage)
-    {
-      this->Internal->ExamineRtDoseDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTPlan
-    else if (sopClass == UID_RTPlanStorage)
-    {
-      this->Internal->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTIonPlan
-    else if (sopClass == UID_RTIonPlanStorage)
-    {
-      this->Internal->ExamineRtPlanDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTStructureSet
-    else if (sopClass == UID_RTStructureSetStorage)
-    {
-      this->Internal->ExamineRtStructureSetDataset(dataset, name, referencedSOPInstanceUIDs);
-    }
-    // RTImage
-    else if (sopClass == UID_RTImageStorage)
+  for (int fileIndex=0; fileIndex<fileList->GetNumberOfValues(); ++fileIndex)
+  {
+    // Get examination result from the cache if the file has not changed since it was last examined,
+    // otherwise parse the file (only the part needed for examination unless requested otherwise)
+    vtkStdString fileName = fileList->GetValue(fileIndex);
+    vtkSlicerDicomRtExamineCache::Entry examineResult;
+    if (!useExamineCache || !this->Internal->ExamineCache->GetEntry(fileName, this->ExamineHeaderOnly, examineResult))
     {
-      this->Internal->ExamineRtImageDataset(dataset, name, referencedSOPInstanceUIDs);
+      if (!this->Internal->ExamineFile(fileName.c_str(), examineResult))
+      {
+        continue; // Failed to parse this file, skip it
+      }
+      if (useExamineCache)
+      {
+        this->Internal->ExamineCache->SetEntry(fileName, this->ExamineHeaderOnly, examineResult);
+      }
     }
-    /* Not yet supported
-    else if (sopClass == UID_RTTreatmentSummaryRecordStorage)
-    else if (sopClass == UID_RTIonBeamsTreatmentRecordStorage)
-    */
-    else
+    if (examineResult.Name.empty())
     {
       continue; // Not an RT file
     }
 
     // The file is a loadable RT object, create and set up loadable
+    OFString name(examineResult.Name.c_str());
+    if (examineResult.SOPClassUID == UID_RTDoseStorage)
+    {
+      OFString referencedRtPlanSOPInstanceUID( examineResult.ReferencedSOPInstanceUIDs.empty() ? "" : examineResult.ReferencedSOPInstanceUIDs[0].c_str() );
+      this->Internal->AppendReferencedRtPlanLabel(name, referencedRtPlanSOPInstanceUID);
+    }
     vtkNew<vtkSlicerDICOMLoadable> loadable;
     loadable->SetName(name.c_str());
     loadable->AddFile(fileName.c_str());
     loadable->SetConfidence(1.0);
     loadable->SetSelected(true);
-    std::vector<OFString>::iterator uidIt;
-    for (uidIt = referencedSOPInstanceUIDs.begin(); uidIt != referencedSOPInstanceUIDs.end(); ++uidIt)
+    std::vector<std::string>::iterator uidIt;
+    for (uidIt = examineResult.ReferencedSOPInstanceUIDs.begin(); uidIt != examineResult.ReferencedSOPInstanceUIDs.end(); ++uidIt)
     {
       loadable->AddReferencedInstanceUID(uidIt->c_str());
     }
     loadables->AddItem(loadable);
   }
+
+  if (useExamineCache)
+  {
+    this->Internal->ExamineCache->Save();
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDicomRtImportExportModuleLogic::ClearExamineCache()
+{
+  std::string examineCacheFilePath = this->Internal->GetExamineCacheFilePath();
+  if (!examineCacheFilePath.empty())
+  {
+    this->Internal->ExamineCache->SetCacheFilePath(examineCacheFilePath);
+  }
+  this->Internal->ExamineCache->RemoveAllEntries();
+  this->Internal->ExamineCache->Save();
 }
 
 //---------------------------------------------------------------------------
@@ -2359,6 +3222,8 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable
 
   vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
   rtReader->SetFileName(firstFileName);
+  rtReader->SetNumberOfThreads(this->NumberOfThreads);
+  rtReader->SetLoadRoiContoursOnDemand(this->LoadRoiContoursOnDemand);
   rtReader->Update();
 
   // One series can contain composite information, e.g, an RTPLAN series can contain structure sets and plans as well
@@ -2608,7 +3473,15 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
   if (doseNode)
   {
     vtkSmartPointer<vtkOrientedImageData> doseOrientedImageData = vtkSmartPointer<vtkOrientedImageData>::New();
-    if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(doseNode, doseOrientedImageData))
+    if (this->ExportDoseAndContoursDirectly && !doseNode->GetParentTransformNode() && doseNode->GetImageData())
+    {
+      // The writer only reads the voxels, so they are shared with the dose volume instead of copied
+      doseOrientedImageData->vtkImageData::ShallowCopy(doseNode->GetImageData());
+      vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      doseNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+      doseOrientedImageData->SetGeometryFromImageToWorldMatrix(doseIjkToRasMatrix);
+    }
+    else if (!vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(doseNode, doseOrientedImageData))
     {
       error = "Failed to convert dose volume " + std::string(doseNode->GetName()) + " to oriented image data";
       vtkErrorMacro("ExportDicomRTStudy: " + error);
@@ -2627,221 +3500,383 @@ std::string vtkSlicerDicomRtImportExportModuleLogic::ExportDicomRTStudy(vtkColle
       identityMatrix->Identity();
       doseOrientedImageData->SetGeometryFromImageToWorldMatrix(identityMatrix);
     }
-    // Set anatomical image to RT writer
-    Plm_image::Pointer dose_img = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(doseOrientedImageData);
-    if (dose_img->dim(0) * dose_img->dim(1) * dose_img->dim(2) == 0)
+    // Set dose image to RT writer directly, or after converting it to Plastimatch image
+    if (this->ExportDoseAndContoursDirectly)
     {
-      error = "Failed to convert dose volume to Plastimatch format";
-      vtkErrorMacro("ExportDicomRTStudy: " + error);
-      return error;
+      rtWriter->SetDoseImageData(doseOrientedImageData);
+
+      // Reference the RT plan of the dose if it was loaded from DICOM
+      std::string referencedInstanceUIDs = shNode->GetItemAttribute(shNode->GetItemByDataNode(doseNode),
+        vtkMRMLSubjectHierarchyConstants::GetDICOMReferencedInstanceUIDsAttributeName() );
+      std::string referencedPlanUID = referencedInstanceUIDs.substr(0, referencedInstanceUIDs.find(' '));
+      rtWriter->SetDoseReferencedRTPlanSOPInstanceUID(referencedPlanUID.empty() ? nullptr : referencedPlanUID.c_str());
+    }
+    else
+    {
+      Plm_image::Pointer dose_img = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(doseOrientedImageData);
+      if (dose_img->dim(0) * dose_img->dim(1) * dose_img->dim(2) == 0)
+      {
+        error = "Failed to convert dose volume to Plastimatch format";
+        vtkErrorMacro("ExportDicomRTStudy: " + error);
+        return error;
+      }
+      rtWriter->SetDose(dose_img);
     }
-    rtWriter->SetDose(dose_img);
   }
 
   // Convert input segmentation to the format Plastimatch can use
   if (segmentationNode)
   {
-    // If master representation is labelmap type, then export binary labelmap
+    // Load all contours of structure sets loaded on demand
+    this->LoadDeferredRoiContours(segmentationNode);
+
+    // Segments are prepared for export (resampled and converted to Plastimatch image, or cut into slice contours)
+    // on worker threads, and added to the writer in segment order on the calling thread.
+    // The representations and transforms are accessed on the calling thread, the workers only use their own objects
+    struct SegmentExportItem
+    {
+      std::string SegmentID;
+      std::string Name;
+      double Color[3];
+      vtkSmartPointer<vtkGeneralTransform> SegmentationToWorldTransform;
+      // Binary labelmap export. The labelmap of the segment is extracted from the shared labelmap on the worker thread
+      vtkSmartPointer<vtkOrientedImageData> SharedLabelmap;
+      int LabelValue;
+      vtkSmartPointer<vtkOrientedImageData> BinaryLabelmap;
+      Plm_image::Pointer PlmStructure;
+      // Closed surface export
+      vtkSmartPointer<vtkPolyData> ClosedSurface;
+      std::vector<int> SliceNumbers;
+      std::vector<std::string> SliceUIDs;
+      std::vector< vtkSmartPointer<vtkPolyData> > SliceContours;
+      // Planar contour export
+      vtkSmartPointer<vtkPolyData> PlanarContours;
+      // Contours in world coordinate system written directly (from planar contours or cut closed surface)
+      vtkSmartPointer<vtkPolyData> Contours;
+      std::vector<int> ContourSliceNumbers;
+      // Error message if preparation failed
+      std::string Error;
+    };
+
     vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
-    if (segmentation->IsMasterRepresentationImageData())
+    bool exportBinaryLabelmap = segmentation->IsMasterRepresentationImageData();
+    if (!exportBinaryLabelmap && !segmentation->IsMasterRepresentationPolyData())
     {
-      // Make sure segmentation contains binary labelmap
-      if ( !segmentationNode->GetSegmentation()->CreateRepresentation(
-        vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) )
-      {
-        error = "Failed to get binary labelmap representation from segmentation " + std::string(segmentationNode->GetName());
-        vtkErrorMacro("ExportDicomRTStudy: " + error);
-        return error;
-      }
+      error = "Structure set contains unsupported master representation";
+      vtkErrorMacro("ExportDicomRTStudy: " + error);
+      return error;
+    }
+
+    // If master representation is labelmap type, then export binary labelmap,
+    // if master representation is poly data type, then export from closed surface.
+    // Planar contours are written as they are if contours are exported directly
+    bool exportContoursDirectly = (this->ExportDoseAndContoursDirectly && !exportBinaryLabelmap);
+    bool exportPlanarContours = ( exportContoursDirectly
+      && segmentation->GetMasterRepresentationName() == vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName() );
+    std::string exportedRepresentationName = ( exportBinaryLabelmap
+      ? vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()
+      : ( exportPlanarContours
+        ? vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName()
+        : vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName() ) );
+    if (!exportPlanarContours && !segmentation->CreateRepresentation(exportedRepresentationName))
+    {
+      error = "Failed to get " + std::string(exportBinaryLabelmap ? "binary labelmap" : "closed surface")
+        + " representation from segmentation " + std::string(segmentationNode->GetName());
+      vtkErrorMacro("ExportDicomRTStudy: " + error);
+      return error;
+    }
 
-      // Export each segment in segmentation
-      std::vector< std::string > segmentIDs;
-      segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
-      for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+    // Geometry of the anatomical image, used for resampling labelmaps and cutting surfaces
+    vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    imageOrientedImageData->GetImageToWorldMatrix(imageToWorldMatrix);
+    int imageExtent[6] = {0,-1,0,-1,0,-1};
+    imageOrientedImageData->GetExtent(imageExtent);
+    vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Invert(imageToWorldMatrix, worldToImageMatrix);
+
+    // Segments are prepared and added to the writer in batches of a fixed number of segments per thread,
+    // so that the prepared data (e.g. resampled labelmaps) of only one batch is kept in memory at a time
+    std::vector< std::string > segmentIDs;
+    segmentation->GetSegmentIDs(segmentIDs);
+    unsigned int totalNumberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->NumberOfThreads, 0);
+    unsigned int numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->NumberOfThreads, segmentIDs.size());
+    unsigned int numberOfThreadsPerSegment = std::max(1u, totalNumberOfThreads / numberOfThreads);
+    const size_t segmentsPerThreadInBatch = 2;
+    size_t batchSize = segmentsPerThreadInBatch * numberOfThreads;
+    for (size_t batchStart = 0; batchStart < segmentIDs.size(); batchStart += batchSize)
+    {
+      size_t batchEnd = std::min(batchStart + batchSize, segmentIDs.size());
+
+      // Get the representations of the segments of the batch
+      std::vector<SegmentExportItem> segmentItems(batchEnd - batchStart);
+      for (size_t segmentIndex = batchStart; segmentIndex < batchEnd; ++segmentIndex)
       {
-        std::string segmentID = *segmentIdIt;
-        vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt);
+        SegmentExportItem& item = segmentItems[segmentIndex - batchStart];
+        item.SegmentID = segmentIDs[segmentIndex];
+        vtkSegment* segment = segmentation->GetSegment(item.SegmentID);
+        item.Name = segment->GetName();
+        segment->GetColor(item.Color);
+
+        // Transform from segmentation to world (RAS). Each segment gets its own instance, as transforms are updated when used
+        if (segmentationNode->GetParentTransformNode())
+        {
+          item.SegmentationToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+          segmentationNode->GetParentTransformNode()->GetTransformToWorld(item.SegmentationToWorldTransform);
+        }
 
-        // Get binary labelmap representation
+        if (exportBinaryLabelmap)
+        {
+          // Get binary labelmap representation. It is not modified, so there is no need to copy it
 #if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
-        vtkNew<vtkOrientedImageData> binaryLabelmap;
-        segmentationNode->GetBinaryLabelmapRepresentation(segmentID, binaryLabelmap);
+          item.SharedLabelmap = vtkOrientedImageData::SafeDownCast(segment->GetRepresentation(exportedRepresentationName));
+          item.LabelValue = segment->GetLabelValue();
 #else
-        vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(
-          segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()) );
+          item.BinaryLabelmap = vtkOrientedImageData::SafeDownCast(segment->GetRepresentation(exportedRepresentationName));
 #endif
-        if (!binaryLabelmap)
+        }
+        else if (exportPlanarContours)
         {
-          error = "Failed to get binary labelmap representation from segment " + segmentID;
+          item.PlanarContours = vtkPolyData::SafeDownCast(segment->GetRepresentation(exportedRepresentationName));
+        }
+        else
+        {
+          item.ClosedSurface = vtkPolyData::SafeDownCast(segment->GetRepresentation(exportedRepresentationName));
+        }
+        if ( !item.BinaryLabelmap && !item.PlanarContours && !item.ClosedSurface
+          && (!item.SharedLabelmap || item.SharedLabelmap->GetNumberOfScalarComponents() != 1) )
+        {
+          error = "Failed to get " + exportedRepresentationName + " representation from segment " + item.SegmentID;
           vtkErrorMacro("ExportDicomRTStudy: " + error);
           return error;
         }
-        // Temporarily copy labelmap image data as it will be probably resampled
-        vtkSmartPointer<vtkOrientedImageData> binaryLabelmapCopy = vtkSmartPointer<vtkOrientedImageData>::New();
-        binaryLabelmapCopy->DeepCopy(binaryLabelmap);
+      }
 
-        // Apply parent transformation nodes if necessary
-        if (segmentationNode->GetParentTransformNode())
+      // Prepare the segments of the batch on worker threads. The threaded filters used by the workers
+      // (e.g. reslice in resampling) are limited to the threads not used for the segments
+      int globalMaximumNumberOfThreads = vtkMultiThreader::GetGlobalMaximumNumberOfThreads();
+      vtkMultiThreader::SetGlobalMaximumNumberOfThreads(static_cast<int>(numberOfThreadsPerSegment));
+      vtkSlicerRtCommon::RunOnWorkerThreads(segmentItems.size(), numberOfThreads,
+        [&segmentItems, &imageOrientedImageData, &imageToWorldMatrix, &worldToImageMatrix, &imageExtent, &imageSliceUIDs, exportContoursDirectly](size_t segmentIndex)
         {
-          if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, binaryLabelmapCopy))
+          SegmentExportItem& item = segmentItems[segmentIndex];
+          if (item.SharedLabelmap)
           {
-            std::string errorMessage("Failed to apply parent transformation to exported segment");
-            vtkErrorMacro("ExportDicomRTStudy: " << errorMessage);
-            return errorMessage;
+            item.BinaryLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+            item.BinaryLabelmap->SetExtent(item.SharedLabelmap->GetExtent());
+            item.BinaryLabelmap->CopyDirections(item.SharedLabelmap);
+            item.BinaryLabelmap->SetOrigin(item.SharedLabelmap->GetOrigin());
+            item.BinaryLabelmap->SetSpacing(item.SharedLabelmap->GetSpacing());
+            item.BinaryLabelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+            unsigned char* binaryLabelmapVoxels = static_cast<unsigned char*>(item.BinaryLabelmap->GetScalarPointer());
+            vtkIdType numberOfVoxels = item.SharedLabelmap->GetNumberOfPoints();
+            switch (item.SharedLabelmap->GetScalarType())
+            {
+              vtkTemplateMacro(ExtractLabelValue(static_cast<const VTK_TT*>(item.SharedLabelmap->GetScalarPointer()),
+                numberOfVoxels, item.LabelValue, binaryLabelmapVoxels));
+              default:
+                item.Error = "Unsupported labelmap scalar type of segment " + item.SegmentID;
+                return;
+            }
           }
-        }
-        // Make sure the labelmap dimensions match the reference dimensions
-        if ( !vtkOrientedImageDataResample::DoGeometriesMatch(imageOrientedImageData, binaryLabelmapCopy)
-          || !vtkOrientedImageDataResample::DoExtentsMatch(imageOrientedImageData, binaryLabelmapCopy) )
-        {
-          if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(binaryLabelmapCopy, imageOrientedImageData, binaryLabelmapCopy))
+          if (item.BinaryLabelmap)
           {
-            error = "Failed to resample segment " + segmentID + " to match anatomical image geometry";
-            vtkErrorMacro("ExportDicomRTStudy: " + error);
-            return error;
+            // Resample labelmap to match the reference geometry if necessary, applying the parent transform.
+            // Only the effective extent of the labelmap is resampled, the rest of it is empty
+            vtkSmartPointer<vtkOrientedImageData> exportedLabelmap = item.BinaryLabelmap;
+            if ( item.SegmentationToWorldTransform
+              || !vtkOrientedImageDataResample::DoGeometriesMatch(imageOrientedImageData, item.BinaryLabelmap)
+              || !vtkOrientedImageDataResample::DoExtentsMatch(imageOrientedImageData, item.BinaryLabelmap) )
+            {
+              vtkSmartPointer<vtkOrientedImageData> labelmapToResample = item.BinaryLabelmap;
+              int effectiveExtent[6] = {0,-1,0,-1,0,-1};
+              vtkOrientedImageDataResample::CalculateEffectiveExtent(item.BinaryLabelmap, effectiveExtent);
+              if ( effectiveExtent[0] <= effectiveExtent[1] && effectiveExtent[2] <= effectiveExtent[3]
+                && effectiveExtent[4] <= effectiveExtent[5] )
+              {
+                vtkNew<vtkImageClip> clipper;
+                clipper->SetInputData(item.BinaryLabelmap);
+                clipper->SetOutputWholeExtent(effectiveExtent);
+                clipper->ClipDataOn();
+                clipper->Update();
+                labelmapToResample = vtkSmartPointer<vtkOrientedImageData>::New();
+                labelmapToResample->ShallowCopy(clipper->GetOutput());
+                labelmapToResample->CopyDirections(item.BinaryLabelmap);
+              }
+
+              exportedLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+              if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+                labelmapToResample, imageOrientedImageData, exportedLabelmap, false, false, item.SegmentationToWorldTransform))
+              {
+                item.Error = "Failed to resample segment " + item.SegmentID + " to match anatomical image geometry";
+                return;
+              }
+            }
+
+            // Convert mask to Plm image
+            item.PlmStructure = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(exportedLabelmap);
+            if (!item.PlmStructure)
+            {
+              item.Error = "Failed to convert segment labelmap " + item.SegmentID + " to Plastimatch image";
+            }
+            return;
           }
-        }
 
-        // Convert mask to Plm image
-        Plm_image::Pointer plmStructure = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(binaryLabelmapCopy);
-        if (!plmStructure)
-        {
-          error = "Failed to convert segment labelmap " + segmentID + " to Plastimatch image";
-          vtkErrorMacro("ExportDicomRTStudy: " + error);
-          return error;
-        }
+          if (item.PlanarContours)
+          {
+            // Transform contours to world. Worker uses its own poly data, as cells are built when first accessed
+            item.Contours = vtkSmartPointer<vtkPolyData>::New();
+            if (item.SegmentationToWorldTransform)
+            {
+              vtkNew<vtkTransformPolyDataFilter> transformContours;
+              transformContours->SetTransform(item.SegmentationToWorldTransform);
+              transformContours->SetInputData(item.PlanarContours);
+              transformContours->Update();
+              item.Contours->ShallowCopy(transformContours->GetOutput());
+            }
+            else
+            {
+              item.Contours->ShallowCopy(item.PlanarContours);
+            }
+
+            // Find the anatomical image slice of each contour from its first point
+            vtkNew<vtkIdList> cellPointIds;
+            item.ContourSliceNumbers.resize(item.Contours->GetNumberOfCells(), -1);
+            for (vtkIdType cellIndex = 0; cellIndex < item.Contours->GetNumberOfCells(); ++cellIndex)
+            {
+              item.Contours->GetCellPoints(cellIndex, cellPointIds);
+              if (cellPointIds->GetNumberOfIds() == 0)
+              {
+                continue;
+              }
+              double pointWorld[4] = { 0.0, 0.0, 0.0, 1.0 };
+              item.Contours->GetPoint(cellPointIds->GetId(0), pointWorld);
+              double pointIjk[4] = { 0.0, 0.0, 0.0, 1.0 };
+              worldToImageMatrix->MultiplyPoint(pointWorld, pointIjk);
+              int slice = static_cast<int>(std::floor(pointIjk[2] + 0.5));
+              if (slice >= imageExtent[4] && slice <= imageExtent[5])
+              {
+                item.ContourSliceNumbers[cellIndex] = slice - imageExtent[4];
+              }
+            }
+            return;
+          }
 
-        // Get segment properties
-        std::string segmentName = segment->GetName();
-        double* segmentColor = segment->GetColor();
+          // Initialize cutter pipeline for segment
+          vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+          vtkSmartPointer<vtkGeneralTransform> identityTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+          transformPolyData->SetTransform(item.SegmentationToWorldTransform ? item.SegmentationToWorldTransform : identityTransform);
+          transformPolyData->SetInputData(item.ClosedSurface);
 
-        rtWriter->AddStructure(plmStructure->itk_uchar(), segmentName.c_str(), segmentColor);
-      } // For each segment
-    }
-    // If master representation is poly data type, then export from closed surface
-    else if (segmentation->IsMasterRepresentationPolyData())
-    {
-      // Make sure segmentation contains closed surface
-      if ( !segmentationNode->GetSegmentation()->CreateRepresentation(
-        vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName() ) )
-      {
-        error = "Failed to get closed surface representation from segmentation " + std::string(segmentationNode->GetName());
-        vtkErrorMacro("ExportDicomRTStudy: " + error);
-        return error;
-      }
+          // Cutting plane with normal of the Z axis of the anatomical image
+          double normal[3] = { imageToWorldMatrix->GetElement(0,2), imageToWorldMatrix->GetElement(1,2), imageToWorldMatrix->GetElement(2,2) };
+          vtkSmartPointer<vtkPlane> slicePlane = vtkSmartPointer<vtkPlane>::New();
+          slicePlane->SetNormal(normal);
 
-      // Get transform  from segmentation to world (RAS)
-      vtkSmartPointer<vtkGeneralTransform> nodeToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-      nodeToWorldTransform->Identity();
-      if (segmentationNode->GetParentTransformNode())
-      {
-        segmentationNode->GetParentTransformNode()->GetTransformToWorld(nodeToWorldTransform);
-      }
-      // Initialize poly data transformer
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetTransform(nodeToWorldTransform);
-
-      // Initialize cutting plane with normal of the Z axis of the anatomical image
-      vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-      imageOrientedImageData->GetImageToWorldMatrix(imageToWorldMatrix);
-      double normal[3] = { imageToWorldMatrix->GetElement(0,2), imageToWorldMatrix->GetElement(1,2), imageToWorldMatrix->GetElement(2,2) };
-      vtkSmartPointer<vtkPlane> slicePlane = vtkSmartPointer<vtkPlane>::New();
-      slicePlane->SetNormal(normal);
-
-      // Export each segment in segmentation
-      std::vector< std::string > segmentIDs;
-      segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
-      for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
-      {
-        std::string segmentID = *segmentIdIt;
-        vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt);
+          vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
+          cutter->SetInputConnection(transformPolyData->GetOutputPort());
+          cutter->SetGenerateCutScalars(0);
+          cutter->SetCutFunction(slicePlane);
+          vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
+          stripper->SetInputConnection(cutter->GetOutputPort());
+
+          // Get segment bounding box
+          double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
+          transformPolyData->Update();
+          transformPolyData->GetOutput()->GetBounds(bounds);
 
-        // Get closed surface representation
-        vtkPolyData* closedSurfacePolyData = vtkPolyData::SafeDownCast(
-          segment->GetRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName()) );
-        if (!closedSurfacePolyData)
+          // Create planar contours from closed surface based on each of the anatomical image slices
+          for (int slice=imageExtent[4]; slice<imageExtent[5]; ++slice)
+          {
+            // Calculate slice origin
+            double origin[3] = { imageToWorldMatrix->GetElement(0,3) + slice*normal[0],
+                                 imageToWorldMatrix->GetElement(1,3) + slice*normal[1],
+                                 imageToWorldMatrix->GetElement(2,3) + slice*normal[2] };
+            if (origin[2] < bounds[4] || origin[2] > bounds[5])
+            {
+              // No contours outside surface bounds
+              continue;
+            }
+
+            // Cut closed surface at slice
+            slicePlane->SetOrigin(origin);
+
+            // Get instance UID of corresponding slice
+            int sliceNumber = slice-imageExtent[0];
+            item.SliceNumbers.push_back(sliceNumber);
+            std::string sliceInstanceUID = (imageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? imageSliceUIDs[sliceNumber] : "");
+            item.SliceUIDs.push_back(sliceInstanceUID);
+
+            // Save slice contour
+            stripper->Update();
+            vtkSmartPointer<vtkPolyData> sliceContour = vtkSmartPointer<vtkPolyData>::New();
+            sliceContour->SetPoints(stripper->GetOutput()->GetPoints());
+            sliceContour->SetPolys(stripper->GetOutput()->GetLines());
+            item.SliceContours.push_back(sliceContour);
+          } // For each anatomical image slice
+
+          // Combine slice contours if they are written directly
+          if (exportContoursDirectly)
+          {
+            vtkNew<vtkAppendPolyData> appendContours;
+            for (size_t sliceIndex = 0; sliceIndex < item.SliceContours.size(); ++sliceIndex)
+            {
+              appendContours->AddInputData(item.SliceContours[sliceIndex]);
+              item.ContourSliceNumbers.insert(item.ContourSliceNumbers.end(),
+                item.SliceContours[sliceIndex]->GetNumberOfCells(), item.SliceNumbers[sliceIndex]);
+            }
+            item.Contours = vtkSmartPointer<vtkPolyData>::New();
+            if (!item.SliceContours.empty())
+            {
+              appendContours->Update();
+              item.Contours->ShallowCopy(appendContours->GetOutput());
+            }
+          }
+        },
+        [](size_t) {});
+      vtkMultiThreader::SetGlobalMaximumNumberOfThreads(globalMaximumNumberOfThreads);
+
+      // Add structures to the writer in segment order. The writer keeps what it needs for writing (a copy of the
+      // labelmap or slice contours, or the directly written contours), so the prepared data of each segment is
+      // released when it has been added
+      for (std::vector<SegmentExportItem>::iterator itemIt = segmentItems.begin(); itemIt != segmentItems.end(); ++itemIt)
+      {
+        if (!itemIt->Error.empty())
         {
-          error = "Failed to get closed surface representation from segment " + segmentID;
+          error = itemIt->Error;
           vtkErrorMacro("ExportDicomRTStudy: " + error);
           return error;
         }
-
-        // Initialize cutter pipeline for segment
-        transformPolyData->SetInputData(closedSurfacePolyData);
-        vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
-        cutter->SetInputConnection(transformPolyData->GetOutputPort());
-        cutter->SetGenerateCutScalars(0);
-        vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
-        stripper->SetInputConnection(cutter->GetOutputPort());
-
-        // Get segment bounding box
-        double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
-        transformPolyData->Update();
-        transformPolyData->GetOutput()->GetBounds(bounds);
-
-        // Containers to be passed to the writer
-        std::vector<int> sliceNumbers;
-        std::vector<std::string> sliceUIDs;
-        std::vector<vtkPolyData*> sliceContours;
-
-        // Create planar contours from closed surface based on each of the anatomical image slices
-        int imageExtent[6] = {0,-1,0,-1,0,-1};
-        imageOrientedImageData->GetExtent(imageExtent);
-        for (int slice=imageExtent[4]; slice<imageExtent[5]; ++slice)
+        if (exportBinaryLabelmap)
+        {
+          rtWriter->AddStructure(itemIt->PlmStructure->itk_uchar(), itemIt->Name.c_str(), itemIt->Color);
+        }
+        else if (exportContoursDirectly)
         {
-          // Calculate slice origin
-          double origin[3] = { imageToWorldMatrix->GetElement(0,3) + slice*normal[0],
-                               imageToWorldMatrix->GetElement(1,3) + slice*normal[1],
-                               imageToWorldMatrix->GetElement(2,3) + slice*normal[2] };
-          slicePlane->SetOrigin(origin);
-          if (origin[2] < bounds[4] || origin[2] > bounds[5])
+          rtWriter->AddStructureContours(itemIt->Name.c_str(), itemIt->Color, itemIt->Contours, itemIt->ContourSliceNumbers);
+        }
+        else
+        {
+          std::vector<vtkPolyData*> sliceContours;
+          for (std::vector< vtkSmartPointer<vtkPolyData> >::iterator contourIt = itemIt->SliceContours.begin();
+            contourIt != itemIt->SliceContours.end(); ++contourIt)
           {
-            // No contours outside surface bounds
-            continue;
+            sliceContours.push_back(*contourIt);
           }
-
-          // Cut closed surface at slice
-          cutter->SetCutFunction(slicePlane);
-
-          // Get instance UID of corresponding slice
-          int sliceNumber = slice-imageExtent[0];
-          sliceNumbers.push_back(sliceNumber);
-          std::string sliceInstanceUID = (imageSliceUIDs.size() > static_cast<size_t>(sliceNumber) ? imageSliceUIDs[sliceNumber] : "");
-          sliceUIDs.push_back(sliceInstanceUID);
-
-          // Save slice contour
-          stripper->Update();
-          vtkPolyData* sliceContour = vtkPolyData::New();
-          sliceContour->SetPoints(stripper->GetOutput()->GetPoints());
-          sliceContour->SetPolys(stripper->GetOutput()->GetLines());
-          sliceContours.push_back(sliceContour);
-        } // For each anatomical image slice
-
-        // Get segment properties
-        std::string segmentName = segment->GetName();
-        double* segmentColor = segment->GetColor();
-
-        // Add contours to writer
-        rtWriter->AddStructure(segmentName.c_str(), segmentColor, sliceNumbers, sliceUIDs, sliceContours);
-
-        // Clean up slice contours
-        for (std::vector<vtkPolyData*>::iterator contourIt=sliceContours.begin(); contourIt!=sliceContours.end(); ++contourIt)
-        {
-          (*contourIt)->Delete();
+          rtWriter->AddStructure(itemIt->Name.c_str(), itemIt->Color, itemIt->SliceNumbers, itemIt->SliceUIDs, sliceContours);
         }
+        *itemIt = SegmentExportItem();
       } // For each segment
-    }
-    else
-    {
-      error = "Structure set contains unsupported master representation";
-      vtkErrorMacro("ExportDicomRTStudy: " + error);
-      return error;
-    }
+    } // For each batch
   }
 
   // Write files to disk
   rtWriter->SetFileName(outputPath);
-  rtWriter->Write();
+  if (!rtWriter->Write())
+  {
+    error = "Failed to write DICOM-RT files to " + std::string(outputPath ? outputPath : "");
+    vtkErrorMacro("ExportDicomRTStudy: " + error);
+    return error;
+  }
 
   // Success (error is empty string)
   return error;
@@ -38,6 +38,7 @@
 #include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
 
 class vtkCollection;
+class vtkMRMLRTBeamNode;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLScene;
 class vtkMRMLSegmentationNode;
@@ -52,6 +53,16 @@ class vtkStringArray;
 class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerDicomRtImportExportModuleLogic :
   public vtkSlicerModuleLogic
 {
+public:
+  /// Name of the examine cache file in the DICOM database directory
+  static const std::string EXAMINE_CACHE_FILE_NAME;
+  /// Reference role from a beam loaded with \sa LoadDynamicBeamsCompact to its control point table
+  static const std::string CONTROL_POINT_TABLE_REFERENCE_ROLE;
+  /// Reference role from an ion beam loaded with \sa LoadDynamicBeamsCompact to the table of the scan spots of all control points
+  static const std::string SCAN_SPOT_CONTROL_POINT_TABLE_REFERENCE_ROLE;
+  /// Attribute of a beam loaded with \sa LoadDynamicBeamsCompact storing the index of its current control point
+  static const std::string CONTROL_POINT_INDEX_ATTRIBUTE_NAME;
+
 public:
   static vtkSlicerDicomRtImportExportModuleLogic *New();
   vtkTypeMacro(vtkSlicerDicomRtImportExportModuleLogic, vtkSlicerModuleLogic);
@@ -90,9 +101,55 @@ public:
   vtkGetMacro(BeamModelsInSeparateBranch, bool);
   vtkBooleanMacro(BeamModelsInSeparateBranch, bool);
 
+  vtkSetMacro(ExamineHeaderOnly, bool);
+  vtkGetMacro(ExamineHeaderOnly, bool);
+  vtkBooleanMacro(ExamineHeaderOnly, bool);
+
+  vtkSetMacro(UseExamineCache, bool);
+  vtkGetMacro(UseExamineCache, bool);
+  vtkBooleanMacro(UseExamineCache, bool);
+
+  /// Clear examine cache (see \sa UseExamineCache)
+  void ClearExamineCache();
+
+  vtkSetMacro(NumberOfThreads, int);
+  vtkGetMacro(NumberOfThreads, int);
+
+  vtkSetMacro(LoadRoiContoursOnDemand, bool);
+  vtkGetMacro(LoadRoiContoursOnDemand, bool);
+  vtkBooleanMacro(LoadRoiContoursOnDemand, bool);
+
+  /// Create the closed surface of placeholder segments of a structure set loaded with \sa LoadRoiContoursOnDemand.
+  /// Segments are also loaded automatically when they are shown. Needs to be called before using the closed surface
+  /// of segments that have not been shown, as it is an empty placeholder until then
+  /// \param segmentIDs Segments to load. If null, then all segments that have not been loaded are loaded
+  /// \return Number of loaded segments
+  int LoadDeferredRoiContours(vtkMRMLSegmentationNode* segmentationNode, vtkStringArray* segmentIDs=nullptr);
+
+  vtkSetMacro(LoadDynamicBeamsCompact, bool);
+  vtkGetMacro(LoadDynamicBeamsCompact, bool);
+  vtkBooleanMacro(LoadDynamicBeamsCompact, bool);
+
+  /// Get number of control points of a beam loaded with \sa LoadDynamicBeamsCompact
+  /// \return 0 if the beam has no control point table
+  int GetBeamNumberOfControlPoints(vtkMRMLRTBeamNode* beamNode);
+
+  /// Set the geometry (angles, jaw and leaf positions, scan spots) of a beam loaded with \sa LoadDynamicBeamsCompact
+  /// from a row of its control point table. The index is stored in the \sa CONTROL_POINT_INDEX_ATTRIBUTE_NAME attribute
+  /// \return Success flag
+  bool SetBeamControlPointIndex(vtkMRMLRTBeamNode* beamNode, int controlPointIndex);
+
+  vtkSetMacro(ExportDoseAndContoursDirectly, bool);
+  vtkGetMacro(ExportDoseAndContoursDirectly, bool);
+  vtkBooleanMacro(ExportDoseAndContoursDirectly, bool);
+
 protected:
   void SetMRMLSceneInternal(vtkMRMLScene* newScene) override;
   void OnMRMLSceneEndClose() override;
+  void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) override;
+
+  /// Load placeholder segments of structure sets loaded with \sa LoadRoiContoursOnDemand when they are shown
+  void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData) override;
 
   /// Register MRML Node classes to Scene. Gets called automatically when the MRMLScene is attached to this logic class.
   void RegisterNodes() override;
@@ -121,6 +178,46 @@ private:
   /// Flag determining whether the generated beam models are arranged in a separate subject hierarchy
   /// branch, or each beam model is added under its corresponding isocenter fiducial
   bool BeamModelsInSeparateBranch;
+
+  /// Flag determining whether only the part of the files needed for examination is parsed in \sa ExamineForLoad.
+  /// If on (default), then parsing stops before the structure set ROI and contour sequences and the pixel data.
+  /// If off, then the whole files are parsed
+  bool ExamineHeaderOnly;
+
+  /// Flag determining whether the results of \sa ExamineForLoad are stored in a cache file in the DICOM database
+  /// directory, so that files that have not changed (same path, size and modification time) are not parsed again
+  /// in later examinations, even in later sessions. On by default
+  bool UseExamineCache;
+
+  /// Number of threads used when loading structure sets, both for reading the ROI contours and for creating
+  /// their closed surface representation. The segments are added to the segmentation node on the calling thread
+  /// after all of them are done. Also used when exporting segmentations, for preparing the structures of the
+  /// segments, which are then added to the writer in segment order. 0 by default, meaning the number of threads of the
+  /// vtkSMPTools backend (see vtkSlicerRtCommon::GetNumberOfWorkerThreads). The progress of creating the closed surfaces is reported by
+  /// vtkCommand::ProgressEvent (progress between 0 and 1 as call data)
+  int NumberOfThreads;
+
+  /// Flag determining whether the closed surfaces of structure set ROIs are only created when needed.
+  /// If on, then the contour ROIs are loaded as hidden placeholder segments with name, color, ROI number, number
+  /// of contours and bounds (segment tags) and the complete planar contours, so the representations converted from
+  /// the planar contours (such as binary labelmap) are complete. The closed surface of a placeholder is created when
+  /// the segment is shown or \sa LoadDeferredRoiContours is called. The parsed structure set is not kept in memory.
+  /// Off by default, so the structure sets are loaded completely
+  bool LoadRoiContoursOnDemand;
+
+  /// Flag determining how beams with multiple control points are loaded. If off (default), then a sequence is created
+  /// with a beam node, a transform node and an MLC or scan spot table node for each control point. If on, then one beam
+  /// node is created with a table containing the parameters of all control points (and an ion beam also gets a table of
+  /// the scan spots of all control points), so the number of nodes does not depend on the number of control points.
+  /// The beam shows the first control point, which can be changed using \sa SetBeamControlPointIndex
+  bool LoadDynamicBeamsCompact;
+
+  /// Flag determining how dose and structures are written in \sa ExportDicomRTStudy. If off (default), then they are
+  /// converted to Plastimatch images and contours and written by Plastimatch. If on, then the dose voxels are written
+  /// with DCMTK from the dose volume, and segmentations with poly data master representation are written as contours
+  /// without rasterization (planar contours as they are, closed surfaces cut at the anatomical image slices).
+  /// Segmentations with labelmap master representation and the anatomical image are always written by Plastimatch
+  bool ExportDoseAndContoursDirectly;
 };
 
 #endif
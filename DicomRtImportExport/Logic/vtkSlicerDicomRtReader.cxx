@@ -29,22 +29,39 @@
 
 // VTK includes
 #include <vtkCellArray.h>
+#include <vtkCommand.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPoints.h>
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
+#include <vtkVariant.h>
 
 // STD includes
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <limits>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
 
 // DCMTK includes
 #include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
 
 #include <dcmtk/ofstd/ofconapp.h>
 
+#include <dcmtk/dcmdata/dcfcache.h>
+#include <dcmtk/dcmdata/dcswap.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
 #include <dcmtk/dcmrt/drtdose.h>
 #include <dcmtk/dcmrt/drtimage.h>
 #include <dcmtk/dcmrt/drtplan.h>
@@ -56,8 +73,31 @@
 // Qt includes
 #include <QSettings>
 
+// Slicer includes
+#include <vtkSlicerVersionConfigure.h>
+
 vtkStandardNewMacro(vtkSlicerDicomRtReader);
 
+//----------------------------------------------------------------------------
+// Convert stored RT dose pixel values to dose values: dose = pixel * doseGridScaling
+template <class T>
+static void ScalePixelValuesToDose(const T* pixelValues, vtkIdType numberOfPixels, double doseGridScaling, float* doseValues)
+{
+  for (vtkIdType pixelIndex = 0; pixelIndex < numberOfPixels; ++pixelIndex)
+  {
+    doseValues[pixelIndex] = static_cast<float>(pixelValues[pixelIndex] * doseGridScaling);
+  }
+}
+
+//----------------------------------------------------------------------------
+// Store a message of loading a ROI so that it can be reported on the calling thread (\sa ReportRoiLoadMessages)
+#define vtkRoiLoadMessageMacro(messages, x) \
+  { \
+    std::ostringstream roiLoadMessageStream; \
+    roiLoadMessageStream << x; \
+    (messages).push_back(roiLoadMessageStream.str()); \
+  }
+
 //----------------------------------------------------------------------------
 class vtkSlicerDicomRtReader::vtkInternal
 {
@@ -146,6 +186,23 @@ public:
     std::string ReferencedSeriesUID;
     std::string ReferencedFrameOfReferenceUID;
     std::map<int,std::string> ContourIndexToSOPInstanceUIDMap;
+
+    /// Number of contours, -1 if the contour sequence has not been read
+    int NumberOfContours;
+    /// Number of contour points
+    vtkIdType NumberOfPoints;
+    /// Bounding box of the contour points (RAS)
+    std::array< double, 6 > Bounds;
+    /// Flag indicating that the poly data has not been created yet from \sa DeferredContourPointsRas.
+    /// Only set if the structure set was loaded with \sa LoadRoiContoursOnDemand
+    bool PolyDataDeferred;
+    /// Contour points (RAS) and number of points of each contour, kept until the poly data is first requested
+    std::vector<float> DeferredContourPointsRas;
+    std::vector<vtkIdType> DeferredContourNumberOfPoints;
+    /// Errors and warnings of loading the contours. The contours may be loaded on worker threads, so the
+    /// messages are only collected there, and reported by \sa ReportRoiLoadMessages on the calling thread
+    std::vector<std::string> LoadErrors;
+    std::vector<std::string> LoadWarnings;
   };
 
   /// List of loaded contour ROIs from structure set
@@ -343,6 +400,12 @@ public:
   /// List of loaded channels from brachytherapy plan
   std::vector<ChannelEntry> ChannelSequenceVector;
 
+  /// Indices of the entries in \sa RoiSequenceVector, \sa BeamSequenceVector and \sa ChannelSequenceVector
+  /// by their DICOM number. If a number occurs multiple times, then the first entry is indexed
+  std::unordered_map<unsigned int, size_t> RoiIndexByNumber;
+  std::unordered_map<unsigned int, size_t> BeamIndexByNumber;
+  std::unordered_map<unsigned int, size_t> ChannelIndexByNumber;
+
 public:
   /// Load RT Dose
   void LoadRTDose(DcmDataset* dataset);
@@ -356,8 +419,17 @@ public:
   void LoadRTStructureSet(DcmDataset* dataset);
   /// Load contours from a structure sequence
   void LoadContoursFromRoiSequence(DRTStructureSetROISequence* roiSequence);
-  /// Load individual contour from RT Structure Set
-  vtkSlicerDicomRtReader::vtkInternal::RoiEntry* LoadContour(DRTROIContourSequence::Item &roiObject, DRTStructureSetIOD* rtStructureSet);
+  /// Load individual contour from RT Structure Set into its ROI entry.
+  /// Only accesses the given ROI contour item and ROI entry, so different ROIs can be loaded on multiple threads
+  /// \param deferPolyData If true, then only the contour points and their bounds are stored in the ROI entry,
+  ///   and the poly data is created by \sa CreateDeferredRoiPolyData when it is first requested
+  void LoadContour(DRTROIContourSequence::Item &roiObject, RoiEntry* roiEntry, DRTStructureSetIOD* rtStructureSet, bool deferPolyData=false);
+  /// Create the poly data of a ROI entry from its contour points and cells (offsets and connectivity of the closed contours)
+  void SetRoiPolyData(RoiEntry* roiEntry, vtkPoints* contourPoints, vtkIdTypeArray* contourOffsets, vtkIdTypeArray* contourConnectivity);
+  /// Create the poly data of a ROI entry loaded with deferred poly data, then release its contour points
+  void CreateDeferredRoiPolyData(RoiEntry* roiEntry);
+  /// Report the errors and warnings collected while loading the contours of a ROI, then clear them
+  void ReportRoiLoadMessages(RoiEntry* roiEntry);
 
   /// Load RT Image
   void LoadRTImage(DcmDataset* dataset);
@@ -381,8 +453,18 @@ public:
   /// Get contour image sequence object in the referenced frame of reference sequence for a structure set
   DRTContourImageSequence* GetReferencedFrameOfReferenceContourImageSequence(DRTStructureSetIOD* rtStructureSet);
 
+  /// Get referenced SOP instance UIDs from the contour image sequence in the referenced frame of reference sequence.
+  /// The sequence is only read at the first call, as it is only needed for ROIs without per-contour image references.
+  /// Invalid items are stored as empty strings. Can be called from multiple threads
+  const std::vector<std::string>& GetReferencedFrameOfReferenceContourImageUids(DRTStructureSetIOD* rtStructureSet);
+
 public:
   vtkSlicerDicomRtReader* External;
+
+  /// Referenced SOP instance UIDs read by \sa GetReferencedFrameOfReferenceContourImageUids
+  std::vector<std::string> ReferencedFrameOfReferenceContourImageUids;
+  bool ReferencedFrameOfReferenceContourImageUidsRead{false};
+  std::mutex ReferencedFrameOfReferenceContourImageUidsMutex;
 };
 
 //----------------------------------------------------------------------------
@@ -395,6 +477,9 @@ vtkSlicerDicomRtReader::vtkInternal::vtkInternal(vtkSlicerDicomRtReader* externa
   this->RoiSequenceVector.clear();
   this->BeamSequenceVector.clear();
   this->ChannelSequenceVector.clear();
+  this->RoiIndexByNumber.clear();
+  this->BeamIndexByNumber.clear();
+  this->ChannelIndexByNumber.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -403,6 +488,9 @@ vtkSlicerDicomRtReader::vtkInternal::~vtkInternal()
   this->RoiSequenceVector.clear();
   this->BeamSequenceVector.clear();
   this->ChannelSequenceVector.clear();
+  this->RoiIndexByNumber.clear();
+  this->BeamIndexByNumber.clear();
+  this->ChannelIndexByNumber.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -411,6 +499,10 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry::RoiEntry()
   this->Number = 0;
   this->DisplayColor = { 1.0, 0.0, 0.0 };
   this->PolyData = nullptr;
+  this->NumberOfContours = -1;
+  this->NumberOfPoints = 0;
+  this->Bounds = { 0.0, -1.0, 0.0, -1.0, 0.0, -1.0 };
+  this->PolyDataDeferred = false;
 }
 
 //----------------------------------------------------------------------------
@@ -431,6 +523,14 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry::RoiEntry(const RoiEntry& src)
   this->ReferencedSeriesUID = src.ReferencedSeriesUID;
   this->ReferencedFrameOfReferenceUID = src.ReferencedFrameOfReferenceUID;
   this->ContourIndexToSOPInstanceUIDMap = src.ContourIndexToSOPInstanceUIDMap;
+  this->NumberOfContours = src.NumberOfContours;
+  this->NumberOfPoints = src.NumberOfPoints;
+  this->Bounds = src.Bounds;
+  this->PolyDataDeferred = src.PolyDataDeferred;
+  this->DeferredContourPointsRas = src.DeferredContourPointsRas;
+  this->DeferredContourNumberOfPoints = src.DeferredContourNumberOfPoints;
+  this->LoadErrors = src.LoadErrors;
+  this->LoadWarnings = src.LoadWarnings;
 }
 
 //----------------------------------------------------------------------------
@@ -444,6 +544,14 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry& vtkSlicerDicomRtReader::vtkIntern
   this->ReferencedSeriesUID = src.ReferencedSeriesUID;
   this->ReferencedFrameOfReferenceUID = src.ReferencedFrameOfReferenceUID;
   this->ContourIndexToSOPInstanceUIDMap = src.ContourIndexToSOPInstanceUIDMap;
+  this->NumberOfContours = src.NumberOfContours;
+  this->NumberOfPoints = src.NumberOfPoints;
+  this->Bounds = src.Bounds;
+  this->PolyDataDeferred = src.PolyDataDeferred;
+  this->DeferredContourPointsRas = src.DeferredContourPointsRas;
+  this->DeferredContourNumberOfPoints = src.DeferredContourNumberOfPoints;
+  this->LoadErrors = src.LoadErrors;
+  this->LoadWarnings = src.LoadWarnings;
 
   return (*this);
 }
@@ -574,12 +682,10 @@ vtkSlicerDicomRtReader::vtkInternal::ControlPointEntry::operator=(const ControlP
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::vtkInternal::BeamEntry* vtkSlicerDicomRtReader::vtkInternal::FindBeamByNumber(unsigned int beamNumber)
 {
-  for (unsigned int i=0; i<this->BeamSequenceVector.size(); i++)
+  std::unordered_map<unsigned int, size_t>::iterator beamIt = this->BeamIndexByNumber.find(beamNumber);
+  if (beamIt != this->BeamIndexByNumber.end())
   {
-    if (this->BeamSequenceVector[i].Number == beamNumber)
-    {
-      return &this->BeamSequenceVector[i];
-    }
+    return &this->BeamSequenceVector[beamIt->second];
   }
 
   // Not found
@@ -590,12 +696,10 @@ vtkSlicerDicomRtReader::vtkInternal::BeamEntry* vtkSlicerDicomRtReader::vtkInter
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkInternal::FindRoiByNumber(unsigned int roiNumber)
 {
-  for (unsigned int i=0; i<this->RoiSequenceVector.size(); i++)
+  std::unordered_map<unsigned int, size_t>::iterator roiIt = this->RoiIndexByNumber.find(roiNumber);
+  if (roiIt != this->RoiIndexByNumber.end())
   {
-    if (this->RoiSequenceVector[i].Number == roiNumber)
-    {
-      return &this->RoiSequenceVector[i];
-    }
+    return &this->RoiSequenceVector[roiIt->second];
   }
 
   // Not found
@@ -606,12 +710,10 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
 //----------------------------------------------------------------------------
 vtkSlicerDicomRtReader::vtkInternal::ChannelEntry* vtkSlicerDicomRtReader::vtkInternal::FindChannelByNumber(unsigned int channelNumber)
 {
-  for (unsigned int i=0; i<this->ChannelSequenceVector.size(); i++)
+  std::unordered_map<unsigned int, size_t>::iterator channelIt = this->ChannelIndexByNumber.find(channelNumber);
+  if (channelIt != this->ChannelIndexByNumber.end())
   {
-    if (this->ChannelSequenceVector[i].Number == channelNumber)
-    {
-      return &this->ChannelSequenceVector[i];
-    }
+    return &this->ChannelSequenceVector[channelIt->second];
   }
 
   // Not found
@@ -710,11 +812,49 @@ DRTContourImageSequence* vtkSlicerDicomRtReader::vtkInternal::GetReferencedFrame
   return &rtContourImageSequence;
 }
 
+//----------------------------------------------------------------------------
+const std::vector<std::string>& vtkSlicerDicomRtReader::vtkInternal::GetReferencedFrameOfReferenceContourImageUids(DRTStructureSetIOD* rtStructureSet)
+{
+  std::lock_guard<std::mutex> lock(this->ReferencedFrameOfReferenceContourImageUidsMutex);
+  if (this->ReferencedFrameOfReferenceContourImageUidsRead)
+  {
+    return this->ReferencedFrameOfReferenceContourImageUids;
+  }
+  this->ReferencedFrameOfReferenceContourImageUidsRead = true;
+
+  DRTContourImageSequence* rtContourImageSequence = this->GetReferencedFrameOfReferenceContourImageSequence(rtStructureSet);
+  if (!rtContourImageSequence || !rtContourImageSequence->gotoFirstItem().good())
+  {
+    return this->ReferencedFrameOfReferenceContourImageUids;
+  }
+  do
+  {
+    DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequence->getCurrentItem();
+    OFString referencedSOPInstanceUID("");
+    if (rtContourImageSequenceItem.isValid())
+    {
+      rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
+    }
+    else
+    {
+      vtkErrorWithObjectMacro(this->External, "GetReferencedFrameOfReferenceContourImageUids: Contour image sequence object item in referenced frame of reference sequence is invalid");
+    }
+    this->ReferencedFrameOfReferenceContourImageUids.push_back(referencedSOPInstanceUID.c_str());
+  }
+  while (rtContourImageSequence->gotoNextItem().good());
+
+  return this->ReferencedFrameOfReferenceContourImageUids;
+}
+
 //----------------------------------------------------------------------------
 void vtkSlicerDicomRtReader::vtkInternal::LoadRTDose(DcmDataset* dataset)
 {
   this->External->LoadRTDoseSuccessful = false;
 
+  // The pixel data is read frame by frame by ReadDoseImageData. It is removed from the dataset
+  // so that it is not loaded into memory when the IOD copies the attributes
+  delete dataset->remove(DCM_PixelData);
+
   DRTDoseIOD rtDose;
   if (rtDose.read(*dataset).bad())
   {
@@ -1203,6 +1343,7 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTPlan(DcmDataset* dataset)
         vtkErrorWithObjectMacro( this->External, "LoadRTPlan: Number of control points expected ("
           << beamNumberOfControlPoints << ") and found (" << controlPointCount << ") do not match. Invalid points remain among control points");
       }
+      this->BeamIndexByNumber.emplace(beamEntry.Number, this->BeamSequenceVector.size());
       this->BeamSequenceVector.push_back(beamEntry);
     }
     while (rtPlanBeamSequence.gotoNextItem().good());
@@ -1309,6 +1450,7 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTPlan(DcmDataset* dataset)
           << channelNumberOfControlPoints << ") and found (" << controlPointCount << ") do not match. Invalid points remain among control points");
       }
 
+      this->ChannelIndexByNumber.emplace(channelEntry.Number, this->ChannelSequenceVector.size());
       this->ChannelSequenceVector.push_back(channelEntry);
     }
     while (channelSequence.gotoNextItem().good());
@@ -1848,6 +1990,7 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTIonPlan(DcmDataset* dataset)
         vtkErrorWithObjectMacro( this->External, "LoadRTIonPlan: Number of control points expected ("
           << beamNumberOfControlPoints << ") and found (" << controlPointCount << ") do not match. Invalid points remain among control points");
       }
+      this->BeamIndexByNumber.emplace(beamEntry.Number, this->BeamSequenceVector.size());
       this->BeamSequenceVector.push_back(beamEntry);
     }
     while (ionBeamSequence.gotoNextItem().good());
@@ -1944,19 +2087,93 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadRTStructureSet(DcmDataset* dataset
     return;
   }
 
-  // Read ROIs, iterate over ROI contour sequence
+  // Collect ROIs and their entries, iterate over ROI contour sequence
+  std::vector<DRTROIContourSequence::Item*> roiContourItems;
+  std::vector<RoiEntry*> roiContourEntries;
+  std::set<RoiEntry*> uniqueRoiContourEntries;
   do 
   {
     DRTROIContourSequence::Item &currentRoi = rtROIContourSequence.getCurrentItem();
-    RoiEntry* currentRoiEntry = this->LoadContour(currentRoi, rtStructureSet);
-    if (currentRoiEntry)
+    if (!currentRoi.isValid())
     {
-      // Set referenced series UID
-      currentRoiEntry->ReferencedSeriesUID = (std::string)referencedSeriesInstanceUID.c_str();
+      continue;
     }
+
+    // Get ROI entry created for the referenced ROI
+    Sint32 referencedRoiNumber = -1;
+    currentRoi.getReferencedROINumber(referencedRoiNumber);
+    RoiEntry* currentRoiEntry = this->FindRoiByNumber(referencedRoiNumber);
+    if (currentRoiEntry == nullptr)
+    {
+      vtkErrorWithObjectMacro(this->External, "LoadRTStructureSet: ROI with number " << referencedRoiNumber << " is not found");
+      continue;
+    }
+
+    // Set referenced series UID
+    currentRoiEntry->ReferencedSeriesUID = (std::string)referencedSeriesInstanceUID.c_str();
+
+    roiContourItems.push_back(&currentRoi);
+    roiContourEntries.push_back(currentRoiEntry);
+    uniqueRoiContourEntries.insert(currentRoiEntry);
   }
   while (rtROIContourSequence.gotoNextItem().good());
 
+  // Read ROI contours. Each ROI only accesses its own contour item and entry, so they are read concurrently,
+  // unless multiple contour items reference the same ROI (then they are read in order, as the last one is kept).
+  // If the poly data is created on demand, then only the contour points and bounds are stored here, so that the
+  // structure set can be released after loading. The frame of reference contour image UIDs are read here, so that
+  // their errors are reported on this thread
+  bool deferPolyData = this->External->LoadRoiContoursOnDemand;
+  this->ReferencedFrameOfReferenceContourImageUids.clear();
+  this->ReferencedFrameOfReferenceContourImageUidsRead = false;
+  this->GetReferencedFrameOfReferenceContourImageUids(rtStructureSet);
+  unsigned int numberOfThreads = 1;
+  if (uniqueRoiContourEntries.size() == roiContourEntries.size())
+  {
+    numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->External->NumberOfThreads, roiContourItems.size());
+  }
+  vtkSlicerRtCommon::RunOnWorkerThreads(roiContourItems.size(), numberOfThreads,
+    [this, &roiContourItems, &roiContourEntries, rtStructureSet, deferPolyData](size_t roiIndex)
+    {
+      this->LoadContour(*roiContourItems[roiIndex], roiContourEntries[roiIndex], rtStructureSet, deferPolyData);
+    },
+    [this, &roiContourItems](size_t numberOfFinishedRois)
+    {
+      double progress = static_cast<double>(numberOfFinishedRois) / roiContourItems.size();
+      this->External->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+    });
+  for (std::vector<RoiEntry*>::iterator roiIt = roiContourEntries.begin(); roiIt != roiContourEntries.end(); ++roiIt)
+  {
+    this->ReportRoiLoadMessages(*roiIt);
+  }
+
+  // Store the referenced SOP instance UIDs of the last loaded ROI contour
+  for (std::vector<RoiEntry*>::reverse_iterator roiIt = roiContourEntries.rbegin(); roiIt != roiContourEntries.rend(); ++roiIt)
+  {
+    if ((*roiIt)->NumberOfContours < 0)
+    {
+      continue; // Contour sequence was empty
+    }
+    std::set<std::string> referencedSopInstanceUids;
+    for (std::map<int, std::string>::iterator uidIt = (*roiIt)->ContourIndexToSOPInstanceUIDMap.begin();
+      uidIt != (*roiIt)->ContourIndexToSOPInstanceUIDMap.end(); ++uidIt)
+    {
+      referencedSopInstanceUids.insert(uidIt->second);
+    }
+
+    // Serialize referenced SOP instance UID set
+    std::string serializedUidList("");
+    for (std::set<std::string>::iterator uidIt = referencedSopInstanceUids.begin(); uidIt != referencedSopInstanceUids.end(); ++uidIt)
+    {
+      serializedUidList.append(*uidIt);
+      serializedUidList.append(" ");
+    }
+    // Strip last space
+    serializedUidList = serializedUidList.substr(0, serializedUidList.size()-1);
+    this->External->SetRTStructureSetReferencedSOPInstanceUIDs(serializedUidList.c_str());
+    break;
+  }
+
   // Get SOP instance UID
   OFString sopInstanceUid("");
   if (rtStructureSet->getSOPInstanceUID(sopInstanceUid).bad())
@@ -2009,49 +2226,52 @@ void vtkSlicerDicomRtReader::vtkInternal::LoadContoursFromRoiSequence(DRTStructu
     roiEntry.Number=roiNumber;
 
     // Save to vector          
+    this->RoiIndexByNumber.emplace(roiEntry.Number, this->RoiSequenceVector.size());
     this->RoiSequenceVector.push_back(roiEntry);
   }
   while (rtStructureSetROISequence->gotoNextItem().good());
 }
 
 //----------------------------------------------------------------------------
-vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkInternal::LoadContour(
-  DRTROIContourSequence::Item &roi, DRTStructureSetIOD* rtStructureSet)
+void vtkSlicerDicomRtReader::vtkInternal::LoadContour(
+  DRTROIContourSequence::Item &roi, RoiEntry* roiEntry, DRTStructureSetIOD* rtStructureSet, bool deferPolyData/*=false*/)
 {
-  if (!roi.isValid())
-  {
-    return nullptr;
-  }
-
   // Used for connection from one planar contour ROI to the corresponding anatomical volume slice instance
   std::map<int, std::string> contourToSliceInstanceUIDMap;
-  std::set<std::string> referencedSopInstanceUids;
-
-  // Get ROI entry created for the referenced ROI
-  Sint32 referencedRoiNumber = -1;
-  roi.getReferencedROINumber(referencedRoiNumber);
-  RoiEntry* roiEntry = this->FindRoiByNumber(referencedRoiNumber);
-  if (roiEntry == nullptr)
-  {
-    vtkErrorWithObjectMacro(this->External, "LoadContour: ROI with number " << referencedRoiNumber << " is not found");      
-    return nullptr;
-  } 
 
   // Get contour sequence
   DRTContourSequence &rtContourSequence = roi.getContourSequence();
   if (!rtContourSequence.gotoFirstItem().good())
   {
-    vtkErrorWithObjectMacro(this->External, "LoadContour: Contour sequence for ROI named '"
-      << roiEntry->Name << "' with number " << referencedRoiNumber << " is empty");
-    return roiEntry;
+    vtkRoiLoadMessageMacro(roiEntry->LoadErrors, "LoadContour: Contour sequence for ROI named '"
+      << roiEntry->Name << "' with number " << roiEntry->Number << " is empty");
+    return;
   }
 
-  // Create containers for contour poly data
+  // Create containers for contour poly data. The points and the connectivity (each contour is closed by
+  // repeating its first point) are written directly into the arrays. There is at most one cell per contour
+  // item, and the point arrays grow geometrically, so that each contour item is only parsed once
+  vtkIdType maxNumberOfRoiContours = static_cast<vtkIdType>(rtContourSequence.getNumberOfItems());
   vtkSmartPointer<vtkPoints> currentRoiContourPoints = vtkSmartPointer<vtkPoints>::New();
-  vtkSmartPointer<vtkCellArray> currentRoiContourCells = vtkSmartPointer<vtkCellArray>::New();
+  vtkNew<vtkIdTypeArray> currentRoiContourOffsets;
+  vtkNew<vtkIdTypeArray> currentRoiContourConnectivity;
+  vtkIdType roiPointsCapacity = 0;
+  float* roiPointsRas = nullptr;
+  vtkIdType* roiOffsets = nullptr;
+  vtkIdType* roiConnectivity = nullptr;
+  roiEntry->DeferredContourPointsRas.clear();
+  roiEntry->DeferredContourNumberOfPoints.clear();
+  if (!deferPolyData)
+  {
+    currentRoiContourOffsets->SetNumberOfValues(maxNumberOfRoiContours + 1);
+    roiOffsets = currentRoiContourOffsets->GetPointer(0);
+    roiOffsets[0] = 0;
+  }
   vtkIdType pointId = 0;
+  vtkIdType contourIndex = 0;
 
   // Read contour data, iterate over contour sequence
+  OFVector<vtkTypeFloat64> contourData_LPS;
   do
   {
     // Get contour
@@ -2061,36 +2281,67 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
       continue;
     }
 
-    // Get number of contour points
-    OFString numberOfPointsString("");
-    contourItem.getNumberOfContourPoints(numberOfPointsString);
-    std::stringstream ss;
-    ss << numberOfPointsString;
-    int numberOfPoints;
-    ss >> numberOfPoints;
+    // Get number of contour points. Contours without points are skipped, as they cannot form a cell
+    Sint32 numberOfPoints = 0;
+    contourItem.getNumberOfContourPoints(numberOfPoints);
+    if (numberOfPoints <= 0)
+    {
+      vtkRoiLoadMessageMacro(roiEntry->LoadWarnings, "LoadContour: Skipping contour without points in ROI " << roiEntry->Number << ": " << roiEntry->Name);
+      continue;
+    }
 
     // Get contour point data
-    OFVector<vtkTypeFloat64> contourData_LPS;
+    contourData_LPS.clear();
     contourItem.getContourData(contourData_LPS);
     if (contourData_LPS.size() != size_t(numberOfPoints * 3))
     {
-      vtkErrorWithObjectMacro(this->External, "LoadContour: Contour sequence object item is invalid: "
+      vtkRoiLoadMessageMacro(roiEntry->LoadErrors, "LoadContour: Contour sequence object item is invalid: "
         << " number of contour points is " << numberOfPoints << " therefore expected "
         << numberOfPoints * 3 << " values in contour data but only found " << contourData_LPS.size());
       continue;
     }
+    const vtkTypeFloat64* contourPointLps = &(contourData_LPS[0]);
 
-    unsigned int contourIndex = currentRoiContourCells->InsertNextCell(numberOfPoints+1);
-    for (int k=0; k<numberOfPoints; k++)
+    float* contourPointRas = nullptr;
+    if (deferPolyData)
     {
-      // Convert from DICOM LPS -> Slicer RAS
-      currentRoiContourPoints->InsertPoint(pointId, -contourData_LPS[3*k], -contourData_LPS[3*k+1], contourData_LPS[3*k+2]);
-      currentRoiContourCells->InsertCellPoint(pointId);
-      pointId++;
+      // Only the points are kept, the cells are created with the poly data
+      roiEntry->DeferredContourPointsRas.resize(3 * (pointId + numberOfPoints));
+      roiEntry->DeferredContourNumberOfPoints.push_back(numberOfPoints);
+      contourPointRas = roiEntry->DeferredContourPointsRas.data() + 3 * pointId;
+    }
+    else
+    {
+      // Grow the point and connectivity arrays if needed (existing values are kept)
+      if (pointId + numberOfPoints > roiPointsCapacity)
+      {
+        roiPointsCapacity = std::max(2 * roiPointsCapacity, pointId + static_cast<vtkIdType>(numberOfPoints));
+        currentRoiContourPoints->SetNumberOfPoints(roiPointsCapacity);
+        roiPointsRas = static_cast<float*>(currentRoiContourPoints->GetVoidPointer(0));
+        currentRoiContourConnectivity->SetNumberOfValues(roiPointsCapacity + maxNumberOfRoiContours);
+        roiConnectivity = currentRoiContourConnectivity->GetPointer(0);
+      }
+
+      contourPointRas = roiPointsRas + 3 * pointId;
+
+      // Add contour cell, closed by its first point
+      vtkIdType* contourConnectivity = roiConnectivity + roiOffsets[contourIndex];
+      for (Sint32 k = 0; k < numberOfPoints; ++k)
+      {
+        contourConnectivity[k] = pointId + k;
+      }
+      contourConnectivity[numberOfPoints] = pointId;
+      roiOffsets[contourIndex + 1] = roiOffsets[contourIndex] + numberOfPoints + 1;
     }
 
-    // Close the contour
-    currentRoiContourCells->InsertCellPoint(pointId-numberOfPoints);
+    // Convert from DICOM LPS -> Slicer RAS
+    for (Sint32 k = 0; k < 3 * numberOfPoints; k += 3)
+    {
+      contourPointRas[k] = static_cast<float>(-contourPointLps[k]);
+      contourPointRas[k+1] = static_cast<float>(-contourPointLps[k+1]);
+      contourPointRas[k+2] = static_cast<float>(contourPointLps[k+2]);
+    }
+    pointId += numberOfPoints;
 
     // Add map to the referenced slice instance UID
     // This is not a mandatory field so no error logged if not found. The reason why
@@ -2103,68 +2354,80 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
       {
         OFString referencedSOPInstanceUID("");
         rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
-        contourToSliceInstanceUIDMap[contourIndex] = referencedSOPInstanceUID.c_str();
-        referencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
+        contourToSliceInstanceUIDMap[static_cast<int>(contourIndex)] = referencedSOPInstanceUID.c_str();
 
         // Check if multiple SOP instance UIDs are referenced
         if (rtContourImageSequence.getNumberOfItems() > 1)
         {
-          vtkWarningWithObjectMacro(this->External, "LoadContour: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported");
+          vtkRoiLoadMessageMacro(roiEntry->LoadWarnings, "LoadContour: Contour in ROI " << roiEntry->Number << ": " << roiEntry->Name << " contains multiple referenced instances. This is not yet supported");
         }
       }
       else
       {
-        vtkErrorWithObjectMacro(this->External, "LoadContour: Contour image sequence object item is invalid");
+        vtkRoiLoadMessageMacro(roiEntry->LoadErrors, "LoadContour: Contour image sequence object item is invalid");
       }
     }
+    ++contourIndex;
   }
   while (rtContourSequence.gotoNextItem().good());
 
+  roiEntry->NumberOfContours = static_cast<int>(contourIndex);
+  roiEntry->NumberOfPoints = pointId;
+
   // Read slice reference UIDs from referenced frame of reference sequence if it was not included in the ROIContourSequence above
   if (contourToSliceInstanceUIDMap.empty())
   {
-    DRTContourImageSequence* rtContourImageSequence = this->GetReferencedFrameOfReferenceContourImageSequence(rtStructureSet);
-    if (rtContourImageSequence && rtContourImageSequence->gotoFirstItem().good())
+    const std::vector<std::string>& frameOfReferenceContourImageUids = this->GetReferencedFrameOfReferenceContourImageUids(rtStructureSet);
+    if (!frameOfReferenceContourImageUids.empty())
     {
       int currentSliceNumber = -1; // Use negative keys to indicate that the slice instances cannot be directly mapped to the ROI planar contours
-      do 
+      for (std::vector<std::string>::const_iterator uidIt = frameOfReferenceContourImageUids.begin(); uidIt != frameOfReferenceContourImageUids.end(); ++uidIt)
       {
-        DRTContourImageSequence::Item &rtContourImageSequenceItem = rtContourImageSequence->getCurrentItem();
-        if (rtContourImageSequenceItem.isValid())
-        {
-          OFString referencedSOPInstanceUID("");
-          rtContourImageSequenceItem.getReferencedSOPInstanceUID(referencedSOPInstanceUID);
-          contourToSliceInstanceUIDMap[currentSliceNumber] = referencedSOPInstanceUID.c_str();
-          referencedSopInstanceUids.insert(referencedSOPInstanceUID.c_str());
-        }
-        else
+        if (!uidIt->empty())
         {
-          vtkErrorWithObjectMacro(this->External, "LoadContour: Contour image sequence object item in referenced frame of reference sequence is invalid");
+          contourToSliceInstanceUIDMap[currentSliceNumber] = *uidIt;
         }
         currentSliceNumber--;
       }
-      while (rtContourImageSequence->gotoNextItem().good());
     }
     else
     {
-      vtkErrorWithObjectMacro(this->External, "LoadContour: No items in contour image sequence object item in referenced frame of reference sequence");
+      vtkRoiLoadMessageMacro(roiEntry->LoadErrors, "LoadContour: No items in contour image sequence object item in referenced frame of reference sequence");
     }
   }
 
-  // Save just loaded contour data into ROI entry
-  vtkSmartPointer<vtkPolyData> currentRoiPolyData = vtkSmartPointer<vtkPolyData>::New();
-  currentRoiPolyData->SetPoints(currentRoiContourPoints);
-  if (currentRoiContourPoints->GetNumberOfPoints() == 1)
+  roiEntry->PolyDataDeferred = deferPolyData;
+  if (deferPolyData)
   {
-    // Point ROI
-    currentRoiPolyData->SetVerts(currentRoiContourCells);
+    // Compute bounds from the stored points, so that they are available before the poly data is created
+    roiEntry->DeferredContourPointsRas.shrink_to_fit();
+    roiEntry->DeferredContourNumberOfPoints.shrink_to_fit();
+    roiEntry->Bounds = { 0.0, -1.0, 0.0, -1.0, 0.0, -1.0 };
+    const std::vector<float>& roiPointsRasVector = roiEntry->DeferredContourPointsRas;
+    for (size_t k = 0; k < roiPointsRasVector.size(); k += 3)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        double coordinate = roiPointsRasVector[k + axis];
+        if (k == 0 || coordinate < roiEntry->Bounds[2 * axis])
+        {
+          roiEntry->Bounds[2 * axis] = coordinate;
+        }
+        if (k == 0 || coordinate > roiEntry->Bounds[2 * axis + 1])
+        {
+          roiEntry->Bounds[2 * axis + 1] = coordinate;
+        }
+      }
+    }
   }
-  else if (currentRoiContourPoints->GetNumberOfPoints() > 1)
+  else
   {
-    // Contour ROI
-    currentRoiPolyData->SetLines(currentRoiContourCells);
+    // Trim the arrays if there were invalid contours
+    currentRoiContourPoints->SetNumberOfPoints(pointId);
+    currentRoiContourOffsets->SetNumberOfValues(contourIndex + 1);
+    currentRoiContourConnectivity->SetNumberOfValues(roiOffsets[contourIndex]);
+    this->SetRoiPolyData(roiEntry, currentRoiContourPoints, currentRoiContourOffsets, currentRoiContourConnectivity);
   }
-  roiEntry->SetPolyData(currentRoiPolyData);
 
   // Get structure color
   Sint32 roiDisplayColor = -1;
@@ -2176,20 +2439,106 @@ vtkSlicerDicomRtReader::vtkInternal::RoiEntry* vtkSlicerDicomRtReader::vtkIntern
 
   // Set referenced SOP instance UIDs
   roiEntry->ContourIndexToSOPInstanceUIDMap = contourToSliceInstanceUIDMap;
+}
 
-  // Serialize referenced SOP instance UID set
-  std::set<std::string>::iterator uidIt;
-  std::string serializedUidList("");
-  for (uidIt = referencedSopInstanceUids.begin(); uidIt != referencedSopInstanceUids.end(); ++uidIt)
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::SetRoiPolyData(
+  RoiEntry* roiEntry, vtkPoints* contourPoints, vtkIdTypeArray* contourOffsets, vtkIdTypeArray* contourConnectivity)
+{
+  vtkIdType numberOfContours = contourOffsets->GetNumberOfValues() - 1;
+  vtkSmartPointer<vtkCellArray> contourCells = vtkSmartPointer<vtkCellArray>::New();
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  contourCells->SetData(contourOffsets, contourConnectivity);
+#else
+  // The legacy cell array stores the number of points before the point IDs of each cell
+  vtkIdType* offsets = contourOffsets->GetPointer(0);
+  vtkIdType* connectivity = contourConnectivity->GetPointer(0);
+  vtkNew<vtkIdTypeArray> contourLegacyCells;
+  contourLegacyCells->SetNumberOfValues(offsets[numberOfContours] + numberOfContours);
+  vtkIdType* legacyCells = contourLegacyCells->GetPointer(0);
+  for (vtkIdType cellIndex = 0; cellIndex < numberOfContours; ++cellIndex)
+  {
+    vtkIdType numberOfCellPoints = offsets[cellIndex + 1] - offsets[cellIndex];
+    *(legacyCells++) = numberOfCellPoints;
+    legacyCells = std::copy(connectivity + offsets[cellIndex], connectivity + offsets[cellIndex + 1], legacyCells);
+  }
+  contourCells->SetCells(numberOfContours, contourLegacyCells);
+#endif
+
+  // Save contour data into ROI entry
+  vtkSmartPointer<vtkPolyData> roiPolyData = vtkSmartPointer<vtkPolyData>::New();
+  roiPolyData->SetPoints(contourPoints);
+  if (contourPoints->GetNumberOfPoints() == 1)
   {
-    serializedUidList.append(*uidIt);
-    serializedUidList.append(" ");
+    // Point ROI
+    roiPolyData->SetVerts(contourCells);
   }
-  // Strip last space
-  serializedUidList = serializedUidList.substr(0, serializedUidList.size()-1);
-  this->External->SetRTStructureSetReferencedSOPInstanceUIDs(serializedUidList.c_str());
+  else if (contourPoints->GetNumberOfPoints() > 1)
+  {
+    // Contour ROI
+    roiPolyData->SetLines(contourCells);
+  }
+  roiEntry->SetPolyData(roiPolyData);
+  if (contourPoints->GetNumberOfPoints() > 0)
+  {
+    roiPolyData->GetBounds(roiEntry->Bounds.data());
+  }
+}
 
-  return roiEntry;
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::CreateDeferredRoiPolyData(RoiEntry* roiEntry)
+{
+  const std::vector<float>& roiPointsRas = roiEntry->DeferredContourPointsRas;
+  const std::vector<vtkIdType>& contourNumberOfPoints = roiEntry->DeferredContourNumberOfPoints;
+  vtkIdType numberOfPoints = static_cast<vtkIdType>(roiPointsRas.size() / 3);
+  vtkIdType numberOfContours = static_cast<vtkIdType>(contourNumberOfPoints.size());
+
+  vtkSmartPointer<vtkPoints> contourPoints = vtkSmartPointer<vtkPoints>::New();
+  contourPoints->SetNumberOfPoints(numberOfPoints);
+  std::copy(roiPointsRas.begin(), roiPointsRas.end(), static_cast<float*>(contourPoints->GetVoidPointer(0)));
+
+  // Each contour is closed by repeating its first point
+  vtkNew<vtkIdTypeArray> contourOffsets;
+  contourOffsets->SetNumberOfValues(numberOfContours + 1);
+  vtkIdType* offsets = contourOffsets->GetPointer(0);
+  vtkNew<vtkIdTypeArray> contourConnectivity;
+  contourConnectivity->SetNumberOfValues(numberOfPoints + numberOfContours);
+  vtkIdType* connectivity = contourConnectivity->GetPointer(0);
+  offsets[0] = 0;
+  vtkIdType pointId = 0;
+  for (vtkIdType contourIndex = 0; contourIndex < numberOfContours; ++contourIndex)
+  {
+    vtkIdType* contourConnectivityPtr = connectivity + offsets[contourIndex];
+    for (vtkIdType k = 0; k < contourNumberOfPoints[contourIndex]; ++k)
+    {
+      contourConnectivityPtr[k] = pointId + k;
+    }
+    contourConnectivityPtr[contourNumberOfPoints[contourIndex]] = pointId;
+    offsets[contourIndex + 1] = offsets[contourIndex] + contourNumberOfPoints[contourIndex] + 1;
+    pointId += contourNumberOfPoints[contourIndex];
+  }
+
+  // Release the stored points, they are now in the poly data
+  std::vector<float>().swap(roiEntry->DeferredContourPointsRas);
+  std::vector<vtkIdType>().swap(roiEntry->DeferredContourNumberOfPoints);
+  roiEntry->PolyDataDeferred = false;
+
+  this->SetRoiPolyData(roiEntry, contourPoints, contourOffsets, contourConnectivity);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtReader::vtkInternal::ReportRoiLoadMessages(RoiEntry* roiEntry)
+{
+  for (std::vector<std::string>::iterator errorIt = roiEntry->LoadErrors.begin(); errorIt != roiEntry->LoadErrors.end(); ++errorIt)
+  {
+    vtkErrorWithObjectMacro(this->External, << *errorIt);
+  }
+  for (std::vector<std::string>::iterator warningIt = roiEntry->LoadWarnings.begin(); warningIt != roiEntry->LoadWarnings.end(); ++warningIt)
+  {
+    vtkWarningWithObjectMacro(this->External, << *warningIt);
+  }
+  roiEntry->LoadErrors.clear();
+  roiEntry->LoadWarnings.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -2466,6 +2815,9 @@ vtkSlicerDicomRtReader::vtkSlicerDicomRtReader()
   this->LoadRTPlanSuccessful = false;
   this->LoadRTIonPlanSuccessful = false;
   this->LoadRTImageSuccessful = false;
+
+  this->NumberOfThreads = 0;
+  this->LoadRoiContoursOnDemand = false;
 }
 
 //----------------------------------------------------------------------------
@@ -2482,6 +2834,9 @@ vtkSlicerDicomRtReader::~vtkSlicerDicomRtReader()
 void vtkSlicerDicomRtReader::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "LoadRoiContoursOnDemand: " << (this->LoadRoiContoursOnDemand ? "true" : "false") << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -2595,7 +2950,61 @@ vtkPolyData* vtkSlicerDicomRtReader::GetRoiPolyData(unsigned int internalIndex)
     vtkErrorMacro("GetRoiPolyData: Cannot get ROI with internal index: " << internalIndex);
     return nullptr;
   }
-  return this->Internal->RoiSequenceVector[internalIndex].PolyData;
+
+  // Create poly data if it was not created when loading the structure set
+  vtkInternal::RoiEntry& roiEntry = this->Internal->RoiSequenceVector[internalIndex];
+  if (roiEntry.PolyDataDeferred)
+  {
+    this->Internal->CreateDeferredRoiPolyData(&roiEntry);
+  }
+
+  return roiEntry.PolyData;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtReader::IsRoiPolyDataLoaded(unsigned int internalIndex)
+{
+  if (internalIndex >= this->Internal->RoiSequenceVector.size())
+  {
+    vtkErrorMacro("IsRoiPolyDataLoaded: Cannot get ROI with internal index: " << internalIndex);
+    return false;
+  }
+  return !this->Internal->RoiSequenceVector[internalIndex].PolyDataDeferred;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerDicomRtReader::GetRoiNumberOfContours(unsigned int internalIndex)
+{
+  if (internalIndex >= this->Internal->RoiSequenceVector.size())
+  {
+    vtkErrorMacro("GetRoiNumberOfContours: Cannot get ROI with internal index: " << internalIndex);
+    return 0;
+  }
+  return std::max(0, this->Internal->RoiSequenceVector[internalIndex].NumberOfContours);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerDicomRtReader::GetRoiNumberOfPoints(unsigned int internalIndex)
+{
+  if (internalIndex >= this->Internal->RoiSequenceVector.size())
+  {
+    vtkErrorMacro("GetRoiNumberOfPoints: Cannot get ROI with internal index: " << internalIndex);
+    return 0;
+  }
+  return this->Internal->RoiSequenceVector[internalIndex].NumberOfPoints;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtReader::GetRoiBounds(unsigned int internalIndex, double bounds[6])
+{
+  if (internalIndex >= this->Internal->RoiSequenceVector.size())
+  {
+    vtkErrorMacro("GetRoiBounds: Cannot get ROI with internal index: " << internalIndex);
+    return false;
+  }
+  const vtkInternal::RoiEntry& roiEntry = this->Internal->RoiSequenceVector[internalIndex];
+  std::copy(roiEntry.Bounds.begin(), roiEntry.Bounds.end(), bounds);
+  return (roiEntry.NumberOfPoints > 0);
 }
 
 //----------------------------------------------------------------------------
@@ -2963,6 +3372,84 @@ bool vtkSlicerDicomRtReader::GetBeamControlPointScanningSpotSize( unsigned int b
   return false;
 }
 
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtReader::GetBeamControlPointArrays(unsigned int beamNumber, BeamControlPointArrays& arrays)
+{
+  arrays = BeamControlPointArrays();
+
+  vtkInternal::BeamEntry* beam = this->Internal->FindBeamByNumber(beamNumber);
+  if (!beam)
+  {
+    vtkErrorMacro("GetBeamControlPointArrays: Unable to find beam of number" << beamNumber);
+    return false;
+  }
+
+  size_t numberOfControlPoints = beam->ControlPointSequenceVector.size();
+  arrays.GantryAngles.reserve(numberOfControlPoints);
+  arrays.PatientSupportAngles.reserve(numberOfControlPoints);
+  arrays.BeamLimitingDeviceAngles.reserve(numberOfControlPoints);
+  arrays.NominalBeamEnergies.reserve(numberOfControlPoints);
+  arrays.CumulativeMetersetWeights.reserve(numberOfControlPoints);
+  arrays.IsocenterPositionsRas.reserve(numberOfControlPoints * 3);
+  arrays.JawPositions.reserve(numberOfControlPoints * 4);
+  for (const vtkInternal::ControlPointEntry& controlPoint : beam->ControlPointSequenceVector)
+  {
+    arrays.GantryAngles.push_back(controlPoint.GantryAngle);
+    arrays.PatientSupportAngles.push_back(controlPoint.PatientSupportAngle);
+    arrays.BeamLimitingDeviceAngles.push_back(controlPoint.BeamLimitingDeviceAngle);
+    arrays.NominalBeamEnergies.push_back(controlPoint.NominalBeamEnergy);
+    arrays.CumulativeMetersetWeights.push_back(controlPoint.CumulativeMetersetWeight);
+    arrays.IsocenterPositionsRas.insert(arrays.IsocenterPositionsRas.end(),
+      controlPoint.IsocenterPositionRas.begin(), controlPoint.IsocenterPositionRas.end());
+    arrays.JawPositions.insert(arrays.JawPositions.end(),
+      controlPoint.JawPositions.begin(), controlPoint.JawPositions.end());
+  }
+
+  // MLC leaf positions, with the same validity checks as GetBeamControlPointMultiLeafCollimatorPositions
+  unsigned int numberOfLeafPairs = beam->MultiLeafCollimator.NumberOfLeafJawPairs;
+  if ( !beam->MultiLeafCollimatorType.empty() && numberOfLeafPairs
+    && beam->MultiLeafCollimator.LeafPositionBoundary.size() == numberOfLeafPairs + 1 )
+  {
+    arrays.MultiLeafCollimatorType = beam->MultiLeafCollimatorType;
+    arrays.LeafPositionBoundaries = beam->MultiLeafCollimator.LeafPositionBoundary;
+    arrays.LeafPositions.reserve(numberOfControlPoints * numberOfLeafPairs * 2);
+    for (const vtkInternal::ControlPointEntry& controlPoint : beam->ControlPointSequenceVector)
+    {
+      if ( controlPoint.MultiLeafCollimatorType == beam->MultiLeafCollimatorType
+        && controlPoint.LeafPositions.size() == numberOfLeafPairs * 2 )
+      {
+        arrays.LeafPositions.insert(arrays.LeafPositions.end(), controlPoint.LeafPositions.begin(), controlPoint.LeafPositions.end());
+      }
+      else
+      {
+        arrays.LeafPositions.insert(arrays.LeafPositions.end(), numberOfLeafPairs * 2, std::numeric_limits<double>::quiet_NaN());
+      }
+    }
+  }
+
+  // Scan spots, with the same validity checks as GetBeamControlPointScanSpotParameters and GetBeamControlPointScanningSpotSize
+  bool modulatedScanMode = (beam->ScanMode == "MODULATED" || beam->ScanMode == "MODULATED_SPEC");
+  arrays.ScanningSpotSizes.reserve(numberOfControlPoints * 2);
+  arrays.ScanSpotOffsets.reserve(numberOfControlPoints + 1);
+  for (const vtkInternal::ControlPointEntry& controlPoint : beam->ControlPointSequenceVector)
+  {
+    arrays.ScanningSpotSizes.push_back(modulatedScanMode ? controlPoint.ScanningSpotSize[0] : 0.0f);
+    arrays.ScanningSpotSizes.push_back(modulatedScanMode ? controlPoint.ScanningSpotSize[1] : 0.0f);
+    arrays.ScanSpotOffsets.push_back(arrays.ScanSpotMetersetWeights.size());
+    size_t numberOfSpots = controlPoint.NumberOfScanSpotPositions;
+    if ( numberOfSpots && controlPoint.ScanSpotPositionMap.size() == numberOfSpots * 2
+      && controlPoint.ScanSpotMetersetWeights.size() == numberOfSpots )
+    {
+      arrays.ScanSpotPositionMap.insert(arrays.ScanSpotPositionMap.end(),
+        controlPoint.ScanSpotPositionMap.begin(), controlPoint.ScanSpotPositionMap.end());
+      arrays.ScanSpotMetersetWeights.insert(arrays.ScanSpotMetersetWeights.end(),
+        controlPoint.ScanSpotMetersetWeights.begin(), controlPoint.ScanSpotMetersetWeights.end());
+    }
+  }
+  arrays.ScanSpotOffsets.push_back(arrays.ScanSpotMetersetWeights.size());
+  return true;
+}
+
 //----------------------------------------------------------------------------
 double vtkSlicerDicomRtReader::GetBeamSourceToMultiLeafCollimatorDistance(unsigned int beamNumber)
 {
@@ -3069,3 +3556,183 @@ bool vtkSlicerDicomRtReader::GetChannelControlPoint(
   controlPointPosition[2] = channel->ControlPointVector[controlPointNumber][2];
   return true;
 }
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtReader::ReadDoseImageData(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix)
+{
+  if (!doseImageData || !ijkToRasMatrix || !this->FileName)
+  {
+    vtkErrorMacro("ReadDoseImageData: Invalid input arguments");
+    return false;
+  }
+
+  // Elements longer than the maximum read length (such as the pixel data) are not loaded, only their position in the file is stored
+  DcmFileFormat fileformat;
+  if (fileformat.loadFile(this->FileName, EXS_Unknown, EGL_noChange, DCM_MaxReadLength).bad())
+  {
+    vtkErrorMacro("ReadDoseImageData: Failed to read file '" << this->FileName << "'");
+    return false;
+  }
+  DcmDataset* dataset = fileformat.getDataset();
+  if (DcmXfer(dataset->getOriginalXfer()).isEncapsulated())
+  {
+    vtkDebugMacro("ReadDoseImageData: Pixel data is encapsulated in file '" << this->FileName << "'");
+    return false;
+  }
+
+  // Pixel description
+  Uint16 rows = 0;
+  Uint16 columns = 0;
+  Uint16 samplesPerPixel = 1;
+  Uint16 bitsAllocated = 0;
+  Uint16 pixelRepresentation = 0;
+  Sint32 numberOfFrames = 1;
+  dataset->findAndGetUint16(DCM_Rows, rows);
+  dataset->findAndGetUint16(DCM_Columns, columns);
+  dataset->findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel);
+  dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated);
+  dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+  if (dataset->findAndGetSint32(DCM_NumberOfFrames, numberOfFrames).bad())
+  {
+    numberOfFrames = 1;
+  }
+  if (rows == 0 || columns == 0 || numberOfFrames < 1 || samplesPerPixel != 1 || (bitsAllocated != 16 && bitsAllocated != 32))
+  {
+    vtkDebugMacro("ReadDoseImageData: Unsupported pixel format in file '" << this->FileName << "'");
+    return false;
+  }
+  DcmElement* pixelDataElement = nullptr;
+  vtkIdType numberOfPixelsPerFrame = static_cast<vtkIdType>(rows) * columns;
+  Uint32 frameLength = static_cast<Uint32>(numberOfPixelsPerFrame * (bitsAllocated / 8));
+  if ( dataset->findAndGetElement(DCM_PixelData, pixelDataElement).bad() || !pixelDataElement
+    || static_cast<vtkTypeUInt64>(frameLength) * numberOfFrames > pixelDataElement->getLength() )
+  {
+    vtkErrorMacro("ReadDoseImageData: Missing or incomplete pixel data in file '" << this->FileName << "'");
+    return false;
+  }
+
+  // Geometry (in LPS)
+  Float64 imagePositionPatient[3] = { 0.0, 0.0, 0.0 };
+  Float64 imageOrientationPatient[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  Float64 pixelSpacing[2] = { 0.0, 0.0 };
+  bool geometryValid = true;
+  for (unsigned long index = 0; index < 6; ++index)
+  {
+    geometryValid &= dataset->findAndGetFloat64(DCM_ImageOrientationPatient, imageOrientationPatient[index], index).good();
+    if (index < 3)
+    {
+      geometryValid &= dataset->findAndGetFloat64(DCM_ImagePositionPatient, imagePositionPatient[index], index).good();
+    }
+    if (index < 2)
+    {
+      geometryValid &= dataset->findAndGetFloat64(DCM_PixelSpacing, pixelSpacing[index], index).good();
+    }
+  }
+  // Frame positions along the normal of the image plane, relative to the first frame
+  std::vector<Float64> gridFrameOffsets(numberOfFrames, 0.0);
+  for (Sint32 frame = 0; frame < numberOfFrames && numberOfFrames > 1; ++frame)
+  {
+    geometryValid &= dataset->findAndGetFloat64(DCM_GridFrameOffsetVector, gridFrameOffsets[frame], frame).good();
+  }
+  if (!geometryValid)
+  {
+    vtkErrorMacro("ReadDoseImageData: Failed to get image geometry from file '" << this->FileName << "'");
+    return false;
+  }
+  double sliceSpacing = 1.0;
+  if (numberOfFrames > 1)
+  {
+    sliceSpacing = (gridFrameOffsets[numberOfFrames - 1] - gridFrameOffsets[0]) / (numberOfFrames - 1);
+    for (Sint32 frame = 1; frame < numberOfFrames; ++frame)
+    {
+      if (std::fabs(gridFrameOffsets[frame] - gridFrameOffsets[0] - frame * sliceSpacing) > 0.001 * std::fabs(sliceSpacing))
+      {
+        vtkWarningMacro("ReadDoseImageData: Frames are not evenly spaced in file '" << this->FileName << "', using average spacing " << sliceSpacing);
+        break;
+      }
+    }
+  }
+  else
+  {
+    Float64 sliceThickness = 0.0;
+    if (dataset->findAndGetFloat64(DCM_SliceThickness, sliceThickness).good() && sliceThickness > 0.0)
+    {
+      sliceSpacing = sliceThickness;
+    }
+  }
+  if (sliceSpacing == 0.0)
+  {
+    vtkErrorMacro("ReadDoseImageData: Invalid frame offsets in file '" << this->FileName << "'");
+    return false;
+  }
+
+  // Columns follow the I axis, rows the J axis, and frames the K axis (along the normal of the image plane)
+  double rowDirectionLps[3] = { imageOrientationPatient[0], imageOrientationPatient[1], imageOrientationPatient[2] };
+  double columnDirectionLps[3] = { imageOrientationPatient[3], imageOrientationPatient[4], imageOrientationPatient[5] };
+  double sliceNormalLps[3] = { 0.0, 0.0, 0.0 };
+  vtkMath::Cross(rowDirectionLps, columnDirectionLps, sliceNormalLps);
+  ijkToRasMatrix->Identity();
+  for (int i = 0; i < 3; ++i)
+  {
+    // LPS to RAS conversion
+    double lpsToRas = (i < 2 ? -1.0 : 1.0);
+    ijkToRasMatrix->SetElement(i, 0, lpsToRas * rowDirectionLps[i] * pixelSpacing[1]);
+    ijkToRasMatrix->SetElement(i, 1, lpsToRas * columnDirectionLps[i] * pixelSpacing[0]);
+    ijkToRasMatrix->SetElement(i, 2, lpsToRas * sliceNormalLps[i] * sliceSpacing);
+    ijkToRasMatrix->SetElement(i, 3, lpsToRas * imagePositionPatient[i]);
+  }
+
+  // Dose grid scaling, as read (or defaulted) by LoadRTDose
+  if (!this->DoseGridScaling)
+  {
+    vtkErrorMacro("ReadDoseImageData: Dose grid scaling is not set, the RT Dose file needs to be loaded first");
+    return false;
+  }
+  double doseGridScaling = vtkVariant(this->DoseGridScaling).ToDouble();
+
+  // Read frames into the output buffer and scale them
+  doseImageData->SetExtent(0, columns - 1, 0, rows - 1, 0, numberOfFrames - 1);
+  doseImageData->SetOrigin(0.0, 0.0, 0.0);
+  doseImageData->SetSpacing(1.0, 1.0, 1.0);
+  doseImageData->AllocateScalars(VTK_FLOAT, 1);
+  float* doseValues = static_cast<float*>(doseImageData->GetScalarPointer());
+  std::vector<Uint32> frameBuffer((frameLength + 3) / 4);
+  DcmFileCache fileCache;
+  // The pixel data element (OW) would only be swapped in 16-bit words, so the frames are read in the byte order
+  // of the file and the pixels are swapped with their actual size
+  E_ByteOrder fileByteOrder = DcmXfer(dataset->getOriginalXfer()).getByteOrder();
+  for (Sint32 frame = 0; frame < numberOfFrames; ++frame)
+  {
+    if (pixelDataElement->getPartialValue(frameBuffer.data(), frame * frameLength, frameLength, &fileCache, fileByteOrder).bad())
+    {
+      vtkErrorMacro("ReadDoseImageData: Failed to read frame " << frame << " from file '" << this->FileName << "'");
+      return false;
+    }
+    swapIfNecessary(gLocalByteOrder, fileByteOrder, frameBuffer.data(), frameLength, bitsAllocated / 8);
+    float* frameDoseValues = doseValues + frame * numberOfPixelsPerFrame;
+    if (bitsAllocated == 16)
+    {
+      if (pixelRepresentation == 0)
+      {
+        ScalePixelValuesToDose(reinterpret_cast<const Uint16*>(frameBuffer.data()), numberOfPixelsPerFrame, doseGridScaling, frameDoseValues);
+      }
+      else
+      {
+        ScalePixelValuesToDose(reinterpret_cast<const Sint16*>(frameBuffer.data()), numberOfPixelsPerFrame, doseGridScaling, frameDoseValues);
+      }
+    }
+    else
+    {
+      if (pixelRepresentation == 0)
+      {
+        ScalePixelValuesToDose(reinterpret_cast<const Uint32*>(frameBuffer.data()), numberOfPixelsPerFrame, doseGridScaling, frameDoseValues);
+      }
+      else
+      {
+        ScalePixelValuesToDose(reinterpret_cast<const Sint32*>(frameBuffer.data()), numberOfPixelsPerFrame, doseGridScaling, frameDoseValues);
+      }
+    }
+  }
+
+  return true;
+}
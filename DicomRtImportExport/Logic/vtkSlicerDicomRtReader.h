@@ -38,11 +38,45 @@
 // STD includes
 #include <vector>
 
+class vtkImageData;
+class vtkMatrix4x4;
 class vtkPolyData;
 
 /// \ingroup SlicerRt_QtModules_DicomRtImport
 class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerDicomRtReader : public vtkSlicerDicomReaderBase
 {
+public:
+  /// Attributes of all control points of a beam. Each attribute is stored contiguously,
+  /// with one value (or tuple) per control point in control point order
+  struct BeamControlPointArrays
+  {
+    std::vector<double> GantryAngles;
+    std::vector<double> PatientSupportAngles;
+    std::vector<double> BeamLimitingDeviceAngles;
+    std::vector<double> NominalBeamEnergies;
+    std::vector<double> CumulativeMetersetWeights;
+    /// Three values (R, A, S) per control point
+    std::vector<double> IsocenterPositionsRas;
+    /// Four values (X1, X2, Y1, Y2) per control point
+    std::vector<double> JawPositions;
+    /// MLC type ("MLCX" or "MLCY"), empty if the beam has no MLC with consistent leaf pair boundaries
+    std::string MultiLeafCollimatorType;
+    /// Leaf pair boundaries of the MLC (number of leaf pairs + 1 values)
+    std::vector<double> LeafPositionBoundaries;
+    /// Leaf positions (two values per leaf pair) per control point. NaN for control points without valid
+    /// MLC data (see \sa GetBeamControlPointMultiLeafCollimatorPositions)
+    std::vector<double> LeafPositions;
+    /// Two values (X, Y) per control point, zero if the beam is not a modulated ion beam
+    std::vector<float> ScanningSpotSizes;
+    /// Index of the first scan spot of each control point, followed by the total number of scan spots.
+    /// Control points without valid scan spot data (see \sa GetBeamControlPointScanSpotParameters) have no spots
+    std::vector<size_t> ScanSpotOffsets;
+    /// Two values (X, Y) per scan spot of all control points
+    std::vector<float> ScanSpotPositionMap;
+    /// One value per scan spot of all control points
+    std::vector<float> ScanSpotMetersetWeights;
+  };
+
 public:
   static vtkSlicerDicomRtReader *New();
   vtkTypeMacro(vtkSlicerDicomRtReader, vtkSlicerDicomReaderBase);
@@ -63,10 +97,28 @@ public:
   /// \param internalIndex Internal index of ROI to get
   double* GetRoiDisplayColor(unsigned int internalIndex);
 
-  /// Get model of a certain ROI by internal index
+  /// Get model of a certain ROI by internal index.
+  /// If the structure set was loaded with \sa LoadRoiContoursOnDemand, then the poly data is created at the first call
   /// \param internalIndex Internal index of ROI to get
   vtkPolyData* GetRoiPolyData(unsigned int internalIndex);
 
+  /// Determine whether the poly data of a certain ROI has been created (see \sa LoadRoiContoursOnDemand)
+  /// \param internalIndex Internal index of ROI to get
+  bool IsRoiPolyDataLoaded(unsigned int internalIndex);
+
+  /// Get number of contours of a certain ROI by internal index. Available without creating the poly data
+  /// \param internalIndex Internal index of ROI to get
+  int GetRoiNumberOfContours(unsigned int internalIndex);
+
+  /// Get number of contour points of a certain ROI by internal index. Available without creating the poly data
+  /// \param internalIndex Internal index of ROI to get
+  vtkIdType GetRoiNumberOfPoints(unsigned int internalIndex);
+
+  /// Get bounding box (RAS) of a certain ROI by internal index. Available without creating the poly data
+  /// \param internalIndex Internal index of ROI to get
+  /// \return False if the ROI has no contour points
+  bool GetRoiBounds(unsigned int internalIndex, double bounds[6]);
+
   /// Get referenced series UID for a certain ROI by internal index
   /// \param internalIndex Internal index of ROI to get
   const char* GetRoiReferencedSeriesUid(unsigned int internalIndex);
@@ -145,6 +197,14 @@ public:
   bool GetBeamControlPointScanningSpotSize( unsigned int beamNumber, 
     unsigned int controlPointIndex, std::array< float, 2 >& ScanSpotSize);
 
+  /// Get the attributes of all control points of a beam in one call, including the MLC leaf positions and the scan spots.
+  /// Faster than calling the per control point getters for plans with many control points (e.g. VMAT arcs).
+  /// Invalid MLC and scan spot data is skipped without the messages logged by the per control point getters
+  /// \param arrays Structure in which the attributes are copied. Contains all control points read from the
+  ///   plan, even if \sa GetBeamNumberOfControlPoints returns 0 because there is only one
+  /// \return true if the beam is found, false otherwise
+  bool GetBeamControlPointArrays(unsigned int beamNumber, BeamControlPointArrays& arrays);
+
   /// Get source to beam limiting device distance (MLC) for a given beam of RTPlan
   /// or isocenter to beam limiting device distance (MLC) for a given beam of RTIonPlan
   /// \param beamNumber - number of a beam
@@ -202,6 +262,15 @@ public:
   /// Set dose grid scaling
   vtkSetStringMacro(DoseGridScaling);
 
+  /// Read the voxels of the RT Dose file set as \sa FileName into a float image, multiplied by the dose grid scaling.
+  /// The scaling is taken from \sa DoseGridScaling, so the file needs to be loaded by \sa Update first.
+  /// The frames are read from the file one by one directly into the output buffer, so the pixel data is not loaded
+  /// into memory as a whole, and no intermediate volume is created. Only uncompressed pixel data is supported.
+  /// \param doseImageData Output image, with zero origin and unit spacing (the geometry is returned in ijkToRasMatrix)
+  /// \param ijkToRasMatrix Output geometry of the dose volume
+  /// \return Success flag. False if the file cannot be read this way (e.g. compressed pixel data)
+  bool ReadDoseImageData(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix);
+
   /// Get RT Plan SOP instance UID referenced by RT Dose
   vtkGetStringMacro(RTDoseReferencedRTPlanSOPInstanceUID);
   /// Set RT Plan SOP instance UID referenced by RT Dose
@@ -289,6 +358,17 @@ public:
   /// Get load image successful flag
   vtkGetMacro(LoadRTImageSuccessful, bool);
 
+  /// Get number of threads reading the ROI contours of a structure set
+  vtkGetMacro(NumberOfThreads, int);
+  /// Set number of threads reading the ROI contours of a structure set
+  vtkSetMacro(NumberOfThreads, int);
+
+  /// Get flag determining whether the ROI poly data is only created when first requested
+  vtkGetMacro(LoadRoiContoursOnDemand, bool);
+  /// Set flag determining whether the ROI poly data is only created when first requested
+  vtkSetMacro(LoadRoiContoursOnDemand, bool);
+  vtkBooleanMacro(LoadRoiContoursOnDemand, bool);
+
 protected:
   /// Set pixel spacing for dose volume
   vtkSetVector2Macro(PixelSpacing, double);
@@ -370,6 +450,18 @@ protected:
   /// Flag indicating if RT Image has been successfully read from the input dataset
   bool LoadRTImageSuccessful;
 
+  /// Number of threads reading the ROI contours of a structure set concurrently.
+  /// 0 by default, meaning the number of threads of the vtkSMPTools backend (see vtkSlicerRtCommon::GetNumberOfWorkerThreads).
+  /// The progress of reading the ROIs is reported on the calling thread by vtkCommand::ProgressEvent
+  /// (progress between 0 and 1 as call data)
+  int NumberOfThreads;
+
+  /// Flag determining whether the poly data of the structure set ROIs is only created when first requested
+  /// by \sa GetRoiPolyData. If on, then loading the structure set only stores the contour points (RAS) and the
+  /// number of points of each contour, and computes the bounds, number of contours and referenced instances.
+  /// The parsed structure set is released after loading in both cases. Off by default
+  bool LoadRoiContoursOnDemand;
+
 protected:
   vtkSlicerDicomRtReader();
   ~vtkSlicerDicomRtReader() override;
@@ -19,19 +19,30 @@
 
 ==============================================================================*/
 
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include <string>
 #include <vector>
 
 // DicomRtExport includes
 #include "vtkSlicerDicomRtWriter.h"
 
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
 // VTK includes
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkSmartPointer.h>
 #include <vtkPolyData.h>
 #include <vtkCell.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
 #include <vtkPoints.h>
+#include <vtkVariant.h>
 
 // ITK includes
 #include "itkImage.h"
@@ -39,6 +50,12 @@
 // DCMTK includes
 #include "dcmtk/config/osconfig.h" // make sure OS specific configuration is included first
 #include "dcmtk/ofstd/ofconapp.h"
+#include "dcmtk/dcmdata/dcdeftag.h"
+#include "dcmtk/dcmdata/dcfilefo.h"
+#include "dcmtk/dcmdata/dcpixel.h"
+#include "dcmtk/dcmdata/dcuid.h"
+#include "dcmtk/dcmdata/dcvrda.h"
+#include "dcmtk/dcmdata/dcvrtm.h"
 #include "dcmtk/dcmrt/drtdose.h"
 #include "dcmtk/dcmrt/drtimage.h"
 #include "dcmtk/dcmrt/drtplan.h"
@@ -53,6 +70,45 @@
 #include "rtss_roi.h"
 #include "rtss_contour.h"
 
+//----------------------------------------------------------------------------
+// Maximum stored value of the 32-bit unsigned RT dose pixels
+static const double DOSE_PIXEL_VALUE_MAX = 4294967295.0;
+
+//----------------------------------------------------------------------------
+// Format numbers into a multi-valued decimal string (DS) element value.
+// Eight significant digits keep each value within the 16 character limit of DS
+static std::string FormatDecimalStringValues(const double* values, int numberOfValues)
+{
+  std::ostringstream valuesStream;
+  valuesStream.precision(8);
+  for (int index = 0; index < numberOfValues; ++index)
+  {
+    if (index > 0)
+    {
+      valuesStream << "\\";
+    }
+    // Avoid writing negative zero
+    valuesStream << (values[index] == 0.0 ? 0.0 : values[index]);
+  }
+  return valuesStream.str();
+}
+
+//----------------------------------------------------------------------------
+// Store dose voxel values as unsigned 32-bit pixel values: pixel = dose / doseGridScaling.
+// DCMTK keeps pixel data as 16-bit words (OW) in host byte order and only swaps the bytes within the words,
+// so each pixel is split into two words explicitly, the less significant first (as in little endian files)
+template <class T>
+static void ScaleDoseToPixelValues(const T* doseValues, vtkIdType numberOfVoxels, double doseGridScaling, Uint16* pixelWords)
+{
+  for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    double pixelValue = std::floor(static_cast<double>(doseValues[voxelIndex]) / doseGridScaling + 0.5);
+    Uint32 pixel = static_cast<Uint32>(std::max(0.0, std::min(pixelValue, DOSE_PIXEL_VALUE_MAX)));
+    pixelWords[2 * voxelIndex] = static_cast<Uint16>(pixel & 0xFFFF);
+    pixelWords[2 * voxelIndex + 1] = static_cast<Uint16>(pixel >> 16);
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDicomRtWriter);
 
@@ -74,6 +130,7 @@ vtkSlicerDicomRtWriter::vtkSlicerDicomRtWriter()
 
   this->DoseSeriesDescription = nullptr;
   this->DoseSeriesNumber = nullptr;
+  this->DoseReferencedRTPlanSOPInstanceUID = nullptr;
 
   this->RtssSeriesDescription = nullptr;
   this->RtssSeriesNumber = nullptr;
@@ -181,7 +238,341 @@ void vtkSlicerDicomRtWriter::AddStructure(const char *name, double *color,
 }
 
 //----------------------------------------------------------------------------
-void vtkSlicerDicomRtWriter::Write()
+void vtkSlicerDicomRtWriter::SetDoseImageData(vtkOrientedImageData* doseImageData)
+{
+  this->DoseImageData = doseImageData;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtWriter::AddStructureContours(const char* name, double* color, vtkPolyData* contours, const std::vector<int>& contourSliceNumbers)
+{
+  if (!contours || contourSliceNumbers.size() != static_cast<size_t>(contours->GetNumberOfCells()))
+  {
+    vtkErrorMacro("AddStructureContours: Invalid contours arguments!");
+    return;
+  }
+
+  ContourStructure structure;
+  structure.Name = (name ? name : "");
+  for (int i = 0; i < 3; ++i)
+  {
+    structure.Color[i] = color[i];
+  }
+  structure.Contours = contours;
+  structure.ContourSliceNumbers = contourSliceNumbers;
+  this->ContourStructures.push_back(structure);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerDicomRtWriter::AddCommonAttributes(DcmItem* dataset, const char* modality, const char* seriesDescription, const char* seriesNumber)
+{
+  Rt_study_metadata::Pointer& rt_metadata = this->RtStudy.get_rt_study_metadata();
+
+  OFString currentDate;
+  OFString currentTime;
+  DcmDate::getCurrentDate(currentDate);
+  DcmTime::getCurrentTime(currentTime);
+  char seriesInstanceUid[100];
+  dcmGenerateUniqueIdentifier(seriesInstanceUid, SITE_SERIES_UID_ROOT);
+
+  // Patient
+  dataset->putAndInsertString(DCM_PatientName, this->PatientName ? this->PatientName : "");
+  dataset->putAndInsertString(DCM_PatientID, this->PatientID ? this->PatientID : "");
+  dataset->putAndInsertString(DCM_PatientBirthDate, "");
+  dataset->putAndInsertString(DCM_PatientSex, this->PatientSex ? this->PatientSex : "");
+
+  // Study (same as the anatomical image written by Plastimatch)
+  dataset->putAndInsertString(DCM_StudyInstanceUID, rt_metadata->get_study_uid());
+  dataset->putAndInsertString(DCM_StudyDate, rt_metadata->get_study_date().c_str());
+  dataset->putAndInsertString(DCM_StudyTime, rt_metadata->get_study_time().c_str());
+  dataset->putAndInsertString(DCM_ReferringPhysicianName, "");
+  dataset->putAndInsertString(DCM_StudyID, this->StudyID ? this->StudyID : "");
+  dataset->putAndInsertString(DCM_AccessionNumber, "");
+  if (this->StudyDescription && this->StudyDescription[0] != 0)
+  {
+    dataset->putAndInsertString(DCM_StudyDescription, this->StudyDescription);
+  }
+
+  // Series
+  dataset->putAndInsertString(DCM_Modality, modality);
+  dataset->putAndInsertString(DCM_SeriesInstanceUID, seriesInstanceUid);
+  dataset->putAndInsertString(DCM_SeriesNumber, seriesNumber ? seriesNumber : "");
+  if (seriesDescription && seriesDescription[0] != 0)
+  {
+    dataset->putAndInsertString(DCM_SeriesDescription, seriesDescription);
+  }
+  dataset->putAndInsertString(DCM_Manufacturer, "SlicerRT");
+  dataset->putAndInsertString(DCM_InstanceCreationDate, currentDate.c_str());
+  dataset->putAndInsertString(DCM_InstanceCreationTime, currentTime.c_str());
+  dataset->putAndInsertString(DCM_InstanceNumber, "1");
+
+  // Frame of reference
+  dataset->putAndInsertString(DCM_FrameOfReferenceUID, rt_metadata->get_frame_of_reference_uid());
+  dataset->putAndInsertString(DCM_PositionReferenceIndicator, "");
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtWriter::WriteDoseImageData()
+{
+  vtkOrientedImageData* doseImage = this->DoseImageData;
+  if (!doseImage->GetPointData() || !doseImage->GetPointData()->GetScalars() || doseImage->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("WriteDoseImageData: Dose image must have single component scalars");
+    return false;
+  }
+  int* extent = doseImage->GetExtent();
+  int dimensions[3] = { extent[1] - extent[0] + 1, extent[3] - extent[2] + 1, extent[5] - extent[4] + 1 };
+  if (dimensions[0] < 1 || dimensions[1] < 1 || dimensions[2] < 1 || dimensions[0] > 65535 || dimensions[1] > 65535)
+  {
+    vtkErrorMacro("WriteDoseImageData: Invalid dose image dimensions " << dimensions[0] << "x" << dimensions[1] << "x" << dimensions[2]);
+    return false;
+  }
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  // Geometry in LPS. Columns of DICOM pixels follow the I axis, rows the J axis, and frames the K axis of the image
+  vtkNew<vtkMatrix4x4> ijkToRasMatrix;
+  doseImage->GetImageToWorldMatrix(ijkToRasMatrix);
+  double firstVoxelPositionRas[4] = { static_cast<double>(extent[0]), static_cast<double>(extent[2]), static_cast<double>(extent[4]), 1.0 };
+  ijkToRasMatrix->MultiplyPoint(firstVoxelPositionRas, firstVoxelPositionRas);
+  double firstVoxelPositionLps[3] = { -firstVoxelPositionRas[0], -firstVoxelPositionRas[1], firstVoxelPositionRas[2] };
+  double axisDirectionsLps[3][3] = { { 0.0 } };
+  double axisSpacings[3] = { 0.0 };
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    double axisVectorLps[3] = { -ijkToRasMatrix->GetElement(0, axis), -ijkToRasMatrix->GetElement(1, axis), ijkToRasMatrix->GetElement(2, axis) };
+    axisSpacings[axis] = vtkMath::Norm(axisVectorLps);
+    if (axisSpacings[axis] <= 0.0)
+    {
+      vtkErrorMacro("WriteDoseImageData: Invalid dose image geometry");
+      return false;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      axisDirectionsLps[axis][i] = axisVectorLps[i] / axisSpacings[axis];
+    }
+  }
+  double imageOrientationPatient[6] = { axisDirectionsLps[0][0], axisDirectionsLps[0][1], axisDirectionsLps[0][2],
+    axisDirectionsLps[1][0], axisDirectionsLps[1][1], axisDirectionsLps[1][2] };
+  double pixelSpacing[2] = { axisSpacings[1], axisSpacings[0] };
+  // Frame offsets are measured along the normal of the image plane, which may be opposite to the K axis
+  double sliceNormalLps[3] = { 0.0 };
+  vtkMath::Cross(axisDirectionsLps[0], axisDirectionsLps[1], sliceNormalLps);
+  double frameOffsetIncrement = axisSpacings[2] * vtkMath::Dot(axisDirectionsLps[2], sliceNormalLps);
+  std::vector<double> gridFrameOffsets(dimensions[2], 0.0);
+  for (int frame = 0; frame < dimensions[2]; ++frame)
+  {
+    gridFrameOffsets[frame] = frame * frameOffsetIncrement;
+  }
+
+  // Scale the dose so that the maximum is stored as the largest pixel value.
+  // The scaling is parsed back from its decimal string so that pixels are computed with the exact written value
+  double doseRange[2] = { 0.0, 0.0 };
+  doseImage->GetScalarRange(doseRange);
+  if (doseRange[0] < 0.0)
+  {
+    vtkWarningMacro("WriteDoseImageData: Dose image contains negative values (minimum " << doseRange[0] << "), they are written as 0");
+  }
+  double doseGridScaling = (doseRange[1] > 0.0 ? doseRange[1] / DOSE_PIXEL_VALUE_MAX : 1.0);
+  std::string doseGridScalingString = FormatDecimalStringValues(&doseGridScaling, 1);
+  doseGridScaling = vtkVariant(doseGridScalingString).ToDouble();
+  // The pixels are written directly into the buffer of the pixel data element
+  DcmPixelData* pixelData = new DcmPixelData(DCM_PixelData);
+  Uint16* pixelWords = nullptr;
+  if (pixelData->createUint16Array(static_cast<Uint32>(2 * numberOfVoxels), pixelWords).bad() || !pixelWords)
+  {
+    vtkErrorMacro("WriteDoseImageData: Failed to allocate pixel data for " << numberOfVoxels << " voxels");
+    delete pixelData;
+    return false;
+  }
+  switch (doseImage->GetScalarType())
+  {
+    vtkTemplateMacro(ScaleDoseToPixelValues(static_cast<VTK_TT*>(doseImage->GetScalarPointer()), numberOfVoxels, doseGridScaling, pixelWords));
+    default:
+      vtkErrorMacro("WriteDoseImageData: Unsupported dose image scalar type " << doseImage->GetScalarTypeAsString());
+      delete pixelData;
+      return false;
+  }
+
+  // Assemble dataset
+  DcmFileFormat fileFormat;
+  DcmDataset* dataset = fileFormat.getDataset();
+  char sopInstanceUid[100];
+  dcmGenerateUniqueIdentifier(sopInstanceUid, SITE_INSTANCE_UID_ROOT);
+  dataset->putAndInsertString(DCM_SOPClassUID, UID_RTDoseStorage);
+  dataset->putAndInsertString(DCM_SOPInstanceUID, sopInstanceUid);
+  this->AddCommonAttributes(dataset, "RTDOSE", this->DoseSeriesDescription, this->DoseSeriesNumber);
+
+  dataset->putAndInsertString(DCM_ImagePositionPatient, FormatDecimalStringValues(firstVoxelPositionLps, 3).c_str());
+  dataset->putAndInsertString(DCM_ImageOrientationPatient, FormatDecimalStringValues(imageOrientationPatient, 6).c_str());
+  dataset->putAndInsertString(DCM_PixelSpacing, FormatDecimalStringValues(pixelSpacing, 2).c_str());
+  dataset->putAndInsertString(DCM_SliceThickness, FormatDecimalStringValues(axisSpacings + 2, 1).c_str());
+  dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+  dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+  dataset->putAndInsertUint16(DCM_Rows, static_cast<Uint16>(dimensions[1]));
+  dataset->putAndInsertUint16(DCM_Columns, static_cast<Uint16>(dimensions[0]));
+  dataset->putAndInsertUint16(DCM_BitsAllocated, 32);
+  dataset->putAndInsertUint16(DCM_BitsStored, 32);
+  dataset->putAndInsertUint16(DCM_HighBit, 31);
+  dataset->putAndInsertUint16(DCM_PixelRepresentation, 0);
+  dataset->putAndInsertString(DCM_NumberOfFrames, vtkVariant(dimensions[2]).ToString().c_str());
+  dataset->putAndInsertTagKey(DCM_FrameIncrementPointer, DCM_GridFrameOffsetVector);
+  dataset->putAndInsertString(DCM_GridFrameOffsetVector, FormatDecimalStringValues(gridFrameOffsets.data(), dimensions[2]).c_str());
+  dataset->putAndInsertString(DCM_DoseUnits, "GY");
+  dataset->putAndInsertString(DCM_DoseType, "PHYSICAL");
+  if (this->DoseReferencedRTPlanSOPInstanceUID && this->DoseReferencedRTPlanSOPInstanceUID[0] != 0)
+  {
+    dataset->putAndInsertString(DCM_DoseSummationType, "PLAN");
+    DcmItem* referencedPlanItem = nullptr;
+    dataset->findOrCreateSequenceItem(DCM_ReferencedRTPlanSequence, referencedPlanItem, -2);
+    referencedPlanItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_RTPlanStorage);
+    referencedPlanItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, this->DoseReferencedRTPlanSOPInstanceUID);
+  }
+  else
+  {
+    // The referenced RT plan sequence is required for all other summation types that do not reference a treatment record
+    dataset->putAndInsertString(DCM_DoseSummationType, "PLAN_OVERVIEW");
+  }
+  dataset->putAndInsertString(DCM_DoseGridScaling, doseGridScalingString.c_str());
+  dataset->insert(pixelData, true);
+
+  std::string doseFilePath = std::string(this->FileName) + "/dose.dcm";
+  OFCondition result = fileFormat.saveFile(doseFilePath.c_str(), EXS_LittleEndianExplicit);
+  if (result.bad())
+  {
+    vtkErrorMacro("WriteDoseImageData: Failed to write RT dose file '" << doseFilePath << "': " << result.text());
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtWriter::WriteStructureContours()
+{
+  Rt_study_metadata::Pointer& rt_metadata = this->RtStudy.get_rt_study_metadata();
+  int numberOfSlices = static_cast<int>(rt_metadata->num_slices());
+
+  DcmFileFormat fileFormat;
+  DcmDataset* dataset = fileFormat.getDataset();
+  char sopInstanceUid[100];
+  dcmGenerateUniqueIdentifier(sopInstanceUid, SITE_INSTANCE_UID_ROOT);
+  dataset->putAndInsertString(DCM_SOPClassUID, UID_RTStructureSetStorage);
+  dataset->putAndInsertString(DCM_SOPInstanceUID, sopInstanceUid);
+  this->AddCommonAttributes(dataset, "RTSTRUCT", this->RtssSeriesDescription, this->RtssSeriesNumber);
+  // Frame of reference is only referenced in structure sets
+  dataset->findAndDeleteElement(DCM_FrameOfReferenceUID);
+  dataset->findAndDeleteElement(DCM_PositionReferenceIndicator);
+
+  OFString currentDate;
+  OFString currentTime;
+  DcmDate::getCurrentDate(currentDate);
+  DcmTime::getCurrentTime(currentTime);
+  dataset->putAndInsertString(DCM_StructureSetLabel, "SlicerRT");
+  dataset->putAndInsertString(DCM_StructureSetDate, currentDate.c_str());
+  dataset->putAndInsertString(DCM_StructureSetTime, currentTime.c_str());
+
+  // Referenced frame of reference, study, and anatomical image series with all its slices
+  DcmItem* frameOfReferenceItem = nullptr;
+  dataset->findOrCreateSequenceItem(DCM_ReferencedFrameOfReferenceSequence, frameOfReferenceItem, -2);
+  frameOfReferenceItem->putAndInsertString(DCM_FrameOfReferenceUID, rt_metadata->get_frame_of_reference_uid());
+  DcmItem* referencedStudyItem = nullptr;
+  frameOfReferenceItem->findOrCreateSequenceItem(DCM_RTReferencedStudySequence, referencedStudyItem, -2);
+  referencedStudyItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_RETIRED_DetachedStudyManagementSOPClass);
+  referencedStudyItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, rt_metadata->get_study_uid());
+  DcmItem* referencedSeriesItem = nullptr;
+  referencedStudyItem->findOrCreateSequenceItem(DCM_RTReferencedSeriesSequence, referencedSeriesItem, -2);
+  referencedSeriesItem->putAndInsertString(DCM_SeriesInstanceUID, rt_metadata->get_ct_series_uid());
+  for (int sliceNumber = 0; sliceNumber < numberOfSlices; ++sliceNumber)
+  {
+    DcmItem* contourImageItem = nullptr;
+    referencedSeriesItem->findOrCreateSequenceItem(DCM_ContourImageSequence, contourImageItem, -2);
+    contourImageItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_CTImageStorage);
+    contourImageItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, rt_metadata->get_slice_uid(sliceNumber));
+  }
+
+  // Structures
+  vtkNew<vtkIdList> cellPointIds;
+  std::vector<double> contourDataLps;
+  for (size_t structureIndex = 0; structureIndex < this->ContourStructures.size(); ++structureIndex)
+  {
+    ContourStructure& structure = this->ContourStructures[structureIndex];
+    std::string roiNumber = vtkVariant(static_cast<int>(structureIndex + 1)).ToString();
+
+    DcmItem* roiItem = nullptr;
+    dataset->findOrCreateSequenceItem(DCM_StructureSetROISequence, roiItem, -2);
+    roiItem->putAndInsertString(DCM_ROINumber, roiNumber.c_str());
+    roiItem->putAndInsertString(DCM_ReferencedFrameOfReferenceUID, rt_metadata->get_frame_of_reference_uid());
+    roiItem->putAndInsertString(DCM_ROIName, structure.Name.c_str());
+    roiItem->putAndInsertString(DCM_ROIGenerationAlgorithm, "");
+
+    DcmItem* observationItem = nullptr;
+    dataset->findOrCreateSequenceItem(DCM_RTROIObservationsSequence, observationItem, -2);
+    observationItem->putAndInsertString(DCM_ObservationNumber, roiNumber.c_str());
+    observationItem->putAndInsertString(DCM_ReferencedROINumber, roiNumber.c_str());
+    observationItem->putAndInsertString(DCM_RTROIInterpretedType, "");
+    observationItem->putAndInsertString(DCM_ROIInterpreter, "");
+
+    DcmItem* roiContourItem = nullptr;
+    dataset->findOrCreateSequenceItem(DCM_ROIContourSequence, roiContourItem, -2);
+    std::string colorString = this->formatColorString(structure.Color);
+    std::replace(colorString.begin(), colorString.end(), ' ', '\\');
+    roiContourItem->putAndInsertString(DCM_ROIDisplayColor, colorString.c_str());
+    roiContourItem->putAndInsertString(DCM_ReferencedROINumber, roiNumber.c_str());
+
+    vtkPolyData* contours = structure.Contours;
+    vtkPoints* points = contours->GetPoints();
+    for (vtkIdType cellIndex = 0; cellIndex < contours->GetNumberOfCells(); ++cellIndex)
+    {
+      contours->GetCellPoints(cellIndex, cellPointIds);
+      vtkIdType numberOfPoints = cellPointIds->GetNumberOfIds();
+      // Closed planar contours are closed implicitly, so a repeated first point is omitted
+      if (numberOfPoints > 1 && cellPointIds->GetId(numberOfPoints - 1) == cellPointIds->GetId(0))
+      {
+        --numberOfPoints;
+      }
+      if (numberOfPoints < 1)
+      {
+        continue;
+      }
+
+      // RAS to LPS conversion
+      contourDataLps.resize(3 * numberOfPoints);
+      for (vtkIdType pointIndex = 0; pointIndex < numberOfPoints; ++pointIndex)
+      {
+        double point[3] = { 0.0, 0.0, 0.0 };
+        points->GetPoint(cellPointIds->GetId(pointIndex), point);
+        contourDataLps[3 * pointIndex] = -point[0];
+        contourDataLps[3 * pointIndex + 1] = -point[1];
+        contourDataLps[3 * pointIndex + 2] = point[2];
+      }
+
+      DcmItem* contourItem = nullptr;
+      roiContourItem->findOrCreateSequenceItem(DCM_ContourSequence, contourItem, -2);
+      int sliceNumber = structure.ContourSliceNumbers[cellIndex];
+      if (sliceNumber >= 0 && sliceNumber < numberOfSlices)
+      {
+        DcmItem* contourImageItem = nullptr;
+        contourItem->findOrCreateSequenceItem(DCM_ContourImageSequence, contourImageItem, -2);
+        contourImageItem->putAndInsertString(DCM_ReferencedSOPClassUID, UID_CTImageStorage);
+        contourImageItem->putAndInsertString(DCM_ReferencedSOPInstanceUID, rt_metadata->get_slice_uid(sliceNumber));
+      }
+      contourItem->putAndInsertString(DCM_ContourGeometricType, "CLOSED_PLANAR");
+      contourItem->putAndInsertString(DCM_NumberOfContourPoints, vtkVariant(static_cast<int>(numberOfPoints)).ToString().c_str());
+      contourItem->putAndInsertString(DCM_ContourData, FormatDecimalStringValues(contourDataLps.data(), static_cast<int>(3 * numberOfPoints)).c_str());
+    }
+  }
+
+  std::string structureSetFilePath = std::string(this->FileName) + "/rtss.dcm";
+  OFCondition result = fileFormat.saveFile(structureSetFilePath.c_str(), EXS_LittleEndianExplicit);
+  if (result.bad())
+  {
+    vtkErrorMacro("WriteStructureContours: Failed to write RT structure set file '" << structureSetFilePath << "': " << result.text());
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomRtWriter::Write()
 {
   // Set study metadata
   Rt_study_metadata::Pointer& rt_metadata = this->RtStudy.get_rt_study_metadata ();
@@ -250,4 +641,16 @@ void vtkSlicerDicomRtWriter::Write()
   
   // Write output to files
   this->RtStudy.save_dicom(this->FileName);
+
+  // Write objects that are not converted to Plastimatch. The UIDs of the anatomical image written above are referenced
+  bool success = true;
+  if (this->DoseImageData && !this->WriteDoseImageData())
+  {
+    success = false;
+  }
+  if (!this->ContourStructures.empty() && !this->WriteStructureContours())
+  {
+    success = false;
+  }
+  return success;
 }
@@ -31,9 +31,16 @@
 #include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
 
 #include "vtkObject.h"
+#include "vtkSmartPointer.h"
 
 #include "rt_study.h"
 
+// STD includes
+#include <string>
+#include <vector>
+
+class DcmItem;
+class vtkOrientedImageData;
 class vtkPolyData;
 
 /// \ingroup SlicerRt_QtModules_DicomRtExport
@@ -60,10 +67,24 @@ public:
                     std::vector<int> sliceNumbers,
                     std::vector<std::string> sliceUIDs,
                     std::vector<vtkPolyData*> sliceContours);
-  /// Add
 
-  /// TODO: Description, argument names and descriptions
-  void Write();
+  /// Set dose distribution image to be written directly from its voxel buffer with DCMTK,
+  /// without conversion to a Plastimatch image (use instead of \sa SetDose).
+  /// The image geometry must be in world (RAS) coordinate system, the voxel values in Gy.
+  void SetDoseImageData(vtkOrientedImageData* doseImageData);
+
+  /// Add structure from closed planar contours to be written directly with DCMTK, without rasterization.
+  /// \param contours Poly data in world (RAS) coordinate system, each line or polygon cell is a closed contour
+  /// \param contourSliceNumbers Index of the anatomical image slice containing each cell of the contours.
+  ///   Used for referencing the image slice. Negative if the contour is outside the image
+  void AddStructureContours(const char* name, double* color, vtkPolyData* contours, const std::vector<int>& contourSliceNumbers);
+
+  /// Write anatomical image, dose and structures into DICOM files in the directory specified by \sa FileName.
+  /// The anatomical image and the objects added as Plastimatch images are written by Plastimatch, then
+  /// the dose image set by \sa SetDoseImageData and the contours added by \sa AddStructureContours
+  /// are written with DCMTK, referencing the anatomical image series written by Plastimatch.
+  /// \return Success flag. False if the dose or the contours could not be written with DCMTK
+  bool Write();
 
 public:
   /// Get the DICOM Patient Name
@@ -119,6 +140,11 @@ public:
   vtkGetStringMacro(DoseSeriesNumber);
   /// Set the DICOM Dose Series Number
   vtkSetStringMacro(DoseSeriesNumber);
+  /// Get the SOP instance UID of the RT plan referenced by the dose written from \sa SetDoseImageData
+  vtkGetStringMacro(DoseReferencedRTPlanSOPInstanceUID);
+  /// Set the SOP instance UID of the RT plan referenced by the dose written from \sa SetDoseImageData.
+  /// If set, the dose summation type is PLAN, otherwise PLAN_OVERVIEW, which does not require a plan reference
+  vtkSetStringMacro(DoseReferencedRTPlanSOPInstanceUID);
   /// Get the DICOM Rtss Series Description
   vtkGetStringMacro(RtssSeriesDescription);
   /// Set the DICOM Rtss Series Description
@@ -133,6 +159,16 @@ public:
 
 protected:
   std::string formatColorString (const double *color);
+
+  /// Write dose image set by \sa SetDoseImageData into an RT Dose file using DCMTK
+  /// \return Success flag
+  bool WriteDoseImageData();
+  /// Write structures added by \sa AddStructureContours into an RT Structure Set file using DCMTK
+  /// \return Success flag
+  bool WriteStructureContours();
+  /// Add patient, study and frame of reference attributes shared with the files written by Plastimatch
+  void AddCommonAttributes(DcmItem* dataset, const char* modality, const char* seriesDescription, const char* seriesNumber);
+
   vtkSlicerDicomRtWriter();
   ~vtkSlicerDicomRtWriter() override;
 
@@ -151,6 +187,7 @@ protected:
   char* ImageSeriesModality;
   char* DoseSeriesDescription;
   char* DoseSeriesNumber;
+  char* DoseReferencedRTPlanSOPInstanceUID;
   char* RtssSeriesDescription;
   char* RtssSeriesNumber;
 
@@ -160,6 +197,19 @@ protected:
   /// Plastimatch RT study structure
   Rt_study RtStudy;
 
+  /// Dose image written directly with DCMTK
+  vtkSmartPointer<vtkOrientedImageData> DoseImageData;
+
+  /// Structure written directly with DCMTK from planar contours
+  struct ContourStructure
+  {
+    std::string Name;
+    double Color[3];
+    vtkSmartPointer<vtkPolyData> Contours;
+    std::vector<int> ContourSliceNumbers;
+  };
+  std::vector<ContourStructure> ContourStructures;
+
 private:
   vtkSlicerDicomRtWriter(const vtkSlicerDicomRtWriter&) = delete;
   void operator=(const vtkSlicerDicomRtWriter&) = delete;
@@ -0,0 +1,715 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// SegmentationCore includes
+#include <vtkClosedSurfaceToBinaryLabelmapConversionRule.h>
+#include <vtkOrientedImageData.h>
+#include <vtkSegmentationConverter.h>
+
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+#include <vtkSegment.h>
+#endif
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataConnectivityFilter.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Conversion rule pairing the lines of neighboring planes by comparing every line of one plane with every line
+// of the other, as the rule did before the lines were indexed in a grid
+class vtkBruteForcePairingConversionRule : public vtkPlanarContourToClosedSurfaceConversionRule
+{
+public:
+  static vtkBruteForcePairingConversionRule* New()
+  {
+    vtkBruteForcePairingConversionRule* rule = new vtkBruteForcePairingConversionRule;
+    rule->InitializeObjectBase();
+    return rule;
+  }
+  vtkTypeMacro(vtkBruteForcePairingConversionRule, vtkPlanarContourToClosedSurfaceConversionRule);
+
+  /// Compare the overlapping lines found by the grid of the base class with the brute force pairing
+  bool DoesGridPairingMatch(const std::vector<std::array<double, 4> >& lineBounds,
+    vtkIdType firstLineOnPlane1Index, int numberOfLinesInPlane1, vtkIdType firstLineOnPlane2Index, int numberOfLinesInPlane2)
+  {
+    std::vector<std::vector<vtkIdType> > gridPlane1Overlaps;
+    std::vector<std::vector<vtkIdType> > gridPlane2Overlaps;
+    this->vtkPlanarContourToClosedSurfaceConversionRule::FindOverlappingLines(lineBounds,
+      firstLineOnPlane1Index, numberOfLinesInPlane1, firstLineOnPlane2Index, numberOfLinesInPlane2, gridPlane1Overlaps, gridPlane2Overlaps);
+    std::vector<std::vector<vtkIdType> > plane1Overlaps;
+    std::vector<std::vector<vtkIdType> > plane2Overlaps;
+    this->FindOverlappingLines(lineBounds,
+      firstLineOnPlane1Index, numberOfLinesInPlane1, firstLineOnPlane2Index, numberOfLinesInPlane2, plane1Overlaps, plane2Overlaps);
+    return gridPlane1Overlaps == plane1Overlaps && gridPlane2Overlaps == plane2Overlaps;
+  }
+
+protected:
+  void FindOverlappingLines(const std::vector<std::array<double, 4> >& lineBounds,
+    vtkIdType firstLineOnPlane1Index, int numberOfLinesInPlane1, vtkIdType firstLineOnPlane2Index, int numberOfLinesInPlane2,
+    std::vector<std::vector<vtkIdType> >& plane1Overlaps, std::vector<std::vector<vtkIdType> >& plane2Overlaps) override
+  {
+    plane1Overlaps.assign(numberOfLinesInPlane1, std::vector<vtkIdType>());
+    plane2Overlaps.assign(numberOfLinesInPlane2, std::vector<vtkIdType>());
+    for (int line1Index = 0; line1Index < numberOfLinesInPlane1; ++line1Index)
+    {
+      for (int line2Index = 0; line2Index < numberOfLinesInPlane2; ++line2Index)
+      {
+        if (DoLineBoundsOverlap(lineBounds[firstLineOnPlane1Index + line1Index].data(), lineBounds[firstLineOnPlane2Index + line2Index].data()))
+        {
+          plane1Overlaps[line1Index].push_back(firstLineOnPlane2Index + line2Index);
+          plane2Overlaps[line2Index].push_back(firstLineOnPlane1Index + line1Index);
+        }
+      }
+    }
+  }
+};
+
+//-----------------------------------------------------------------------------
+// Add a closed contour with the given XY corner points on the plane z
+static void AddPolygonContour(vtkPoints* points, vtkCellArray* lines, const std::vector<std::array<double, 2> >& corners, double z)
+{
+  vtkIdType firstPointId = points->GetNumberOfPoints();
+  for (const std::array<double, 2>& corner : corners)
+  {
+    points->InsertNextPoint(corner[0], corner[1], z);
+  }
+  lines->InsertNextCell(static_cast<int>(corners.size()) + 1);
+  for (vtkIdType pointIndex = 0; pointIndex < static_cast<vtkIdType>(corners.size()); ++pointIndex)
+  {
+    lines->InsertCellPoint(firstPointId + pointIndex);
+  }
+  lines->InsertCellPoint(firstPointId);
+}
+
+//-----------------------------------------------------------------------------
+// Add a closed square contour with the given corner and size on the plane z
+static void AddSquareContour(vtkPoints* points, vtkCellArray* lines, double x, double y, double z, double size)
+{
+  AddPolygonContour(points, lines, { { x, y }, { x + size, y }, { x + size, y + size }, { x, y + size } }, z);
+}
+
+//-----------------------------------------------------------------------------
+// Grid of square islands (4mm wide, 10mm apart) on planes 2mm apart. Each column of islands along the planes
+// overlaps only itself, so it has to form a separate tube
+static vtkSmartPointer<vtkPolyData> CreateIslandGridContours(int islandsPerRow, int numberOfPlanes)
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    for (int row = 0; row < islandsPerRow; ++row)
+    {
+      for (int column = 0; column < islandsPerRow; ++column)
+      {
+        AddSquareContour(points, lines, 10.0 * column, 10.0 * row, 2.0 * planeIndex, 4.0);
+      }
+    }
+  }
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  contours->SetPoints(points);
+  contours->SetLines(lines);
+  return contours;
+}
+
+//-----------------------------------------------------------------------------
+// Grids of squares shifted by half a grid cell on every other plane, so that each square overlaps up to four squares
+// on the neighboring planes and the contours branch. The last plane has a single contour covering all the others
+static vtkSmartPointer<vtkPolyData> CreateBranchingContours()
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  const int squaresPerRow = 4;
+  const int numberOfPlanes = 6;
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    double shift = (planeIndex % 2 == 0 ? 0.0 : 4.0);
+    for (int row = 0; row < squaresPerRow; ++row)
+    {
+      for (int column = 0; column < squaresPerRow; ++column)
+      {
+        AddSquareContour(points, lines, 8.0 * column + shift, 8.0 * row + shift, 2.0 * planeIndex, 6.0);
+      }
+    }
+  }
+  AddSquareContour(points, lines, -1.0, -1.0, 2.0 * numberOfPlanes, 8.0 * squaresPerRow + 6.0);
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  contours->SetPoints(points);
+  contours->SetLines(lines);
+  return contours;
+}
+
+//-----------------------------------------------------------------------------
+// Two squares connected by a thin bridge on three planes. Offsetting the contour inwards by the distance that leaves
+// half of its area turns the bridge inside out, so the offset contour intersects itself
+static vtkSmartPointer<vtkPolyData> CreateDumbbellContours()
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  for (int planeIndex = 0; planeIndex < 3; ++planeIndex)
+  {
+    AddPolygonContour(points, lines, {
+      { 0.0, -5.0 }, { 10.0, -5.0 }, { 10.0, -0.1 }, { 20.0, -0.1 }, { 20.0, -5.0 }, { 30.0, -5.0 },
+      { 30.0, 5.0 }, { 20.0, 5.0 }, { 20.0, 0.1 }, { 10.0, 0.1 }, { 10.0, 5.0 }, { 0.0, 5.0 } },
+      2.0 * planeIndex);
+  }
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  contours->SetPoints(points);
+  contours->SetLines(lines);
+  return contours;
+}
+
+//-----------------------------------------------------------------------------
+// Circles around the same center with the radius changing from plane to plane. If tilt is not zero, then the planes
+// are tilted around the X axis (z increases by tilt*y), so that they are not parallel to the image slices
+static vtkSmartPointer<vtkPolyData> CreateCircleContours(int numberOfPlanes, double planeSpacing, double tilt)
+{
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  const int numberOfPointsPerCircle = 64;
+  for (int planeIndex = 0; planeIndex < numberOfPlanes; ++planeIndex)
+  {
+    double radius = 8.0 + 6.0 * std::sin(vtkMath::Pi() * planeIndex / (numberOfPlanes - 1));
+    std::vector<std::array<double, 2> > circle(numberOfPointsPerCircle);
+    for (int pointIndex = 0; pointIndex < numberOfPointsPerCircle; ++pointIndex)
+    {
+      double angle = 2.0 * vtkMath::Pi() * pointIndex / numberOfPointsPerCircle;
+      circle[pointIndex] = { 20.0 + radius * std::cos(angle), 20.0 + radius * std::sin(angle) };
+    }
+    AddPolygonContour(points, lines, circle, planeSpacing * planeIndex);
+  }
+  for (vtkIdType pointId = 0; pointId < points->GetNumberOfPoints(); ++pointId)
+  {
+    double point[3] = { 0.0, 0.0, 0.0 };
+    points->GetPoint(pointId, point);
+    points->SetPoint(pointId, point[0], point[1], point[2] + tilt * point[1]);
+  }
+  vtkSmartPointer<vtkPolyData> contours = vtkSmartPointer<vtkPolyData>::New();
+  contours->SetPoints(points);
+  contours->SetLines(lines);
+  return contours;
+}
+
+//-----------------------------------------------------------------------------
+// Convert the contours with the given chain of rules (the first rule converts from planar contour, each further rule
+// from the target representation of the previous one). Returns nullptr if a conversion fails
+static vtkSmartPointer<vtkDataObject> ConvertContours(const std::vector<vtkSegmentationConverterRule*>& rules, vtkPolyData* contours)
+{
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  vtkNew<vtkSegment> segment;
+  segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(), contours);
+  for (vtkSegmentationConverterRule* rule : rules)
+  {
+    if (!rule->Convert(segment))
+    {
+      return nullptr;
+    }
+  }
+  return segment->GetRepresentation(rules.back()->GetTargetRepresentationName());
+#else
+  vtkSmartPointer<vtkDataObject> sourceRepresentation = contours;
+  for (vtkSegmentationConverterRule* rule : rules)
+  {
+    vtkSmartPointer<vtkDataObject> targetRepresentation = vtkSmartPointer<vtkDataObject>::Take(
+      rule->ConstructRepresentationObjectByRepresentation(rule->GetTargetRepresentationName()));
+    if (!rule->Convert(sourceRepresentation, targetRepresentation))
+    {
+      return nullptr;
+    }
+    sourceRepresentation = targetRepresentation;
+  }
+  return sourceRepresentation;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Convert the contours to closed surface with the given rule. Returns nullptr if the conversion fails
+static vtkSmartPointer<vtkPolyData> ConvertToClosedSurface(vtkPlanarContourToClosedSurfaceConversionRule* rule, vtkPolyData* contours)
+{
+  vtkSmartPointer<vtkPolyData> surface = vtkPolyData::SafeDownCast(ConvertContours({ rule }, contours));
+  if (!surface || surface->GetNumberOfPolys() == 0)
+  {
+    return nullptr;
+  }
+  return surface;
+}
+
+//-----------------------------------------------------------------------------
+// Convert the contours to binary labelmap with the given chain of rules, in the reference geometry with unit spacing
+// and slices parallel to the XY plane. Returns nullptr if the conversion fails
+static vtkSmartPointer<vtkOrientedImageData> ConvertToBinaryLabelmap(const std::vector<vtkSegmentationConverterRule*>& rules, vtkPolyData* contours)
+{
+  vtkNew<vtkOrientedImageData> geometryImage;
+  geometryImage->SetSpacing(1.0, 1.0, 1.0);
+  geometryImage->SetExtent(-5, 55, -5, 55, -5, 50);
+  std::string referenceGeometry = vtkSegmentationConverter::SerializeImageGeometry(geometryImage);
+  for (vtkSegmentationConverterRule* rule : rules)
+  {
+    rule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometry);
+  }
+  return vtkOrientedImageData::SafeDownCast(ConvertContours(rules, contours));
+}
+
+//-----------------------------------------------------------------------------
+// Number of foreground voxels of a labelmap
+static vtkIdType CountForegroundVoxels(vtkOrientedImageData* labelmap)
+{
+  vtkIdType numberOfVoxels = 0;
+  int extent[6] = { 0, -1, 0, -1, 0, -1 };
+  labelmap->GetExtent(extent);
+  for (int k = extent[4]; k <= extent[5]; ++k)
+  {
+    for (int j = extent[2]; j <= extent[3]; ++j)
+    {
+      for (int i = extent[0]; i <= extent[1]; ++i)
+      {
+        if (labelmap->GetScalarComponentAsDouble(i, j, k, 0) != 0.0)
+        {
+          ++numberOfVoxels;
+        }
+      }
+    }
+  }
+  return numberOfVoxels;
+}
+
+//-----------------------------------------------------------------------------
+// Dice similarity coefficient of two labelmaps, 1 if their foreground voxels are the same. The labelmaps have
+// the same spacing, origin and directions, only their extents may differ
+static double ComputeDiceCoefficient(vtkOrientedImageData* labelmap1, vtkOrientedImageData* labelmap2)
+{
+  vtkIdType numberOfVoxels = CountForegroundVoxels(labelmap1) + CountForegroundVoxels(labelmap2);
+  if (numberOfVoxels == 0)
+  {
+    return 1.0;
+  }
+  vtkIdType numberOfCommonVoxels = 0;
+  int extent1[6] = { 0, -1, 0, -1, 0, -1 };
+  labelmap1->GetExtent(extent1);
+  int extent2[6] = { 0, -1, 0, -1, 0, -1 };
+  labelmap2->GetExtent(extent2);
+  for (int k = std::max(extent1[4], extent2[4]); k <= std::min(extent1[5], extent2[5]); ++k)
+  {
+    for (int j = std::max(extent1[2], extent2[2]); j <= std::min(extent1[3], extent2[3]); ++j)
+    {
+      for (int i = std::max(extent1[0], extent2[0]); i <= std::min(extent1[1], extent2[1]); ++i)
+      {
+        if (labelmap1->GetScalarComponentAsDouble(i, j, k, 0) != 0.0 && labelmap2->GetScalarComponentAsDouble(i, j, k, 0) != 0.0)
+        {
+          ++numberOfCommonVoxels;
+        }
+      }
+    }
+  }
+  return 2.0 * numberOfCommonVoxels / numberOfVoxels;
+}
+
+//-----------------------------------------------------------------------------
+// Check that the surface created from the island grid consists of the expected number of separate tubes,
+// spanning the islands in the XY plane and the given range along Z
+static bool CheckIslandTubes(vtkPolyData* surface, int islandsPerRow, double expectedMinimumZ, double expectedMaximumZ)
+{
+  if (!surface)
+  {
+    std::cerr << "Failed to convert the island grid to closed surface" << std::endl;
+    return false;
+  }
+
+  vtkNew<vtkPolyDataConnectivityFilter> connectivity;
+  connectivity->SetInputData(surface);
+  connectivity->SetExtractionModeToAllRegions();
+  connectivity->Update();
+  if (connectivity->GetNumberOfExtractedRegions() != islandsPerRow * islandsPerRow)
+  {
+    std::cerr << "Island grid surface has " << connectivity->GetNumberOfExtractedRegions() << " regions instead of "
+      << islandsPerRow * islandsPerRow << std::endl;
+    return false;
+  }
+
+  const double tolerance = 1.0e-6;
+  double expectedBounds[6] = { 0.0, 10.0 * (islandsPerRow - 1) + 4.0, 0.0, 10.0 * (islandsPerRow - 1) + 4.0, expectedMinimumZ, expectedMaximumZ };
+  double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  surface->GetBounds(bounds);
+  for (int index = 0; index < 6; ++index)
+  {
+    if (std::fabs(bounds[index] - expectedBounds[index]) > tolerance)
+    {
+      std::cerr << "Island grid surface bound " << index << " is " << bounds[index] << " instead of " << expectedBounds[index] << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Check that two surfaces have exactly the same points and triangles
+static bool AreSurfacesIdentical(vtkPolyData* surface1, vtkPolyData* surface2)
+{
+  if (!surface1 || !surface2)
+  {
+    return false;
+  }
+  if ( surface1->GetNumberOfPoints() != surface2->GetNumberOfPoints()
+    || surface1->GetNumberOfPolys() != surface2->GetNumberOfPolys() )
+  {
+    return false;
+  }
+  for (vtkIdType pointId = 0; pointId < surface1->GetNumberOfPoints(); ++pointId)
+  {
+    double point1[3] = { 0.0, 0.0, 0.0 };
+    double point2[3] = { 0.0, 0.0, 0.0 };
+    surface1->GetPoint(pointId, point1);
+    surface2->GetPoint(pointId, point2);
+    if (point1[0] != point2[0] || point1[1] != point2[1] || point1[2] != point2[2])
+    {
+      return false;
+    }
+  }
+  vtkNew<vtkIdList> cellPointIds1;
+  vtkNew<vtkIdList> cellPointIds2;
+  vtkCellArray* polys1 = surface1->GetPolys();
+  vtkCellArray* polys2 = surface2->GetPolys();
+  polys1->InitTraversal();
+  polys2->InitTraversal();
+  while (polys1->GetNextCell(cellPointIds1))
+  {
+    polys2->GetNextCell(cellPointIds2);
+    if (cellPointIds1->GetNumberOfIds() != cellPointIds2->GetNumberOfIds())
+    {
+      return false;
+    }
+    for (vtkIdType index = 0; index < cellPointIds1->GetNumberOfIds(); ++index)
+    {
+      if (cellPointIds1->GetId(index) != cellPointIds2->GetId(index))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Test planar contour to closed surface conversion
+static bool TestClosedSurfaceConversion(vtkPolyData* islandContours, int islandsPerRow, int numberOfPlanes)
+{
+  // Bounding boxes on a coarse integer lattice, so that many of them overlap, touch, or coincide. The grid pairing
+  // must find exactly the same overlapping lines in the same order as comparing all lines
+  vtkNew<vtkBruteForcePairingConversionRule> bruteForceRule;
+  const int numberOfLinesPerPlane = 200;
+  std::vector<std::array<double, 4> > lineBounds(2 * numberOfLinesPerPlane);
+  unsigned int randomState = 12345;
+  for (std::array<double, 4>& bounds : lineBounds)
+  {
+    for (int axis = 0; axis < 2; ++axis)
+    {
+      randomState = randomState * 1103515245 + 12345;
+      double minimum = static_cast<double>((randomState >> 16) % 60);
+      randomState = randomState * 1103515245 + 12345;
+      double size = static_cast<double>((randomState >> 16) % 12);
+      bounds[2 * axis] = minimum;
+      bounds[2 * axis + 1] = minimum + size;
+    }
+  }
+  for (int numberOfLines : { 0, 1, 7, numberOfLinesPerPlane })
+  {
+    if ( !bruteForceRule->DoesGridPairingMatch(lineBounds, 0, numberOfLines, numberOfLinesPerPlane, numberOfLinesPerPlane)
+      || !bruteForceRule->DoesGridPairingMatch(lineBounds, numberOfLinesPerPlane, numberOfLinesPerPlane, 0, numberOfLines) )
+    {
+      std::cerr << "Overlapping lines found by the grid differ from brute force pairing (" << numberOfLines << " lines)" << std::endl;
+      return false;
+    }
+  }
+
+  // Surfaces are the same as with brute force pairing, also for branching contours
+  vtkSmartPointer<vtkPolyData> branchingContours = CreateBranchingContours();
+  for (vtkPolyData* contours : { islandContours, branchingContours.GetPointer() })
+  {
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> rule;
+    vtkSmartPointer<vtkPolyData> surface = ConvertToClosedSurface(rule, contours);
+    vtkSmartPointer<vtkPolyData> bruteForceSurface = ConvertToClosedSurface(bruteForceRule, contours);
+    if (!surface || !AreSurfacesIdentical(surface, bruteForceSurface))
+    {
+      std::cerr << "Closed surface differs from the one created with brute force pairing" << std::endl;
+      return false;
+    }
+  }
+
+  // Islands are only connected to the overlapping island on the neighboring planes
+  {
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> rule;
+    rule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetEndCappingParameterName(), "0");
+    if (!CheckIslandTubes(ConvertToClosedSurface(rule, islandContours), islandsPerRow, 0.0, 2.0 * (numberOfPlanes - 1)))
+    {
+      return false;
+    }
+  }
+
+  // Triangles must not depend on the number of threads triangulating the plane pairs
+  {
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> singleThreadRule;
+    singleThreadRule->SetNumberOfThreads(1);
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> multiThreadRule;
+    multiThreadRule->SetNumberOfThreads(4);
+    vtkSmartPointer<vtkPolyData> singleThreadSurface = ConvertToClosedSurface(singleThreadRule, islandContours);
+    if (!singleThreadSurface || !AreSurfacesIdentical(singleThreadSurface, ConvertToClosedSurface(multiThreadRule, islandContours)))
+    {
+      std::cerr << "Closed surface depends on the number of threads" << std::endl;
+      return false;
+    }
+  }
+
+  // Smooth end caps created geometrically and from the rasterized contours close the same tubes
+  // half a slice beyond the first and last planes
+  for (bool geometricEndCapping : { true, false })
+  {
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> rule;
+    rule->SetGeometricEndCapping(geometricEndCapping);
+    if (!CheckIslandTubes(ConvertToClosedSurface(rule, islandContours), islandsPerRow, -1.0, 2.0 * (numberOfPlanes - 1) + 1.0))
+    {
+      std::cerr << "Invalid end caps (geometric end capping " << (geometricEndCapping ? "on" : "off") << ")" << std::endl;
+      return false;
+    }
+  }
+
+  // Contours that cannot be offset without self intersection are capped from the rasterized contour,
+  // so the surface is the same as without geometric end capping. Convex islands are capped geometrically
+  {
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> geometricRule;
+    geometricRule->SetGeometricEndCapping(true);
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> rasterRule;
+    rasterRule->SetGeometricEndCapping(false);
+    vtkSmartPointer<vtkPolyData> dumbbellContours = CreateDumbbellContours();
+    vtkSmartPointer<vtkPolyData> dumbbellSurface = ConvertToClosedSurface(geometricRule, dumbbellContours);
+    if (!dumbbellSurface || !AreSurfacesIdentical(dumbbellSurface, ConvertToClosedSurface(rasterRule, dumbbellContours)))
+    {
+      std::cerr << "Self intersecting geometric end cap is not replaced by the rasterized end cap" << std::endl;
+      return false;
+    }
+    double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    dumbbellSurface->GetBounds(bounds);
+    if (std::fabs(bounds[4] + 1.0) > 1.0e-6 || std::fabs(bounds[5] - 5.0) > 1.0e-6)
+    {
+      std::cerr << "Dumbbell surface is not capped half a slice beyond the first and last planes" << std::endl;
+      return false;
+    }
+    if (AreSurfacesIdentical(ConvertToClosedSurface(geometricRule, islandContours), ConvertToClosedSurface(rasterRule, islandContours)))
+    {
+      std::cerr << "Island grid is not capped geometrically" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Test planar contour to binary labelmap conversion
+static bool TestBinaryLabelmapConversion(vtkPolyData* islandContours, int islandsPerRow, int numberOfPlanes)
+{
+  // The slices between the planes are interpolated, and the first and last planes are extended by half of the
+  // plane spacing (one slice below the first plane, none above the last one)
+  {
+    vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+    vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap({ rule }, islandContours);
+    vtkIdType expectedNumberOfVoxels = 2 * numberOfPlanes * islandsPerRow * islandsPerRow * 4 * 4;
+    if (!labelmap || CountForegroundVoxels(labelmap) != expectedNumberOfVoxels)
+    {
+      std::cerr << "Island grid labelmap has " << (labelmap ? CountForegroundVoxels(labelmap) : 0) << " voxels instead of "
+        << expectedNumberOfVoxels << std::endl;
+      return false;
+    }
+  }
+
+  // A single plane is extended by half of the default slice thickness, or only fills the closest slice if it is not set
+  {
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> lines;
+    AddSquareContour(points, lines, 0.0, 0.0, 10.0, 10.0);
+    vtkNew<vtkPolyData> singlePlaneContours;
+    singlePlaneContours->SetPoints(points);
+    singlePlaneContours->SetLines(lines);
+    for (const char* defaultSliceThickness : { "0.0", "5.0" })
+    {
+      vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+      rule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName(), defaultSliceThickness);
+      vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap({ rule }, singlePlaneContours);
+      vtkIdType expectedNumberOfVoxels = (std::string(defaultSliceThickness) == "0.0" ? 1 : 5) * 10 * 10;
+      if (!labelmap || CountForegroundVoxels(labelmap) != expectedNumberOfVoxels)
+      {
+        std::cerr << "Single plane labelmap with default slice thickness " << defaultSliceThickness << " has "
+          << (labelmap ? CountForegroundVoxels(labelmap) : 0) << " voxels instead of " << expectedNumberOfVoxels << std::endl;
+        return false;
+      }
+    }
+  }
+
+  // The extended first and last planes are only cropped to the reference image geometry if the crop parameter is set
+  {
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> lines;
+    AddSquareContour(points, lines, 0.0, 0.0, 0.0, 10.0);
+    AddSquareContour(points, lines, 0.0, 0.0, 10.0, 10.0);
+    vtkNew<vtkPolyData> twoPlaneContours;
+    twoPlaneContours->SetPoints(points);
+    twoPlaneContours->SetLines(lines);
+    vtkNew<vtkOrientedImageData> geometryImage;
+    geometryImage->SetSpacing(1.0, 1.0, 1.0);
+    geometryImage->SetExtent(-5, 55, -5, 55, 0, 50);
+    std::string referenceGeometry = vtkSegmentationConverter::SerializeImageGeometry(geometryImage);
+    for (const char* cropToReferenceImageGeometry : { "0", "1" })
+    {
+      vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+      rule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometry);
+      rule->SetConversionParameter(vtkClosedSurfaceToBinaryLabelmapConversionRule::GetCropToReferenceImageGeometryParameterName(),
+        cropToReferenceImageGeometry);
+      vtkSmartPointer<vtkOrientedImageData> labelmap = vtkOrientedImageData::SafeDownCast(ConvertContours({ rule }, twoPlaneContours));
+      // The planes are extended by 5 slices, below the reference geometry for the first plane
+      vtkIdType expectedNumberOfVoxels = (std::string(cropToReferenceImageGeometry) == "1" ? 15 : 20) * 10 * 10;
+      int extent[6] = { 0, -1, 0, -1, 0, -1 };
+      if (labelmap)
+      {
+        labelmap->GetExtent(extent);
+      }
+      if ( !labelmap || CountForegroundVoxels(labelmap) != expectedNumberOfVoxels
+        || (std::string(cropToReferenceImageGeometry) == "1" && extent[4] < 0) )
+      {
+        std::cerr << "Two plane labelmap with crop to reference image geometry " << cropToReferenceImageGeometry << " has "
+          << (labelmap ? CountForegroundVoxels(labelmap) : 0) << " voxels instead of " << expectedNumberOfVoxels
+          << ", first slice " << extent[4] << std::endl;
+        return false;
+      }
+    }
+  }
+
+  // Contour inside another contour on the same plane is a hole
+  {
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> lines;
+    for (int planeIndex = 0; planeIndex < 3; ++planeIndex)
+    {
+      AddSquareContour(points, lines, 0.0, 0.0, 2.0 * planeIndex, 20.0);
+      AddSquareContour(points, lines, 5.0, 5.0, 2.0 * planeIndex, 10.0);
+    }
+    vtkNew<vtkPolyData> ringContours;
+    ringContours->SetPoints(points);
+    ringContours->SetLines(lines);
+    vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+    vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap({ rule }, ringContours);
+    if (!labelmap || CountForegroundVoxels(labelmap) != 6 * (20 * 20 - 10 * 10))
+    {
+      std::cerr << "Inner contour is not a hole in the labelmap" << std::endl;
+      return false;
+    }
+  }
+
+  // The direct conversion is the default path from planar contours to binary labelmap, so it has to give practically
+  // the same labelmap as converting through closed surface. Straight end caps extend the closed surface by half of
+  // the plane spacing, the same way as the first and last planes are extended by the direct conversion
+  {
+    vtkSmartPointer<vtkPolyData> circleContours = CreateCircleContours(7, 3.0, 0.0);
+    vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+    vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule;
+    closedSurfaceRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetEndCappingParameterName(), "2");
+    vtkNew<vtkClosedSurfaceToBinaryLabelmapConversionRule> closedSurfaceToBinaryLabelmapRule;
+    vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap({ rule }, circleContours);
+    vtkSmartPointer<vtkOrientedImageData> closedSurfaceLabelmap = ConvertToBinaryLabelmap({ closedSurfaceRule, closedSurfaceToBinaryLabelmapRule }, circleContours);
+    if (!labelmap || !closedSurfaceLabelmap || CountForegroundVoxels(labelmap) == 0)
+    {
+      std::cerr << "Failed to convert circles to binary labelmap" << std::endl;
+      return false;
+    }
+    double dice = ComputeDiceCoefficient(labelmap, closedSurfaceLabelmap);
+    if (dice < 0.95)
+    {
+      std::cerr << "Labelmap differs from the one converted through closed surface (Dice coefficient " << dice << ")" << std::endl;
+      return false;
+    }
+  }
+
+  // Contours that are not parallel to the slices are converted through closed surface, with the same parameters
+  {
+    vtkSmartPointer<vtkPolyData> tiltedContours = CreateCircleContours(7, 3.0, 0.5);
+    std::vector<vtkSmartPointer<vtkOrientedImageData> > closedSurfaceLabelmaps;
+    for (const char* endCapping : { "1", "2" })
+    {
+      vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> rule;
+      rule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetEndCappingParameterName(), endCapping);
+      vtkNew<vtkPlanarContourToClosedSurfaceConversionRule> closedSurfaceRule;
+      closedSurfaceRule->SetConversionParameter(vtkPlanarContourToClosedSurfaceConversionRule::GetEndCappingParameterName(), endCapping);
+      vtkNew<vtkClosedSurfaceToBinaryLabelmapConversionRule> closedSurfaceToBinaryLabelmapRule;
+      vtkSmartPointer<vtkOrientedImageData> labelmap = ConvertToBinaryLabelmap({ rule }, tiltedContours);
+      vtkSmartPointer<vtkOrientedImageData> closedSurfaceLabelmap = ConvertToBinaryLabelmap({ closedSurfaceRule, closedSurfaceToBinaryLabelmapRule }, tiltedContours);
+      if (!labelmap || !closedSurfaceLabelmap || CountForegroundVoxels(labelmap) == 0 || ComputeDiceCoefficient(labelmap, closedSurfaceLabelmap) != 1.0)
+      {
+        std::cerr << "Tilted contours are not converted through closed surface with end capping " << endCapping << std::endl;
+        return false;
+      }
+      closedSurfaceLabelmaps.push_back(closedSurfaceLabelmap);
+    }
+    if (ComputeDiceCoefficient(closedSurfaceLabelmaps[0], closedSurfaceLabelmaps[1]) == 1.0)
+    {
+      std::cerr << "End capping does not change the labelmap of tilted contours" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+int vtkPlanarContourConversionRulesTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Grid of 5x5 islands on 10 planes, used by the tests of both conversion rules
+  const int islandsPerRow = 5;
+  const int numberOfPlanes = 10;
+  vtkSmartPointer<vtkPolyData> islandContours = CreateIslandGridContours(islandsPerRow, numberOfPlanes);
+
+  if (!TestClosedSurfaceConversion(islandContours, islandsPerRow, numberOfPlanes))
+  {
+    std::cerr << "Planar contour to closed surface conversion test failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!TestBinaryLabelmapConversion(islandContours, islandsPerRow, numberOfPlanes))
+  {
+    std::cerr << "Planar contour to binary labelmap conversion test failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Planar contour conversion rules test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtExamineCache.h"
+
+// VTK includes
+#include <vtkNew.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <fstream>
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDicomRtExamineCacheTest1(int argc, char* argv[])
+{
+  // TemporaryDirectory
+  std::string temporaryDirectory;
+  if (argc > 2 && STRCASECMP(argv[1], "-TemporaryDirectory") == 0)
+  {
+    temporaryDirectory = argv[2];
+    std::cout << "Temporary directory: " << temporaryDirectory << std::endl;
+  }
+  else
+  {
+    std::cerr << "Invalid arguments" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectory);
+
+  // Create examined file and remove cache file of a previous run
+  std::string examinedFilePath = temporaryDirectory + "/ExamineCacheTest_RTSTRUCT.dcm";
+  std::string cacheFilePath = temporaryDirectory + "/ExamineCacheTest_Cache.txt";
+  {
+    std::ofstream examinedFile(examinedFilePath.c_str(), std::ios::out | std::ios::trunc);
+    examinedFile << "Structure set";
+  }
+  vtksys::SystemTools::RemoveFile(cacheFilePath);
+
+  vtkSlicerDicomRtExamineCache::Entry examineResult;
+  examineResult.SOPClassUID = "1.2.840.10008.5.1.4.1.1.481.3";
+  examineResult.SOPInstanceUID = "1.2.3.4";
+  examineResult.Name = "1: RTSTRUCT: Test";
+  examineResult.ReferencedSOPInstanceUIDs.push_back("1.2.3.5");
+  examineResult.ReferencedSOPInstanceUIDs.push_back("1.2.3.6");
+
+  // Entries are only returned for the same header only flag they were stored with
+  vtkNew<vtkSlicerDicomRtExamineCache> cache;
+  cache->SetCacheFilePath(cacheFilePath);
+  cache->SetEntry(examinedFilePath, true, examineResult);
+  vtkSlicerDicomRtExamineCache::Entry cachedResult;
+  if (!cache->GetEntry(examinedFilePath, true, cachedResult))
+  {
+    std::cerr << "Stored examine result is not found in the cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (cache->GetEntry(examinedFilePath, false, cachedResult))
+  {
+    std::cerr << "Header only examine result is returned for full examination" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!cache->Save())
+  {
+    std::cerr << "Failed to save examine cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The cache file is read by a new cache, and the entry is a hit with the same contents
+  vtkNew<vtkSlicerDicomRtExamineCache> reloadedCache;
+  reloadedCache->SetCacheFilePath(cacheFilePath);
+  cachedResult = vtkSlicerDicomRtExamineCache::Entry();
+  if (!reloadedCache->GetEntry(examinedFilePath, true, cachedResult))
+  {
+    std::cerr << "Examine result is not found in the reloaded cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( cachedResult.SOPClassUID != examineResult.SOPClassUID
+    || cachedResult.SOPInstanceUID != examineResult.SOPInstanceUID
+    || cachedResult.Name != examineResult.Name
+    || cachedResult.ReferencedSOPInstanceUIDs != examineResult.ReferencedSOPInstanceUIDs )
+  {
+    std::cerr << "Reloaded examine result differs from the stored one" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (reloadedCache->GetEntry(examinedFilePath, false, cachedResult))
+  {
+    std::cerr << "Header only examine result is returned for full examination from the reloaded cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Changing the file invalidates the entry
+  {
+    std::ofstream examinedFile(examinedFilePath.c_str(), std::ios::out | std::ios::app);
+    examinedFile << " changed";
+  }
+  if (reloadedCache->GetEntry(examinedFilePath, true, cachedResult))
+  {
+    std::cerr << "Examine result of a changed file is returned" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtksys::SystemTools::RemoveFile(examinedFilePath);
+  vtksys::SystemTools::RemoveFile(cacheFilePath);
+
+  std::cout << "Examine cache test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
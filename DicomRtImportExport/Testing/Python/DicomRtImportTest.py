@@ -1,4 +1,5 @@
 import os
+import math
 import unittest
 import vtk, qt, ctk, slicer
 from slicer.ScriptedLoadableModule import *
@@ -36,9 +37,17 @@ class DicomRtImportTest(unittest.TestCase):
     self.TestSection_RetrieveInputData()
     self.TestSection_OpenTempDatabase()
     self.TestSection_ImportStudy()
+    self.TestSection_ExamineHeaderOnly()
     self.TestSection_SelectLoadables()
     self.TestSection_LoadIntoSlicer()
     self.TestSection_SaveScene()
+    self.TestSection_ReadDoseImageData()
+    self.TestSection_LoadRoiContoursOnDemand()
+    self.TestSection_SetBeamControlPointIndex()
+    self.TestSection_LoadDynamicBeamsCompact()
+    self.TestSection_ExportDoseAndContoursDirectly()
+    self.TestSection_ExportLabelmapSegmentation()
+    self.TestSection_PlanarContourToClosedSurface()
     self.TestSection_ClearDatabase()
 
     logging.info("Test finished")
@@ -105,6 +114,45 @@ class DicomRtImportTest(unittest.TestCase):
     self.assertEqual( len(slicer.dicomDatabase.patients()), 1 )
     self.assertIsNotNone( slicer.dicomDatabase.patients()[0] )
 
+  #------------------------------------------------------------------------------
+  def TestSection_ExamineHeaderOnly(self):
+    logging.info("Examine header only")
+
+    # Examine the RT files with and without stopping the parsing before the bulky elements
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    fileList = vtk.vtkStringArray()
+    for fileName in sorted(os.listdir(self.dataDir)):
+      fileList.InsertNextValue(self.dataDir + '/' + fileName)
+
+    def examineResults(headerOnly, useCache=False):
+      rtLogic.SetExamineHeaderOnly(headerOnly)
+      rtLogic.SetUseExamineCache(useCache)
+      loadablesCollection = vtk.vtkCollection()
+      rtLogic.ExamineForLoad(fileList, loadablesCollection)
+      results = []
+      for loadableIndex in range(loadablesCollection.GetNumberOfItems()):
+        loadable = loadablesCollection.GetItemAsObject(loadableIndex)
+        files = [loadable.GetFiles().GetValue(i) for i in range(loadable.GetFiles().GetNumberOfValues())]
+        referencedUids = [loadable.GetReferencedInstanceUIDs().GetValue(i) for i in range(loadable.GetReferencedInstanceUIDs().GetNumberOfValues())]
+        results.append((loadable.GetName(), files, referencedUids, loadable.GetConfidence(), loadable.GetSelected()))
+      return results
+
+    fullResults = examineResults(False)
+    headerOnlyResults = examineResults(True)
+
+    self.assertEqual( len(fullResults), 4 )
+    self.assertEqual( headerOnlyResults, fullResults )
+
+    # Examine with the persistent cache: the first run fills it, the second one is served from it
+    rtLogic.ClearExamineCache()
+    firstCachedResults = examineResults(True, True)
+    secondCachedResults = examineResults(True, True)
+    self.assertEqual( firstCachedResults, fullResults )
+    self.assertEqual( secondCachedResults, fullResults )
+
+    rtLogic.SetExamineHeaderOnly(True)
+    rtLogic.SetUseExamineCache(True)
+
   #------------------------------------------------------------------------------
   def TestSection_SelectLoadables(self):
     # slicer.util.delayDisplay("Select loadables",self.delayMs)
@@ -174,6 +222,487 @@ class DicomRtImportTest(unittest.TestCase):
     readable = os.access(sceneFileName, os.R_OK)
     self.assertTrue( readable )
 
+  #------------------------------------------------------------------------------
+  def TestSection_ReadDoseImageData(self):
+    logging.info("Read dose image data")
+
+    import numpy
+    from vtk.util import numpy_support
+    doseFilePath = self.dataDir + '/RD.1.2.246.352.71.7.2088656855.452083.20110920153746.dcm'
+
+    # Dose read frame by frame from the file
+    rtReader = slicer.vtkSlicerDicomRtReader()
+    rtReader.SetFileName(doseFilePath)
+    rtReader.Update()
+    self.assertTrue( rtReader.GetLoadRTDoseSuccessful() )
+    streamedDoseImageData = vtk.vtkImageData()
+    streamedIjkToRas = vtk.vtkMatrix4x4()
+    self.assertTrue( rtReader.ReadDoseImageData(streamedDoseImageData, streamedIjkToRas) )
+
+    # Dose read by the volume archetype storage node, as in the fallback path of loading compressed doses
+    archetypeVolumeNode = slicer.vtkMRMLScalarVolumeNode()
+    archetypeStorageNode = slicer.vtkMRMLVolumeArchetypeStorageNode()
+    archetypeStorageNode.SetFileName(doseFilePath)
+    archetypeStorageNode.ResetFileNameList()
+    archetypeStorageNode.SetSingleFile(1)
+    self.assertTrue( archetypeStorageNode.ReadData(archetypeVolumeNode) )
+    archetypeSpacing = archetypeVolumeNode.GetSpacing()
+    archetypeVolumeNode.SetSpacing(rtReader.GetPixelSpacing()[0], rtReader.GetPixelSpacing()[1], archetypeSpacing[2])
+    archetypeIjkToRas = vtk.vtkMatrix4x4()
+    archetypeVolumeNode.GetIJKToRASMatrix(archetypeIjkToRas)
+
+    # Geometry
+    self.assertEqual( streamedDoseImageData.GetDimensions(), archetypeVolumeNode.GetImageData().GetDimensions() )
+    for row in range(3):
+      for column in range(4):
+        self.assertAlmostEqual( streamedIjkToRas.GetElement(row, column), archetypeIjkToRas.GetElement(row, column), places=3 )
+
+    # Voxel values, scaled by the dose grid scaling
+    doseGridScaling = float(rtReader.GetDoseGridScaling())
+    streamedDoseVoxels = numpy_support.vtk_to_numpy(streamedDoseImageData.GetPointData().GetScalars()).astype(numpy.float64)
+    archetypeDoseVoxels = numpy_support.vtk_to_numpy(archetypeVolumeNode.GetImageData().GetPointData().GetScalars()).astype(numpy.float64) * doseGridScaling
+    self.assertLessEqual( numpy.max(numpy.abs(streamedDoseVoxels - archetypeDoseVoxels)), numpy.max(archetypeDoseVoxels) * 1e-6 )
+
+  #------------------------------------------------------------------------------
+  def TestSection_LoadRoiContoursOnDemand(self):
+    logging.info("Load ROI contours on demand")
+
+    # Examine the structure set file
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    rtStructureSetStorageSopClassUid = '1.2.840.10008.5.1.4.1.1.481.3'
+    fileList = vtk.vtkStringArray()
+    for fileName in sorted(os.listdir(self.dataDir)):
+      filePath = self.dataDir + '/' + fileName
+      if slicer.dicomDatabase.fileValue(filePath, '0008,0016') == rtStructureSetStorageSopClassUid:
+        fileList.InsertNextValue(filePath)
+    self.assertEqual( fileList.GetNumberOfValues(), 1 )
+    loadablesCollection = vtk.vtkCollection()
+    rtLogic.ExamineForLoad(fileList, loadablesCollection)
+    self.assertEqual( loadablesCollection.GetNumberOfItems(), 1 )
+
+    # Load it again with only placeholder segments
+    loadedSegmentationNode = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')[0]
+    rtLogic.SetLoadRoiContoursOnDemand(True)
+    self.assertTrue( rtLogic.LoadDicomRT(loadablesCollection.GetItemAsObject(0)) )
+    rtLogic.SetLoadRoiContoursOnDemand(False)
+    segmentationNodes = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')
+    self.assertEqual( len(segmentationNodes), 2 )
+    onDemandSegmentationNode = segmentationNodes[1]
+
+    loadedSegmentation = loadedSegmentationNode.GetSegmentation()
+    onDemandSegmentation = onDemandSegmentationNode.GetSegmentation()
+    planarContourName = slicer.vtkSegmentationConverter.GetSegmentationPlanarContourRepresentationName()
+    closedSurfaceName = slicer.vtkSegmentationConverter.GetSegmentationClosedSurfaceRepresentationName()
+    roiBoundsTagName = 'DicomRtImport.RoiBounds'
+    self.assertEqual( onDemandSegmentation.GetNumberOfSegments(), loadedSegmentation.GetNumberOfSegments() )
+    for segmentIndex in range(onDemandSegmentation.GetNumberOfSegments()):
+      onDemandSegment = onDemandSegmentation.GetNthSegment(segmentIndex)
+      loadedSegment = loadedSegmentation.GetNthSegment(segmentIndex)
+      self.assertEqual( onDemandSegment.GetName(), loadedSegment.GetName() )
+      # Planar contours and bounds are complete, only the closed surface is a placeholder
+      self.assertEqual( onDemandSegment.GetRepresentation(planarContourName).GetNumberOfPoints(),
+        loadedSegment.GetRepresentation(planarContourName).GetNumberOfPoints() )
+      onDemandBounds = vtk.mutable('')
+      self.assertTrue( onDemandSegment.GetTag(roiBoundsTagName, onDemandBounds) )
+      loadedBounds = vtk.mutable('')
+      self.assertTrue( loadedSegment.GetTag(roiBoundsTagName, loadedBounds) )
+      self.assertEqual( str(onDemandBounds), str(loadedBounds) )
+      self.assertEqual( onDemandSegment.GetRepresentation(closedSurfaceName).GetNumberOfPoints(), 0 )
+
+    # Show one segment, which creates its closed surface
+    firstSegmentID = onDemandSegmentation.GetNthSegmentID(0)
+    onDemandSegmentationNode.GetDisplayNode().SetSegmentVisibility(firstSegmentID, True)
+    self.assertEqual( onDemandSegmentation.GetSegment(firstSegmentID).GetRepresentation(closedSurfaceName).GetNumberOfPoints(),
+      loadedSegmentation.GetNthSegment(0).GetRepresentation(closedSurfaceName).GetNumberOfPoints() )
+    self.assertEqual( onDemandSegmentation.GetNthSegment(1).GetRepresentation(closedSurfaceName).GetNumberOfPoints(), 0 )
+
+    # Load all remaining segments
+    self.assertEqual( rtLogic.LoadDeferredRoiContours(onDemandSegmentationNode), onDemandSegmentation.GetNumberOfSegments() - 1 )
+    for segmentIndex in range(onDemandSegmentation.GetNumberOfSegments()):
+      self.assertEqual( onDemandSegmentation.GetNthSegment(segmentIndex).GetRepresentation(closedSurfaceName).GetNumberOfPoints(),
+        loadedSegmentation.GetNthSegment(segmentIndex).GetRepresentation(closedSurfaceName).GetNumberOfPoints() )
+
+    slicer.mrmlScene.RemoveNode(onDemandSegmentationNode)
+
+    # Load it again with only placeholder segments, then save it without loading them
+    rtLogic.SetLoadRoiContoursOnDemand(True)
+    self.assertTrue( rtLogic.LoadDicomRT(loadablesCollection.GetItemAsObject(0)) )
+    rtLogic.SetLoadRoiContoursOnDemand(False)
+    onDemandSegmentationNode = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')[1]
+    onDemandSegmentation = onDemandSegmentationNode.GetSegmentation()
+    segmentationFilePath = os.path.join(self.tempDir, 'OnDemandSegmentation.seg.vtm')
+    self.assertTrue( slicer.util.saveNode(onDemandSegmentationNode, segmentationFilePath) )
+
+    # Reload the saved segmentation and compare it to the one loaded with all contours
+    reloadedSegmentationNode = slicer.util.loadSegmentation(segmentationFilePath)
+    self.assertIsNotNone( reloadedSegmentationNode )
+    reloadedSegmentation = reloadedSegmentationNode.GetSegmentation()
+    self.assertEqual( reloadedSegmentation.GetNumberOfSegments(), loadedSegmentation.GetNumberOfSegments() )
+    for segmentIndex in range(reloadedSegmentation.GetNumberOfSegments()):
+      self.assertEqual( reloadedSegmentation.GetNthSegment(segmentIndex).GetRepresentation(planarContourName).GetNumberOfPoints(),
+        loadedSegmentation.GetNthSegment(segmentIndex).GetRepresentation(planarContourName).GetNumberOfPoints() )
+
+    self.assertEqual( rtLogic.LoadDeferredRoiContours(onDemandSegmentationNode), onDemandSegmentation.GetNumberOfSegments() )
+
+    slicer.mrmlScene.RemoveNode(reloadedSegmentationNode)
+    slicer.mrmlScene.RemoveNode(onDemandSegmentationNode)
+
+  #------------------------------------------------------------------------------
+  def TestSection_SetBeamControlPointIndex(self):
+    logging.info("Set beam control point index")
+
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    planNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLRTPlanNode', 'ControlPointTestPlan')
+    beamNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLRTBeamNode', 'ControlPointTestBeam')
+    planNode.AddBeam(beamNode)
+
+    # MLC table as created for a beam loaded with a control point table (see LoadDynamicBeamsCompact)
+    numberOfLeafPairs = 3
+    mlcTableNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLTableNode', 'ControlPointTestMLC')
+    mlcTable = mlcTableNode.GetTable()
+    for columnName in ['Boundary', '1', '2']:
+      column = vtk.vtkDoubleArray()
+      column.SetName(columnName)
+      mlcTable.AddColumn(column)
+    mlcTable.SetNumberOfRows(numberOfLeafPairs + 1)
+    for row in range(numberOfLeafPairs + 1):
+      mlcTable.SetValue(row, 0, -15.0 + 10.0 * row)
+      mlcTable.SetValue(row, 1, 0.0)
+      mlcTable.SetValue(row, 2, 0.0)
+    beamNode.SetAndObserveMultiLeafCollimatorTableNode(mlcTableNode)
+
+    # Control point table with one column for each leaf. The second control point has no valid MLC data
+    def leafPosition(controlPointIndex, side, leafPairIndex):
+      if controlPointIndex == 1:
+        return float('nan')
+      return (-1.0 if side == 1 else 1.0) * (10.0 + 5.0 * controlPointIndex + leafPairIndex)
+    numberOfControlPoints = 3
+    controlPointTableNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLTableNode', 'ControlPointTestControlPoints')
+    columnValues = [
+      ('GantryAngle', lambda controlPointIndex: 90.0 * controlPointIndex),
+      ('CollimatorAngle', lambda controlPointIndex: 0.0),
+      ('CouchAngle', lambda controlPointIndex: 0.0),
+      ('X1Jaw', lambda controlPointIndex: -50.0),
+      ('X2Jaw', lambda controlPointIndex: 50.0),
+      ('Y1Jaw', lambda controlPointIndex: -50.0),
+      ('Y2Jaw', lambda controlPointIndex: 50.0) ]
+    for side in [1, 2]:
+      for leafPairIndex in range(numberOfLeafPairs):
+        columnValues.append( ('Leaf%d_%d' % (side, leafPairIndex),
+          lambda controlPointIndex, side=side, leafPairIndex=leafPairIndex: leafPosition(controlPointIndex, side, leafPairIndex)) )
+    for columnName, value in columnValues:
+      column = vtk.vtkDoubleArray()
+      column.SetName(columnName)
+      column.SetNumberOfValues(numberOfControlPoints)
+      for controlPointIndex in range(numberOfControlPoints):
+        column.SetValue(controlPointIndex, value(controlPointIndex))
+      controlPointTableNode.GetTable().AddColumn(column)
+    beamNode.SetNodeReferenceID('controlPointTableRef', controlPointTableNode.GetID())
+    self.assertEqual( rtLogic.GetBeamNumberOfControlPoints(beamNode), numberOfControlPoints )
+
+    def assertLeafPositions(controlPointIndex):
+      for leafPairIndex in range(numberOfLeafPairs):
+        self.assertEqual( mlcTable.GetValue(leafPairIndex, 0).ToDouble(), -15.0 + 10.0 * leafPairIndex )
+        self.assertEqual( mlcTable.GetValue(leafPairIndex, 1).ToDouble(), leafPosition(controlPointIndex, 1, leafPairIndex) )
+        self.assertEqual( mlcTable.GetValue(leafPairIndex, 2).ToDouble(), leafPosition(controlPointIndex, 2, leafPairIndex) )
+      # The row of the last leaf pair boundary has no leaf positions
+      self.assertEqual( mlcTable.GetValue(numberOfLeafPairs, 1).ToDouble(), 0.0 )
+      self.assertEqual( mlcTable.GetValue(numberOfLeafPairs, 2).ToDouble(), 0.0 )
+
+    self.assertTrue( rtLogic.SetBeamControlPointIndex(beamNode, 2) )
+    self.assertEqual( beamNode.GetGantryAngle(), 180.0 )
+    assertLeafPositions(2)
+
+    # Leaf positions are kept for a control point without MLC data
+    self.assertTrue( rtLogic.SetBeamControlPointIndex(beamNode, 1) )
+    self.assertEqual( beamNode.GetGantryAngle(), 90.0 )
+    assertLeafPositions(2)
+
+    self.assertTrue( rtLogic.SetBeamControlPointIndex(beamNode, 0) )
+    self.assertEqual( beamNode.GetGantryAngle(), 0.0 )
+    assertLeafPositions(0)
+    self.assertEqual( beamNode.GetAttribute('DicomRtImport.ControlPointIndex'), '0' )
+
+    slicer.mrmlScene.RemoveNode(controlPointTableNode)
+    slicer.mrmlScene.RemoveNode(mlcTableNode)
+    slicer.mrmlScene.RemoveNode(beamNode)
+    slicer.mrmlScene.RemoveNode(planNode)
+
+  #------------------------------------------------------------------------------
+  def TestSection_LoadDynamicBeamsCompact(self):
+    logging.info("Load dynamic beams compact")
+
+    # Examine the plan file
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    rtPlanStorageSopClassUid = '1.2.840.10008.5.1.4.1.1.481.5'
+    fileList = vtk.vtkStringArray()
+    for fileName in sorted(os.listdir(self.dataDir)):
+      filePath = self.dataDir + '/' + fileName
+      if slicer.dicomDatabase.fileValue(filePath, '0008,0016') == rtPlanStorageSopClassUid:
+        fileList.InsertNextValue(filePath)
+    self.assertEqual( fileList.GetNumberOfValues(), 1 )
+    loadablesCollection = vtk.vtkCollection()
+    rtLogic.ExamineForLoad(fileList, loadablesCollection)
+    self.assertEqual( loadablesCollection.GetNumberOfItems(), 1 )
+
+    # Load the plan again with one beam node and control point table for each dynamic beam
+    existingNodeIDs = set(node.GetID() for node in slicer.util.getNodes('*').values())
+    rtLogic.SetLoadDynamicBeamsCompact(True)
+    self.assertTrue( rtLogic.LoadDicomRT(loadablesCollection.GetItemAsObject(0)) )
+    rtLogic.SetLoadDynamicBeamsCompact(False)
+    newNodes = [node for node in slicer.util.getNodes('*').values() if node.GetID() not in existingNodeIDs]
+    newBeamNodes = [node for node in newNodes if node.IsA('vtkMRMLRTBeamNode')]
+    self.assertGreater( len(newBeamNodes), 0 )
+
+    numberOfCompactBeams = 0
+    for beamNode in newBeamNodes:
+      controlPointTableNode = beamNode.GetNodeReference('controlPointTableRef')
+      if not controlPointTableNode:
+        # Static beam
+        self.assertEqual( rtLogic.GetBeamNumberOfControlPoints(beamNode), 0 )
+        continue
+      numberOfCompactBeams += 1
+      controlPointTable = controlPointTableNode.GetTable()
+      numberOfControlPoints = controlPointTable.GetNumberOfRows()
+      self.assertGreater( numberOfControlPoints, 1 )
+      self.assertEqual( rtLogic.GetBeamNumberOfControlPoints(beamNode), numberOfControlPoints )
+      gantryAngleColumn = controlPointTable.GetColumnByName('GantryAngle')
+      self.assertIsNotNone( gantryAngleColumn )
+
+      # The first control point is applied by the loader
+      self.assertEqual( beamNode.GetAttribute('DicomRtImport.ControlPointIndex'), '0' )
+      self.assertAlmostEqual( beamNode.GetGantryAngle(), gantryAngleColumn.GetValue(0) )
+
+      # Apply the last control point, including its MLC leaf positions if valid
+      lastControlPointIndex = numberOfControlPoints - 1
+      self.assertTrue( rtLogic.SetBeamControlPointIndex(beamNode, lastControlPointIndex) )
+      self.assertEqual( beamNode.GetAttribute('DicomRtImport.ControlPointIndex'), str(lastControlPointIndex) )
+      self.assertAlmostEqual( beamNode.GetGantryAngle(), gantryAngleColumn.GetValue(lastControlPointIndex) )
+      for jawName, jawPosition in [('X1Jaw', beamNode.GetX1Jaw()), ('X2Jaw', beamNode.GetX2Jaw()),
+          ('Y1Jaw', beamNode.GetY1Jaw()), ('Y2Jaw', beamNode.GetY2Jaw())]:
+        self.assertAlmostEqual( jawPosition, controlPointTable.GetColumnByName(jawName).GetValue(lastControlPointIndex) )
+      mlcTableNode = beamNode.GetMultiLeafCollimatorTableNode()
+      firstLeafColumn = controlPointTable.GetColumnByName('Leaf1_0')
+      self.assertEqual( mlcTableNode is not None, firstLeafColumn is not None )
+      if mlcTableNode and not math.isnan(firstLeafColumn.GetValue(lastControlPointIndex)):
+        mlcTable = mlcTableNode.GetTable()
+        numberOfLeafPairs = mlcTable.GetNumberOfRows() - 1
+        for leafPairIndex in range(numberOfLeafPairs):
+          self.assertAlmostEqual( mlcTable.GetValue(leafPairIndex, 1).ToDouble(),
+            controlPointTable.GetColumnByName('Leaf1_%d' % leafPairIndex).GetValue(lastControlPointIndex) )
+          self.assertAlmostEqual( mlcTable.GetValue(leafPairIndex, 2).ToDouble(),
+            controlPointTable.GetColumnByName('Leaf2_%d' % leafPairIndex).GetValue(lastControlPointIndex) )
+    self.assertGreater( numberOfCompactBeams, 0 )
+
+    for node in newNodes:
+      if node.GetScene():
+        slicer.mrmlScene.RemoveNode(node)
+
+  #------------------------------------------------------------------------------
+  def TestSection_ExportDoseAndContoursDirectly(self):
+    logging.info("Export dose and contours directly")
+
+    import vtkSlicerRtCommonPython as vtkSlicerRtCommon
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    shNode = slicer.vtkMRMLSubjectHierarchyNode.GetSubjectHierarchyNode(slicer.mrmlScene)
+    doseNode = [node for node in slicer.util.getNodesByClass('vtkMRMLScalarVolumeNode') if vtkSlicerRtCommon.vtkSlicerRtCommon.IsDoseVolumeNode(node)][0]
+    segmentationNode = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')[0]
+
+    # Anatomical image is required for export, create one with the geometry of the dose
+    anatomicalImageData = vtk.vtkImageData()
+    anatomicalImageData.DeepCopy(doseNode.GetImageData())
+    ijkToRas = vtk.vtkMatrix4x4()
+    doseNode.GetIJKToRASMatrix(ijkToRas)
+    anatomicalNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLScalarVolumeNode', 'DirectExportAnatomicalImage')
+    anatomicalNode.SetAndObserveImageData(anatomicalImageData)
+    anatomicalNode.SetIJKToRASMatrix(ijkToRas)
+
+    exportDir = self.tempDir + '/DirectExport'
+    if not os.access(exportDir, os.F_OK):
+      os.makedirs(exportDir)
+    for fileName in os.listdir(exportDir):
+      os.remove(exportDir + '/' + fileName)
+
+    # Export dose (first, so that its study is used), anatomical image, and structures
+    exportables = vtk.vtkCollection()
+    for node in [doseNode, anatomicalNode, segmentationNode]:
+      exportable = slicer.vtkSlicerDICOMExportable()
+      exportable.SetSubjectHierarchyItemID(shNode.GetItemByDataNode(node))
+      exportable.SetDirectory(exportDir)
+      exportables.AddItem(exportable)
+    rtLogic.SetExportDoseAndContoursDirectly(True)
+    error = rtLogic.ExportDicomRTStudy(exportables)
+    rtLogic.SetExportDoseAndContoursDirectly(False)
+    self.assertEqual( error, '' )
+
+    # Load the exported dose and structure set
+    fileList = vtk.vtkStringArray()
+    fileList.InsertNextValue(exportDir + '/dose.dcm')
+    fileList.InsertNextValue(exportDir + '/rtss.dcm')
+    loadablesCollection = vtk.vtkCollection()
+    rtLogic.ExamineForLoad(fileList, loadablesCollection)
+    self.assertEqual( loadablesCollection.GetNumberOfItems(), 2 )
+    volumeNodesBeforeLoad = slicer.util.getNodesByClass('vtkMRMLScalarVolumeNode')
+    segmentationNodesBeforeLoad = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')
+    for loadableIndex in range(loadablesCollection.GetNumberOfItems()):
+      self.assertTrue( rtLogic.LoadDicomRT(loadablesCollection.GetItemAsObject(loadableIndex)) )
+    loadedDoseNodes = [node for node in slicer.util.getNodesByClass('vtkMRMLScalarVolumeNode') if node not in volumeNodesBeforeLoad]
+    loadedSegmentationNodes = [node for node in slicer.util.getNodesByClass('vtkMRMLSegmentationNode') if node not in segmentationNodesBeforeLoad]
+    self.assertEqual( len(loadedDoseNodes), 1 )
+    self.assertEqual( len(loadedSegmentationNodes), 1 )
+
+    # Dose values are stored with 32-bit precision relative to the maximum dose
+    import numpy
+    from vtk.util import numpy_support
+    originalDoseRange = doseNode.GetImageData().GetScalarRange()
+    loadedDoseRange = loadedDoseNodes[0].GetImageData().GetScalarRange()
+    self.assertAlmostEqual( loadedDoseRange[1], originalDoseRange[1], delta=originalDoseRange[1]*1e-6 )
+    self.assertEqual( loadedDoseNodes[0].GetImageData().GetDimensions(), doseNode.GetImageData().GetDimensions() )
+    for axis in range(3):
+      self.assertAlmostEqual( loadedDoseNodes[0].GetOrigin()[axis], doseNode.GetOrigin()[axis], places=3 )
+      self.assertAlmostEqual( loadedDoseNodes[0].GetSpacing()[axis], doseNode.GetSpacing()[axis], places=3 )
+    originalDoseVoxels = numpy_support.vtk_to_numpy(doseNode.GetImageData().GetPointData().GetScalars()).astype(numpy.float64)
+    loadedDoseVoxels = numpy_support.vtk_to_numpy(loadedDoseNodes[0].GetImageData().GetPointData().GetScalars()).astype(numpy.float64)
+    self.assertLessEqual( numpy.max(numpy.abs(loadedDoseVoxels - originalDoseVoxels)), originalDoseRange[1]*1e-6 )
+    # The exported dose references the RT plan of the original dose
+    referencedInstanceUIDsAttributeName = slicer.vtkMRMLSubjectHierarchyConstants.GetDICOMReferencedInstanceUIDsAttributeName()
+    originalReferencedPlanUID = shNode.GetItemAttribute(shNode.GetItemByDataNode(doseNode), referencedInstanceUIDsAttributeName)
+    self.assertNotEqual( originalReferencedPlanUID, '' )
+    self.assertEqual( shNode.GetItemAttribute(shNode.GetItemByDataNode(loadedDoseNodes[0]), referencedInstanceUIDsAttributeName),
+      originalReferencedPlanUID )
+
+    # Planar contours are written without changes
+    segmentation = segmentationNode.GetSegmentation()
+    loadedSegmentation = loadedSegmentationNodes[0].GetSegmentation()
+    planarContourName = slicer.vtkSegmentationConverter.GetSegmentationPlanarContourRepresentationName()
+    self.assertEqual( loadedSegmentation.GetNumberOfSegments(), segmentation.GetNumberOfSegments() )
+    for segmentIndex in range(segmentation.GetNumberOfSegments()):
+      segment = segmentation.GetNthSegment(segmentIndex)
+      loadedSegment = loadedSegmentation.GetNthSegment(segmentIndex)
+      self.assertEqual( loadedSegment.GetName(), segment.GetName() )
+      self.assertEqual( loadedSegment.GetRepresentation(planarContourName).GetNumberOfPoints(),
+        segment.GetRepresentation(planarContourName).GetNumberOfPoints() )
+      self.assertEqual( loadedSegment.GetRepresentation(planarContourName).GetNumberOfCells(),
+        segment.GetRepresentation(planarContourName).GetNumberOfCells() )
+      # Coordinates are written with eight significant digits
+      if segment.GetRepresentation(planarContourName).GetNumberOfPoints() > 0:
+        originalPoints = numpy_support.vtk_to_numpy(segment.GetRepresentation(planarContourName).GetPoints().GetData())
+        loadedPoints = numpy_support.vtk_to_numpy(loadedSegment.GetRepresentation(planarContourName).GetPoints().GetData())
+        self.assertLessEqual( numpy.max(numpy.abs(loadedPoints - originalPoints)), 1e-3 )
+
+    for node in loadedDoseNodes + loadedSegmentationNodes + [anatomicalNode]:
+      slicer.mrmlScene.RemoveNode(node)
+
+  #------------------------------------------------------------------------------
+  def TestSection_ExportLabelmapSegmentation(self):
+    logging.info("Export labelmap segmentation")
+
+    import vtkSlicerRtCommonPython as vtkSlicerRtCommon
+    rtLogic = slicer.modules.dicomrtimportexport.logic()
+    shNode = slicer.vtkMRMLSubjectHierarchyNode.GetSubjectHierarchyNode(slicer.mrmlScene)
+    doseNode = [node for node in slicer.util.getNodesByClass('vtkMRMLScalarVolumeNode') if vtkSlicerRtCommon.vtkSlicerRtCommon.IsDoseVolumeNode(node)][0]
+    segmentationNode = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')[0]
+    binaryLabelmapName = slicer.vtkSegmentationConverter.GetSegmentationBinaryLabelmapRepresentationName()
+    planarContourName = slicer.vtkSegmentationConverter.GetSegmentationPlanarContourRepresentationName()
+
+    # Anatomical image is required for export, create one with the geometry of the dose
+    anatomicalImageData = vtk.vtkImageData()
+    anatomicalImageData.DeepCopy(doseNode.GetImageData())
+    ijkToRas = vtk.vtkMatrix4x4()
+    doseNode.GetIJKToRASMatrix(ijkToRas)
+    anatomicalNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLScalarVolumeNode', 'LabelmapExportAnatomicalImage')
+    anatomicalNode.SetAndObserveImageData(anatomicalImageData)
+    anatomicalNode.SetIJKToRASMatrix(ijkToRas)
+
+    # Segmentation with binary labelmap master representation, so that the segments are exported through Plastimatch
+    labelmapSegmentationNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLSegmentationNode', 'LabelmapExportSegmentation')
+    labelmapSegmentationNode.GetSegmentation().DeepCopy(segmentationNode.GetSegmentation())
+    labelmapSegmentationNode.SetReferenceImageGeometryParameterFromVolumeNode(anatomicalNode)
+    self.assertTrue( labelmapSegmentationNode.GetSegmentation().CreateRepresentation(binaryLabelmapName) )
+    labelmapSegmentationNode.GetSegmentation().SetMasterRepresentationName(binaryLabelmapName)
+
+    # Export with one thread and with segments prepared on multiple threads, the results must be the same
+    loadedSegmentations = []
+    for numberOfThreads in [1, 4]:
+      exportDir = self.tempDir + '/LabelmapExport%d' % numberOfThreads
+      if not os.access(exportDir, os.F_OK):
+        os.makedirs(exportDir)
+      for fileName in os.listdir(exportDir):
+        os.remove(exportDir + '/' + fileName)
+
+      exportables = vtk.vtkCollection()
+      for node in [doseNode, anatomicalNode, labelmapSegmentationNode]:
+        exportable = slicer.vtkSlicerDICOMExportable()
+        exportable.SetSubjectHierarchyItemID(shNode.GetItemByDataNode(node))
+        exportable.SetDirectory(exportDir)
+        exportables.AddItem(exportable)
+      rtLogic.SetNumberOfThreads(numberOfThreads)
+      error = rtLogic.ExportDicomRTStudy(exportables)
+      rtLogic.SetNumberOfThreads(0)
+      self.assertEqual( error, '' )
+
+      fileList = vtk.vtkStringArray()
+      fileList.InsertNextValue(exportDir + '/rtss.dcm')
+      loadablesCollection = vtk.vtkCollection()
+      rtLogic.ExamineForLoad(fileList, loadablesCollection)
+      self.assertEqual( loadablesCollection.GetNumberOfItems(), 1 )
+      segmentationNodesBeforeLoad = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')
+      self.assertTrue( rtLogic.LoadDicomRT(loadablesCollection.GetItemAsObject(0)) )
+      loadedSegmentationNodes = [node for node in slicer.util.getNodesByClass('vtkMRMLSegmentationNode') if node not in segmentationNodesBeforeLoad]
+      self.assertEqual( len(loadedSegmentationNodes), 1 )
+      loadedSegmentations.append(loadedSegmentationNodes[0])
+
+    # All segments are exported in order, with contours of the non-empty labelmaps
+    labelmapSegmentation = labelmapSegmentationNode.GetSegmentation()
+    for loadedSegmentationNode in loadedSegmentations:
+      self.assertEqual( loadedSegmentationNode.GetSegmentation().GetNumberOfSegments(), labelmapSegmentation.GetNumberOfSegments() )
+    for segmentIndex in range(labelmapSegmentation.GetNumberOfSegments()):
+      segment = labelmapSegmentation.GetNthSegment(segmentIndex)
+      singleThreadSegment = loadedSegmentations[0].GetSegmentation().GetNthSegment(segmentIndex)
+      multiThreadSegment = loadedSegmentations[1].GetSegmentation().GetNthSegment(segmentIndex)
+      self.assertEqual( singleThreadSegment.GetName(), segment.GetName() )
+      self.assertEqual( multiThreadSegment.GetName(), segment.GetName() )
+      self.assertEqual( multiThreadSegment.GetRepresentation(planarContourName).GetNumberOfPoints(),
+        singleThreadSegment.GetRepresentation(planarContourName).GetNumberOfPoints() )
+      labelmap = slicer.vtkOrientedImageData()
+      labelmapSegmentationNode.GetBinaryLabelmapRepresentation(labelmapSegmentation.GetNthSegmentID(segmentIndex), labelmap)
+      if labelmap.GetNumberOfPoints() > 0 and labelmap.GetScalarRange()[1] > 0:
+        self.assertGreater( singleThreadSegment.GetRepresentation(planarContourName).GetNumberOfPoints(), 0 )
+
+    for node in loadedSegmentations + [labelmapSegmentationNode, anatomicalNode]:
+      slicer.mrmlScene.RemoveNode(node)
+
+  #------------------------------------------------------------------------------
+  def TestSection_PlanarContourToClosedSurface(self):
+    logging.info("Planar contour to closed surface conversion")
+
+    import vtkSlicerDicomRtImportExportConversionRulesPython as conversionRules
+    planarContourName = slicer.vtkSegmentationConverter.GetSegmentationPlanarContourRepresentationName()
+    closedSurfaceName = slicer.vtkSegmentationConverter.GetSegmentationClosedSurfaceRepresentationName()
+
+    # Triangulating in a narrow band of the dynamic programming table gives practically the same surface as the whole table.
+    # Conversion of synthetic contours is tested in vtkPlanarContourConversionRulesTest1
+    segmentation = slicer.util.getNodesByClass('vtkMRMLSegmentationNode')[0].GetSegmentation()
+    for segmentIndex in range(segmentation.GetNumberOfSegments()):
+      loadedSegment = segmentation.GetNthSegment(segmentIndex)
+      if loadedSegment.GetRepresentation(planarContourName).GetNumberOfLines() == 0:
+        continue
+      surfaceAreas = []
+      for maximumTableSize in [0, 1000]:
+        segment = slicer.vtkSegment()
+        segment.AddRepresentation(planarContourName, loadedSegment.GetRepresentation(planarContourName))
+        rule = conversionRules.vtkPlanarContourToClosedSurfaceConversionRule()
+        rule.SetConversionParameter(rule.GetDefaultSliceThicknessParameterName(),
+          segmentation.GetConversionParameter(rule.GetDefaultSliceThicknessParameterName()))
+        rule.SetMaximumTriangulationTableSize(maximumTableSize)
+        self.assertTrue( rule.Convert(segment) )
+        self.assertGreater( segment.GetRepresentation(closedSurfaceName).GetNumberOfPolys(), 0 )
+        massProperties = vtk.vtkMassProperties()
+        massProperties.SetInputData(segment.GetRepresentation(closedSurfaceName))
+        massProperties.Update()
+        surfaceAreas.append(massProperties.GetSurfaceArea())
+      self.assertAlmostEqual( surfaceAreas[1] / surfaceAreas[0], 1.0, delta=0.01 )
+
   #------------------------------------------------------------------------------
   def TestSection_ClearDatabase(self):
     # slicer.util.delayDisplay("Clear database",self.delayMs)
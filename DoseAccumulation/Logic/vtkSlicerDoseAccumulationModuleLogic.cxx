@@ -30,8 +30,12 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkResampledDoseCache.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
 
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
@@ -205,6 +209,14 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
   // Get reference image info
   int referenceDimensions[3] = {0, 0, 0};
   referenceDoseVolumeNode->GetImageData()->GetDimensions(referenceDimensions);
+  // The input volumes are resampled to the reference volume in world coordinates, so the cached images are keyed on
+  // the world geometry of the reference volume. They are not cached if the reference is under a non-linear transform
+  vtkSmartPointer<vtkOrientedImageData> referenceGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+  bool useResampledDoseCache = vtkResampledDoseCache::GetVolumeWorldGeometry(referenceDoseVolumeNode, referenceGeometry);
+  if (!useResampledDoseCache)
+  {
+    vtkResampledDoseCache::GetVolumeGeometry(referenceDoseVolumeNode, referenceGeometry);
+  }
 
   // Apply weight and accumulate input dose volumes
   vtkSmartPointer<vtkImageData> accumulatedImageData = vtkSmartPointer<vtkImageData>::New();
@@ -221,12 +233,41 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
     double currentWeight = (*volumeNodeIdsToWeightsMap)[currentInputDoseVolumeNode->GetID()];
 
-    vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode = 
-      vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
+    // Use the input dose volume resampled to the reference geometry earlier if available
+    std::string inputDoseVolumeKey = (useResampledDoseCache ? vtkResampledDoseCache::GetVolumeKey(currentInputDoseVolumeNode) : "");
+    vtkSmartPointer<vtkOrientedImageData> resampledInputDoseImage = vtkResampledDoseCache::GetInstance()->GetImage(
+      inputDoseVolumeKey, referenceGeometry, VTK_LINEAR_INTERPOLATION);
+    if (!resampledInputDoseImage)
+    {
+      vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode =
+        vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
+      if (!resampledInputDoseVolumeNode || !resampledInputDoseVolumeNode->GetImageData())
+      {
+        std::stringstream errorMessage;
+        errorMessage << "Failed to resample input volume #" << inputVolumeIndex;
+        vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage.str());
+        return errorMessage.str().c_str();
+      }
+      resampledInputDoseImage = vtkSmartPointer<vtkOrientedImageData>::New();
+      resampledInputDoseImage->ShallowCopy(resampledInputDoseVolumeNode->GetImageData());
+      resampledInputDoseImage->CopyDirections(referenceGeometry);
+      resampledInputDoseImage->SetOrigin(referenceGeometry->GetOrigin());
+      resampledInputDoseImage->SetSpacing(referenceGeometry->GetSpacing());
+      vtkResampledDoseCache::GetInstance()->AddImage(inputDoseVolumeKey, referenceGeometry, VTK_LINEAR_INTERPOLATION, resampledInputDoseImage);
+
+      // Remove the resample dose currentNode from scene and release the memory
+      this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
+    }
+
+    // The accumulated image data is set to the output volume, so it is kept in IJK coordinates
+    vtkSmartPointer<vtkImageData> resampledInputDoseImageData = vtkSmartPointer<vtkImageData>::New();
+    resampledInputDoseImageData->ShallowCopy(resampledInputDoseImage);
+    resampledInputDoseImageData->SetOrigin(0.0, 0.0, 0.0);
+    resampledInputDoseImageData->SetSpacing(1.0, 1.0, 1.0);
 
     // Apply weight
     vtkSmartPointer<vtkImageMathematics> multiplyFilter = vtkSmartPointer<vtkImageMathematics>::New();
-    multiplyFilter->SetInputConnection(resampledInputDoseVolumeNode->GetImageDataConnection());
+    multiplyFilter->SetInputData(resampledInputDoseImageData);
     multiplyFilter->SetConstantK(currentWeight);
     multiplyFilter->SetOperationToMultiplyByK();
     multiplyFilter->Update();
@@ -248,9 +289,6 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     {
       accumulatedImageData->DeepCopy(multiplyFilter->GetOutput());
     }
-
-    // Remove the resample dose currentNode from scene and release the memory
-    this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
   }
 
   // Create display currentNode for the accumulated volume
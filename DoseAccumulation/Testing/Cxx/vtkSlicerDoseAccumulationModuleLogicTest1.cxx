@@ -25,6 +25,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkResampledDoseCache.h"
 
 // Subject hierarchy includes
 #include "vtkMRMLSubjectHierarchyConstants.h"
@@ -32,6 +33,7 @@
 
 // MRML includes
 #include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
@@ -43,6 +45,7 @@
 #include <vtkImageAccumulate.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkTransform.h>
 
 // ITK includes
 #if ITK_VERSION_MAJOR > 3
@@ -52,6 +55,22 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+//-----------------------------------------------------------------------------
+// Check that the voxels of two images are the same
+bool AreImageVoxelsEqual(vtkImageData* image1, vtkImageData* image2)
+{
+  vtkSmartPointer<vtkImageMathematics> difference = vtkSmartPointer<vtkImageMathematics>::New();
+  difference->SetInput1Data(image1);
+  difference->SetInput2Data(image2);
+  difference->SetOperationToSubtract();
+  difference->Update();
+
+  vtkSmartPointer<vtkImageAccumulate> differenceHistogram = vtkSmartPointer<vtkImageAccumulate>::New();
+  differenceHistogram->SetInputData(difference->GetOutput());
+  differenceHistogram->Update();
+  return differenceHistogram->GetMax()[0] == 0.0 && differenceHistogram->GetMin()[0] == 0.0;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
 {
@@ -233,6 +252,68 @@ int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Accumulate again from the resampled input volumes in the cache, then again without the cache,
+  // and check that the accumulated voxels are the same
+  if (vtkResampledDoseCache::GetInstance()->GetNumberOfImages() == 0)
+  {
+    std::cerr << "ERROR: Resampled input dose volumes are not cached" << std::endl;
+    return EXIT_FAILURE;
+  }
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkImageData> cachedAccumulatedImageData = vtkSmartPointer<vtkImageData>::New();
+  cachedAccumulatedImageData->DeepCopy(accumulatedDoseVolumeNode->GetImageData());
+
+  vtkResampledDoseCache::GetInstance()->RemoveAllImages();
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!AreImageVoxelsEqual(cachedAccumulatedImageData, accumulatedDoseVolumeNode->GetImageData()))
+  {
+    std::cerr << "ERROR: Dose accumulated from the cached resampled volumes differs from the one accumulated without the cache" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Moving the reference volume changes where the input volumes are resampled. Accumulate with the reference volume
+  // under a transform while the cache holds the input volumes resampled to the untransformed reference volume,
+  // then again without the cache, and check that the cached images of the old reference position are not used
+  vtkSmartPointer<vtkMRMLLinearTransformNode> referenceTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  mrmlScene->AddNode(referenceTransformNode);
+  vtkSmartPointer<vtkTransform> referenceTransform = vtkSmartPointer<vtkTransform>::New();
+  referenceTransform->Translate(7.5, -5.0, 10.0);
+  referenceTransformNode->SetMatrixTransformToParent(referenceTransform->GetMatrix());
+  doseScalarVolumeNode->SetAndObserveTransformNodeID(referenceTransformNode->GetID());
+
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkImageData> transformedAccumulatedImageData = vtkSmartPointer<vtkImageData>::New();
+  transformedAccumulatedImageData->DeepCopy(accumulatedDoseVolumeNode->GetImageData());
+
+  vtkResampledDoseCache::GetInstance()->RemoveAllImages();
+  errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!AreImageVoxelsEqual(transformedAccumulatedImageData, accumulatedDoseVolumeNode->GetImageData()))
+  {
+    std::cerr << "ERROR: Dose accumulated after moving the reference volume uses resampled volumes of the old reference position" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
 
@@ -58,6 +58,9 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
   this->ResultsValid = false;
   this->ReportString = nullptr;
   this->LocalDoseDifference = false;
+  this->UseNativeGammaCalculation = false;
+  this->GammaCriteria = nullptr;
+  this->SetGammaCriteria("3/3,3/2,2/2,1/1");
 
   this->HideFromEditors = false;
 }
@@ -66,6 +69,7 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
 vtkMRMLDoseComparisonNode::~vtkMRMLDoseComparisonNode()
 {
   this->SetMaskSegmentID(nullptr);
+  this->SetGammaCriteria(nullptr);
 }
 
 //----------------------------------------------------------------------------
@@ -83,6 +87,8 @@ void vtkMRMLDoseComparisonNode::WriteXML(ostream& of, int nIndent)
   of << " UseMaximumDose=\"" << (this->UseMaximumDose ? "true" : "false") << "\"";
   of << " UseGeometricGammaCalculation=\"" << (this->UseGeometricGammaCalculation ? "true" : "false") << "\"";
   of << " LocalDoseDifference=\"" << (this->LocalDoseDifference ? "true" : "false") << "\"";
+  of << " UseNativeGammaCalculation=\"" << (this->UseNativeGammaCalculation ? "true" : "false") << "\"";
+  of << " GammaCriteria=\"" << (this->GammaCriteria ? this->GammaCriteria : "") << "\"";
   of << " DoseThresholdOnReferenceOnly=\"" << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\"";
   of << " PassFractionPercent=\"" << this->PassFractionPercent << "\"";
   of << " ResultsValid=\"" << (this->ResultsValid ? "true" : "false") << "\"";
@@ -139,6 +145,14 @@ void vtkMRMLDoseComparisonNode::ReadXMLAttributes(const char** atts)
       {
       this->LocalDoseDifference = (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "UseNativeGammaCalculation"))
+      {
+      this->UseNativeGammaCalculation = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "GammaCriteria"))
+      {
+      this->SetGammaCriteria(attValue);
+      }
     else if (!strcmp(attName, "DoseThresholdOnReferenceOnly"))
       {
       this->DoseThresholdOnReferenceOnly = (strcmp(attValue,"true") ? false : true);
@@ -176,6 +190,8 @@ void vtkMRMLDoseComparisonNode::Copy(vtkMRMLNode *anode)
   this->UseMaximumDose = node->UseMaximumDose;
   this->UseGeometricGammaCalculation = node->UseGeometricGammaCalculation;
   this->LocalDoseDifference = node->LocalDoseDifference;
+  this->UseNativeGammaCalculation = node->UseNativeGammaCalculation;
+  this->SetGammaCriteria(node->GammaCriteria);
   this->DoseThresholdOnReferenceOnly = node->DoseThresholdOnReferenceOnly;
   this->ResultsValid = node->ResultsValid;
   this->ReportString = node->ReportString;
@@ -198,6 +214,8 @@ void vtkMRMLDoseComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "UseMaximumDose:   " << (this->UseMaximumDose ? "true" : "false") << "\n";
   os << indent << "UseGeometricGammaCalculation:   " << (this->UseGeometricGammaCalculation ? "true" : "false") << "\n";
   os << indent << "LocalDoseDifference:   " << (this->LocalDoseDifference ? "true" : "false") << "\n";
+  os << indent << "UseNativeGammaCalculation:   " << (this->UseNativeGammaCalculation ? "true" : "false") << "\n";
+  os << indent << "GammaCriteria:   " << (this->GammaCriteria ? this->GammaCriteria : "") << "\n";
   os << indent << "DoseThresholdOnReferenceOnly:   " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
   os << indent << "PassFractionPercent:   " << this->PassFractionPercent << "\n";
   os << indent << "ResultsValid:   " << (this->ResultsValid ? "true" : "false") << "\n";
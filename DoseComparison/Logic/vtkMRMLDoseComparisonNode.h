@@ -129,6 +129,18 @@ public:
   /// Set dose threshold on reference flag
   vtkBooleanMacro(DoseThresholdOnReferenceOnly, bool);
 
+  /// Get native gamma calculation flag
+  vtkGetMacro(UseNativeGammaCalculation, bool);
+  /// Set native gamma calculation flag
+  vtkSetMacro(UseNativeGammaCalculation, bool);
+  /// Set native gamma calculation flag
+  vtkBooleanMacro(UseNativeGammaCalculation, bool);
+
+  /// Get gamma criteria for pass rate computation
+  vtkGetStringMacro(GammaCriteria);
+  /// Set gamma criteria for pass rate computation
+  vtkSetStringMacro(GammaCriteria);
+
   /// Get local dose difference flag
   vtkGetMacro(LocalDoseDifference, bool);
   /// Set local dose difference flag
@@ -196,6 +208,16 @@ protected:
   /// Flag determining whether local dose difference is used in the gamma calculation. Global if false (default).
   bool LocalDoseDifference;
 
+  /// Flag determining whether gamma is computed by the multithreaded SlicerRT implementation working directly
+  /// on the VTK images (vtkGammaDoseComparison), avoiding conversion to and from ITK images.
+  /// Default value is false, meaning that the plastimatch gamma computation is used.
+  bool UseNativeGammaCalculation;
+
+  /// Gamma criteria used when computing pass rates for multiple criteria in one pass.
+  /// Comma separated list of "<dose difference %>/<DTA mm>" pairs, with an 'L' suffix if local dose difference is used,
+  /// for example "3/3, 3/2, 2/2, 1/1, 3/3L". Default value is "3/3,3/2,2/2,1/1"
+  char* GammaCriteria;
+
   /// Flag determining whether dose thresholding should be performed using only the reference image
   /// Default value is false, meaning that both images will be used
   bool DoseThresholdOnReferenceOnly;
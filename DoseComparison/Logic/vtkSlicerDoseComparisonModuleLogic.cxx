@@ -24,6 +24,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkGammaDoseComparison.h"
 #include "PlmCommon.h"
 
 // Plastimatch includes
@@ -33,6 +34,7 @@
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // MRML includes
@@ -41,6 +43,7 @@
 #include <vtkMRMLTransformNode.h>
 #include <vtkMRMLColorTableNode.h>
 #include <vtkMRMLSelectionNode.h>
+#include <vtkMRMLTableNode.h>
 #include <vtkMRMLScene.h>
 #include <vtkMRMLSubjectHierarchyConstants.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
@@ -51,7 +54,13 @@
 #include <vtkSlicerSubjectHierarchyModuleLogic.h>
 
 // VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNew.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
 #include <vtkTimerLog.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
@@ -61,6 +70,10 @@
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
+// STD includes
+#include <algorithm>
+#include <sstream>
+
 //---------------------------------------------------------------------------
 const char* vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME = "DoseComparison.GammaVolume"; // Identifier
 const char* vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_DEFAULT_GAMMA_COLOR_TABLE_FILE_NAME = "Gamma_ColorTable.ctbl";
@@ -78,6 +91,17 @@ void GammaProgressCallback(float progress)
   }
 }
 
+//---------------------------------------------------------------------------
+void NativeGammaProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* callData)
+{
+  vtkSlicerDoseComparisonModuleLogic* logic = reinterpret_cast<vtkSlicerDoseComparisonModuleLogic*>(clientData);
+  double* progress = reinterpret_cast<double*>(callData);
+  if (logic && progress)
+  {
+    logic->GammaProgressUpdated(static_cast<float>(*progress));
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseComparisonModuleLogic);
 
@@ -194,6 +218,17 @@ void vtkSlicerDoseComparisonModuleLogic::GammaProgressUpdated(float progress)
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode)
 {
+  if (!parameterNode)
+  {
+    std::string errorMessage("Invalid parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+  if (parameterNode->GetUseNativeGammaCalculation())
+  {
+    return this->ComputeGammaDoseDifferenceNative(parameterNode);
+  }
+
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
 
@@ -209,42 +244,10 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   const char* maskSegmentID = parameterNode->GetMaskSegmentID();
   if (maskSegmentationNode && maskSegmentID)
   {
-    // Extract a labelmap for the dose comparison to use it as a mask
-    vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
-    vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
-    if (!maskSegment)
-    {
-      std::string errorMessage("Failed to get mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
-    }
-
-    // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
-    vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
-    segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
-    segmentationCopy->CopyConversionParameters(maskSegmentation);
-    segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
-    if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    std::string errorMessage = this->GetMaskSegmentLabelmap(parameterNode, maskSegmentLabelmap);
+    if (!errorMessage.empty())
     {
-      std::string errorMessage("Failed to create binary labelmap representation for mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
-    }
-    // Get segment binary labelmap
-#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
-    vtkNew<vtkOrientedImageData>  maskSegmentLabelmap;
-    maskSegmentationNode->GetBinaryLabelmapRepresentation(maskSegmentID, maskSegmentLabelmap);
-#else
-    vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
-      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
-#endif
-
-    // Apply parent transformation nodes if necessary
-    if ( maskSegmentationNode->GetParentTransformNode()
-      && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskSegmentLabelmap)) )
-    {
-      std::string errorMessage("Failed to apply parent transform on mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
 
@@ -299,6 +302,387 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   }
 
   vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
+  std::string errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  parameterNode->ResultsValidOn();
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+              << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
+              << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
+              << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
+              << "\tConverting back from ITK to VTK: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+
+  parameterNode->ResultsValidOff();
+
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  if (gammaVolumeNode == nullptr)
+  {
+    std::string errorMessage("Invalid gamma volume node in parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Compute gamma dose volume
+  vtkNew<vtkGammaDoseComparison> gamma;
+  vtkNew<vtkMatrix4x4> referenceIjkToRasMatrix;
+  std::string errorMessage = this->SetUpNativeGammaComputation(parameterNode, gamma, referenceIjkToRasMatrix);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+  double checkpointGammaStart = timer->GetUniversalTime();
+  gamma->SetDtaDistanceToleranceMm(parameterNode->GetDtaDistanceToleranceMm());
+  gamma->SetDoseDifferenceTolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+  gamma->SetLocalGamma(parameterNode->GetLocalDoseDifference());
+  if (!gamma->Update())
+  {
+    errorMessage = "Gamma computation failed";
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+  parameterNode->SetPassFractionPercent(gamma->GetPassFraction() * 100.0);
+  parameterNode->SetReportString(gamma->GetReportString().c_str());
+
+  // Set gamma image to output volume node in the reference geometry
+  double checkpointOutputStart = timer->GetUniversalTime();
+  vtkSmartPointer<vtkImageData> gammaImage = vtkSmartPointer<vtkImageData>::New();
+  gammaImage->ShallowCopy(gamma->GetGammaImage());
+  gammaImage->SetOrigin(0.0, 0.0, 0.0);
+  gammaImage->SetSpacing(1.0, 1.0, 1.0);
+  gammaVolumeNode->SetIJKToRASMatrix(referenceIjkToRasMatrix);
+  gammaVolumeNode->SetAndObserveImageData(gammaImage);
+
+  errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  parameterNode->ResultsValidOn();
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
+              << "\tApplying transforms and resampling: " << checkpointGammaStart-checkpointStart << " s" << std::endl
+              << "\tGamma computation: " << checkpointOutputStart-checkpointGammaStart << " s" << std::endl
+              << "\tSetting up output: " << checkpointEnd-checkpointOutputStart << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::SetUpNativeGammaComputation(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkGammaDoseComparison* gamma, vtkMatrix4x4* referenceIjkToRasMatrix)
+{
+  if (!parameterNode || !gamma || !referenceIjkToRasMatrix)
+  {
+    std::string errorMessage("Invalid inputs");
+    vtkErrorMacro("SetUpNativeGammaComputation: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Get input doses in world coordinate system, and resample the compare dose (and the mask) to the reference dose geometry.
+  // The resampled images must not be padded, as the gamma computation requires the extent of the reference dose
+  vtkSmartPointer<vtkOrientedImageData> referenceDose = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareDose = vtkSmartPointer<vtkOrientedImageData>::New();
+  if ( !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetReferenceDoseVolumeNode(), referenceDose)
+    || !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetCompareDoseVolumeNode(), compareDose) )
+  {
+    std::string errorMessage("Failed to get input dose volumes");
+    vtkErrorMacro("SetUpNativeGammaComputation: " << errorMessage);
+    return errorMessage;
+  }
+  vtkSmartPointer<vtkOrientedImageData> resampledCompareDose = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(compareDose, referenceDose, resampledCompareDose, true, false))
+  {
+    std::string errorMessage("Failed to resample compare dose volume");
+    vtkErrorMacro("SetUpNativeGammaComputation: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> resampledMask;
+  if (parameterNode->GetMaskSegmentationNode() && parameterNode->GetMaskSegmentID())
+  {
+    vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    std::string errorMessage = this->GetMaskSegmentLabelmap(parameterNode, maskSegmentLabelmap);
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
+    resampledMask = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(maskSegmentLabelmap, referenceDose, resampledMask, false, false))
+    {
+      errorMessage = "Failed to resample mask segment labelmap";
+      vtkErrorMacro("SetUpNativeGammaComputation: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Set common parameters. The criteria are set by the caller
+  gamma->SetReferenceImage(referenceDose);
+  gamma->SetCompareImage(resampledCompareDose);
+  gamma->SetMaskImage(resampledMask);
+  gamma->SetReferenceDose(parameterNode->GetUseMaximumDose() ? 0.0 : parameterNode->GetReferenceDoseGy());
+  gamma->SetAnalysisThreshold(parameterNode->GetAnalysisThresholdPercent() / 100.0);
+  gamma->SetMaximumGamma(parameterNode->GetMaximumGamma());
+  gamma->SetThresholdOnReferenceOnly(parameterNode->GetDoseThresholdOnReferenceOnly());
+  gamma->SetInterpolatedSearch(parameterNode->GetUseGeometricGammaCalculation());
+  vtkNew<vtkCallbackCommand> progressCommand;
+  progressCommand->SetCallback(NativeGammaProgressCallback);
+  progressCommand->SetClientData(this);
+  gamma->AddObserver(vtkCommand::ProgressEvent, progressCommand);
+
+  referenceDose->GetImageToWorldMatrix(referenceIjkToRasMatrix);
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaPassRates(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkMRMLTableNode* passRateTableNode, bool createGammaVolumes/*=false*/)
+{
+  if (!this->GetMRMLScene() || !parameterNode || !passRateTableNode)
+  {
+    std::string errorMessage("Invalid MRML scene, parameter set node or pass rate table node");
+    vtkErrorMacro("ComputeGammaPassRates: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Parse criteria
+  std::vector<double> doseDifferenceTolerancesPercent;
+  std::vector<double> dtaDistanceTolerancesMm;
+  std::vector<bool> localDoseDifferences;
+  if ( !this->ParseGammaCriteria(parameterNode->GetGammaCriteria(), doseDifferenceTolerancesPercent, dtaDistanceTolerancesMm, localDoseDifferences)
+    || doseDifferenceTolerancesPercent.empty() )
+  {
+    std::string errorMessage("Invalid gamma criteria: '") + (parameterNode->GetGammaCriteria() ? parameterNode->GetGammaCriteria() : "") + "'";
+    vtkErrorMacro("ComputeGammaPassRates: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Compute gamma for all criteria in one pass
+  vtkNew<vtkGammaDoseComparison> gamma;
+  vtkNew<vtkMatrix4x4> referenceIjkToRasMatrix;
+  std::string errorMessage = this->SetUpNativeGammaComputation(parameterNode, gamma, referenceIjkToRasMatrix);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+  for (size_t criterionIndex = 0; criterionIndex < doseDifferenceTolerancesPercent.size(); ++criterionIndex)
+  {
+    gamma->AddCriterion(dtaDistanceTolerancesMm[criterionIndex], doseDifferenceTolerancesPercent[criterionIndex] / 100.0,
+      localDoseDifferences[criterionIndex]);
+  }
+  gamma->SetComputeGammaImages(createGammaVolumes);
+  if (!gamma->Update())
+  {
+    errorMessage = "Gamma computation failed";
+    vtkErrorMacro("ComputeGammaPassRates: " << errorMessage);
+    return errorMessage;
+  }
+  parameterNode->SetReportString(gamma->GetReportString().c_str());
+
+  // Fill pass rate table, one row for each criterion
+  vtkTable* passRateTable = passRateTableNode->GetTable();
+  passRateTable->Initialize();
+  vtkNew<vtkStringArray> criterionColumn;
+  criterionColumn->SetName("Criterion");
+  vtkNew<vtkDoubleArray> doseDifferenceColumn;
+  doseDifferenceColumn->SetName("Dose difference (%)");
+  vtkNew<vtkDoubleArray> dtaColumn;
+  dtaColumn->SetName("DTA (mm)");
+  vtkNew<vtkStringArray> typeColumn;
+  typeColumn->SetName("Type");
+  vtkNew<vtkIdTypeArray> analyzedColumn;
+  analyzedColumn->SetName("Analyzed voxels");
+  vtkNew<vtkIdTypeArray> passedColumn;
+  passedColumn->SetName("Passed voxels");
+  vtkNew<vtkDoubleArray> passRateColumn;
+  passRateColumn->SetName("Pass rate (%)");
+  for (size_t criterionIndex = 0; criterionIndex < doseDifferenceTolerancesPercent.size(); ++criterionIndex)
+  {
+    std::stringstream criterionNameStream;
+    criterionNameStream << doseDifferenceTolerancesPercent[criterionIndex] << "%/" << dtaDistanceTolerancesMm[criterionIndex] << "mm"
+      << (localDoseDifferences[criterionIndex] ? " local" : "");
+    criterionColumn->InsertNextValue(criterionNameStream.str());
+    doseDifferenceColumn->InsertNextValue(doseDifferenceTolerancesPercent[criterionIndex]);
+    dtaColumn->InsertNextValue(dtaDistanceTolerancesMm[criterionIndex]);
+    typeColumn->InsertNextValue(localDoseDifferences[criterionIndex] ? "Local" : "Global");
+    analyzedColumn->InsertNextValue(gamma->GetNumberOfAnalyzedVoxels());
+    passedColumn->InsertNextValue(gamma->GetNumberOfPassingVoxels(static_cast<int>(criterionIndex)));
+    passRateColumn->InsertNextValue(gamma->GetPassFraction(static_cast<int>(criterionIndex)) * 100.0);
+  }
+  passRateTable->AddColumn(criterionColumn);
+  passRateTable->AddColumn(doseDifferenceColumn);
+  passRateTable->AddColumn(dtaColumn);
+  passRateTable->AddColumn(typeColumn);
+  passRateTable->AddColumn(analyzedColumn);
+  passRateTable->AddColumn(passedColumn);
+  passRateTable->AddColumn(passRateColumn);
+  passRateTableNode->Modified();
+
+  // Create gamma volume for each criterion if requested
+  if (createGammaVolumes)
+  {
+    std::string referenceDoseName(parameterNode->GetReferenceDoseVolumeNode()->GetName() ? parameterNode->GetReferenceDoseVolumeNode()->GetName() : "");
+    for (size_t criterionIndex = 0; criterionIndex < doseDifferenceTolerancesPercent.size(); ++criterionIndex)
+    {
+      // Criterion label contains '/' that would be a path separator when the volume is saved
+      std::string criterionName = criterionColumn->GetValue(criterionIndex);
+      std::replace(criterionName.begin(), criterionName.end(), '/', '_');
+      std::replace(criterionName.begin(), criterionName.end(), '\\', '_');
+      vtkSmartPointer<vtkMRMLScalarVolumeNode> gammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+      std::string gammaVolumeName = vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_OUTPUT_BASE_NAME_PREFIX + referenceDoseName
+        + "_" + criterionName;
+      gammaVolumeNode->SetName(this->GetMRMLScene()->GenerateUniqueName(gammaVolumeName).c_str());
+      this->GetMRMLScene()->AddNode(gammaVolumeNode);
+
+      vtkSmartPointer<vtkImageData> gammaImage = vtkSmartPointer<vtkImageData>::New();
+      gammaImage->ShallowCopy(gamma->GetGammaImage(static_cast<int>(criterionIndex)));
+      gammaImage->SetOrigin(0.0, 0.0, 0.0);
+      gammaImage->SetSpacing(1.0, 1.0, 1.0);
+      gammaVolumeNode->SetIJKToRASMatrix(referenceIjkToRasMatrix);
+      gammaVolumeNode->SetAndObserveImageData(gammaImage);
+      gammaVolumeNode->CreateDefaultDisplayNodes();
+
+      errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+      if (!errorMessage.empty())
+      {
+        return errorMessage;
+      }
+    }
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseComparisonModuleLogic::ParseGammaCriteria(const char* criteriaString, std::vector<double>& doseDifferenceTolerancesPercent,
+  std::vector<double>& dtaDistanceTolerancesMm, std::vector<bool>& localDoseDifferences)
+{
+  doseDifferenceTolerancesPercent.clear();
+  dtaDistanceTolerancesMm.clear();
+  localDoseDifferences.clear();
+  if (!criteriaString)
+  {
+    return false;
+  }
+
+  std::vector<std::string> criterionStrings;
+  vtksys::SystemTools::Split(criteriaString, criterionStrings, ',');
+  for (std::vector<std::string>::iterator criterionIt = criterionStrings.begin(); criterionIt != criterionStrings.end(); ++criterionIt)
+  {
+    std::string criterionString = vtksys::SystemTools::TrimWhitespace(*criterionIt);
+    if (criterionString.empty())
+    {
+      continue;
+    }
+    bool local = false;
+    if (criterionString.back() == 'L' || criterionString.back() == 'l')
+    {
+      local = true;
+      criterionString.pop_back();
+    }
+    size_t separatorPosition = criterionString.find('/');
+    if (separatorPosition == std::string::npos)
+    {
+      vtkErrorMacro("ParseGammaCriteria: Missing '/' in criterion '" << (*criterionIt) << "'");
+      return false;
+    }
+    double doseDifferencePercent = 0.0;
+    double dtaMm = 0.0;
+    std::stringstream doseDifferenceStream(criterionString.substr(0, separatorPosition));
+    std::stringstream dtaStream(criterionString.substr(separatorPosition+1));
+    doseDifferenceStream >> doseDifferencePercent;
+    dtaStream >> dtaMm;
+    if (doseDifferenceStream.fail() || dtaStream.fail() || doseDifferencePercent <= 0.0 || dtaMm <= 0.0)
+    {
+      vtkErrorMacro("ParseGammaCriteria: Invalid criterion '" << (*criterionIt) << "'");
+      return false;
+    }
+    doseDifferenceTolerancesPercent.push_back(doseDifferencePercent);
+    dtaDistanceTolerancesMm.push_back(dtaMm);
+    localDoseDifferences.push_back(local);
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::GetMaskSegmentLabelmap(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap)
+{
+  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
+  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
+  if (!maskSegmentationNode || !maskSegmentID || !maskLabelmap)
+  {
+    std::string errorMessage("Invalid mask segment selection");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Extract a labelmap for the dose comparison to use it as a mask
+  vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
+  vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
+  if (!maskSegment)
+  {
+    std::string errorMessage("Failed to get mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
+  vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+  segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
+  segmentationCopy->CopyConversionParameters(maskSegmentation);
+  segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
+  if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+  {
+    std::string errorMessage("Failed to create binary labelmap representation for mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+  // Get segment binary labelmap
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  vtkNew<vtkOrientedImageData>  maskSegmentLabelmap;
+  maskSegmentationNode->GetBinaryLabelmapRepresentation(maskSegmentID, maskSegmentLabelmap);
+#else
+  vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+#endif
+
+  // Apply parent transformation nodes if necessary
+  if ( maskSegmentationNode->GetParentTransformNode()
+    && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskSegmentLabelmap)) )
+  {
+    std::string errorMessage("Failed to apply parent transform on mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  maskLabelmap->DeepCopy(maskSegmentLabelmap);
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
   gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
 
   // Set default colormap to red
@@ -321,21 +705,21 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
     else
     {
-      vtkWarningMacro("ComputeGammaDoseDifference: Loading gamma color table failed, stock color table is used!");
+      vtkWarningMacro("SetupGammaVolumeNode: Loading gamma color table failed, stock color table is used!");
       gammaScalarVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeRainbow");
     }
   }
   else
   {
-    vtkWarningMacro("ComputeGammaDoseDifference: Display node is not available for gamma volume node. The default color table will be used.");
+    vtkWarningMacro("SetupGammaVolumeNode: Display node is not available for gamma volume node. The default color table will be used.");
   }
 
   // Get common ancestor of the two input dose volumes in subject hierarchy
   vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
   if (!shNode)
   {
-    std::string errorMessage("");
-    vtkErrorMacro("ComputeGammaDoseDifference: Failed to access subject hierarchy node" << errorMessage);
+    std::string errorMessage("Failed to access subject hierarchy node");
+    vtkErrorMacro("SetupGammaVolumeNode: " << errorMessage);
     return errorMessage;
   }
   vtkIdType commonAncestorItemID = vtkSlicerSubjectHierarchyModuleLogic::AreNodesInSameBranch(
@@ -365,18 +749,6 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
   }
 
-  parameterNode->ResultsValidOn();
-
-  if (this->LogSpeedMeasurements)
-  {
-    double checkpointEnd = timer->GetUniversalTime();
-    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
-              << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
-              << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
-              << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
-              << "\tConverting back from ITK to VTK: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
-  }
-
   return "";
 }
 
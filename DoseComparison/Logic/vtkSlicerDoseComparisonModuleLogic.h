@@ -32,7 +32,15 @@
 
 #include "vtkSlicerDoseComparisonModuleLogicExport.h"
 
+// STD includes
+#include <vector>
+
+class vtkGammaDoseComparison;
+class vtkMatrix4x4;
 class vtkMRMLDoseComparisonNode;
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLTableNode;
+class vtkOrientedImageData;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkSlicerDoseComparisonModuleLogic :
@@ -55,6 +63,14 @@ public:
   /// \return Error message, empty string if no error
   std::string ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode);
 
+  /// Compute gamma pass rates for multiple criteria in one pass, using the native gamma computation.
+  /// The criteria are specified in \sa vtkMRMLDoseComparisonNode::GammaCriteria, the rest of the inputs and
+  /// parameters (dose volumes, mask, threshold, maximum gamma) are the same as in \sa ComputeGammaDoseDifference
+  /// \param passRateTableNode Output table containing the pass rate of each criterion in a row
+  /// \param createGammaVolumes If true, then a gamma volume is created for each criterion
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaPassRates(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLTableNode* passRateTableNode, bool createGammaVolumes=false);
+
   /// Function called when gamma progress is updated by algorithm
   void GammaProgressUpdated(float progress);
 
@@ -66,6 +82,30 @@ protected:
   /// Loads default gamma color table from the supplied color table file
   void LoadDefaultGammaColorTable();
 
+  /// Compute gamma using \sa vtkGammaDoseComparison directly on the VTK images of the input volumes
+  /// instead of the plastimatch gamma computation. Called from \sa ComputeGammaDoseDifference
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode);
+
+  /// Get binary labelmap of the mask segment selected in the parameter set node in world coordinate system
+  /// \return Error message, empty string if no error
+  std::string GetMaskSegmentLabelmap(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap);
+
+  /// Set up inputs and common parameters of the native gamma computation from the parameter set node.
+  /// The compare dose and the mask are resampled to the reference dose geometry
+  /// \param referenceIjkToRasMatrix Output IJK to RAS matrix of the reference dose (and the gamma images)
+  /// \return Error message, empty string if no error
+  std::string SetUpNativeGammaComputation(vtkMRMLDoseComparisonNode* parameterNode, vtkGammaDoseComparison* gamma, vtkMatrix4x4* referenceIjkToRasMatrix);
+
+  /// Parse gamma criteria string (see \sa vtkMRMLDoseComparisonNode::GammaCriteria)
+  /// \return Success flag
+  bool ParseGammaCriteria(const char* criteriaString, std::vector<double>& doseDifferenceTolerancesPercent,
+    std::vector<double>& dtaDistanceTolerancesMm, std::vector<bool>& localDoseDifferences);
+
+  /// Set up display, subject hierarchy and references of an output gamma volume after its image has been computed
+  /// \return Error message, empty string if no error
+  std::string SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
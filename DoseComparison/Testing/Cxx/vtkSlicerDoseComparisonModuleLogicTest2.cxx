@@ -0,0 +1,293 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Adam Rankin, Perk Lab, Queen's University 
+  and was supported by Cancer Care Ontario (CCO)'s ACRU program 
+  with funds provided by the Ontario Ministry of Health and Long-Term Care
+  and Ontario Consortium for Adaptive Interventions in Radiation Oncology (OCAIRO).
+
+==============================================================================*/
+
+// DoseComparison includes
+#include "vtkSlicerDoseComparisonModuleLogic.h"
+#include "vtkMRMLDoseComparisonNode.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Add dose volume sampling a Gaussian dose distribution on the given grid
+vtkMRMLScalarVolumeNode* AddGaussianDoseVolume(vtkMRMLScene* mrmlScene, const char* name,
+  const int dimensions[3], const double origin[3], double spacing, const double center[3], double maximumDose)
+{
+  vtkNew<vtkImageData> doseImage;
+  doseImage->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+  doseImage->AllocateScalars(VTK_FLOAT, 1);
+  float* dosePtr = static_cast<float*>(doseImage->GetScalarPointer());
+  const double sigma = 25.0;
+  for (int k = 0; k < dimensions[2]; ++k)
+  {
+    for (int j = 0; j < dimensions[1]; ++j)
+    {
+      for (int i = 0; i < dimensions[0]; ++i)
+      {
+        double x = origin[0] + i * spacing - center[0];
+        double y = origin[1] + j * spacing - center[1];
+        double z = origin[2] + k * spacing - center[2];
+        *(dosePtr++) = static_cast<float>(maximumDose * exp(-(x*x + y*y + z*z) / (2.0 * sigma * sigma)));
+      }
+    }
+  }
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> doseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  doseVolumeNode->SetName(name);
+  doseVolumeNode->SetOrigin(origin[0], origin[1], origin[2]);
+  doseVolumeNode->SetSpacing(spacing, spacing, spacing);
+  doseVolumeNode->SetAndObserveImageData(doseImage);
+  mrmlScene->AddNode(doseVolumeNode);
+  return doseVolumeNode;
+}
+
+//-----------------------------------------------------------------------------
+// Compute gamma and check that the gamma volume is in the reference dose geometry
+bool ComputeGammaInReferenceGeometry(vtkSlicerDoseComparisonModuleLogic* doseComparisonLogic, vtkMRMLDoseComparisonNode* paramNode,
+  bool native, double& passFractionPercent)
+{
+  paramNode->SetUseNativeGammaCalculation(native);
+  std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Gamma computation failed: " << errorMessage << std::endl;
+    return false;
+  }
+
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = paramNode->GetReferenceDoseVolumeNode();
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = paramNode->GetGammaVolumeNode();
+  int referenceDimensions[3] = {0, 0, 0};
+  referenceDoseVolumeNode->GetImageData()->GetDimensions(referenceDimensions);
+  int gammaDimensions[3] = {0, 0, 0};
+  gammaVolumeNode->GetImageData()->GetDimensions(gammaDimensions);
+  vtkNew<vtkMatrix4x4> referenceIjkToRasMatrix;
+  referenceDoseVolumeNode->GetIJKToRASMatrix(referenceIjkToRasMatrix);
+  vtkNew<vtkMatrix4x4> gammaIjkToRasMatrix;
+  gammaVolumeNode->GetIJKToRASMatrix(gammaIjkToRasMatrix);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (gammaDimensions[axis] != referenceDimensions[axis])
+    {
+      std::cerr << "ERROR: Gamma volume computed " << (native ? "natively" : "by plastimatch") << " has dimension " << gammaDimensions[axis]
+        << " along axis " << axis << " instead of the reference dose dimension " << referenceDimensions[axis] << std::endl;
+      return false;
+    }
+  }
+  for (int row = 0; row < 3; ++row)
+  {
+    for (int column = 0; column < 4; ++column)
+    {
+      if (fabs(gammaIjkToRasMatrix->GetElement(row, column) - referenceIjkToRasMatrix->GetElement(row, column)) > 1e-3)
+      {
+        std::cerr << "ERROR: Geometry of the gamma volume computed " << (native ? "natively" : "by plastimatch")
+          << " differs from the reference dose geometry" << std::endl;
+        return false;
+      }
+    }
+  }
+
+  passFractionPercent = paramNode->GetPassFractionPercent();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Compute pass rates for multiple criteria in one pass and check them against the single criterion native gamma computation
+bool CheckGammaPassRates(vtkMRMLScene* mrmlScene, vtkSlicerDoseComparisonModuleLogic* doseComparisonLogic, vtkMRMLDoseComparisonNode* paramNode)
+{
+  const int numberOfCriteria = 2;
+  const double doseDifferenceTolerancesPercent[numberOfCriteria] = { 3.0, 2.0 };
+  const double dtaDistanceTolerancesMm[numberOfCriteria] = { 3.0, 2.0 };
+  const bool localDoseDifferences[numberOfCriteria] = { false, true };
+  const char* expectedCriterionNames[numberOfCriteria] = { "3%/3mm", "2%/2mm local" };
+  const char* expectedTypes[numberOfCriteria] = { "Global", "Local" };
+
+  // Pass rates computed one criterion at a time
+  std::vector<double> expectedPassFractionsPercent;
+  paramNode->SetUseNativeGammaCalculation(true);
+  for (int criterionIndex = 0; criterionIndex < numberOfCriteria; ++criterionIndex)
+  {
+    paramNode->SetDoseDifferenceTolerancePercent(doseDifferenceTolerancesPercent[criterionIndex]);
+    paramNode->SetDtaDistanceToleranceMm(dtaDistanceTolerancesMm[criterionIndex]);
+    paramNode->SetLocalDoseDifference(localDoseDifferences[criterionIndex]);
+    std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+    if (!errorMessage.empty())
+    {
+      std::cerr << "ERROR: Gamma computation failed for criterion " << expectedCriterionNames[criterionIndex] << ": " << errorMessage << std::endl;
+      return false;
+    }
+    expectedPassFractionsPercent.push_back(paramNode->GetPassFractionPercent());
+  }
+  paramNode->SetLocalDoseDifference(false);
+
+  vtkSmartPointer<vtkMRMLTableNode> passRateTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  passRateTableNode->SetName("GammaPassRates");
+  mrmlScene->AddNode(passRateTableNode);
+  int numberOfVolumesBefore = mrmlScene->GetNumberOfNodesByClass("vtkMRMLScalarVolumeNode");
+  paramNode->SetGammaCriteria("3/3, 2/2L");
+  std::string errorMessage = doseComparisonLogic->ComputeGammaPassRates(paramNode, passRateTableNode, true);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Gamma pass rate computation failed: " << errorMessage << std::endl;
+    return false;
+  }
+
+  vtkTable* passRateTable = passRateTableNode->GetTable();
+  if (passRateTable->GetNumberOfRows() != numberOfCriteria)
+  {
+    std::cerr << "ERROR: Pass rate table has " << passRateTable->GetNumberOfRows() << " rows instead of " << numberOfCriteria << std::endl;
+    return false;
+  }
+  for (int criterionIndex = 0; criterionIndex < numberOfCriteria; ++criterionIndex)
+  {
+    std::string criterionName = passRateTable->GetValueByName(criterionIndex, "Criterion").ToString();
+    std::string type = passRateTable->GetValueByName(criterionIndex, "Type").ToString();
+    double doseDifferencePercent = passRateTable->GetValueByName(criterionIndex, "Dose difference (%)").ToDouble();
+    double dtaMm = passRateTable->GetValueByName(criterionIndex, "DTA (mm)").ToDouble();
+    vtkIdType numberOfAnalyzedVoxels = passRateTable->GetValueByName(criterionIndex, "Analyzed voxels").ToTypeInt64();
+    vtkIdType numberOfPassedVoxels = passRateTable->GetValueByName(criterionIndex, "Passed voxels").ToTypeInt64();
+    double passRatePercent = passRateTable->GetValueByName(criterionIndex, "Pass rate (%)").ToDouble();
+    std::cout << criterionName << " (" << type << "): " << numberOfPassedVoxels << " of " << numberOfAnalyzedVoxels
+      << " voxels passed, pass rate " << passRatePercent << "% (single criterion: " << expectedPassFractionsPercent[criterionIndex] << "%)" << std::endl;
+
+    if ( criterionName != expectedCriterionNames[criterionIndex] || type != expectedTypes[criterionIndex]
+      || doseDifferencePercent != doseDifferenceTolerancesPercent[criterionIndex] || dtaMm != dtaDistanceTolerancesMm[criterionIndex] )
+    {
+      std::cerr << "ERROR: Criterion in pass rate table row " << criterionIndex << " does not match " << expectedCriterionNames[criterionIndex] << std::endl;
+      return false;
+    }
+    if ( numberOfAnalyzedVoxels <= 0 || numberOfPassedVoxels < 0 || numberOfPassedVoxels > numberOfAnalyzedVoxels
+      || fabs(passRatePercent - 100.0 * numberOfPassedVoxels / numberOfAnalyzedVoxels) > 1e-6 )
+    {
+      std::cerr << "ERROR: Inconsistent voxel counts and pass rate in pass rate table row " << criterionIndex << std::endl;
+      return false;
+    }
+    if (fabs(passRatePercent - expectedPassFractionsPercent[criterionIndex]) > 1e-6)
+    {
+      std::cerr << "ERROR: Pass rate of criterion " << criterionName << " differs from the single criterion gamma computation" << std::endl;
+      return false;
+    }
+  }
+
+  // One gamma volume per criterion, without path separators in its name
+  std::vector<vtkMRMLNode*> volumeNodes;
+  mrmlScene->GetNodesByClass("vtkMRMLScalarVolumeNode", volumeNodes);
+  if (static_cast<int>(volumeNodes.size()) != numberOfVolumesBefore + numberOfCriteria)
+  {
+    std::cerr << "ERROR: " << static_cast<int>(volumeNodes.size()) - numberOfVolumesBefore << " gamma volumes were created instead of " << numberOfCriteria << std::endl;
+    return false;
+  }
+  for (size_t volumeIndex = numberOfVolumesBefore; volumeIndex < volumeNodes.size(); ++volumeIndex)
+  {
+    std::string gammaVolumeName(volumeNodes[volumeIndex]->GetName());
+    if (gammaVolumeName.find_first_of("/\\") != std::string::npos)
+    {
+      std::cerr << "ERROR: Gamma volume name '" << gammaVolumeName << "' contains a path separator" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDoseComparisonModuleLogicTest2(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene);
+
+  // The compare dose grid has a different spacing and origin, and only partly overlaps the reference dose grid.
+  // The compare dose distribution is shifted and scaled so that some of the voxels fail 3%/3mm
+  const int referenceDimensions[3] = { 40, 40, 32 };
+  const double referenceOrigin[3] = { 0.0, 0.0, 0.0 };
+  const double referenceCenter[3] = { 50.0, 50.0, 40.0 };
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = AddGaussianDoseVolume(mrmlScene, "ReferenceDose",
+    referenceDimensions, referenceOrigin, 2.5, referenceCenter, 60.0);
+  const int compareDimensions[3] = { 55, 50, 40 };
+  const double compareOrigin[3] = { -8.3, -3.7, -6.1 };
+  const double compareCenter[3] = { 52.5, 49.0, 40.5 };
+  vtkMRMLScalarVolumeNode* compareDoseVolumeNode = AddGaussianDoseVolume(mrmlScene, "CompareDose",
+    compareDimensions, compareOrigin, 2.0, compareCenter, 62.0);
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> gammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  gammaVolumeNode->SetName("Gamma");
+  mrmlScene->AddNode(gammaVolumeNode);
+
+  vtkSmartPointer<vtkMRMLDoseComparisonNode> paramNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveReferenceDoseVolumeNode(referenceDoseVolumeNode);
+  paramNode->SetAndObserveCompareDoseVolumeNode(compareDoseVolumeNode);
+  paramNode->SetAndObserveGammaVolumeNode(gammaVolumeNode);
+  paramNode->SetDtaDistanceToleranceMm(3.0);
+  paramNode->SetDoseDifferenceTolerancePercent(3.0);
+  paramNode->SetUseGeometricGammaCalculation(false);
+  paramNode->SetDoseThresholdOnReferenceOnly(true);
+
+  vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic> doseComparisonLogic = vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic>::New();
+  doseComparisonLogic->SetMRMLScene(mrmlScene);
+
+  // Both the native gamma computation and plastimatch (that resamples the compare dose itself) must give
+  // gamma in the reference dose geometry, and the same pass rate up to interpolation differences
+  double plastimatchPassFractionPercent = 0.0;
+  if (!ComputeGammaInReferenceGeometry(doseComparisonLogic, paramNode, false, plastimatchPassFractionPercent))
+  {
+    return EXIT_FAILURE;
+  }
+  double nativePassFractionPercent = 0.0;
+  if (!ComputeGammaInReferenceGeometry(doseComparisonLogic, paramNode, true, nativePassFractionPercent))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Pass rate: " << nativePassFractionPercent << "% (plastimatch: " << plastimatchPassFractionPercent << "%)" << std::endl;
+  if (plastimatchPassFractionPercent <= 0.0 || plastimatchPassFractionPercent >= 100.0)
+  {
+    std::cerr << "ERROR: Test doses are expected to partially pass the gamma criteria" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double passFractionTolerancePercent = 1.0;
+  if (fabs(nativePassFractionPercent - plastimatchPassFractionPercent) > passFractionTolerancePercent)
+  {
+    std::cerr << "ERROR: Pass rate of the native gamma computation differs from the plastimatch pass rate by more than "
+      << passFractionTolerancePercent << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!CheckGammaPassRates(mrmlScene, doseComparisonLogic, paramNode))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -25,6 +25,8 @@
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 #include "vtkFractionalImageAccumulate.h"
+#include "vtkMultiStructureImageAccumulate.h"
+#include "vtkResampledDoseCache.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -42,6 +44,7 @@
 
 // MRML includes
 #include <vtkMRMLLayoutNode.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkMRMLPlotSeriesNode.h>
 #include <vtkMRMLPlotChartNode.h>
 #include <vtkMRMLPlotViewNode.h>
@@ -53,19 +56,21 @@
 // VTK includes
 #include <vtkBitArray.h>
 #include <vtkCallbackCommand.h>
+#include <vtkDataArray.h>
 #include <vtkDelimitedTextWriter.h>
 #include <vtkDoubleArray.h>
 #include <vtkFieldData.h>
+#include <vtkGeneralTransform.h>
 #include <vtkImageAccumulate.h>
 #include <vtkImageConstantPad.h>
 #include <vtkImageDilateErode3D.h>
 #include <vtkImageMathematics.h>
 #include <vtkImageStencilData.h>
+#include <vtkImageThreshold.h>
 #include <vtkImageToImageStencil.h>
 #include <vtkMath.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
-#include <vtkPiecewiseFunction.h>
 #include <vtkStringArray.h>
 #include <vtkTable.h>
 #include <vtkTimerLog.h>
@@ -75,6 +80,9 @@
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
+#include <cstring>
+#include <mutex>
 #include <set>
 
 // Slicer includes
@@ -106,6 +114,62 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramModuleLogic);
 
+//---------------------------------------------------------------------------
+// Set the given bit in the structure mask where the labelmap is foreground, within the given extent
+template <class LabelmapScalarType, class MaskScalarType>
+void AddLabelmapToStructureMask(vtkImageData* labelmap, LabelmapScalarType*, vtkImageData* structureMask, MaskScalarType bit, int extent[6])
+{
+  for (int k = extent[4]; k <= extent[5]; ++k)
+  {
+    for (int j = extent[2]; j <= extent[3]; ++j)
+    {
+      LabelmapScalarType* labelmapPtr = static_cast<LabelmapScalarType*>(labelmap->GetScalarPointer(extent[0], j, k));
+      MaskScalarType* maskPtr = static_cast<MaskScalarType*>(structureMask->GetScalarPointer(extent[0], j, k));
+      for (int i = 0; i <= extent[1] - extent[0]; ++i)
+      {
+        // Same foreground criterion as the stencil used in the per-segment computation (>=epsilon)
+        if (labelmapPtr[i] >= 1e-10)
+        {
+          maskPtr[i] |= bit;
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+template <class MaskScalarType>
+void AddLabelmapToStructureMask(vtkImageData* labelmap, vtkImageData* structureMask, int structureIndex, int extent[6])
+{
+  MaskScalarType bit = static_cast<MaskScalarType>(MaskScalarType(1) << structureIndex);
+  switch (labelmap->GetScalarType())
+  {
+    vtkTemplateMacro(AddLabelmapToStructureMask(labelmap, static_cast<VTK_TT*>(nullptr), structureMask, bit, extent));
+  }
+}
+
+//---------------------------------------------------------------------------
+// Copy the dose (first) and volume (second) columns of a DVH table into contiguous arrays.
+// Numeric columns are read directly, other column types through variants.
+static bool GetDvhArrays(vtkTable* dvhTable, std::vector<double>& doses, std::vector<double>& volumes)
+{
+  if (!dvhTable || dvhTable->GetNumberOfColumns() < 2 || dvhTable->GetNumberOfRows() < 1)
+  {
+    return false;
+  }
+  vtkIdType numberOfRows = dvhTable->GetNumberOfRows();
+  doses.resize(numberOfRows);
+  volumes.resize(numberOfRows);
+  vtkDataArray* doseArray = vtkDataArray::SafeDownCast(dvhTable->GetColumn(0));
+  vtkDataArray* volumeArray = vtkDataArray::SafeDownCast(dvhTable->GetColumn(1));
+  for (vtkIdType row=0; row<numberOfRows; ++row)
+  {
+    doses[row] = (doseArray ? doseArray->GetComponent(row, 0) : dvhTable->GetValue(row, 0).ToDouble());
+    volumes[row] = (volumeArray ? volumeArray->GetComponent(row, 0) : dvhTable->GetValue(row, 1).ToDouble());
+  }
+  return true;
+}
+
 //---------------------------------------------------------------------------
 class vtkDoseVolumeHistogramEventCallbackCommand : public vtkCallbackCommand
 {
@@ -127,6 +191,8 @@ vtkSlicerDoseVolumeHistogramModuleLogic::vtkSlicerDoseVolumeHistogramModuleLogic
   this->NumberOfSamplesForNonDoseVolumes = 100;
   this->DefaultDoseVolumeOversamplingFactor = 2.0;
   this->UseLinearInterpolationForDoseVolume = true;
+  this->NumberOfThreads = 0;
+  this->MemoryLimitMB = 0;
 
   this->LogSpeedMeasurements = false;
 }
@@ -180,7 +246,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     return errorMessage;
   }
 
-  parameterNode->ClearAutomaticOversamplingFactors();
   vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
   vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
   if ( !segmentationNode || !doseVolumeNode )
@@ -211,6 +276,53 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     selectedSegmentation->GetSegmentIDs(segmentIDs);
   }
 
+  // Skip segments whose DVH has been computed from the same inputs and is still available.
+  // Automatic oversampling factors of the skipped segments are kept for reporting.
+  std::string doseVolumeKey = vtkResampledDoseCache::GetVolumeKey(doseVolumeNode);
+  if (this->MemoryLimitMB > 0)
+  {
+    // The resampled dose volumes kept in the cache count against the memory limit. Leave at most half of
+    // the limit to them, the same as the part of the limit that the oversampled dose volume may take
+    vtkResampledDoseCache::GetInstance()->ReduceMemorySizeKB(static_cast<unsigned long>(this->MemoryLimitMB) * 1024 / 2);
+  }
+  std::map<std::string, double> previousAutomaticOversamplingFactors;
+  parameterNode->GetAutomaticOversamplingFactors(previousAutomaticOversamplingFactors);
+  parameterNode->ClearAutomaticOversamplingFactors();
+  std::map<std::string, std::string> segmentInputSignatures;
+  std::vector<std::string> changedSegmentIDs;
+  for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+  {
+    std::string signature = this->GetSegmentDvhInputSignature(parameterNode, *segmentIt, doseVolumeKey);
+    std::string dvhNodeReference = parameterNode->AssembleDvhNodeReference(*segmentIt);
+    vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
+    if ( !signature.empty() && signature == parameterNode->GetSegmentDvhInputSignature(*segmentIt)
+      && metricsTableNode && metricsTableNode->GetNodeReference(dvhNodeReference.c_str()) )
+    {
+      std::map<std::string, double>::iterator factorIt = previousAutomaticOversamplingFactors.find(*segmentIt);
+      if (factorIt != previousAutomaticOversamplingFactors.end())
+      {
+        parameterNode->AddAutomaticOversamplingFactor(factorIt->first, factorIt->second);
+      }
+      continue;
+    }
+    parameterNode->SetSegmentDvhInputSignature(*segmentIt, "");
+    segmentInputSignatures[*segmentIt] = signature;
+    changedSegmentIDs.push_back(*segmentIt);
+  }
+  if (changedSegmentIDs.size() < segmentIDs.size())
+  {
+    vtkDebugMacro("ComputeDvh: Inputs of " << segmentIDs.size() - changedSegmentIDs.size() << " segments are unchanged, their DVH is not recomputed");
+  }
+  segmentIDs = changedSegmentIDs;
+  if (segmentIDs.empty())
+  {
+    double progress = 1.0;
+    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+    this->SetDisableModifiedEvent(0);
+    parameterNode->EndModify(disabledNodeModify);
+    return "";
+  }
+
   // Create oriented image data from dose volume
   vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
     vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(doseVolumeNode) );
@@ -304,8 +416,14 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     }
   }
 
+  // The histograms of all segments can be computed in a single pass over the dose volume if they share
+  // the same binary labelmap geometry and dose bins. Other cases are computed segment by segment.
+  bool singlePassPossible = !parameterNode->GetAutomaticOversampling() && !useFractionalLabelmap
+    && !parameterNode->GetDoseSurfaceHistogram() && vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode) && this->StartValue > 0.0;
+
   // Use the same resampled dose volume if oversampling is fixed
   vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseVolume;
+  bool streamFixedOversampledDoseVolume = false;
   if (!parameterNode->GetAutomaticOversampling())
   {
     // Get geometry of oversampled dose volume
@@ -313,49 +431,78 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     fixedOversampledDoseVolume->ShallowCopy(doseImageData);
     vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(fixedOversampledDoseVolume, this->DefaultDoseVolumeOversamplingFactor);
 
+    // Use the dose volume resampled to the same geometry earlier if available
+    vtkSmartPointer<vtkOrientedImageData> cachedDoseVolume = vtkResampledDoseCache::GetInstance()->GetImage(
+      doseVolumeKey, fixedOversampledDoseVolume, VTK_LINEAR_INTERPOLATION);
+
+    // If the oversampled dose volume takes more than half of the memory limit (the rest is left for the structure masks),
+    // then it is not resampled here, but slab by slab during the histogram computation
+    int oversampledDimensions[3] = {0, 0, 0};
+    fixedOversampledDoseVolume->GetDimensions(oversampledDimensions);
+    double oversampledDoseVolumeSizeMB = (double)oversampledDimensions[0] * (double)oversampledDimensions[1]
+      * (double)oversampledDimensions[2] * (double)doseImageData->GetScalarSize() / (1024.0 * 1024.0);
+    if (!cachedDoseVolume && singlePassPossible && this->MemoryLimitMB > 0 && oversampledDoseVolumeSizeMB > 0.5 * this->MemoryLimitMB)
+    {
+      vtkDebugMacro("ComputeDvh: Oversampled dose volume (" << oversampledDoseVolumeSizeMB << " MB) exceeds the memory limit, it is resampled in slabs");
+      streamFixedOversampledDoseVolume = true;
+    }
+
+    if (streamFixedOversampledDoseVolume)
+    {
+      // Keep only the geometry
+      vtkSmartPointer<vtkOrientedImageData> oversampledGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+      oversampledGeometry->SetExtent(fixedOversampledDoseVolume->GetExtent());
+      oversampledGeometry->SetOrigin(fixedOversampledDoseVolume->GetOrigin());
+      oversampledGeometry->SetSpacing(fixedOversampledDoseVolume->GetSpacing());
+      oversampledGeometry->CopyDirections(fixedOversampledDoseVolume);
+      fixedOversampledDoseVolume = oversampledGeometry;
+    }
+    else if (cachedDoseVolume)
+    {
+      fixedOversampledDoseVolume->ShallowCopy(cachedDoseVolume);
+    }
     // Resample dose volume using linear interpolation
-    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+    else if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
       doseImageData, fixedOversampledDoseVolume, fixedOversampledDoseVolume, true ) )
     {
       std::string errorMessage("Failed to resample dose volume");
       vtkErrorMacro("ComputeDvh: " << errorMessage);
       return errorMessage;
     }
+    else
+    {
+      vtkSmartPointer<vtkOrientedImageData> cachedCopy = vtkSmartPointer<vtkOrientedImageData>::New();
+      cachedCopy->ShallowCopy(fixedOversampledDoseVolume);
+      vtkResampledDoseCache::GetInstance()->AddImage(doseVolumeKey, fixedOversampledDoseVolume, VTK_LINEAR_INTERPOLATION, cachedCopy);
+    }
   }
 
   //
   // Compute DVH for each selected segment
   //
-  int counter = 1; // Start at one so that progress can reach 100%
-  int numberOfSelectedSegments = segmentationCopy->GetNumberOfSegments();
-  for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt, ++counter)
-  {
-    std::string segmentID = *segmentIdIt;
-    vtkSegment* segment = segmentationCopy->GetSegment(*segmentIdIt);
-
-    // Get segment labelmap
-#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
-    vtkSmartPointer<vtkOrientedImageData> segmentLabelmap = vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
-      representationName ) );
-    if (representationName == vtkSegmentationConverter::GetBinaryLabelmapRepresentationName())
-    {
-      vtkSmartPointer<vtkOrientedImageData> mergedLabelmap = segmentLabelmap;
-      vtkNew<vtkImageThreshold> threshold;
-      threshold->SetInputData(mergedLabelmap);
-      threshold->ThresholdBetween(segment->GetLabelValue(), segment->GetLabelValue());
-      threshold->SetInValue(1);
-      threshold->SetOutValue(0);
-      threshold->SetOutputScalarTypeToUnsignedChar();
-      threshold->Update();
-      segmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
-      segmentLabelmap->ShallowCopy(threshold->GetOutput());
-      segmentLabelmap->CopyDirections(mergedLabelmap);
-    }
-#else
-    vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
-      representationName ) );
-#endif
-
+  DvhComputationContext context;
+  context.DoseImageData = doseImageData;
+  context.DoseVolumeKey = doseVolumeKey;
+  context.FixedOversampledDoseVolume = fixedOversampledDoseVolume;
+  context.StreamFixedOversampledDoseVolume = streamFixedOversampledDoseVolume;
+  context.RepresentationName = representationName;
+  context.UseFractionalLabelmap = useFractionalLabelmap;
+  context.ResamplingRequired = resamplingRequired || (segmentationNode->GetParentTransformNode() != nullptr);
+  context.AutomaticOversampling = parameterNode->GetAutomaticOversampling();
+  context.DoseSurfaceHistogram = parameterNode->GetDoseSurfaceHistogram();
+  context.UseInsideDoseSurface = parameterNode->GetUseInsideDoseSurface();
+  context.IsDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
+  context.MaxDose = maxDose;
+
+  // Collect inputs for each segment. Everything that touches the segmentation or the MRML scene
+  // is done here so that the numerical part can run on worker threads.
+  std::vector<SegmentDvh> segmentDvhs(segmentIDs.size());
+  for (size_t segmentIndex = 0; segmentIndex < segmentIDs.size(); ++segmentIndex)
+  {
+    SegmentDvh& segmentDvh = segmentDvhs[segmentIndex];
+    segmentDvh.SegmentID = segmentIDs[segmentIndex];
+    vtkSegment* segment = segmentationCopy->GetSegment(segmentDvh.SegmentID);
+    vtkOrientedImageData* segmentLabelmap = (segment ? vtkOrientedImageData::SafeDownCast(segment->GetRepresentation(representationName)) : nullptr);
     if (!segmentLabelmap)
     {
       std::string errorMessage("Failed to get labelmap for segments");
@@ -363,80 +510,57 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
       return errorMessage;
     }
 
-    double minimumValue = 0.0;
-    vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
-      segmentLabelmap->GetFieldData()->GetAbstractArray(vtkSegmentationConverter::GetScalarRangeFieldName()));
-    if (scalarRange && scalarRange->GetNumberOfValues() == 2)
-    {
-      minimumValue = scalarRange->GetValue(0);
-    }
+    // Shallow copy so that the pipelines on the worker threads do not share input data objects
+    segmentDvh.SegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    segmentDvh.SegmentLabelmap->ShallowCopy(segmentLabelmap);
+    segmentDvh.LabelValue = segment->GetLabelValue();
 
-    // Apply parent transformation nodes if necessary
+    // Each segment gets its own copy of the parent transform, as transforms are not safe to be used from multiple threads
     if (segmentationNode->GetParentTransformNode())
     {
-      double backgroundValue[4] = {minimumValue, minimumValue, minimumValue, 0.0};
-      if (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, segmentLabelmap, useFractionalLabelmap, backgroundValue))
-      {
-        std::string errorMessage("Failed to apply parent transformation to segment");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-      resamplingRequired = true;
+      segmentDvh.SegmentationToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+      segmentationNode->GetParentTransformNode()->GetTransformToWorld(segmentDvh.SegmentationToWorldTransform);
     }
-    // Resample labelmap if necessary (if it was master, and could not be re-converted using the oversampled geometry, or if there was a parent transform)
-    if (resamplingRequired)
-    {
-      // Resample segmentation labelmap volume
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        segmentLabelmap, fixedOversampledDoseVolume, segmentLabelmap, useFractionalLabelmap, false, nullptr, minimumValue ) )
+  }
+
+  unsigned int numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->NumberOfThreads, segmentDvhs.size());
+
+  // Compute the histograms of all segments in one pass over the dose volume if possible
+  if (singlePassPossible && (segmentDvhs.size() > 1 || context.StreamFixedOversampledDoseVolume))
+  {
+    this->ComputeSegmentDvhsInSinglePass(context, segmentDvhs, numberOfThreads);
+  }
+  else
+  {
+    vtkSlicerRtCommon::RunOnWorkerThreads(segmentDvhs.size(), numberOfThreads,
+      [&](size_t segmentIndex)
       {
-        std::string errorMessage("Failed to resample segment binary labelmap");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-    }
+        this->ComputeSegmentDvh(context, segmentDvhs[segmentIndex]);
+      },
+      [&](size_t numberOfFinishedSegments)
+      {
+        // Update progress bar
+        double progress = (double)numberOfFinishedSegments / (double)segmentDvhs.size();
+        this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+      });
+  }
 
-    // Get oversampled dose volume
-    vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume;
-    // Use the same resampled dose volume if oversampling is fixed
-    if (!parameterNode->GetAutomaticOversampling())
+  // Store results in the scene in the order of the segments
+  for (std::vector<SegmentDvh>::iterator segmentDvhIt = segmentDvhs.begin(); segmentDvhIt != segmentDvhs.end(); ++segmentDvhIt)
+  {
+    std::string errorMessage = segmentDvhIt->ErrorMessage;
+    if (errorMessage.empty())
     {
-      oversampledDoseVolume = fixedOversampledDoseVolume;
+      errorMessage = this->StoreSegmentDvh(parameterNode, *segmentDvhIt);
     }
-    // Resample dose volume to match automatically oversampled segment labelmap geometry
-    else
-    {
-      oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        doseImageData, segmentLabelmap, oversampledDoseVolume, this->UseLinearInterpolationForDoseVolume ) )
-      {
-        std::string errorMessage("Failed to resample dose volume");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
-      }
-    }
-
-    // Make sure the segment labelmap is the same dimension as the dose volume
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(segmentLabelmap);
-    padder->SetConstant(minimumValue);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    oversampledDoseVolume->GetExtent(extent);
-    padder->SetOutputWholeExtent(extent);
-    padder->Update();
-    segmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
-
-    // Calculate DVH for current segment
-    std::string errorMessage = this->ComputeDvh(parameterNode, segmentLabelmap, oversampledDoseVolume, segmentID, maxDose);
     if (!errorMessage.empty())
     {
       vtkErrorMacro("ComputeDvh: " << errorMessage);
       return errorMessage;
     }
 
-    // Update progress bar
-    double progress = (double)counter / (double)numberOfSelectedSegments;
-    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+    // Record the inputs so that the DVH is not recomputed until they change
+    parameterNode->SetSegmentDvhInputSignature(segmentDvhIt->SegmentID, segmentInputSignatures[segmentDvhIt->SegmentID]);
   } // For each segment
 
   // Fire only one modified event when the computation is done
@@ -453,54 +577,171 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 }
 
 //---------------------------------------------------------------------------
-std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume, std::string segmentID, double maxDoseGy)
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::GetSegmentDvhInputSignature(
+  vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID, std::string doseVolumeKey)
 {
-  if (!this->GetMRMLScene() || !parameterNode)
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkSegmentation* segmentation = (segmentationNode ? segmentationNode->GetSegmentation() : nullptr);
+  vtkSegment* segment = (segmentation ? segmentation->GetSegment(segmentID) : nullptr);
+  vtkDataObject* masterRepresentation = (segment ? segment->GetRepresentation(segmentation->GetMasterRepresentationName()) : nullptr);
+  if (!masterRepresentation || doseVolumeKey.empty())
   {
-    std::string errorMessage("Invalid MRML scene or parameter set node");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    return "";
   }
-  if (!segmentLabelmap)
+
+  std::stringstream signatureStream;
+  // Segment (modified time of the master representation covers edits, label value the location in a shared labelmap)
+  signatureStream << segmentationNode->GetID() << ";" << segmentID << ";" << segment->GetName() << ";"
+    << masterRepresentation->GetMTime() << ";" << segment->GetLabelValue() << ";"
+    << segmentation->SerializeAllConversionParameters() << ";";
+  // Transform to world of the segmentation (covers edits of any transform in the chain, not only the parent)
+  signatureStream << vtkSlicerRtCommon::GetTransformToWorldSignature(segmentationNode->GetParentTransformNode()) << ";";
+  // Dose volume (node, image modified time and world geometry)
+  signatureStream << doseVolumeKey << ";";
+  // Computation settings
+  signatureStream << parameterNode->GetAutomaticOversampling() << parameterNode->GetUseFractionalLabelmap()
+    << parameterNode->GetDoseSurfaceHistogram() << parameterNode->GetUseInsideDoseSurface() << this->UseLinearInterpolationForDoseVolume << ";"
+    << this->DefaultDoseVolumeOversamplingFactor << ";" << this->StartValue << ";" << this->StepSize << ";" << this->NumberOfSamplesForNonDoseVolumes;
+  return signatureStream.str();
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkOrientedImageData> vtkSlicerDoseVolumeHistogramModuleLogic::PrepareSegmentLabelmap(
+  const DvhComputationContext& context, SegmentDvh& segmentDvh, double& minimumValue, double& maximumValue)
+{
+  vtkSmartPointer<vtkOrientedImageData> segmentLabelmap = segmentDvh.SegmentLabelmap;
+  bool useFractionalLabelmap = context.UseFractionalLabelmap;
+
+  // Get segment labelmap
+#if Slicer_VERSION_MAJOR >= 5 || (Slicer_VERSION_MAJOR >= 4 && Slicer_VERSION_MINOR >= 11)
+  if (context.RepresentationName == vtkSegmentationConverter::GetBinaryLabelmapRepresentationName())
+  {
+    vtkSmartPointer<vtkOrientedImageData> mergedLabelmap = segmentLabelmap;
+    vtkNew<vtkImageThreshold> threshold;
+    threshold->SetInputData(mergedLabelmap);
+    threshold->ThresholdBetween(segmentDvh.LabelValue, segmentDvh.LabelValue);
+    threshold->SetInValue(1);
+    threshold->SetOutValue(0);
+    threshold->SetOutputScalarTypeToUnsignedChar();
+    threshold->Update();
+    segmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    segmentLabelmap->ShallowCopy(threshold->GetOutput());
+    segmentLabelmap->CopyDirections(mergedLabelmap);
+  }
+#endif
+
+  minimumValue = 0.0;
+  maximumValue = 1.0;
+  vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
+    segmentLabelmap->GetFieldData()->GetAbstractArray(vtkSegmentationConverter::GetScalarRangeFieldName()));
+  if (scalarRange && scalarRange->GetNumberOfValues() == 2)
   {
-    std::string errorMessage("Invalid segment labelmap");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    minimumValue = scalarRange->GetValue(0);
+    maximumValue = scalarRange->GetValue(1);
   }
-  if (!oversampledDoseVolume)
+
+  // Apply parent transformation if necessary
+  if (segmentDvh.SegmentationToWorldTransform)
   {
-    std::string errorMessage("Invalid oversampled dose volume");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    double backgroundValue[4] = {minimumValue, minimumValue, minimumValue, 0.0};
+    vtkOrientedImageDataResample::TransformOrientedImage(segmentLabelmap, segmentDvh.SegmentationToWorldTransform,
+      false, false, useFractionalLabelmap, backgroundValue);
   }
-  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
-  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if ( !segmentationNode || !doseVolumeNode )
+  // Resample labelmap if necessary (if it was master, and could not be re-converted using the oversampled geometry, or if there was a parent transform)
+  if (context.ResamplingRequired)
   {
-    std::string errorMessage("Both segmentation node and dose volume node need to be set");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
+    // Resample segmentation labelmap volume
+    vtkSmartPointer<vtkOrientedImageData> referenceGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+    referenceGeometry->ShallowCopy(context.FixedOversampledDoseVolume);
+    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      segmentLabelmap, referenceGeometry, segmentLabelmap, useFractionalLabelmap, false, nullptr, minimumValue ) )
+    {
+      segmentDvh.ErrorMessage = "Failed to resample segment binary labelmap";
+      return nullptr;
+    }
   }
-  std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
-  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
 
+  return segmentLabelmap;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeSegmentDvh(const DvhComputationContext& context, SegmentDvh& segmentDvh)
+{
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
 
+  segmentDvh.ErrorMessage.clear();
+  bool useFractionalLabelmap = context.UseFractionalLabelmap;
+
+  double minimumValue = 0.0;
+  double maximumValue = 1.0;
+  vtkSmartPointer<vtkOrientedImageData> segmentLabelmap = this->PrepareSegmentLabelmap(context, segmentDvh, minimumValue, maximumValue);
+  if (!segmentLabelmap)
+  {
+    return;
+  }
+
+  // Get oversampled dose volume
+  vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+  // Use the same resampled dose volume if oversampling is fixed
+  if (!context.AutomaticOversampling)
+  {
+    oversampledDoseVolume->ShallowCopy(context.FixedOversampledDoseVolume);
+  }
+  // Resample dose volume to match automatically oversampled segment labelmap geometry
+  else
+  {
+    // The cache is shared by the worker threads
+    int interpolation = (this->UseLinearInterpolationForDoseVolume ? VTK_LINEAR_INTERPOLATION : VTK_NEAREST_INTERPOLATION);
+    vtkSmartPointer<vtkOrientedImageData> cachedDoseVolume = vtkResampledDoseCache::GetInstance()->GetImage(
+      context.DoseVolumeKey, segmentLabelmap, interpolation);
+    if (cachedDoseVolume)
+    {
+      oversampledDoseVolume->ShallowCopy(cachedDoseVolume);
+    }
+    else
+    {
+      vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+      doseImageData->ShallowCopy(context.DoseImageData);
+      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+        doseImageData, segmentLabelmap, oversampledDoseVolume, this->UseLinearInterpolationForDoseVolume ) )
+      {
+        segmentDvh.ErrorMessage = "Failed to resample dose volume";
+        return;
+      }
+      // Cache a separate copy, as the data object of this thread is used as pipeline input
+      vtkSmartPointer<vtkOrientedImageData> cachedCopy = vtkSmartPointer<vtkOrientedImageData>::New();
+      cachedCopy->ShallowCopy(oversampledDoseVolume);
+      vtkResampledDoseCache::GetInstance()->AddImage(context.DoseVolumeKey, segmentLabelmap, interpolation, cachedCopy);
+    }
+  }
+
+  // Make sure the segment labelmap is the same dimension as the dose volume
+  vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+  padder->SetInputData(segmentLabelmap);
+  padder->SetConstant(minimumValue);
+  int extent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseVolume->GetExtent(extent);
+  padder->SetOutputWholeExtent(extent);
+  padder->Update();
+  vtkSmartPointer<vtkOrientedImageData> paddedSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  paddedSegmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
+  paddedSegmentLabelmap->CopyDirections(segmentLabelmap);
+  segmentLabelmap = paddedSegmentLabelmap;
+
   // If the user has enabled the flag to calculate the dose surface histogram, then extract the surface from the labelmap
-  if (parameterNode->GetDoseSurfaceHistogram())
+  if (context.DoseSurfaceHistogram)
   {
-    if (parameterNode->GetUseFractionalLabelmap())
+    if (useFractionalLabelmap)
     {
-      std::string errorMessage("Dose surface histogram is not currently supported for fractional labelmaps");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
+      segmentDvh.ErrorMessage = "Dose surface histogram is not currently supported for fractional labelmaps";
+      return;
     }
 
     double dilateValue = 0.0;
     double erodeValue = 1.0;
-    if (!parameterNode->GetUseInsideDoseSurface())
+    if (!context.UseInsideDoseSurface)
     {
       dilateValue = 1.0;
       erodeValue = 0.0;
@@ -517,7 +758,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 
     vtkNew<vtkImageMathematics> imageMathematics;
     imageMathematics->SetOperationToSubtract();
-    if (parameterNode->GetUseInsideDoseSurface())
+    if (context.UseInsideDoseSurface)
     {
       imageMathematics->SetInput1Data(segmentLabelmap);
       imageMathematics->SetInputConnection(1, dilateErodeFilter->GetOutputPort());
@@ -539,66 +780,397 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   // So, we have to choose >=epsilon (epsilon is a very small positive number).
   // How small the number is has a significance when the segmentLabelmap is a floating-point image,
   // which is a rare scenario, but may still happen.
-  double minimumValue = 0.0;
-  double maximumValue = 1.0;
-  segmentLabelmap->GetFieldData();
-  vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
-    segmentLabelmap->GetFieldData()->GetAbstractArray( vtkSegmentationConverter::GetScalarRangeFieldName() )
-    );
-  if (scalarRange && scalarRange->GetNumberOfValues() == 2)
+  if (useFractionalLabelmap)
   {
-    minimumValue = scalarRange->GetValue(0);
-    maximumValue = scalarRange->GetValue(1);
+    stencil->ThresholdByUpper(minimumValue + 1e-10);
+  }
+  else
+  {
+    stencil->ThresholdByUpper(1e-10);
+  }
+  stencil->Update();
+
+  vtkSmartPointer<vtkImageStencilData> structureStencil = vtkSmartPointer<vtkImageStencilData>::New();
+  structureStencil->DeepCopy(stencil->GetOutput());
+
+  int stencilExtent[6] = {0,-1,0,-1,0,-1};
+  structureStencil->GetExtent(stencilExtent);
+  if (stencilExtent[1]-stencilExtent[0] <= 0 || stencilExtent[3]-stencilExtent[2] <= 0 || stencilExtent[5]-stencilExtent[4] <= 0)
+  {
+    segmentDvh.ErrorMessage = "Invalid stenciled dose volume";
+    return;
+  }
+
+  // Compute statistics
+  vtkSmartPointer<vtkImageAccumulate> structureStat;
+  if (useFractionalLabelmap)
+  {
+    structureStat = vtkSmartPointer<vtkFractionalImageAccumulate>::New();
+    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->UseFractionalLabelmapOn();
+    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetFractionalLabelmap(segmentLabelmap);
+    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMinimumFractionalValue(minimumValue);
+    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMaximumFractionalValue(maximumValue);
+  }
+  else
+  {
+    structureStat = vtkSmartPointer<vtkImageAccumulate>::New();
+  }
+  structureStat->SetInputData(oversampledDoseVolume);
+  structureStat->SetStencilData(structureStencil);
+  structureStat->Update();
+
+  // Report error if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
+  if (structureStat->GetVoxelCount() < 1)
+  {
+    segmentDvh.ErrorMessage = "Dose volume and the structure do not overlap"; // User-friendly error to help troubleshooting
+    return;
+  }
+
+  // Get spacing and voxel volume
+  double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
+  double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
+  double ccPerCubicMM = 0.001;
+
+  double totalVoxels = 0;
+  if (useFractionalLabelmap)
+  {
+    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
+  }
+  else
+  {
+    totalVoxels = structureStat->GetVoxelCount();
   }
+  segmentDvh.VolumeCc = totalVoxels * cubicMMPerVoxel * ccPerCubicMM;
+  segmentDvh.MeanDose = structureStat->GetMean()[0];
+  segmentDvh.MinDose = structureStat->GetMin()[0];
+  segmentDvh.MaxDose = structureStat->GetMax()[0];
+
+  // Create DVH plot values
+  int numSamples = 0;
+  double startValue = 0.0;
+  double stepSize = 0.0;
+  double rangeMin = structureStat->GetMin()[0];
+  double rangeMax = structureStat->GetMax()[0];
+  if (context.IsDoseVolume)
+  {
+    if (rangeMin<0)
+    {
+      segmentDvh.ErrorMessage = "The dose volume contains negative dose values";
+      return;
+    }
+
+    startValue = this->StartValue;
+    stepSize = this->StepSize;
+    numSamples = (int)ceil( (context.MaxDose-startValue)/stepSize ) + 1;
+  }
+  else
+  {
+    startValue = rangeMin;
+    numSamples = this->NumberOfSamplesForNonDoseVolumes;
+    stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
+  }
+
+  // Get the number of voxels with smaller dose than at the start value
+  structureStat->SetComponentExtent(0,1,0,0,0,0);
+  structureStat->SetComponentOrigin(0,0,0);
+  structureStat->SetComponentSpacing(startValue,1,1);
+  structureStat->Update();
+  double voxelBelowDose = structureStat->GetOutput()->GetScalarComponentAsDouble(0,0,0,0);
+
+  // We put a fixed point at (0.0, 100%), but only if there are only positive values in the histogram
+  // Negative values can occur when the user requests histogram for an image, such as s CT volume (in
+  // this case Intensity Volume Histogram is computed), or the startValue became negative for the dose
+  // volume because the range minimum was smaller than the original start value.
+  bool insertPointAtOrigin = true;
+  if (startValue < 0.0)
+  {
+    insertPointAtOrigin = false;
+  }
+
+  structureStat->SetComponentExtent(0,numSamples-1,0,0,0,0);
+  structureStat->SetComponentOrigin(startValue,0,0);
+  structureStat->SetComponentSpacing(stepSize,1,1);
+  structureStat->Update();
+
+  segmentDvh.Doses.clear();
+  segmentDvh.VolumePercents.clear();
+  segmentDvh.Doses.reserve(numSamples + 1);
+  segmentDvh.VolumePercents.reserve(numSamples + 1);
+  if (insertPointAtOrigin)
+  {
+    // Add first fixed point at (0.0, 100%)
+    segmentDvh.Doses.push_back(0.0);
+    segmentDvh.VolumePercents.push_back(100.0);
+  }
+
+  vtkImageData* statArray = structureStat->GetOutput();
+  for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
+  {
+    double voxelsInBin = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
+    segmentDvh.Doses.push_back(startValue + sampleIndex * stepSize);
+    if (useFractionalLabelmap)
+    {
+      segmentDvh.VolumePercents.push_back(std::max(0.0, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0));
+    }
+    else
+    {
+      segmentDvh.VolumePercents.push_back((1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0);
+    }
+    voxelBelowDose += voxelsInBin;
+  }
+
+  // Set the start of the first bin to 0 if the volume contains dose and the start value was negative
+  if (context.IsDoseVolume && !insertPointAtOrigin)
+  {
+    segmentDvh.Doses[0] = 0.0;
+  }
+
+  // Log measured time
+  double checkpointEnd = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+  if (this->LogSpeedMeasurements)
+  {
+    vtkDebugMacro("ComputeSegmentDvh: DVH computation time for structure '" << segmentDvh.SegmentID << "': " << checkpointEnd-checkpointStart << " s");
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeSegmentDvhsInSinglePass(
+  const DvhComputationContext& context, std::vector<SegmentDvh>& segmentDvhs, unsigned int numberOfThreads)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+
+  vtkOrientedImageData* oversampledDoseVolume = context.FixedOversampledDoseVolume;
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseVolume->GetExtent(doseExtent);
+  if (doseExtent[1]-doseExtent[0] <= 0 || doseExtent[3]-doseExtent[2] <= 0 || doseExtent[5]-doseExtent[4] <= 0)
+  {
+    for (std::vector<SegmentDvh>::iterator segmentDvhIt = segmentDvhs.begin(); segmentDvhIt != segmentDvhs.end(); ++segmentDvhIt)
+    {
+      segmentDvhIt->ErrorMessage = "Invalid stenciled dose volume";
+    }
+    return;
+  }
+
+  // Number of segments that can be stored in one mask (number of bits in the largest mask scalar type).
+  // If memory is limited, then smaller mask types are used so that the mask fits in half of the limit.
+  size_t maximumNumberOfSegmentsInMask = sizeof(vtkTypeUInt32) * 8;
+  double numberOfDoseVoxelsInSlice = (double)(doseExtent[1]-doseExtent[0]+1) * (double)(doseExtent[3]-doseExtent[2]+1);
+  double numberOfDoseVoxels = numberOfDoseVoxelsInSlice * (double)(doseExtent[5]-doseExtent[4]+1);
+  double memoryLimitBytes = (double)this->MemoryLimitMB * 1024.0 * 1024.0;
+  if (this->MemoryLimitMB > 0)
+  {
+    if (numberOfDoseVoxels * sizeof(vtkTypeUInt16) > 0.5 * memoryLimitBytes)
+    {
+      maximumNumberOfSegmentsInMask = sizeof(vtkTypeUInt8) * 8;
+    }
+    else if (numberOfDoseVoxels * sizeof(vtkTypeUInt32) > 0.5 * memoryLimitBytes)
+    {
+      maximumNumberOfSegmentsInMask = sizeof(vtkTypeUInt16) * 8;
+    }
+  }
+
+  // Get spacing and voxel volume (segment labelmaps have the same geometry as the oversampled dose volume)
+  double* doseSpacing = oversampledDoseVolume->GetSpacing();
+  double cubicMMPerVoxel = doseSpacing[0] * doseSpacing[1] * doseSpacing[2];
+  double ccPerCubicMM = 0.001;
+
+  double startValue = this->StartValue;
+  double stepSize = this->StepSize;
+  int numSamples = (int)ceil( (context.MaxDose-startValue)/stepSize ) + 1;
+
+  for (size_t batchStartIndex = 0; batchStartIndex < segmentDvhs.size(); batchStartIndex += maximumNumberOfSegmentsInMask)
+  {
+    size_t numberOfSegmentsInBatch = std::min(maximumNumberOfSegmentsInMask, segmentDvhs.size() - batchStartIndex);
+
+    // Create empty mask with the smallest scalar type that has a bit for each segment
+    int maskScalarType = VTK_UNSIGNED_INT;
+    if (numberOfSegmentsInBatch <= sizeof(vtkTypeUInt8) * 8)
+    {
+      maskScalarType = VTK_UNSIGNED_CHAR;
+    }
+    else if (numberOfSegmentsInBatch <= sizeof(vtkTypeUInt16) * 8)
+    {
+      maskScalarType = VTK_UNSIGNED_SHORT;
+    }
+    vtkNew<vtkImageData> structureMask;
+    structureMask->SetExtent(doseExtent);
+    structureMask->AllocateScalars(maskScalarType, 1);
+    memset(structureMask->GetScalarPointer(), 0, structureMask->GetScalarSize() * structureMask->GetNumberOfPoints());
+
+    // Prepare segment labelmaps and add them to the mask. The labelmaps are released as soon as they are added
+    std::mutex maskMutex;
+    vtkSlicerRtCommon::RunOnWorkerThreads(numberOfSegmentsInBatch, numberOfThreads,
+      [&](size_t segmentIndexInBatch)
+      {
+        SegmentDvh& segmentDvh = segmentDvhs[batchStartIndex + segmentIndexInBatch];
+        segmentDvh.ErrorMessage.clear();
+        double minimumValue = 0.0;
+        double maximumValue = 1.0;
+        vtkSmartPointer<vtkOrientedImageData> segmentLabelmap = this->PrepareSegmentLabelmap(context, segmentDvh, minimumValue, maximumValue);
+        if (!segmentLabelmap)
+        {
+          return;
+        }
+
+        // Voxels of the labelmap outside the dose volume are ignored (same as cropping by the padding filter)
+        int extent[6] = {0,-1,0,-1,0,-1};
+        segmentLabelmap->GetExtent(extent);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          extent[axis*2] = std::max(extent[axis*2], doseExtent[axis*2]);
+          extent[axis*2+1] = std::min(extent[axis*2+1], doseExtent[axis*2+1]);
+        }
+        // Skip empty segments and segments outside the dose volume, they have no voxels in the stenciled dose volume.
+        // The error is the same as the one reported by ComputeSegmentDvh for such segments
+        if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+        {
+          segmentDvh.ErrorMessage = "Dose volume and the structure do not overlap";
+          return;
+        }
+
+        int structureIndex = static_cast<int>(segmentIndexInBatch);
+        std::lock_guard<std::mutex> lock(maskMutex);
+        switch (maskScalarType)
+        {
+          case VTK_UNSIGNED_CHAR:
+            AddLabelmapToStructureMask<vtkTypeUInt8>(segmentLabelmap, structureMask, structureIndex, extent);
+            break;
+          case VTK_UNSIGNED_SHORT:
+            AddLabelmapToStructureMask<vtkTypeUInt16>(segmentLabelmap, structureMask, structureIndex, extent);
+            break;
+          default:
+            AddLabelmapToStructureMask<vtkTypeUInt32>(segmentLabelmap, structureMask, structureIndex, extent);
+            break;
+        }
+      },
+      [&](size_t numberOfFinishedSegmentsInBatch)
+      {
+        // Update progress bar
+        double progress = (double)(batchStartIndex + numberOfFinishedSegmentsInBatch) / (double)segmentDvhs.size();
+        this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+      });
+
+    // Compute histograms of all the segments in the batch
+    vtkNew<vtkMultiStructureImageAccumulate> structureStat;
+    structureStat->SetStructureMask(structureMask);
+    structureStat->SetMaskTypeToBitset();
+    structureStat->SetNumberOfStructures(static_cast<int>(numberOfSegmentsInBatch));
+    structureStat->SetBinStart(startValue);
+    structureStat->SetBinSpacing(stepSize);
+    structureStat->SetNumberOfBins(numSamples);
+    if (!context.StreamFixedOversampledDoseVolume)
+    {
+      structureStat->SetInputImage(oversampledDoseVolume);
+      structureStat->Update();
+    }
+    else
+    {
+      // Resample and accumulate the dose volume slab by slab, so that the whole oversampled dose volume
+      // is never allocated. Slabs use the memory left by the mask, but contain at least one slice.
+      structureStat->AccumulateOn();
+      double sliceSizeBytes = numberOfDoseVoxelsInSlice * context.DoseImageData->GetScalarSize();
+      double slabMemoryBytes = memoryLimitBytes - numberOfDoseVoxels * structureMask->GetScalarSize();
+      int numberOfSlicesInSlab = std::max(1, (int)(slabMemoryBytes / sliceSizeBytes));
+      for (int slabStartSlice = doseExtent[4]; slabStartSlice <= doseExtent[5]; slabStartSlice += numberOfSlicesInSlab)
+      {
+        vtkSmartPointer<vtkOrientedImageData> slabGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+        slabGeometry->SetExtent(doseExtent[0], doseExtent[1], doseExtent[2], doseExtent[3],
+          slabStartSlice, std::min(slabStartSlice + numberOfSlicesInSlab - 1, doseExtent[5]));
+        slabGeometry->SetOrigin(oversampledDoseVolume->GetOrigin());
+        slabGeometry->SetSpacing(oversampledDoseVolume->GetSpacing());
+        slabGeometry->CopyDirections(oversampledDoseVolume);
+
+        vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+        doseImageData->ShallowCopy(context.DoseImageData);
+        vtkSmartPointer<vtkOrientedImageData> doseSlab = vtkSmartPointer<vtkOrientedImageData>::New();
+        if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(doseImageData, slabGeometry, doseSlab, true))
+        {
+          for (size_t segmentIndexInBatch = 0; segmentIndexInBatch < numberOfSegmentsInBatch; ++segmentIndexInBatch)
+          {
+            segmentDvhs[batchStartIndex + segmentIndexInBatch].ErrorMessage = "Failed to resample dose volume";
+          }
+          break;
+        }
+        structureStat->SetInputImage(doseSlab);
+        structureStat->Update();
+      }
+    }
 
-  bool useFractionalLabelmap = parameterNode->GetUseFractionalLabelmap();
-  if (useFractionalLabelmap)
-  {
-    stencil->ThresholdByUpper(minimumValue + 1e-10);
-  }
-  else
-  {
-    stencil->ThresholdByUpper(1e-10);
-  }
-  stencil->Update();
+    vtkNew<vtkDoubleArray> cumulativeHistogram;
+    for (size_t segmentIndexInBatch = 0; segmentIndexInBatch < numberOfSegmentsInBatch; ++segmentIndexInBatch)
+    {
+      SegmentDvh& segmentDvh = segmentDvhs[batchStartIndex + segmentIndexInBatch];
+      if (!segmentDvh.ErrorMessage.empty())
+      {
+        continue;
+      }
+      int structureIndex = static_cast<int>(segmentIndexInBatch);
 
-  vtkSmartPointer<vtkImageStencilData> structureStencil = vtkSmartPointer<vtkImageStencilData>::New();
-  structureStencil->DeepCopy(stencil->GetOutput());
+      // Report error if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
+      vtkIdType totalVoxels = structureStat->GetVoxelCount(structureIndex);
+      if (totalVoxels < 1)
+      {
+        segmentDvh.ErrorMessage = "Dose volume and the structure do not overlap"; // User-friendly error to help troubleshooting
+        continue;
+      }
+      segmentDvh.VolumeCc = totalVoxels * cubicMMPerVoxel * ccPerCubicMM;
+      segmentDvh.MeanDose = structureStat->GetMean(structureIndex);
+      segmentDvh.MinDose = structureStat->GetMinimum(structureIndex);
+      segmentDvh.MaxDose = structureStat->GetMaximum(structureIndex);
+      if (segmentDvh.MinDose < 0)
+      {
+        segmentDvh.ErrorMessage = "The dose volume contains negative dose values";
+        continue;
+      }
 
-  int stencilExtent[6] = {0,-1,0,-1,0,-1};
-  structureStencil->GetExtent(stencilExtent);
-  if (stencilExtent[1]-stencilExtent[0] <= 0 || stencilExtent[3]-stencilExtent[2] <= 0 || stencilExtent[5]-stencilExtent[4] <= 0)
-  {
-    std::string errorMessage("Invalid stenciled dose volume");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
-    return errorMessage;
-  }
+      // Start value is positive, so the fixed point at (0.0, 100%) is always added
+      structureStat->GetCumulativeHistogram(structureIndex, cumulativeHistogram);
+      segmentDvh.Doses.clear();
+      segmentDvh.VolumePercents.clear();
+      segmentDvh.Doses.reserve(numSamples + 1);
+      segmentDvh.VolumePercents.reserve(numSamples + 1);
+      segmentDvh.Doses.push_back(0.0);
+      segmentDvh.VolumePercents.push_back(100.0);
+      for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
+      {
+        segmentDvh.Doses.push_back(startValue + sampleIndex * stepSize);
+        segmentDvh.VolumePercents.push_back(cumulativeHistogram->GetValue(sampleIndex) * 100.0);
+      }
+    }
+  } // For each batch
 
-  // Compute statistics
-  vtkSmartPointer<vtkImageAccumulate> structureStat;
-  if (useFractionalLabelmap)
+  // Log measured time
+  double checkpointEnd = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+  if (this->LogSpeedMeasurements)
   {
-    structureStat = vtkSmartPointer<vtkFractionalImageAccumulate>::New();
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->UseFractionalLabelmapOn();
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetFractionalLabelmap(segmentLabelmap);
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMinimumFractionalValue(minimumValue);
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMaximumFractionalValue(maximumValue);
+    vtkDebugMacro("ComputeSegmentDvhsInSinglePass: DVH computation time for " << segmentDvhs.size() << " structures: " << checkpointEnd-checkpointStart << " s");
   }
-  else
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::StoreSegmentDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, const SegmentDvh& segmentDvh)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
   {
-    structureStat = vtkSmartPointer<vtkImageAccumulate>::New();
+    std::string errorMessage("Invalid MRML scene or parameter set node");
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
+    return errorMessage;
   }
-  structureStat->SetInputData(oversampledDoseVolume);
-  structureStat->SetStencilData(structureStencil);
-  structureStat->Update();
-
-  // Report error if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
-  if (structureStat->GetVoxelCount() < 1)
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if ( !segmentationNode || !doseVolumeNode )
   {
-    std::string errorMessage("Dose volume and the structure do not overlap"); // User-friendly error to help troubleshooting
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
     return errorMessage;
   }
+  std::string segmentID = segmentDvh.SegmentID;
+  std::string segmentName = segmentationNode->GetSegmentation()->GetSegment(segmentID)->GetName();
+  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
 
   // Get metrics table for the parameter node; Create one if missing
   vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
@@ -656,7 +1228,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   else
   {
     std::string errorMessage("Failed to find metrics table row for structure " + segmentName);
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
     return errorMessage;
   }
 
@@ -668,91 +1240,28 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   oversamplingAttrValueStream << (parameterNode->GetAutomaticOversampling() ? (-1.0) : this->DefaultDoseVolumeOversamplingFactor);
   tableNode->SetAttribute(DVH_DOSE_VOLUME_OVERSAMPLING_FACTOR_ATTRIBUTE_NAME.c_str(), oversamplingAttrValueStream.str().c_str());
 
-  // Get spacing and voxel volume
-  double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
-  double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
-  double ccPerCubicMM = 0.001;
-
   // Set default column values
-
   // Structure name
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure, vtkVariant(segmentName));
   // Volume name
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnDoseVolume, vtkVariant(doseVolumeNode->GetName()));
   // Volume (cc) - save as attribute too (the DVH contains percentages that often need to be converted to volume)
-  double volumeCc = 0;
-  if (useFractionalLabelmap)
-  {
-    volumeCc = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
-  else
-  {
-    volumeCc = structureStat->GetVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(volumeCc));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(segmentDvh.VolumeCc));
   std::ostringstream attributeNameStream;
   std::ostringstream attributeValueStream;
   attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
-  attributeValueStream << volumeCc;
+  attributeValueStream << segmentDvh.VolumeCc;
   tableNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
   // Mean dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(structureStat->GetMean()[0]));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(segmentDvh.MeanDose));
   // Min dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(structureStat->GetMin()[0]));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(segmentDvh.MinDose));
   // Max dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(structureStat->GetMax()[0]));
-
-  // Create DVH plot values
-  int numSamples = 0;
-  double startValue = 0.0;
-  double stepSize = 0.0;
-  double rangeMin = structureStat->GetMin()[0];
-  double rangeMax = structureStat->GetMax()[0];
-  if (isDoseVolume)
-  {
-    if (rangeMin<0)
-    {
-      std::string errorMessage("The dose volume contains negative dose values");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
-    }
-
-    startValue = this->StartValue;
-    stepSize = this->StepSize;
-    numSamples = (int)ceil( (maxDoseGy-startValue)/stepSize ) + 1;
-  }
-  else
-  {
-    startValue = rangeMin;
-    numSamples = this->NumberOfSamplesForNonDoseVolumes;
-    stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
-  }
-
-  // Get the number of voxels with smaller dose than at the start value
-  structureStat->SetComponentExtent(0,1,0,0,0,0);
-  structureStat->SetComponentOrigin(0,0,0);
-  structureStat->SetComponentSpacing(startValue,1,1);
-  structureStat->Update();
-  double voxelBelowDose = structureStat->GetOutput()->GetScalarComponentAsDouble(0,0,0,0);
-
-  // We put a fixed point at (0.0, 100%), but only if there are only positive values in the histogram
-  // Negative values can occur when the user requests histogram for an image, such as s CT volume (in
-  // this case Intensity Volume Histogram is computed), or the startValue became negative for the dose
-  // volume because the range minimum was smaller than the original start value.
-  bool insertPointAtOrigin = true;
-  if (startValue < 0.0)
-  {
-    insertPointAtOrigin = false;
-  }
-
-  structureStat->SetComponentExtent(0,numSamples-1,0,0,0,0);
-  structureStat->SetComponentOrigin(startValue,0,0);
-  structureStat->SetComponentSpacing(stepSize,1,1);
-  structureStat->Update();
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(segmentDvh.MaxDose));
 
   // Allocate table
   vtkTable* table = tableNode->GetTable();
-  int numberOfRows = numSamples + (insertPointAtOrigin?1:0);
+  int numberOfRows = static_cast<int>(segmentDvh.Doses.size());
   vtkNew<vtkDoubleArray> columnDose;
   columnDose->SetName(isDoseVolume ? "Dose" : "Intensity");
   columnDose->SetNumberOfTuples(numberOfRows);
@@ -763,49 +1272,12 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   table->AddColumn(columnVolume);
   table->SetNumberOfRows(numberOfRows);
 
-  int rowIndex = 0;
-
-  if (insertPointAtOrigin)
-  {
-    // Add first fixed point at (0.0, 100%)
-    table->SetValue(rowIndex, 0, 0.0);
-    table->SetValue(rowIndex, 1, 100.0);
-    table->SetValue(rowIndex, 2, 0);
-    ++rowIndex;
-  }
-
-  vtkImageData* statArray = structureStat->GetOutput();
-  double totalVoxels = 0;
-  if (useFractionalLabelmap)
-  {
-    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
-  }
-  else
-  {
-    totalVoxels = structureStat->GetVoxelCount();
-  }
-
-  for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
+  // Fill DVH plot values
+  for (int rowIndex=0; rowIndex<numberOfRows; ++rowIndex)
   {
-    double voxelsInBin = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
-    table->SetValue(rowIndex, 0, startValue + sampleIndex * stepSize);
-    if (useFractionalLabelmap)
-    {
-      table->SetValue(rowIndex, 1, std::max(0.0, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0));
-    }
-    else
-    {
-      table->SetValue(rowIndex, 1, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0);
-    }
+    table->SetValue(rowIndex, 0, segmentDvh.Doses[rowIndex]);
+    table->SetValue(rowIndex, 1, segmentDvh.VolumePercents[rowIndex]);
     table->SetValue(rowIndex, 2, 0);
-    ++rowIndex;
-    voxelBelowDose += voxelsInBin;
-  }
-
-  // Set the start of the first bin to 0 if the volume contains dose and the start value was negative
-  if (isDoseVolume && !insertPointAtOrigin)
-  {
-    table->SetValue(0, 0, 0.0);
   }
 
   // Setup DVH subject hierarchy items
@@ -813,7 +1285,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   if (!shNode)
   {
     std::string errorMessage("Failed to access subject hierarchy node");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkErrorMacro("StoreSegmentDvh: " << errorMessage);
     return errorMessage;
   }
   vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
@@ -833,16 +1305,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   segmentationNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), tableNode->GetID());
   doseVolumeNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), tableNode->GetID());
 
-  // Log measured time
-  double checkpointEnd = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
-  if (this->LogSpeedMeasurements)
-  {
-    vtkDebugMacro("ComputeDvh: DVH computation time for structure '" << segmentID << "': " << checkpointEnd-checkpointStart << " s");
-  }
-
   return ""; // No error
-} // end ComputeDvh
+} // end StoreSegmentDvh
 
 //---------------------------------------------------------------------------
 vtkMRMLPlotViewNode* vtkSlicerDoseVolumeHistogramModuleLogic::GetPlotViewNode()
@@ -1195,23 +1659,17 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetrics(vtkMRMLDoseVolumeH
     return false;
   }
 
-  // Remove all V metrics from the table
+  // Remove all V metrics from the table in one pass. Columns are traversed backwards so that
+  // removing a column does not change the index of the columns still to be visited
   vtkTable* metricsTable = metricsTableNode->GetTable();
-  int numberOfColumnsBeforeRemoval = -1;
-  do
+  for (int col=metricsTable->GetNumberOfColumns()-1; col>=0; --col)
   {
-    numberOfColumnsBeforeRemoval = metricsTable->GetNumberOfColumns();
-    for (int col=0; col<metricsTable->GetNumberOfColumns(); ++col)
+    const char* columnName = metricsTable->GetColumnName(col);
+    if (columnName && this->IsVMetricName(columnName))
     {
-      std::string columnName(metricsTable->GetColumnName(col));
-      if (this->IsVMetricName(columnName))
-      {
-        metricsTable->RemoveColumn(col);
-        break;
-      }
+      metricsTable->RemoveColumn(col);
     }
   }
-  while (numberOfColumnsBeforeRemoval != metricsTable->GetNumberOfColumns());
 
   // If no V metrics need to be shown then exit
   if (!parameterNode->GetShowVMetricsCc() && !parameterNode->GetShowVMetricsPercent())
@@ -1286,39 +1744,25 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetrics(vtkMRMLDoseVolumeH
     }
 
     // Compute volume for all V's
-    vtkTable* table = dvhTableNode->GetTable();
-    vtkNew<vtkPiecewiseFunction> interpolator;
-    interpolator->ClampingOn();
-
-    // Starting from second point, because BuildFunctionFromTable needs uniform distance between X coordinates
-    //  and the first point may be 0 (with different distance to neighbors than the second)
-    double* dvhArrayDouble = new double[table->GetNumberOfRows()-1];
-    for (int i=1; i<table->GetNumberOfRows(); ++i)
+    std::vector<double> volumePercentValues;
+    if (!this->ComputeVMetricsForDvh(dvhTableNode, doseValues, volumePercentValues))
     {
-      dvhArrayDouble[i-1] = table->GetValue(i, 1).ToDouble();
+      continue;
     }
-    interpolator->BuildFunctionFromTable(
-      table->GetValue(1, 0).ToDouble(), table->GetValue(table->GetNumberOfRows()-1, 0).ToDouble(), table->GetNumberOfRows()-1,
-      dvhArrayDouble );
 
-    // Add first point
-    interpolator->AddPoint(table->GetValue(0, 0).ToDouble(), table->GetValue(0, 1).ToDouble());
-
-    // Calculate metrics and set table entries
+    // Set table entries
     int tableColumn = numberOfColumnsBefore;
-    for (std::vector<double>::iterator it = doseValues.begin(); it != doseValues.end(); ++it)
+    for (std::vector<double>::iterator it = volumePercentValues.begin(); it != volumePercentValues.end(); ++it)
     {
-      double volumePercentEstimated = interpolator->GetValue(*it);
       if (parameterNode->GetShowVMetricsCc())
       {
-        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(volumePercentEstimated*structureVolume/100.0) );
+        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant((*it)*structureVolume/100.0) );
       }
       if (parameterNode->GetShowVMetricsPercent())
       {
-        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(volumePercentEstimated) );
+        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(*it) );
       }
     }
-    delete[] dvhArrayDouble;
   } // For all DVHs
 
   metricsTableNode->Modified();
@@ -1383,23 +1827,17 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
       + ")";
   }
 
-  // Remove all D metrics from the table
+  // Remove all D metrics from the table in one pass. Columns are traversed backwards so that
+  // removing a column does not change the index of the columns still to be visited
   vtkTable* metricsTable = metricsTableNode->GetTable();
-  int numberOfColumnsBeforeRemoval = -1;
-  do
+  for (int col=metricsTable->GetNumberOfColumns()-1; col>=0; --col)
   {
-    numberOfColumnsBeforeRemoval = metricsTable->GetNumberOfColumns();
-    for (int col=0; col<metricsTable->GetNumberOfColumns(); ++col)
+    const char* columnName = metricsTable->GetColumnName(col);
+    if (columnName && this->IsDMetricName(columnName))
     {
-      std::string columnName(metricsTable->GetColumnName(col));
-      if (this->IsDMetricName(columnName))
-      {
-        metricsTable->RemoveColumn(col);
-        break;
-      }
+      metricsTable->RemoveColumn(col);
     }
   }
-  while (numberOfColumnsBeforeRemoval != metricsTable->GetNumberOfColumns());
 
   // If no D metrics need to be shown then exit
   if (!parameterNode->GetShowDMetrics())
@@ -1480,16 +1918,21 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     }
 
     // Calculate metrics and set table entries
+    std::vector<double> doseValuesCc;
+    std::vector<double> doseValuesPercent;
+    if ( !this->ComputeDMetricsForDvh(dvhTableNode, volumeValuesCc, structureVolume, false, doseValuesCc)
+      || !this->ComputeDMetricsForDvh(dvhTableNode, volumeValuesPercent, structureVolume, true, doseValuesPercent) )
+    {
+      continue;
+    }
     int tableColumn = numberOfColumnsBefore;
-    for (std::vector<double>::iterator ccIt=volumeValuesCc.begin(); ccIt!=volumeValuesCc.end(); ++ccIt)
+    for (std::vector<double>::iterator doseIt=doseValuesCc.begin(); doseIt!=doseValuesCc.end(); ++doseIt)
     {
-      double d = ComputeDMetric(dvhTableNode, (*ccIt), structureVolume, false);
-      metricsTable->SetValue(tableRow, tableColumn++, vtkVariant(d));
+      metricsTable->SetValue(tableRow, tableColumn++, vtkVariant(*doseIt));
     }
-    for (std::vector<double>::iterator percentIt=volumeValuesPercent.begin(); percentIt!=volumeValuesPercent.end(); ++percentIt)
+    for (std::vector<double>::iterator doseIt=doseValuesPercent.begin(); doseIt!=doseValuesPercent.end(); ++doseIt)
     {
-      double d = ComputeDMetric(dvhTableNode, (*percentIt), structureVolume, true);
-      metricsTable->SetValue(tableRow, tableColumn++, vtkVariant(d));
+      metricsTable->SetValue(tableRow, tableColumn++, vtkVariant(*doseIt));
     }
   } // For all DVHs
 
@@ -1500,60 +1943,178 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
 //---------------------------------------------------------------------------
 double vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetric(vtkMRMLTableNode* tableNode, double volume, double structureVolume, bool isPercent)
 {
-  if (!tableNode)
+  std::vector<double> volumes(1, volume);
+  std::vector<double> doses;
+  if (!this->ComputeDMetricsForDvh(tableNode, volumes, structureVolume, isPercent, doses))
   {
-    vtkErrorMacro("ComputeDMetric: Invalid DVH array node");
     return 0.0;
   }
+  return doses[0];
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricsForDvh(vtkMRMLTableNode* tableNode,
+  const std::vector<double>& volumes, double structureVolume, bool isPercent, std::vector<double>& doses)
+{
+  doses.clear();
+  if (!tableNode)
+  {
+    vtkErrorMacro("ComputeDMetricsForDvh: Invalid DVH array node");
+    return false;
+  }
   if (isPercent && structureVolume == 0.0)
   {
-    vtkErrorMacro("ComputeDMetric: Invalid structure volume");
-    return 0.0;
+    vtkErrorMacro("ComputeDMetricsForDvh: Invalid structure volume");
+    return false;
+  }
+  if (volumes.empty())
+  {
+    return true;
   }
 
-  vtkTable* table = tableNode->GetTable();
-  double volumeSize = 0.0;
-  double doseForVolume = 0.0;
+  std::vector<double> dvhDoses;
+  std::vector<double> dvhVolumes;
+  if (!GetDvhArrays(tableNode->GetTable(), dvhDoses, dvhVolumes))
+  {
+    vtkErrorMacro("ComputeDMetricsForDvh: Invalid DVH table in node " << tableNode->GetName());
+    return false;
+  }
 
-  if (isPercent)
+  // Convert DVH volumes from percent to cc. The volumes are decreasing with the dose (cumulative histogram)
+  for (std::vector<double>::iterator volumeIt=dvhVolumes.begin(); volumeIt!=dvhVolumes.end(); ++volumeIt)
   {
-    volumeSize = volume * structureVolume / 100.0;
+    (*volumeIt) = (*volumeIt) / 100.0 * structureVolume;
   }
-  else
+
+  doses.reserve(volumes.size());
+  for (std::vector<double>::const_iterator volumeIt=volumes.begin(); volumeIt!=volumes.end(); ++volumeIt)
   {
-    volumeSize = volume;
+    double volumeSize = (isPercent ? (*volumeIt) * structureVolume / 100.0 : (*volumeIt));
+
+    // Check if the given volume is above the highest (first) in the array then assign no dose
+    if (volumeSize >= dvhVolumes.front())
+    {
+      doses.push_back(0.0);
+    }
+    // If volume is below the lowest (last) in the array then assign maximum dose
+    else if (volumeSize < dvhVolumes.back())
+    {
+      doses.push_back(dvhDoses.back());
+    }
+    else
+    {
+      // Find the first point with volume not greater than the given volume, then interpolate linearly
+      // between it and the previous point (which is then greater than the given volume)
+      std::vector<double>::iterator nextIt = std::lower_bound(dvhVolumes.begin(), dvhVolumes.end(), volumeSize,
+        [](double dvhVolume, double value) { return dvhVolume > value; } );
+      size_t next = nextIt - dvhVolumes.begin();
+      double volumePrevious = dvhVolumes[next-1];
+      double volumeNext = dvhVolumes[next];
+      double dosePrevious = dvhDoses[next-1];
+      double doseNext = dvhDoses[next];
+      doses.push_back(dosePrevious + (doseNext-dosePrevious)*(volumeSize-volumePrevious)/(volumeNext-volumePrevious));
+    }
   }
 
-  // Check if the given volume is above the highest (first) in the array then assign no dose
-  if (volumeSize >= table->GetValue(0, 1).ToDouble() / 100.0 * structureVolume)
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetricsForDvh(vtkMRMLTableNode* tableNode,
+  const std::vector<double>& doses, std::vector<double>& volumesPercent)
+{
+  volumesPercent.clear();
+  if (!tableNode)
   {
-    doseForVolume = 0.0;
+    vtkErrorMacro("ComputeVMetricsForDvh: Invalid DVH array node");
+    return false;
   }
-  // If volume is below the lowest (last) in the array then assign maximum dose
-  else if (volumeSize < table->GetValue(table->GetNumberOfRows()-1, 1).ToDouble() / 100.0 * structureVolume)
+
+  std::vector<double> dvhDoses;
+  std::vector<double> dvhVolumes;
+  if (!GetDvhArrays(tableNode->GetTable(), dvhDoses, dvhVolumes))
   {
-    doseForVolume = table->GetValue(table->GetNumberOfRows()-1, 0).ToDouble();
+    vtkErrorMacro("ComputeVMetricsForDvh: Invalid DVH table in node " << tableNode->GetName());
+    return false;
   }
-  else
+
+  // Interpolate linearly between the DVH points, clamp to the first and last point outside the dose range
+  volumesPercent.reserve(doses.size());
+  for (std::vector<double>::const_iterator doseIt=doses.begin(); doseIt!=doses.end(); ++doseIt)
   {
-    for (int i=0; i<table->GetNumberOfRows()-1; ++i)
+    if ((*doseIt) <= dvhDoses.front())
     {
-      double volumePrevious = table->GetValue(i, 1).ToDouble() / 100.0 * structureVolume;
-      double volumeNext = table->GetValue(i+1, 1).ToDouble() / 100.0 * structureVolume;
-      if (volumePrevious > volumeSize && volumeSize >= volumeNext)
-      {
-        // Compute the dose using linear interpolation
-        double dosePrevious = table->GetValue(i, 0).ToDouble();
-        double doseNext = table->GetValue(i+1, 0).ToDouble();
-        double doseEstimated = dosePrevious + (doseNext-dosePrevious)*(volumeSize-volumePrevious)/(volumeNext-volumePrevious);
-        doseForVolume = doseEstimated;
-
-        break;
-      }
+      volumesPercent.push_back(dvhVolumes.front());
+    }
+    else if ((*doseIt) >= dvhDoses.back())
+    {
+      volumesPercent.push_back(dvhVolumes.back());
+    }
+    else
+    {
+      std::vector<double>::iterator nextIt = std::upper_bound(dvhDoses.begin(), dvhDoses.end(), (*doseIt));
+      size_t next = nextIt - dvhDoses.begin();
+      double dosePrevious = dvhDoses[next-1];
+      double doseNext = dvhDoses[next];
+      double volumePrevious = dvhVolumes[next-1];
+      double volumeNext = dvhVolumes[next];
+      volumesPercent.push_back(volumePrevious + (volumeNext-volumePrevious)*((*doseIt)-dosePrevious)/(doseNext-dosePrevious));
     }
   }
 
-  return doseForVolume;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricsForDvh(vtkMRMLTableNode* tableNode,
+  vtkDoubleArray* volumes, double structureVolume, bool isPercent, vtkDoubleArray* doses)
+{
+  if (!volumes || !doses)
+  {
+    vtkErrorMacro("ComputeDMetricsForDvh: Invalid volume or dose array");
+    return false;
+  }
+
+  std::vector<double> volumeValues(volumes->GetNumberOfTuples());
+  for (vtkIdType index = 0; index < volumes->GetNumberOfTuples(); ++index)
+  {
+    volumeValues[index] = volumes->GetValue(index);
+  }
+  std::vector<double> doseValues;
+  bool success = this->ComputeDMetricsForDvh(tableNode, volumeValues, structureVolume, isPercent, doseValues);
+
+  doses->SetNumberOfTuples(doseValues.size());
+  for (size_t index = 0; index < doseValues.size(); ++index)
+  {
+    doses->SetValue(index, doseValues[index]);
+  }
+  return success;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetricsForDvh(vtkMRMLTableNode* tableNode,
+  vtkDoubleArray* doses, vtkDoubleArray* volumesPercent)
+{
+  if (!doses || !volumesPercent)
+  {
+    vtkErrorMacro("ComputeVMetricsForDvh: Invalid dose or volume array");
+    return false;
+  }
+
+  std::vector<double> doseValues(doses->GetNumberOfTuples());
+  for (vtkIdType index = 0; index < doses->GetNumberOfTuples(); ++index)
+  {
+    doseValues[index] = doses->GetValue(index);
+  }
+  std::vector<double> volumePercentValues;
+  bool success = this->ComputeVMetricsForDvh(tableNode, doseValues, volumePercentValues);
+
+  volumesPercent->SetNumberOfTuples(volumePercentValues.size());
+  for (size_t index = 0; index < volumePercentValues.size(); ++index)
+  {
+    volumesPercent->SetValue(index, volumePercentValues[index]);
+  }
+  return success;
 }
 
 //---------------------------------------------------------------------------
@@ -32,8 +32,16 @@
 
 #include "vtkSlicerDoseVolumeHistogramModuleLogicExport.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
 class vtkOrientedImageData;
 class vtkCallbackCommand;
+class vtkDoubleArray;
+class vtkGeneralTransform;
 
 class vtkMRMLDoseVolumeHistogramNode;
 class vtkMRMLPlotChartNode;
@@ -121,6 +129,33 @@ public:
   /// \param doseMetricAttributeNamePrefix Prefix of the desired dose metric attribute name, e.g. "Mean "
   std::string AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix);
 
+  /// Calculate one D metric. For multiple metrics of the same DVH use \sa ComputeDMetricsForDvh
+  double ComputeDMetric(vtkMRMLTableNode* tableNode, double volume, double structureVolume, bool isPercent);
+
+  /// Calculate D metrics (dose received by the given volumes) of one DVH. Called from \sa ComputeDMetrics
+  /// The DVH table is read only once, and the dose for each volume is found by binary search.
+  /// \param volumes Volumes in cc or percent of the structure volume, depending on isPercent
+  /// \param doses Output dose values, one for each volume
+  /// \return Success flag
+  bool ComputeDMetricsForDvh(vtkMRMLTableNode* tableNode, const std::vector<double>& volumes,
+    double structureVolume, bool isPercent, std::vector<double>& doses);
+
+  /// Calculate V metrics (volume percent receiving at least the given doses) of one DVH. Called from \sa ComputeVMetrics
+  /// The DVH table is read only once, and the volume for each dose is found by binary search.
+  /// \param volumesPercent Output volumes in percent of the structure volume, one for each dose
+  /// \return Success flag
+  bool ComputeVMetricsForDvh(vtkMRMLTableNode* tableNode, const std::vector<double>& doses, std::vector<double>& volumesPercent);
+
+  /// Calculate D metrics of one DVH. Wrappable version of \sa ComputeDMetricsForDvh
+  /// \param volumes Volumes in cc or percent of the structure volume, depending on isPercent
+  /// \param doses Output array, filled with one dose value for each volume
+  bool ComputeDMetricsForDvh(vtkMRMLTableNode* tableNode, vtkDoubleArray* volumes,
+    double structureVolume, bool isPercent, vtkDoubleArray* doses);
+
+  /// Calculate V metrics of one DVH. Wrappable version of \sa ComputeVMetricsForDvh
+  /// \param volumesPercent Output array, filled with one volume percent for each dose
+  bool ComputeVMetricsForDvh(vtkMRMLTableNode* tableNode, vtkDoubleArray* doses, vtkDoubleArray* volumesPercent);
+
 public:
   vtkGetMacro(StartValue, double);
   vtkSetMacro(StartValue, double);
@@ -142,19 +177,92 @@ public:
   vtkSetMacro(LogSpeedMeasurements, bool);
   vtkBooleanMacro(LogSpeedMeasurements, bool);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+  vtkGetMacro(MemoryLimitMB, int);
+  vtkSetMacro(MemoryLimitMB, int);
+
 protected:
-  /// Compute DVH for the given structure segment with the stenciled dose volume
-  /// (the labelmap representation of a segment but with dose values instead of the labels)
-  /// \param parameterNode Dose volume histogram parameter set node
-  /// \param segmentLabelmap Binary representation of the labelmap representation of the segment the DVH is calculated on
-  /// \param oversampledDoseVolume Dose volume resampled to match the geometry of the segment labelmap (to allow stenciling)
-  /// \param segmentID ID of segment the DVH is calculated on
-  /// \param maxDoseGy Maximum dose determining the number of DVH bins (passed as argument so that it is only calculated once in \sa ComputeDvh() )
+  /// Settings and inputs shared by the DVH computation of all segments. Set up once in \sa ComputeDvh
+  struct DvhComputationContext
+  {
+    /// Dose volume in its original geometry
+    vtkSmartPointer<vtkOrientedImageData> DoseImageData;
+    /// Key of the dose volume in the resampled dose cache (\sa vtkResampledDoseCache)
+    std::string DoseVolumeKey;
+    /// Dose volume resampled with the fixed oversampling factor. Empty if automatic oversampling is used
+    vtkSmartPointer<vtkOrientedImageData> FixedOversampledDoseVolume;
+    /// Flag indicating that \sa FixedOversampledDoseVolume only contains the geometry, as the oversampled
+    /// dose volume does not fit in the memory limit. The dose is then resampled slab by slab
+    bool StreamFixedOversampledDoseVolume{false};
+    /// Name of the labelmap representation used (binary or fractional)
+    std::string RepresentationName;
+    bool UseFractionalLabelmap{false};
+    /// Flag indicating whether the segment labelmaps need to be resampled to the oversampled dose geometry
+    bool ResamplingRequired{false};
+    bool AutomaticOversampling{false};
+    bool DoseSurfaceHistogram{false};
+    bool UseInsideDoseSurface{true};
+    bool IsDoseVolume{true};
+    /// Maximum dose determining the number of DVH bins
+    double MaxDose{0.0};
+  };
+
+  /// Input and result of the DVH computation of one segment.
+  /// Contains no MRML nodes, so that the histogram can be computed on a worker thread.
+  struct SegmentDvh
+  {
+    /// ID of segment the DVH is calculated on
+    std::string SegmentID;
+    /// Labelmap representation of the segment, in the geometry it was converted to
+    vtkSmartPointer<vtkOrientedImageData> SegmentLabelmap;
+    /// Label value of the segment in \sa SegmentLabelmap
+    int LabelValue{1};
+    /// Transform from segmentation to world coordinate system. Empty if the segmentation is not transformed
+    vtkSmartPointer<vtkGeneralTransform> SegmentationToWorldTransform;
+
+    /// Error message of the computation, empty string if no error
+    std::string ErrorMessage;
+    double VolumeCc{0.0};
+    double MeanDose{0.0};
+    double MinDose{0.0};
+    double MaxDose{0.0};
+    /// DVH values (dose and volume percentage for each row of the DVH table)
+    std::vector<double> Doses;
+    std::vector<double> VolumePercents;
+  };
+
+  /// Get signature of the inputs of the DVH computation of a segment: the segment labelmap (or other master representation)
+  /// modified time, label value and conversion parameters, the transform to world of the segmentation, the dose volume key
+  /// (modified time and geometry), and the settings.
+  /// The DVH of a segment is only recomputed if its signature changed since the last computation.
+  /// \return Signature string, empty if the segment is not found
+  std::string GetSegmentDvhInputSignature(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID, std::string doseVolumeKey);
+
+  /// Prepare the labelmap of a segment for the DVH computation: extract it from the shared labelmap, apply the parent
+  /// transform and resample it to the oversampled dose geometry if needed. Can be called concurrently for different segments.
+  /// \param minimumValue Output minimum of the labelmap value range (background)
+  /// \param maximumValue Output maximum of the labelmap value range
+  /// \return Prepared labelmap, nullptr on error (the error is returned in \sa SegmentDvh::ErrorMessage)
+  vtkSmartPointer<vtkOrientedImageData> PrepareSegmentLabelmap(const DvhComputationContext& context, SegmentDvh& segmentDvh,
+    double& minimumValue, double& maximumValue);
+
+  /// Compute DVH for a structure segment: prepare the labelmap, stencil the oversampled dose volume and create the histogram.
+  /// Does not access the MRML scene, so it can be called concurrently for different segments.
+  /// Errors are returned in \sa SegmentDvh::ErrorMessage
+  void ComputeSegmentDvh(const DvhComputationContext& context, SegmentDvh& segmentDvh);
+
+  /// Compute DVH for multiple segments reading the dose volume only once. Can be used if the segments are binary labelmaps
+  /// sharing the fixed oversampled dose geometry. The segments are combined into bitset masks (one bit per segment, so that
+  /// they may overlap) and the histograms of all segments in a mask are computed by \sa vtkMultiStructureImageAccumulate.
+  /// Errors are returned in \sa SegmentDvh::ErrorMessage
+  void ComputeSegmentDvhsInSinglePass(const DvhComputationContext& context, std::vector<SegmentDvh>& segmentDvhs, unsigned int numberOfThreads);
+
+  /// Store DVH of a segment computed by \sa ComputeSegmentDvh in its DVH table node and the metrics table,
+  /// and set up the subject hierarchy items. Needs to be called from the main thread.
   /// \return Error message, empty string if no error
-  std::string ComputeDvh(
-    vtkMRMLDoseVolumeHistogramNode* parameterNode,
-    vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume,
-    std::string segmentID, double maxDoseGy );
+  std::string StoreSegmentDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, const SegmentDvh& segmentDvh);
 
   /// Return the plot view node object from the layout
   vtkMRMLPlotViewNode* GetPlotViewNode();
@@ -171,9 +279,6 @@ protected:
   /// Get numbers from V or D metric parameters list
   void GetNumbersFromMetricString(std::string metricStr, std::vector<double> &metricNumbers);
 
-  /// Calculate one D metric. Called from \sa ComputeDMetrics
-  double ComputeDMetric(vtkMRMLTableNode* tableNode, double volume, double structureVolume, bool isPercent);
-
   /// Callback function observing the visibility column of the metrics table
   static void OnVisibilityChanged(vtkObject* caller, unsigned long eid, void* clientData, void* callData);
 
@@ -213,6 +318,19 @@ protected:
 
   /// Flag telling whether the speed measurements are logged on standard output
   bool LogSpeedMeasurements;
+
+  /// Number of threads computing the DVH of the selected segments concurrently.
+  /// Only the numerical part (labelmap preparation, stenciling, histogram) runs on the worker threads,
+  /// the tables and subject hierarchy items are created on the calling thread after all segments are done.
+  /// 0 by default, meaning the number of threads of the vtkSMPTools backend (see \sa vtkSlicerRtCommon::GetNumberOfWorkerThreads).
+  /// The DVH of a segment does not depend on the number of threads
+  int NumberOfThreads;
+
+  /// Memory limit in megabytes for the oversampled dose volume and the structure masks used in DVH computation.
+  /// If the oversampled dose volume does not fit, then it is resampled and histogrammed slab by slab.
+  /// Only applies to fixed oversampling with binary labelmaps. The resampled dose volumes cached by \sa vtkResampledDoseCache
+  /// count against the limit: the cache is reduced to half of the limit before computation. 0 by default (no limit)
+  int MemoryLimitMB;
 };
 
 #endif
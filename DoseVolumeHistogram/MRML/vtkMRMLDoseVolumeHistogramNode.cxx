@@ -78,6 +78,7 @@ vtkMRMLDoseVolumeHistogramNode::~vtkMRMLDoseVolumeHistogramNode()
   this->SetDVolumeValuesCc(nullptr);
   this->SetDVolumeValuesPercent(nullptr);
   this->AutomaticOversamplingFactors.clear();
+  this->SegmentDvhInputSignatures.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -412,3 +413,25 @@ void vtkMRMLDoseVolumeHistogramNode::GetAutomaticOversamplingFactorSegmentIDs(vt
     segmentIDs->InsertValue(index, factorIt->first.c_str());
   }
 }
+
+//----------------------------------------------------------------------------
+std::string vtkMRMLDoseVolumeHistogramNode::GetSegmentDvhInputSignature(std::string segmentID)
+{
+  std::map<std::string, std::string>::iterator signatureIt = this->SegmentDvhInputSignatures.find(segmentID);
+  if (signatureIt == this->SegmentDvhInputSignatures.end())
+  {
+    return "";
+  }
+  return signatureIt->second;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseVolumeHistogramNode::SetSegmentDvhInputSignature(std::string segmentID, std::string signature)
+{
+  if (signature.empty())
+  {
+    this->SegmentDvhInputSignatures.erase(segmentID);
+    return;
+  }
+  this->SegmentDvhInputSignatures[segmentID] = signature;
+}
@@ -141,6 +141,16 @@ public:
   /// Get segment IDs that are stored in the automatic oversampling factor map
   void GetAutomaticOversamplingFactorSegmentIDs(vtkStringArray* segmentIDs);
 
+  /// Get signature of the inputs the current DVH of a segment was computed from. Empty string if not computed
+  std::string GetSegmentDvhInputSignature(std::string segmentID);
+  /// Set signature of the inputs the current DVH of a segment was computed from. Empty string removes the signature
+  void SetSegmentDvhInputSignature(std::string segmentID, std::string signature);
+  /// Clear DVH input signatures of all segments, so that the DVH of all segments is recomputed next time
+  void ClearSegmentDvhInputSignatures()
+  {
+    this->SegmentDvhInputSignatures.clear();
+  }
+
   /// Assemble DVH node reference role for current input selection and specific segment
   std::string AssembleDvhNodeReference(std::string segmentID);
 
@@ -270,6 +280,11 @@ protected:
   /// This property is not saved to the scene, as these are temporary values.
   std::map<std::string, double> AutomaticOversamplingFactors;
 
+  /// Signature of the inputs (segment labelmap and dose modified times, geometries, computation settings)
+  /// the current DVH of each segment was computed from. Segments with unchanged signature are not recomputed.
+  /// This property is not saved to the scene, as modified times are only valid within the session.
+  std::map<std::string, std::string> SegmentDvhInputSignatures;
+
   /// Flag telling whether or not to use fractional labelmaps
   bool UseFractionalLabelmap;
 
@@ -0,0 +1,123 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkFractionalImageAccumulate.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+int vtkFractionalImageAccumulateTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Dose and fractional labelmap large enough to be accumulated in multiple slabs
+  const int dimensions[3] = { 80, 80, 120 };
+  const double fractionalMinimum = -108.0;
+  const double fractionalMaximum = 108.0;
+
+  vtkNew<vtkImageData> doseImage;
+  doseImage->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+  doseImage->AllocateScalars(VTK_FLOAT, 1);
+  vtkNew<vtkImageData> fractionalLabelmap;
+  fractionalLabelmap->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+  fractionalLabelmap->AllocateScalars(VTK_SIGNED_CHAR, 1);
+
+  float* dosePtr = static_cast<float*>(doseImage->GetScalarPointer());
+  signed char* fractionalPtr = static_cast<signed char*>(fractionalLabelmap->GetScalarPointer());
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+  for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    int i = static_cast<int>(voxelIndex % dimensions[0]);
+    int j = static_cast<int>((voxelIndex / dimensions[0]) % dimensions[1]);
+    int k = static_cast<int>(voxelIndex / (static_cast<vtkIdType>(dimensions[0]) * dimensions[1]));
+    dosePtr[voxelIndex] = static_cast<float>(0.5 * (sin(0.11 * i) + cos(0.07 * j)) * k + 0.013 * i * j);
+    fractionalPtr[voxelIndex] = static_cast<signed char>((i * 7 + j * 13 + k * 3) % 217 - 108);
+  }
+
+  // Accumulate with the filter
+  const int numberOfBins = 200;
+  const double binOrigin = -60.0;
+  const double binSpacing = 0.8;
+  vtkNew<vtkFractionalImageAccumulate> accumulate;
+  accumulate->SetInputData(doseImage);
+  accumulate->UseFractionalLabelmapOn();
+  accumulate->SetFractionalLabelmap(fractionalLabelmap);
+  accumulate->SetMinimumFractionalValue(fractionalMinimum);
+  accumulate->SetMaximumFractionalValue(fractionalMaximum);
+  accumulate->SetComponentExtent(0, numberOfBins - 1, 0, 0, 0, 0);
+  accumulate->SetComponentOrigin(binOrigin, 0.0, 0.0);
+  accumulate->SetComponentSpacing(binSpacing, 1.0, 1.0);
+  accumulate->Update();
+
+  // Accumulate serially voxel by voxel
+  std::vector<double> serialHistogram(numberOfBins, 0.0);
+  double serialFractionalVoxelCount = 0.0;
+  for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    double fraction = (fractionalPtr[voxelIndex] - fractionalMinimum) / (fractionalMaximum - fractionalMinimum);
+    serialFractionalVoxelCount += fraction;
+    int binIndex = vtkMath::Floor((dosePtr[voxelIndex] - binOrigin) / binSpacing);
+    if (binIndex >= 0 && binIndex < numberOfBins)
+    {
+      serialHistogram[binIndex] += fraction;
+    }
+  }
+
+  // The slabs are summed in a different order, so only floating point rounding differences are allowed
+  const double tolerance = 1.0e-9;
+  if (fabs(accumulate->GetFractionalVoxelCount() - serialFractionalVoxelCount) > tolerance * serialFractionalVoxelCount)
+  {
+    std::cerr << "Fractional voxel count " << accumulate->GetFractionalVoxelCount() << " differs from the serial result " << serialFractionalVoxelCount << std::endl;
+    return EXIT_FAILURE;
+  }
+  double* histogramPtr = static_cast<double*>(accumulate->GetOutput()->GetScalarPointer());
+  for (int binIndex = 0; binIndex < numberOfBins; ++binIndex)
+  {
+    if (fabs(histogramPtr[binIndex] - serialHistogram[binIndex]) > tolerance * std::max(1.0, serialHistogram[binIndex]))
+    {
+      std::cerr << "Histogram bin " << binIndex << " (" << histogramPtr[binIndex] << ") differs from the serial result (" << serialHistogram[binIndex] << ")" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Repeated accumulation gives exactly the same histogram
+  std::vector<double> firstHistogram(histogramPtr, histogramPtr + numberOfBins);
+  accumulate->Modified();
+  accumulate->Update();
+  histogramPtr = static_cast<double*>(accumulate->GetOutput()->GetScalarPointer());
+  for (int binIndex = 0; binIndex < numberOfBins; ++binIndex)
+  {
+    if (histogramPtr[binIndex] != firstHistogram[binIndex])
+    {
+      std::cerr << "Histogram bin " << binIndex << " changed when accumulating again" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Fractional histogram matches the serial result" << std::endl;
+  return EXIT_SUCCESS;
+}
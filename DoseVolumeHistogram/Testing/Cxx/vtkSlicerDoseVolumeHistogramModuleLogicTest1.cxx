@@ -25,6 +25,7 @@
 
 // SlicerRt includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkResampledDoseCache.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
 
 // Segmentations includes
@@ -37,6 +38,7 @@
 
 // MRML includes
 #include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLPlotChartNode.h>
 #include <vtkMRMLPlotSeriesNode.h>
 #include <vtkMRMLPlotViewNode.h>
@@ -47,12 +49,14 @@
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
 
 // VTK includes
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
 #include <vtkImageAccumulate.h>
 #include <vtkLookupTable.h>
 #include <vtkNew.h>
 #include <vtkTable.h>
 #include <vtkTimerLog.h>
+#include <vtkTransform.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -60,6 +64,11 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+
 std::string csvSeparatorCharacter(",");
 
 //-----------------------------------------------------------------------------
@@ -69,6 +78,15 @@ int CompareCsvDvhTables(std::string dvhMetricsCsvFileName, std::string baselineC
 
 int CompareCsvDvhMetrics(std::string dvhMetricsCsvFileName, std::string baselineDvhMetricCsvFileName, double metricDifferenceThreshold);
 
+vtkMRMLDoseVolumeHistogramNode* ComputeDvhWithNewParameterNode(vtkMRMLScene* mrmlScene, vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic,
+  vtkMRMLDoseVolumeHistogramNode* referenceParamNode, const std::vector<std::string>& segmentIDs);
+
+int CompareDvhTableNodes(const std::vector<vtkMRMLTableNode*>& dvhNodes, const std::vector<vtkMRMLTableNode*>& baselineDvhNodes, std::string description);
+
+int CompareBatchedDvhMetrics(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, const std::vector<vtkMRMLTableNode*>& dvhNodes);
+
+int CheckDvhRecomputation(vtkMRMLScene* mrmlScene, vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, vtkMRMLDoseVolumeHistogramNode* paramNode);
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
 {
@@ -559,6 +577,75 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
     }
   }
 
+  // Metrics computed in batches must be the same as the ones computed one by one
+  if (CompareBatchedDvhMetrics(dvhLogic, dvhNodes) > 0)
+  {
+    returnWithSuccess = false;
+  }
+
+  // The DVH must not depend on the number of threads computing the segments
+  dvhLogic->SetNumberOfThreads(1);
+  vtkMRMLDoseVolumeHistogramNode* singleThreadParamNode = ComputeDvhWithNewParameterNode(mrmlScene, dvhLogic, paramNode, std::vector<std::string>());
+  dvhLogic->SetNumberOfThreads(0);
+  std::vector<vtkMRMLTableNode*> singleThreadDvhNodes;
+  if (singleThreadParamNode)
+  {
+    singleThreadParamNode->GetDvhTableNodes(singleThreadDvhNodes);
+  }
+  if (!singleThreadParamNode || CompareDvhTableNodes(dvhNodes, singleThreadDvhNodes, "single thread") > 0)
+  {
+    returnWithSuccess = false;
+  }
+
+  // Computing the segments one by one (each reading the dose volume separately) must give the same DVH
+  // as computing all segments in a single pass over the dose volume
+  std::vector<std::string> segmentIDs;
+  segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+  std::vector<vtkMRMLTableNode*> segmentBySegmentDvhNodes;
+  for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+  {
+    vtkMRMLDoseVolumeHistogramNode* segmentParamNode = ComputeDvhWithNewParameterNode(
+      mrmlScene, dvhLogic, paramNode, std::vector<std::string>(1, *segmentIt));
+    if (!segmentParamNode)
+    {
+      returnWithSuccess = false;
+      break;
+    }
+    std::vector<vtkMRMLTableNode*> segmentDvhNodes;
+    segmentParamNode->GetDvhTableNodes(segmentDvhNodes);
+    segmentBySegmentDvhNodes.insert(segmentBySegmentDvhNodes.end(), segmentDvhNodes.begin(), segmentDvhNodes.end());
+  }
+  if (CompareDvhTableNodes(dvhNodes, segmentBySegmentDvhNodes, "segment by segment computation") > 0)
+  {
+    returnWithSuccess = false;
+  }
+
+  // Resampling the dose volume slab by slab when the oversampled dose volume does not fit in the memory limit
+  // must give the same DVH as resampling the whole dose volume at once
+  if (!paramNode->GetAutomaticOversampling())
+  {
+    // The streaming is only used if the oversampled dose volume is not in the cache
+    vtkResampledDoseCache::GetInstance()->RemoveAllImages();
+    dvhLogic->SetMemoryLimitMB(1);
+    vtkMRMLDoseVolumeHistogramNode* streamedParamNode = ComputeDvhWithNewParameterNode(mrmlScene, dvhLogic, paramNode, std::vector<std::string>());
+    dvhLogic->SetMemoryLimitMB(0);
+    std::vector<vtkMRMLTableNode*> streamedDvhNodes;
+    if (streamedParamNode)
+    {
+      streamedParamNode->GetDvhTableNodes(streamedDvhNodes);
+    }
+    if (!streamedParamNode || CompareDvhTableNodes(dvhNodes, streamedDvhNodes, "slab by slab dose resampling") > 0)
+    {
+      returnWithSuccess = false;
+    }
+  }
+
+  // The DVH is only recomputed if its inputs changed. Done last, as it moves the segmentation
+  if (CheckDvhRecomputation(mrmlScene, dvhLogic, paramNode) > 0)
+  {
+    returnWithSuccess = false;
+  }
+
   if (!returnWithSuccess)
   {
     return EXIT_FAILURE;
@@ -567,6 +654,87 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
   return EXIT_SUCCESS;
 }
 
+//-----------------------------------------------------------------------------
+// Compute DVH of the given segments (all if empty) using a new parameter node with the same inputs and settings as the reference one
+vtkMRMLDoseVolumeHistogramNode* ComputeDvhWithNewParameterNode(vtkMRMLScene* mrmlScene, vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic,
+  vtkMRMLDoseVolumeHistogramNode* referenceParamNode, const std::vector<std::string>& segmentIDs)
+{
+  vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode> paramNode = vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveDoseVolumeNode(referenceParamNode->GetDoseVolumeNode());
+  paramNode->SetAndObserveSegmentationNode(referenceParamNode->GetSegmentationNode());
+  paramNode->SetSelectedSegmentIDs(segmentIDs);
+  paramNode->SetAutomaticOversampling(referenceParamNode->GetAutomaticOversampling());
+  paramNode->SetUseFractionalLabelmap(referenceParamNode->GetUseFractionalLabelmap());
+  paramNode->SetDoseSurfaceHistogram(referenceParamNode->GetDoseSurfaceHistogram());
+  paramNode->SetUseInsideDoseSurface(referenceParamNode->GetUseInsideDoseSurface());
+
+  std::string errorMessage = dvhLogic->ComputeDvh(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to compute DVH with new parameter node: " << errorMessage << std::endl;
+    return nullptr;
+  }
+
+  return paramNode;
+}
+
+//-----------------------------------------------------------------------------
+// Compare DVH tables computed from the same inputs in a different way. The tables are matched by segment ID,
+// and their values need to be equal (within floating point tolerance)
+int CompareDvhTableNodes(const std::vector<vtkMRMLTableNode*>& dvhNodes, const std::vector<vtkMRMLTableNode*>& baselineDvhNodes, std::string description)
+{
+  const double tolerance = 1.0e-6;
+
+  std::map<std::string, vtkMRMLTableNode*> baselineDvhNodesBySegmentID;
+  for (std::vector<vtkMRMLTableNode*>::const_iterator dvhIt = baselineDvhNodes.begin(); dvhIt != baselineDvhNodes.end(); ++dvhIt)
+  {
+    const char* segmentID = (*dvhIt)->GetAttribute(vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
+    baselineDvhNodesBySegmentID[segmentID ? segmentID : ""] = (*dvhIt);
+  }
+  if (dvhNodes.empty() || dvhNodes.size() != baselineDvhNodesBySegmentID.size())
+  {
+    std::cerr << "ERROR: Number of DVH tables computed with " << description << " does not match (" << baselineDvhNodesBySegmentID.size() << "<>" << dvhNodes.size() << ")" << std::endl;
+    return 1;
+  }
+
+  for (std::vector<vtkMRMLTableNode*>::const_iterator dvhIt = dvhNodes.begin(); dvhIt != dvhNodes.end(); ++dvhIt)
+  {
+    const char* segmentID = (*dvhIt)->GetAttribute(vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
+    std::map<std::string, vtkMRMLTableNode*>::iterator baselineIt = baselineDvhNodesBySegmentID.find(segmentID ? segmentID : "");
+    if (baselineIt == baselineDvhNodesBySegmentID.end())
+    {
+      std::cerr << "ERROR: No DVH table computed with " << description << " for segment " << (segmentID ? segmentID : "") << std::endl;
+      return 1;
+    }
+    vtkTable* table = (*dvhIt)->GetTable();
+    vtkTable* baselineTable = baselineIt->second->GetTable();
+    if ( table->GetNumberOfRows() != baselineTable->GetNumberOfRows()
+      || table->GetNumberOfColumns() != baselineTable->GetNumberOfColumns() )
+    {
+      std::cerr << "ERROR: Size of DVH table computed with " << description << " for segment " << segmentID << " does not match" << std::endl;
+      return 1;
+    }
+    for (vtkIdType row = 0; row < table->GetNumberOfRows(); ++row)
+    {
+      for (vtkIdType column = 0; column < table->GetNumberOfColumns(); ++column)
+      {
+        double value = table->GetValue(row, column).ToDouble();
+        double baselineValue = baselineTable->GetValue(row, column).ToDouble();
+        if (fabs(value - baselineValue) > tolerance * std::max(1.0, fabs(baselineValue)))
+        {
+          std::cerr << "ERROR: DVH computed with " << description << " for segment " << segmentID << " differs in row " << row
+            << ", column " << column << ": " << value << " <> " << baselineValue << std::endl;
+          return 1;
+        }
+      }
+    }
+  }
+
+  std::cout << "DVH tables computed with " << description << " match" << std::endl;
+  return 0;
+}
+
 //-----------------------------------------------------------------------------
 // IMPORTANT: The baseline table has to be the one with smaller resolution!
 int CompareCsvDvhTables(std::string dvhCsvFileName, std::string baselineCsvFileName,
@@ -790,3 +958,228 @@ int CompareCsvDvhMetrics(std::string dvhMetricsCsvFileName, std::string baseline
 
   return 0;
 }
+
+//-----------------------------------------------------------------------------
+// Compare D and V metrics computed in one batch per DVH with the ones computed metric by metric
+// by scanning the DVH table, as done before the batched computation
+int CompareBatchedDvhMetrics(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, const std::vector<vtkMRMLTableNode*>& dvhNodes)
+{
+  const double structureVolume = 50.0; // Only scales the volumes, so any positive value can be used
+  const double tolerance = 1e-9;
+
+  vtkNew<vtkDoubleArray> volumes;
+  for (double volume = 0.0; volume <= 110.0; volume += 2.5)
+  {
+    volumes->InsertNextValue(volume);
+  }
+  vtkNew<vtkDoubleArray> doses;
+  for (double dose = -1.0; dose <= 80.0; dose += 0.7)
+  {
+    doses->InsertNextValue(dose);
+  }
+
+  int numberOfDifferences = 0;
+  for (std::vector<vtkMRMLTableNode*>::const_iterator dvhIt = dvhNodes.begin(); dvhIt != dvhNodes.end(); ++dvhIt)
+  {
+    vtkTable* table = (*dvhIt)->GetTable();
+    vtkIdType numberOfRows = table->GetNumberOfRows();
+
+    // D metrics with volumes in cc and in percent
+    for (int isPercent = 0; isPercent <= 1; ++isPercent)
+    {
+      vtkNew<vtkDoubleArray> batchedDoses;
+      if (!dvhLogic->ComputeDMetricsForDvh((*dvhIt), volumes, structureVolume, isPercent, batchedDoses)
+        || batchedDoses->GetNumberOfTuples() != volumes->GetNumberOfTuples())
+      {
+        std::cerr << "Failed to compute D metrics for DVH " << (*dvhIt)->GetName() << std::endl;
+        return 1;
+      }
+      for (vtkIdType metricIndex = 0; metricIndex < volumes->GetNumberOfTuples(); ++metricIndex)
+      {
+        double volumeSize = (isPercent ? volumes->GetValue(metricIndex) * structureVolume / 100.0 : volumes->GetValue(metricIndex));
+        double expectedDose = 0.0;
+        if (volumeSize >= table->GetValue(0, 1).ToDouble() / 100.0 * structureVolume)
+        {
+          expectedDose = 0.0;
+        }
+        else if (volumeSize < table->GetValue(numberOfRows-1, 1).ToDouble() / 100.0 * structureVolume)
+        {
+          expectedDose = table->GetValue(numberOfRows-1, 0).ToDouble();
+        }
+        else
+        {
+          for (vtkIdType row = 0; row < numberOfRows-1; ++row)
+          {
+            double volumePrevious = table->GetValue(row, 1).ToDouble() / 100.0 * structureVolume;
+            double volumeNext = table->GetValue(row+1, 1).ToDouble() / 100.0 * structureVolume;
+            if (volumePrevious > volumeSize && volumeSize >= volumeNext)
+            {
+              double dosePrevious = table->GetValue(row, 0).ToDouble();
+              double doseNext = table->GetValue(row+1, 0).ToDouble();
+              expectedDose = dosePrevious + (doseNext-dosePrevious)*(volumeSize-volumePrevious)/(volumeNext-volumePrevious);
+              break;
+            }
+          }
+        }
+        double singleDose = dvhLogic->ComputeDMetric((*dvhIt), volumes->GetValue(metricIndex), structureVolume, isPercent);
+        if ( fabs(batchedDoses->GetValue(metricIndex) - expectedDose) > tolerance * std::max(1.0, fabs(expectedDose))
+          || batchedDoses->GetValue(metricIndex) != singleDose )
+        {
+          std::cerr << "D metric of DVH " << (*dvhIt)->GetName() << " for volume " << volumes->GetValue(metricIndex) << (isPercent ? "%" : "cc")
+            << " computed in batch (" << batchedDoses->GetValue(metricIndex) << ") differs from the one computed alone ("
+            << singleDose << ") or by scanning the table (" << expectedDose << ")" << std::endl;
+          ++numberOfDifferences;
+        }
+      }
+    }
+
+    // V metrics
+    vtkNew<vtkDoubleArray> batchedVolumesPercent;
+    if (!dvhLogic->ComputeVMetricsForDvh((*dvhIt), doses, batchedVolumesPercent)
+      || batchedVolumesPercent->GetNumberOfTuples() != doses->GetNumberOfTuples())
+    {
+      std::cerr << "Failed to compute V metrics for DVH " << (*dvhIt)->GetName() << std::endl;
+      return 1;
+    }
+    for (vtkIdType metricIndex = 0; metricIndex < doses->GetNumberOfTuples(); ++metricIndex)
+    {
+      // Piecewise linear interpolation of the DVH, clamped outside the dose range
+      double dose = doses->GetValue(metricIndex);
+      double expectedVolumePercent = table->GetValue(0, 1).ToDouble();
+      if (dose >= table->GetValue(numberOfRows-1, 0).ToDouble())
+      {
+        expectedVolumePercent = table->GetValue(numberOfRows-1, 1).ToDouble();
+      }
+      else if (dose > table->GetValue(0, 0).ToDouble())
+      {
+        for (vtkIdType row = 0; row < numberOfRows-1; ++row)
+        {
+          double dosePrevious = table->GetValue(row, 0).ToDouble();
+          double doseNext = table->GetValue(row+1, 0).ToDouble();
+          if (dosePrevious <= dose && dose < doseNext)
+          {
+            double volumePrevious = table->GetValue(row, 1).ToDouble();
+            double volumeNext = table->GetValue(row+1, 1).ToDouble();
+            expectedVolumePercent = volumePrevious + (volumeNext-volumePrevious)*(dose-dosePrevious)/(doseNext-dosePrevious);
+            break;
+          }
+        }
+      }
+      if (fabs(batchedVolumesPercent->GetValue(metricIndex) - expectedVolumePercent) > tolerance * std::max(1.0, fabs(expectedVolumePercent)))
+      {
+        std::cerr << "V metric of DVH " << (*dvhIt)->GetName() << " for dose " << dose << " computed in batch ("
+          << batchedVolumesPercent->GetValue(metricIndex) << ") differs from the one computed by scanning the table ("
+          << expectedVolumePercent << ")" << std::endl;
+        ++numberOfDifferences;
+      }
+    }
+  }
+
+  if (numberOfDifferences > 0)
+  {
+    return 1;
+  }
+  std::cout << "DVH metrics computed in batches match the metrics computed one by one" << std::endl;
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Compute DVH again and tell whether the DVH tables were recomputed. The first value of each DVH table is replaced
+// by a marker value before the computation, which is only overwritten if the DVH of the segment is recomputed.
+// \return 1 if all DVH tables were recomputed, 0 if none were, -1 if the computation failed or only some were recomputed
+int ComputeDvhAndCheckRecomputed(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, vtkMRMLDoseVolumeHistogramNode* paramNode)
+{
+  const double markerValue = -12345.0;
+
+  std::vector<vtkMRMLTableNode*> dvhNodes;
+  paramNode->GetDvhTableNodes(dvhNodes);
+  if (dvhNodes.empty())
+  {
+    std::cerr << "ERROR: No DVH tables to check recomputation on" << std::endl;
+    return -1;
+  }
+  for (std::vector<vtkMRMLTableNode*>::iterator dvhIt = dvhNodes.begin(); dvhIt != dvhNodes.end(); ++dvhIt)
+  {
+    (*dvhIt)->GetTable()->SetValue(0, 1, vtkVariant(markerValue));
+  }
+
+  std::string errorMessage = dvhLogic->ComputeDvh(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to compute DVH: " << errorMessage << std::endl;
+    return -1;
+  }
+
+  int numberOfRecomputedDvhs = 0;
+  for (std::vector<vtkMRMLTableNode*>::iterator dvhIt = dvhNodes.begin(); dvhIt != dvhNodes.end(); ++dvhIt)
+  {
+    if ((*dvhIt)->GetTable()->GetValue(0, 1).ToDouble() != markerValue)
+    {
+      ++numberOfRecomputedDvhs;
+    }
+  }
+  if (numberOfRecomputedDvhs == 0)
+  {
+    return 0;
+  }
+  return (numberOfRecomputedDvhs == static_cast<int>(dvhNodes.size()) ? 1 : -1);
+}
+
+//-----------------------------------------------------------------------------
+// Check that computing the DVH again with unchanged inputs does not recompute the segments, but changing a transform
+// anywhere in the chain above the segmentation, or modifying the dose volume, recomputes all of them
+int CheckDvhRecomputation(vtkMRMLScene* mrmlScene, vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, vtkMRMLDoseVolumeHistogramNode* paramNode)
+{
+  vtkMRMLSegmentationNode* segmentationNode = paramNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = paramNode->GetDoseVolumeNode();
+  if (!segmentationNode || !doseVolumeNode || !doseVolumeNode->GetImageData())
+  {
+    std::cerr << "ERROR: Invalid inputs for checking DVH recomputation" << std::endl;
+    return 1;
+  }
+
+  if (ComputeDvhAndCheckRecomputed(dvhLogic, paramNode) != 0)
+  {
+    std::cerr << "ERROR: DVH is recomputed although its inputs did not change" << std::endl;
+    return 1;
+  }
+
+  // Put the segmentation under a transform that has a parent transform
+  vtkSmartPointer<vtkMRMLLinearTransformNode> grandparentTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  mrmlScene->AddNode(grandparentTransformNode);
+  vtkSmartPointer<vtkMRMLLinearTransformNode> parentTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  mrmlScene->AddNode(parentTransformNode);
+  parentTransformNode->SetAndObserveTransformNodeID(grandparentTransformNode->GetID());
+  segmentationNode->SetAndObserveTransformNodeID(parentTransformNode->GetID());
+  if (ComputeDvhAndCheckRecomputed(dvhLogic, paramNode) != 1)
+  {
+    std::cerr << "ERROR: DVH is not recomputed after the segmentation is put under a transform" << std::endl;
+    return 1;
+  }
+  if (ComputeDvhAndCheckRecomputed(dvhLogic, paramNode) != 0)
+  {
+    std::cerr << "ERROR: DVH is recomputed although the transform of the segmentation did not change" << std::endl;
+    return 1;
+  }
+
+  // Move the segmentation by editing the transform that is not its direct parent
+  vtkSmartPointer<vtkTransform> translation = vtkSmartPointer<vtkTransform>::New();
+  translation->Translate(2.0, 0.0, 0.0);
+  grandparentTransformNode->SetMatrixTransformToParent(translation->GetMatrix());
+  if (ComputeDvhAndCheckRecomputed(dvhLogic, paramNode) != 1)
+  {
+    std::cerr << "ERROR: DVH is not recomputed after the parent of the segmentation transform is changed" << std::endl;
+    return 1;
+  }
+
+  // Modify the dose volume
+  doseVolumeNode->GetImageData()->Modified();
+  if (ComputeDvhAndCheckRecomputed(dvhLogic, paramNode) != 1)
+  {
+    std::cerr << "ERROR: DVH is not recomputed after the dose volume is modified" << std::endl;
+    return 1;
+  }
+
+  std::cout << "DVH is recomputed only when its inputs change" << std::endl;
+  return 0;
+}
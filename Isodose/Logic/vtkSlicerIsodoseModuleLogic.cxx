@@ -30,6 +30,10 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkResampledDoseCache.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
 
 // MRML includes
 #include <vtkMRMLColorTableNode.h>
@@ -54,6 +58,7 @@
 #include <vtkLookupTable.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkSmartPointer.h>
 #include <vtkTransformPolyDataFilter.h>
@@ -61,6 +66,9 @@
 #include <vtkWindowedSincPolyDataFilter.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <vector>
+
 //----------------------------------------------------------------------------
 const char* DEFAULT_ISODOSE_COLOR_TABLE_FILE_NAME = "Isodose_ColorTable.ctbl";
 const char* DEFAULT_ISODOSE_COLOR_TABLE_NODE_NAME = "Isodose_ColorTable_Default";
@@ -71,6 +79,84 @@ const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTF
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_RELATIVE_ROOT_HIERARCHY_NAME_POSTFIX = "_RelativeIsodoseSurfaces";
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_COLOR_TABLE_NODE_NAME_POSTFIX = "_IsodoseColorTable";
 
+//----------------------------------------------------------------------------
+// Isodose level read from the color table, and its surface created on a worker thread
+struct IsodoseLevel
+{
+  std::string Name;
+  double Value{0.0};
+  double Color[4]{0.0, 0.0, 0.0, 0.0};
+  vtkSmartPointer<vtkPolyData> Surface;
+};
+
+//----------------------------------------------------------------------------
+// Create isodose surface in RAS from the dose volume resliced to IJK coordinates.
+// Thread safe as long as the dose image is not modified, because the pipeline is connected to
+// a shallow copy of it. Returns null if the level has no surface.
+static vtkSmartPointer<vtkPolyData> CreateIsodoseSurface(vtkImageData* reslicedDoseVolumeImage, double isoLevel, vtkMatrix4x4* ijkToRasMatrix)
+{
+  // The surface is transformed from IJK to RAS after the marching cubes, so the geometry of the image is not used
+  vtkSmartPointer<vtkImageData> doseImage = vtkSmartPointer<vtkImageData>::New();
+  doseImage->ShallowCopy(reslicedDoseVolumeImage);
+  doseImage->SetOrigin(0.0, 0.0, 0.0);
+  doseImage->SetSpacing(1.0, 1.0, 1.0);
+
+  vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
+  marchingCubes->SetInputData(doseImage);
+  marchingCubes->SetNumberOfContours(1); 
+  marchingCubes->SetValue(0, isoLevel);
+  marchingCubes->ComputeScalarsOff();
+  marchingCubes->ComputeGradientsOff();
+  marchingCubes->ComputeNormalsOff();
+  marchingCubes->Update();
+
+  vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
+  if (isoPolyData->GetNumberOfPoints() < 1)
+  {
+    return nullptr;
+  }
+
+  vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+  triangleFilter->SetInputData(marchingCubes->GetOutput());
+  triangleFilter->Update();
+
+  vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+  decimate->SetInputData(triangleFilter->GetOutput());
+  decimate->SetTargetReduction(0.6);
+  decimate->SetFeatureAngle(60);
+  decimate->SplittingOff();
+  decimate->PreserveTopologyOn();
+  decimate->SetMaximumError(1);
+  decimate->Update();
+
+  vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+  smootherSinc->SetPassBand(0.1);
+  smootherSinc->SetInputData(decimate->GetOutput() );
+  smootherSinc->SetNumberOfIterations(2);
+  smootherSinc->FeatureEdgeSmoothingOff();
+  smootherSinc->BoundarySmoothingOff();
+  smootherSinc->Update();
+
+  vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+  normals->SetInputData(smootherSinc->GetOutput());
+  normals->ComputePointNormalsOn();
+  normals->SetFeatureAngle(60);
+  normals->Update();
+
+  vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
+  inputIJKToRASTransform->Identity();
+  inputIJKToRASTransform->SetMatrix(ijkToRasMatrix);
+
+  vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  transformPolyData->SetInputData(normals->GetOutput());
+  transformPolyData->SetTransform(inputIJKToRASTransform);
+  transformPolyData->Update();
+
+  vtkSmartPointer<vtkPolyData> isodoseSurface = vtkSmartPointer<vtkPolyData>::New();
+  isodoseSurface->ShallowCopy(transformPolyData->GetOutput());
+  return isodoseSurface;
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
 
@@ -743,16 +829,29 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
   outputIJK2IJKResliceTransform->Inverse();
 
-  int dimensions[3] = {0, 0, 0};
-  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
-  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(doseVolumeNode->GetImageData());
-  reslice->SetOutputOrigin(0, 0, 0);
-  reslice->SetOutputSpacing(1, 1, 1);
-  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+  // The reslice samples the transformed dose on the lattice of the dose volume, so use the dose volume
+  // resampled to its own lattice earlier if available
+  std::string doseVolumeKey = vtkResampledDoseCache::GetVolumeKey(doseVolumeNode);
+  vtkSmartPointer<vtkOrientedImageData> doseVolumeGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkResampledDoseCache::GetVolumeGeometry(doseVolumeNode, doseVolumeGeometry);
+  vtkSmartPointer<vtkOrientedImageData> reslicedDoseVolumeImage = vtkResampledDoseCache::GetInstance()->GetImage(
+    doseVolumeKey, doseVolumeGeometry, VTK_NEAREST_INTERPOLATION);
+  if (!reslicedDoseVolumeImage)
+  {
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData(doseVolumeNode->GetImageData());
+    reslice->SetOutputOrigin(0, 0, 0);
+    reslice->SetOutputSpacing(1, 1, 1);
+    reslice->SetOutputExtent(doseVolumeGeometry->GetExtent());
+    reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+    reslice->Update();
+    reslicedDoseVolumeImage = vtkSmartPointer<vtkOrientedImageData>::New();
+    reslicedDoseVolumeImage->ShallowCopy(reslice->GetOutput());
+    reslicedDoseVolumeImage->CopyDirections(doseVolumeGeometry);
+    reslicedDoseVolumeImage->SetOrigin(doseVolumeGeometry->GetOrigin());
+    reslicedDoseVolumeImage->SetSpacing(doseVolumeGeometry->GetSpacing());
+    vtkResampledDoseCache::GetInstance()->AddImage(doseVolumeKey, doseVolumeGeometry, VTK_NEAREST_INTERPOLATION, reslicedDoseVolumeImage);
+  }
 
   // Report progress
   ++currentProgressStep;
@@ -762,102 +861,75 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   // reference value for relative representation
   double referenceValue = parameterNode->GetReferenceDoseValue();
 
-  // Create isodose surfaces
+  // Collect isodose levels from the color table
+  std::vector<IsodoseLevel> isodoseLevels(colorTableNode->GetNumberOfColors());
   for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
-    double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    IsodoseLevel& isodoseLevel = isodoseLevels[i];
     const char* strIsoLevel = colorTableNode->GetColorName(i);
-    double isoLevel = vtkVariant(strIsoLevel).ToDouble();
+    isodoseLevel.Name = (strIsoLevel ? strIsoLevel : "");
+    isodoseLevel.Value = vtkVariant(strIsoLevel).ToDouble();
     // change isoLevel value for relative representation
     if (relativeFlag)
     {
       if (doseUnits != vtkMRMLIsodoseNode::Relative)
       {
-        isoLevel = isoLevel * referenceValue / 100.;
+        isodoseLevel.Value = isodoseLevel.Value * referenceValue / 100.;
       }
     }
-    colorTableNode->GetColor(i, val);
-
-    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
-    marchingCubes->SetNumberOfContours(1); 
-    marchingCubes->SetValue(0, isoLevel);
-    marchingCubes->ComputeScalarsOff();
-    marchingCubes->ComputeGradientsOff();
-    marchingCubes->ComputeNormalsOff();
-    marchingCubes->Update();
-
-    vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
-    if (isoPolyData->GetNumberOfPoints() >= 1)
+    colorTableNode->GetColor(i, isodoseLevel.Color);
+  }
+
+  // Create isodose surface geometry for all levels concurrently using vtkSMPTools. The levels only read the resliced
+  // dose volume, and the MRML nodes are created on the calling thread after all surfaces are done. The filters of a
+  // level that use vtkSMPTools themselves run serially within the level, as nested parallelism is not enabled
+  unsigned int numberOfThreads = vtkSlicerRtCommon::GetNumberOfWorkerThreads(this->NumberOfThreads, isodoseLevels.size());
+  vtkSlicerRtCommon::RunOnWorkerThreads(isodoseLevels.size(), numberOfThreads,
+    [&](size_t levelIndex)
     {
-      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-      triangleFilter->SetInputData(marchingCubes->GetOutput());
-      triangleFilter->Update();
-
-      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
-      decimate->SetInputData(triangleFilter->GetOutput());
-      decimate->SetTargetReduction(0.6);
-      decimate->SetFeatureAngle(60);
-      decimate->SplittingOff();
-      decimate->PreserveTopologyOn();
-      decimate->SetMaximumError(1);
-      decimate->Update();
-
-      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smootherSinc->SetPassBand(0.1);
-      smootherSinc->SetInputData(decimate->GetOutput() );
-      smootherSinc->SetNumberOfIterations(2);
-      smootherSinc->FeatureEdgeSmoothingOff();
-      smootherSinc->BoundarySmoothingOff();
-      smootherSinc->Update();
-
-      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-      normals->SetInputData(smootherSinc->GetOutput());
-      normals->ComputePointNormalsOn();
-      normals->SetFeatureAngle(60);
-      normals->Update();
-
-      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
-      inputIJKToRASTransform->Identity();
-      inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
-
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetInputData(normals->GetOutput());
-      transformPolyData->SetTransform(inputIJKToRASTransform);
-      transformPolyData->Update();
-  
-      vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
-      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(displayNode));
-      displayNode->Visibility2DOn();  
-      displayNode->VisibilityOn(); 
-      displayNode->SetColor(val[0], val[1], val[2]);
-      displayNode->SetOpacity(val[3]);
-    
-      // Disable backface culling to make the back side of the model visible as well
-      displayNode->SetBackfaceCulling(0);
-
-      vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
-      std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
-      isodoseModelNode->SetName(isodoseModelNodeName.c_str());
-      isodoseModelNode->SetSelectable(1);
-      isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1"); // The attribute above distinguishes isodoses from regular models
-      scene->AddNode(isodoseModelNode);
-      isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-      isodoseModelNode->SetAndObservePolyData(transformPolyData->GetOutput());
-      shNode->RequestOwnerPluginSearch(isodoseModelNode); //TODO: Why is this needed?
-
-      // Put the new node in the isodose folder
-      vtkIdType isodoseModelItemID = shNode->GetItemByDataNode(isodoseModelNode);
-      if (isodoseModelItemID) // There is no automatic SH creation in automatic tests 
-      {
-        shNode->SetItemParent(isodoseModelItemID, isodoseFolderItemID);
-      }
+      isodoseLevels[levelIndex].Surface = CreateIsodoseSurface(reslicedDoseVolumeImage, isodoseLevels[levelIndex].Value, inputIJK2RASMatrix);
+    },
+    [&](size_t numberOfFinishedLevels)
+    {
+      // Report progress
+      progress = (double)(currentProgressStep + numberOfFinishedLevels) / (double)progressStepCount;
+      this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+    });
+
+  // Create isodose model nodes in the order of the levels
+  for (std::vector<IsodoseLevel>::iterator levelIt = isodoseLevels.begin(); levelIt != isodoseLevels.end(); ++levelIt)
+  {
+    if (!levelIt->Surface)
+    {
+      continue;
     }
 
-    // Report progress
-    ++currentProgressStep;
-    progress = (double)(currentProgressStep) / (double)progressStepCount;
-    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+    vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
+    displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(displayNode));
+    displayNode->Visibility2DOn();  
+    displayNode->VisibilityOn(); 
+    displayNode->SetColor(levelIt->Color[0], levelIt->Color[1], levelIt->Color[2]);
+    displayNode->SetOpacity(levelIt->Color[3]);
+  
+    // Disable backface culling to make the back side of the model visible as well
+    displayNode->SetBackfaceCulling(0);
+
+    vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
+    std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + levelIt->Name + doseUnitName;
+    isodoseModelNode->SetName(isodoseModelNodeName.c_str());
+    isodoseModelNode->SetSelectable(1);
+    isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1"); // The attribute above distinguishes isodoses from regular models
+    scene->AddNode(isodoseModelNode);
+    isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+    isodoseModelNode->SetAndObservePolyData(levelIt->Surface);
+    shNode->RequestOwnerPluginSearch(isodoseModelNode); //TODO: Why is this needed?
+
+    // Put the new node in the isodose folder
+    vtkIdType isodoseModelItemID = shNode->GetItemByDataNode(isodoseModelNode);
+    if (isodoseModelItemID) // There is no automatic SH creation in automatic tests 
+    {
+      shNode->SetItemParent(isodoseModelItemID, isodoseFolderItemID);
+    }
   } // For all isodose levels
 
   // Update dose color table based on isodose
@@ -72,6 +72,9 @@ public:
   /// Update dose volume color table from isodose levels
   void UpdateDoseColorTableFromIsodose(vtkMRMLIsodoseNode* parameterNode);
 
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
 public:
   /// Creates default isodose color table. Gets and returns if already exists
   static vtkMRMLColorTableNode* GetDefaultIsodoseColorTable(vtkMRMLScene* scene);
@@ -105,6 +108,11 @@ protected:
   vtkSlicerIsodoseModuleLogic();
   ~vtkSlicerIsodoseModuleLogic() override;
 
+  /// Number of threads creating the surfaces of the isodose levels concurrently.
+  /// The model nodes are created on the calling thread after all surfaces are done.
+  /// 0 by default, meaning the number of threads of the vtkSMPTools backend (see vtkSlicerRtCommon::GetNumberOfWorkerThreads)
+  int NumberOfThreads{0};
+
 private:
   vtkSlicerIsodoseModuleLogic(const vtkSlicerIsodoseModuleLogic&) = delete;
   void operator=(const vtkSlicerIsodoseModuleLogic&) = delete;
@@ -48,6 +48,14 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+bool CreateIsodoseSurfacesAndGetSizes(vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLIsodoseNode* paramNode,
+  std::vector<vtkIdType>& pointCounts, std::vector<vtkIdType>& cellCounts);
+
 //-----------------------------------------------------------------------------
 int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
 {
@@ -240,5 +248,79 @@ int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Isodose surfaces of multiple levels created on a single thread must be the same as the ones created concurrently
+  double doseRange[2] = {0.0, 0.0};
+  doseScalarVolumeNode->GetImageData()->GetScalarRange(doseRange);
+  const int numberOfLevels = 6;
+  vtkNew<vtkMRMLColorTableNode> multiLevelColorNode;
+  multiLevelColorNode->SetTypeToUser();
+  multiLevelColorNode->SetNumberOfColors(numberOfLevels);
+  for (int levelIndex = 0; levelIndex < numberOfLevels; ++levelIndex)
+  {
+    std::stringstream levelNameStream;
+    levelNameStream << doseRange[1] * (levelIndex + 1) / (numberOfLevels + 1);
+    multiLevelColorNode->SetColor(levelIndex, levelNameStream.str().c_str(), 1.0, 0.1 * levelIndex, 0.0, 1.0);
+  }
+  mrmlScene->AddNode(multiLevelColorNode);
+  paramNode->SetAndObserveColorTableNode(multiLevelColorNode);
+
+  std::vector<vtkIdType> singleThreadPointCounts;
+  std::vector<vtkIdType> singleThreadCellCounts;
+  isodoseLogic->SetNumberOfThreads(1);
+  if (!CreateIsodoseSurfacesAndGetSizes(isodoseLogic, paramNode, singleThreadPointCounts, singleThreadCellCounts))
+  {
+    return EXIT_FAILURE;
+  }
+  std::vector<vtkIdType> multiThreadPointCounts;
+  std::vector<vtkIdType> multiThreadCellCounts;
+  isodoseLogic->SetNumberOfThreads(0);
+  if (!CreateIsodoseSurfacesAndGetSizes(isodoseLogic, paramNode, multiThreadPointCounts, multiThreadCellCounts))
+  {
+    return EXIT_FAILURE;
+  }
+  if (singleThreadPointCounts.empty() || singleThreadPointCounts != multiThreadPointCounts || singleThreadCellCounts != multiThreadCellCounts)
+  {
+    std::cerr << "Isodose surfaces created on multiple threads differ from the ones created on a single thread" << std::endl;
+    for (size_t surfaceIndex = 0; surfaceIndex < std::max(singleThreadPointCounts.size(), multiThreadPointCounts.size()); ++surfaceIndex)
+    {
+      std::cerr << "  Surface " << surfaceIndex << " points: "
+        << (surfaceIndex < singleThreadPointCounts.size() ? singleThreadPointCounts[surfaceIndex] : -1) << " / "
+        << (surfaceIndex < multiThreadPointCounts.size() ? multiThreadPointCounts[surfaceIndex] : -1) << std::endl;
+    }
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
+
+//-----------------------------------------------------------------------------
+// Create isodose surfaces and get the number of points and cells of each surface in the order of the levels
+bool CreateIsodoseSurfacesAndGetSizes(vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLIsodoseNode* paramNode,
+  std::vector<vtkIdType>& pointCounts, std::vector<vtkIdType>& cellCounts)
+{
+  pointCounts.clear();
+  cellCounts.clear();
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(isodoseLogic->GetMRMLScene());
+  vtkIdType isodoseFolderItemID = isodoseLogic->GetIsodoseFolderItemID(paramNode);
+  if (!shNode || !isodoseFolderItemID)
+  {
+    std::cerr << "No isodose subject hierarchy folder created" << std::endl;
+    return false;
+  }
+  std::vector<vtkIdType> isodoseChildItemIDs;
+  shNode->GetItemChildren(isodoseFolderItemID, isodoseChildItemIDs, false);
+  for (std::vector<vtkIdType>::iterator itemIt = isodoseChildItemIDs.begin(); itemIt != isodoseChildItemIDs.end(); ++itemIt)
+  {
+    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(shNode->GetItemDataNode(*itemIt));
+    if (!modelNode || !modelNode->GetPolyData())
+    {
+      std::cerr << "Invalid isodose model in isodose folder" << std::endl;
+      return false;
+    }
+    pointCounts.push_back(modelNode->GetPolyData()->GetNumberOfPoints());
+    cellCounts.push_back(modelNode->GetPolyData()->GetNumberOfCells());
+  }
+  return true;
+}
@@ -30,14 +30,27 @@
 #include <vtkStreamingDemandDrivenPipeline.h>
 #include <vtkFieldData.h>
 #include <vtkMath.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <vector>
 
 vtkStandardNewMacro(vtkFractionalImageAccumulate);
 
+//----------------------------------------------------------------------------
+// Approximate number of voxels in a slab accumulated by one thread. The slab size does not depend on the
+// number of threads, so the summation order (and thus the result) is the same on every machine
+static const vtkIdType SLAB_SIZE_IN_VOXELS = 262144;
+
 //----------------------------------------------------------------------------
 vtkFractionalImageAccumulate::vtkFractionalImageAccumulate()
 {
   this->MinimumFractionalValue = 0;
   this->MaximumFractionalValue = 1.0;
+  this->FractionalLabelmap = nullptr;
+  this->FractionalVoxelCount = 0.0;
+  this->UseFractionalLabelmap = false;
 }
 
 //----------------------------------------------------------------------------
@@ -61,10 +74,213 @@ int vtkFractionalImageAccumulate::RequestInformation (
   return 1;
 }
 
+//----------------------------------------------------------------------------
+namespace
+{
+
+// Statistics and histogram accumulated from one slab of the update extent
+struct vtkFractionalImageAccumulateSlabResult
+{
+  double Sum[3] = {0.0, 0.0, 0.0};
+  double SumSqr[3] = {0.0, 0.0, 0.0};
+  double Min[3] = {VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, VTK_DOUBLE_MAX};
+  double Max[3] = {VTK_DOUBLE_MIN, VTK_DOUBLE_MIN, VTK_DOUBLE_MIN};
+  vtkIdType VoxelCount = 0;
+  double FractionalVoxelCount = 0.0;
+  std::vector<double> Histogram;
+};
+
+// Accumulate the slabs of the update extent. Each slab has its own iterators and private result,
+// so the slabs can be processed concurrently, and the results are merged in slab order afterwards
+// (which makes the result independent of the number of threads).
+template <class BaseImageScalarType, class FractionalImageScalarType>
+class vtkFractionalImageAccumulateFunctor
+{
+public:
+  vtkImageData* InData;
+  vtkImageData* FractionalLabelmap;
+  vtkImageStencilData* Stencil;
+  bool ReverseStencil;
+  bool IgnoreZero;
+  // Fraction of a voxel is (value - FractionOffset) * FractionScale. Only used if UseFractionalLabelmap is on
+  bool UseFractionalLabelmap;
+  double FractionOffset;
+  double FractionScale;
+  int NumberOfComponents;
+  int OutExtent[6];
+  vtkIdType OutIncs[3];
+  double Origin[3];
+  double Spacing[3];
+  vtkIdType HistogramSize;
+  // Slab k covers slices SlabStarts[k] to SlabStarts[k+1]-1 of the update extent
+  int UpdateExtent[6];
+  std::vector<int> SlabStarts;
+  std::vector<vtkFractionalImageAccumulateSlabResult> SlabResults;
+
+  void operator()(vtkIdType beginSlab, vtkIdType endSlab)
+  {
+    for (vtkIdType slabIndex = beginSlab; slabIndex < endSlab; ++slabIndex)
+    {
+      this->AccumulateSlab(slabIndex);
+    }
+  }
+
+  void AccumulateSlab(vtkIdType slabIndex)
+  {
+    vtkFractionalImageAccumulateSlabResult& result = this->SlabResults[slabIndex];
+    result.Histogram.assign(this->HistogramSize, 0.0);
+    double* outPtr = result.Histogram.data();
+
+    int slabExtent[6] = { this->UpdateExtent[0], this->UpdateExtent[1], this->UpdateExtent[2], this->UpdateExtent[3],
+      this->SlabStarts[slabIndex], this->SlabStarts[slabIndex+1] - 1 };
+
+    // No algorithm is given to the iterators, as progress and abort cannot be reported from the worker threads
+    vtkImageStencilIterator<BaseImageScalarType> inIter(this->InData, this->Stencil, slabExtent, nullptr);
+    vtkImageStencilIterator<FractionalImageScalarType> fractionalIter(this->FractionalLabelmap, this->Stencil, slabExtent, nullptr);
+
+    while (!inIter.IsAtEnd())
+    {
+      if (inIter.IsInStencil() ^ this->ReverseStencil)
+      {
+        BaseImageScalarType* inPtr = inIter.BeginSpan();
+        BaseImageScalarType* spanEndPtr = inIter.EndSpan();
+        FractionalImageScalarType* fractionalPtr = fractionalIter.BeginSpan();
+        if (this->NumberOfComponents == 1)
+        {
+          this->AccumulateSingleComponentSpan(inPtr, spanEndPtr, fractionalPtr, outPtr, result);
+        }
+        else
+        {
+          this->AccumulateSpan(inPtr, spanEndPtr, fractionalPtr, outPtr, result);
+        }
+      }
+      fractionalIter.NextSpan();
+      inIter.NextSpan();
+    }
+  }
+
+  // Fast path for single component images (such as dose): the loop has no inner component loop
+  // and uses local accumulators, so that the compiler can keep them in registers
+  void AccumulateSingleComponentSpan(BaseImageScalarType* inPtr, BaseImageScalarType* spanEndPtr,
+    FractionalImageScalarType* fractionalPtr, double* outPtr, vtkFractionalImageAccumulateSlabResult& result)
+  {
+    const bool useFractionalLabelmap = this->UseFractionalLabelmap;
+    const bool ignoreZero = this->IgnoreZero;
+    const double fractionOffset = this->FractionOffset;
+    const double fractionScale = this->FractionScale;
+    const double origin = this->Origin[0];
+    const double spacing = this->Spacing[0];
+    const int outExtentMin = this->OutExtent[0];
+    const int outExtentMax = this->OutExtent[1];
+
+    double sum = 0.0;
+    double sumSqr = 0.0;
+    double min = result.Min[0];
+    double max = result.Max[0];
+    vtkIdType voxelCount = 0;
+    double fractionalVoxelCount = 0.0;
+
+    vtkIdType spanLength = static_cast<vtkIdType>(spanEndPtr - inPtr);
+    for (vtkIdType i = 0; i < spanLength; ++i)
+    {
+      double v = static_cast<double>(inPtr[i]);
+      double f = (useFractionalLabelmap ? (static_cast<double>(fractionalPtr[i]) - fractionOffset) * fractionScale : 1.0);
+      if (ignoreZero && v == 0)
+      {
+        // Excluded from both the statistics and the histogram
+        continue;
+      }
+
+      sum += v*f;
+      sumSqr += v*v*f*f;
+      max = (v > max ? v : max);
+      min = (v < min ? v : min);
+      ++voxelCount;
+      fractionalVoxelCount += f;
+
+      int outIdx = vtkMath::Floor((v - origin) / spacing);
+      if (outIdx >= outExtentMin && outIdx <= outExtentMax)
+      {
+        outPtr[outIdx - outExtentMin] += f;
+      }
+    }
+
+    result.Sum[0] += sum;
+    result.SumSqr[0] += sumSqr;
+    result.Min[0] = min;
+    result.Max[0] = max;
+    result.VoxelCount += voxelCount;
+    result.FractionalVoxelCount += fractionalVoxelCount;
+  }
+
+  // Generic path for images with 2 or 3 components
+  void AccumulateSpan(BaseImageScalarType* inPtr, BaseImageScalarType* spanEndPtr,
+    FractionalImageScalarType* fractionalPtr, double* outPtr, vtkFractionalImageAccumulateSlabResult& result)
+  {
+    while (inPtr != spanEndPtr)
+    {
+      // find the bin for this pixel.
+      bool outOfBounds = false;
+      double* outPtrC = outPtr;
+      double total = 0.0;
+
+      for (int idxC = 0; idxC < this->NumberOfComponents; ++idxC)
+      {
+        double v = static_cast<double>(*inPtr++);
+        double f = 1.0;
+        if (this->UseFractionalLabelmap)
+        {
+          f = (static_cast<double>(*fractionalPtr++) - this->FractionOffset) * this->FractionScale;
+        }
+
+        if (!this->IgnoreZero || v != 0)
+        {
+          // gather statistics
+          result.Sum[idxC] += v*f;
+          result.SumSqr[idxC] += v*v*f*f;
+          if (v > result.Max[idxC])
+          {
+            result.Max[idxC] = v;
+          }
+          if (v < result.Min[idxC])
+          {
+            result.Min[idxC] = v;
+          }
+          result.VoxelCount++;
+          result.FractionalVoxelCount += f;
+          total += f;
+        }
+
+        // compute the index
+        int outIdx = vtkMath::Floor((v - this->Origin[idxC]) / this->Spacing[idxC]);
+
+        // verify that it is in range
+        if (outIdx >= this->OutExtent[idxC*2] && outIdx <= this->OutExtent[idxC*2+1])
+        {
+          outPtrC += (outIdx - this->OutExtent[idxC*2]) * this->OutIncs[idxC];
+        }
+        else
+        {
+          outOfBounds = true;
+        }
+      }
+
+      // increment the bin
+      if (!outOfBounds)
+      {
+        (*outPtrC) += total;
+      }
+    }
+  }
+};
+
+} // namespace
+
 //----------------------------------------------------------------------------
 template<class BaseImageScalarType>
 int vtkFractionalImageAccumulateExecute(vtkFractionalImageAccumulate *self,
                               vtkImageData *inData,
+                              vtkImageData *fractionalLabelmap,
                               vtkImageData *outData,
                               double min[3], double max[3],
                               double mean[3],
@@ -73,12 +289,13 @@ int vtkFractionalImageAccumulateExecute(vtkFractionalImageAccumulate *self,
                               double *fractionalVoxelCount,
                               int* updateExtent)
 {
-    switch (self->GetFractionalLabelmap()->GetScalarType())
+    switch (fractionalLabelmap->GetScalarType())
     {
-    vtkTemplateMacro( vtkFractionalImageAccumulateExecute2( self,
+    vtkTemplateMacro( return vtkFractionalImageAccumulateExecute2( self,
                                                 (BaseImageScalarType*) nullptr,
                                                 (VTK_TT*) nullptr,
                                                 inData,
+                                                fractionalLabelmap,
                                                 outData,
                                                 min, max,
                                                 mean,
@@ -90,17 +307,17 @@ int vtkFractionalImageAccumulateExecute(vtkFractionalImageAccumulate *self,
       //vtkErrorMacro(<< "Execute: Unknown ScalarType");
       return 0;
     }
-
-    return 1;
 }
 
 //----------------------------------------------------------------------------
 // This templated function executes the filter for any type of data.
+// The update extent is split into slabs along the third axis that are accumulated in parallel.
 template <class BaseImageScalarType, class FractionalImageScalarType>
 int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
                               BaseImageScalarType* vtkNotUsed(baseTypePtr),
                               FractionalImageScalarType* vtkNotUsed(fractionalTypePtr),
                               vtkImageData *inData,
+                              vtkImageData *fractionalLabelmap,
                               vtkImageData *outData,
                               double min[3], double max[3],
                               double mean[3],
@@ -132,104 +349,75 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
     return 0;
     }
 
+  vtkFractionalImageAccumulateFunctor<BaseImageScalarType, FractionalImageScalarType> functor;
+  functor.InData = inData;
+  functor.FractionalLabelmap = fractionalLabelmap;
+  functor.Stencil = self->GetStencil();
+  functor.ReverseStencil = (self->GetReverseStencil() != 0);
+  functor.IgnoreZero = (self->GetIgnoreZero() != 0);
+  functor.NumberOfComponents = numC;
+
+  // Precompute normalization of the fractional values, so that only a multiplication is needed per voxel
+  functor.UseFractionalLabelmap = self->GetUseFractionalLabelmap();
+  functor.FractionOffset = self->GetMinimumFractionalValue();
+  functor.FractionScale = 1.0 / (self->GetMaximumFractionalValue() - self->GetMinimumFractionalValue());
+
   // get information for output data
-  int outExtent[6];
-  outData->GetExtent(outExtent);
-  vtkIdType outIncs[3];
-  outData->GetIncrements(outIncs);
-  double origin[3];
-  outData->GetOrigin(origin);
-  double spacing[3];
-  outData->GetSpacing(spacing);
-
-  // zero count in every bin
+  outData->GetExtent(functor.OutExtent);
+  outData->GetIncrements(functor.OutIncs);
+  outData->GetOrigin(functor.Origin);
+  outData->GetSpacing(functor.Spacing);
+
   vtkIdType size = 1;
-  size *= (outExtent[1] - outExtent[0] + 1);
-  size *= (outExtent[3] - outExtent[2] + 1);
-  size *= (outExtent[5] - outExtent[4] + 1);
-  for (vtkIdType j = 0; j < size; j++)
+  size *= (functor.OutExtent[1] - functor.OutExtent[0] + 1);
+  size *= (functor.OutExtent[3] - functor.OutExtent[2] + 1);
+  size *= (functor.OutExtent[5] - functor.OutExtent[4] + 1);
+  functor.HistogramSize = size;
+
+  // Split the update extent into slabs of whole slices with a fixed number of voxels
+  std::copy(updateExtent, updateExtent + 6, functor.UpdateExtent);
+  int numberOfSlices = updateExtent[5] - updateExtent[4] + 1;
+  vtkIdType sliceSizeInVoxels = std::max<vtkIdType>(1,
+    static_cast<vtkIdType>(updateExtent[1] - updateExtent[0] + 1) * static_cast<vtkIdType>(updateExtent[3] - updateExtent[2] + 1));
+  int numberOfSlicesPerSlab = static_cast<int>(std::max<vtkIdType>(1, SLAB_SIZE_IN_VOXELS / sliceSizeInVoxels));
+  int numberOfSlabs = std::max(1, (numberOfSlices + numberOfSlicesPerSlab - 1) / numberOfSlicesPerSlab);
+  for (int slabIndex = 0; slabIndex < numberOfSlabs; ++slabIndex)
     {
-    outPtr[j] = 0;
+    functor.SlabStarts.push_back(updateExtent[4] + slabIndex * numberOfSlicesPerSlab);
     }
+  functor.SlabStarts.push_back(updateExtent[5] + 1);
+  functor.SlabResults.resize(numberOfSlabs);
 
-  vtkImageStencilData *stencil = self->GetStencil();
-  bool reverseStencil = (self->GetReverseStencil() != 0);
-  bool ignoreZero = (self->GetIgnoreZero() != 0);
-
-  vtkImageStencilIterator<BaseImageScalarType> inIter(inData, stencil, updateExtent, self);
-
-  vtkImageData* fractionalLabelmap = self->GetFractionalLabelmap();
-  vtkImageStencilIterator<FractionalImageScalarType> fractionalIter(fractionalLabelmap, stencil, updateExtent, self);
+  if (numberOfSlices > 0)
+    {
+    vtkSMPTools::For(0, numberOfSlabs, functor);
+    }
 
-  while (!inIter.IsAtEnd())
+  // zero count in every bin, then merge the private results of the slabs
+  for (vtkIdType j = 0; j < size; j++)
+    {
+    outPtr[j] = 0;
+    }
+  for (int slabIndex = 0; slabIndex < numberOfSlabs; ++slabIndex)
     {
-    if (inIter.IsInStencil() ^ reverseStencil)
+    const vtkFractionalImageAccumulateSlabResult& result = functor.SlabResults[slabIndex];
+    if (result.Histogram.empty())
       {
-      BaseImageScalarType *inPtr = inIter.BeginSpan();
-      BaseImageScalarType *spanEndPtr = inIter.EndSpan();
-
-      FractionalImageScalarType* fractionalPtr = (FractionalImageScalarType*)fractionalIter.BeginSpan();
-
-      while (inPtr != spanEndPtr)
-        {
-        // find the bin for this pixel.
-        bool outOfBounds = false;
-        double *outPtrC = outPtr;
-        double total  = 0.0;
-
-        for (int idxC = 0; idxC < numC; ++idxC)
-          {
-
-          double v = static_cast<double>(*inPtr++);
-          double f = 1.0;
-
-          if (self->GetUseFractionalLabelmap())
-          {
-            f = ( (*fractionalPtr++) - self->GetMinimumFractionalValue() ) / (self->GetMaximumFractionalValue() - self->GetMinimumFractionalValue());
-          }
-
-          if (!ignoreZero || v != 0)
-            {
-            // gather statistics
-            sum[idxC] += v*f;
-            sumSqr[idxC] += v*v*f*f;
-            if (v > max[idxC])
-              {
-              max[idxC] = v;
-              }
-            if (v < min[idxC])
-              {
-              min[idxC] = v;
-              }
-            (*voxelCount)++;
-            (*fractionalVoxelCount)+=f;
-            total+=f;
-            }
-
-          // compute the index
-          int outIdx = vtkMath::Floor((v - origin[idxC]) / spacing[idxC]);
-
-          // verify that it is in range
-          if (outIdx >= outExtent[idxC*2] && outIdx <= outExtent[idxC*2+1])
-            {
-            outPtrC += (outIdx - outExtent[idxC*2]) * outIncs[idxC];
-            }
-          else
-            {
-              outOfBounds = true;
-            }
-
-          }
-
-        // increment the bin
-        if (!outOfBounds)
-          {
-            (*outPtrC) += total;
-          }
-        }
+      continue;
+      }
+    for (int idxC = 0; idxC < 3; ++idxC)
+      {
+      sum[idxC] += result.Sum[idxC];
+      sumSqr[idxC] += result.SumSqr[idxC];
+      min[idxC] = std::min(min[idxC], result.Min[idxC]);
+      max[idxC] = std::max(max[idxC], result.Max[idxC]);
+      }
+    *voxelCount += result.VoxelCount;
+    *fractionalVoxelCount += result.FractionalVoxelCount;
+    for (vtkIdType j = 0; j < size; j++)
+      {
+      outPtr[j] += result.Histogram[j];
       }
-    fractionalIter.NextSpan();
-    inIter.NextSpan();
     }
 
   // initialize the statistics
@@ -304,10 +492,28 @@ int vtkFractionalImageAccumulate::RequestData(
     return 1;
     }
 
+  // Without fractional labelmap the fraction of each voxel is 1. The input is iterated in place of the labelmap
+  vtkImageData* fractionalLabelmap = inData;
+  if (this->UseFractionalLabelmap)
+    {
+    fractionalLabelmap = this->FractionalLabelmap;
+    if (!fractionalLabelmap)
+      {
+      vtkErrorMacro(<< "Execute: Fractional labelmap is not set");
+      return 1;
+      }
+    if (this->MaximumFractionalValue == this->MinimumFractionalValue)
+      {
+      vtkErrorMacro(<< "Execute: Invalid fractional value range");
+      return 1;
+      }
+    }
+
   switch (inData->GetScalarType())
     {
     vtkTemplateMacro(vtkFractionalImageAccumulateExecute<VTK_TT>( this,
                                                 inData,
+                                                fractionalLabelmap,
                                                 outData,
                                                 this->Min, this->Max,
                                                 this->Mean,
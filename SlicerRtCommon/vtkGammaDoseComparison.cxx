@@ -0,0 +1,641 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkGammaDoseComparison.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkGammaDoseComparison);
+
+namespace
+{
+
+//----------------------------------------------------------------------------
+/// Offset of a neighbor voxel in the search region
+struct GammaSearchOffset
+{
+  int Offset[3];
+  vtkIdType LinearOffset;
+  /// Squared distance of the neighbor in mm^2
+  double DistanceSquared;
+};
+
+//----------------------------------------------------------------------------
+/// Gamma criterion as used in the search
+struct GammaSearchCriterion
+{
+  double DtaDistanceTolerance;
+  double InverseDtaSquared;
+  double DoseDifferenceTolerance;
+  /// Dose tolerance in dose units if global gamma is used
+  double GlobalDoseTolerance;
+  bool LocalGamma;
+  /// Output gamma buffer, null if gamma image is not computed
+  float* Gamma;
+};
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkGammaDoseComparisonCopyToFloat(vtkImageData* image, ScalarType* scalarPtr, std::vector<float>& values)
+{
+  vtkIdType numberOfVoxels = image->GetNumberOfPoints();
+  int numberOfComponents = image->GetNumberOfScalarComponents();
+  values.resize(numberOfVoxels);
+  for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    values[voxelIndex] = static_cast<float>(scalarPtr[voxelIndex * numberOfComponents]);
+  }
+}
+
+//----------------------------------------------------------------------------
+/// Copy the first component of the image into a contiguous float buffer
+void vtkGammaDoseComparisonCopyToFloat(vtkImageData* image, std::vector<float>& values)
+{
+  switch (image->GetScalarType())
+  {
+    vtkTemplateMacro(vtkGammaDoseComparisonCopyToFloat(image, static_cast<VTK_TT*>(image->GetScalarPointer()), values));
+  }
+}
+
+//----------------------------------------------------------------------------
+/// Compute gamma of all criteria for a range of rows of the reference image
+class vtkGammaDoseComparisonFunctor
+{
+public:
+  const std::vector<float>& Reference;
+  const std::vector<float>& Compare;
+  const std::vector<float>* Mask;
+  const std::vector<GammaSearchOffset>& Offsets;
+  const std::vector<GammaSearchCriterion>& Criteria;
+  int Dimensions[3];
+  double Spacing[3];
+  double ThresholdDose;
+  double MaximumGamma;
+  bool ThresholdOnReferenceOnly;
+  bool InterpolatedSearch;
+
+  /// Voxel counts of each thread, summed after all rows are processed
+  vtkSMPThreadLocal<vtkIdType> AnalyzedVoxels;
+  vtkSMPThreadLocal<std::vector<vtkIdType> > PassingVoxels;
+
+  /// Progress reporting. Events are only invoked on the thread that started the computation
+  vtkObject* ProgressObject;
+  std::thread::id CallingThreadId;
+  vtkIdType NumberOfRows;
+  std::atomic<vtkIdType> NumberOfFinishedRows;
+  /// Number of finished rows at which the next progress event is invoked. Only accessed on the calling thread
+  vtkIdType NextProgressRows;
+
+  vtkGammaDoseComparisonFunctor(const std::vector<float>& reference, const std::vector<float>& compare,
+    const std::vector<float>* mask, const std::vector<GammaSearchOffset>& offsets, const std::vector<GammaSearchCriterion>& criteria)
+    : Reference(reference), Compare(compare), Mask(mask), Offsets(offsets), Criteria(criteria)
+    , AnalyzedVoxels(0), PassingVoxels(std::vector<vtkIdType>(criteria.size(), 0))
+    , ProgressObject(nullptr), CallingThreadId(std::this_thread::get_id()), NumberOfRows(0), NumberOfFinishedRows(0), NextProgressRows(0)
+  {
+  }
+
+  /// Count finished rows, and invoke a progress event if on the calling thread and a progress step (5%) is complete
+  void ReportProgress(vtkIdType numberOfRows)
+  {
+    vtkIdType numberOfFinishedRows = (this->NumberOfFinishedRows += numberOfRows);
+    if (!this->ProgressObject || std::this_thread::get_id() != this->CallingThreadId || numberOfFinishedRows < this->NextProgressRows)
+    {
+      return;
+    }
+    const int numberOfProgressSteps = 20;
+    this->NextProgressRows = numberOfFinishedRows + std::max<vtkIdType>(1, this->NumberOfRows / numberOfProgressSteps);
+    double progress = (double)numberOfFinishedRows / this->NumberOfRows;
+    this->ProgressObject->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  }
+
+  /// Process a range of image rows. Row index is j + k * Dimensions[1]
+  void operator()(vtkIdType beginRow, vtkIdType endRow)
+  {
+    vtkIdType& analyzedVoxels = this->AnalyzedVoxels.Local();
+    std::vector<vtkIdType>& passingVoxels = this->PassingVoxels.Local();
+    const double maximumGammaSquared = this->MaximumGamma * this->MaximumGamma;
+    const int numberOfCriteria = static_cast<int>(this->Criteria.size());
+    const int numberOfOffsets = static_cast<int>(this->Offsets.size());
+
+    // Search state of each criterion for the current voxel
+    std::vector<double> inverseDoseToleranceSquared(numberOfCriteria, 0.0);
+    std::vector<double> bestGammaSquared(numberOfCriteria, 0.0);
+    std::vector<int> bestOffsetIndex(numberOfCriteria, -1);
+    std::vector<char> criterionActive(numberOfCriteria, 0);
+
+    for (vtkIdType row = beginRow; row < endRow; ++row)
+    {
+      const vtkIdType k = row / this->Dimensions[1];
+      const int j = static_cast<int>(row % this->Dimensions[1]);
+      vtkIdType voxelIndex = row * this->Dimensions[0];
+      for (int i = 0; i < this->Dimensions[0]; ++i, ++voxelIndex)
+      {
+        for (int c = 0; c < numberOfCriteria; ++c)
+        {
+          if (this->Criteria[c].Gamma)
+          {
+            this->Criteria[c].Gamma[voxelIndex] = 0.0f;
+          }
+        }
+
+        // Skip voxels outside the mask or below threshold
+        if (this->Mask && (*this->Mask)[voxelIndex] == 0.0f)
+        {
+          continue;
+        }
+        double referenceValue = this->Reference[voxelIndex];
+        if ( referenceValue < this->ThresholdDose
+          && (this->ThresholdOnReferenceOnly || this->Compare[voxelIndex] < this->ThresholdDose) )
+        {
+          continue;
+        }
+        ++analyzedVoxels;
+
+        for (int c = 0; c < numberOfCriteria; ++c)
+        {
+          const GammaSearchCriterion& criterion = this->Criteria[c];
+          double doseTolerance = criterion.GlobalDoseTolerance;
+          if (criterion.LocalGamma && referenceValue > 0.0)
+          {
+            doseTolerance = criterion.DoseDifferenceTolerance * referenceValue;
+          }
+          inverseDoseToleranceSquared[c] = 1.0 / (doseTolerance * doseTolerance);
+          bestGammaSquared[c] = maximumGammaSquared;
+          bestOffsetIndex[c] = -1;
+          criterionActive[c] = 1;
+        }
+        int numberOfActiveCriteria = numberOfCriteria;
+
+        // Visit neighbors in increasing distance. A criterion is done when its distance term alone exceeds
+        // its best gamma, and the search ends when all criteria are done
+        for (int offsetIndex = 0; offsetIndex < numberOfOffsets && numberOfActiveCriteria > 0; ++offsetIndex)
+        {
+          const GammaSearchOffset& offset = this->Offsets[offsetIndex];
+          for (int c = 0; c < numberOfCriteria; ++c)
+          {
+            if (criterionActive[c] && offset.DistanceSquared * this->Criteria[c].InverseDtaSquared >= bestGammaSquared[c])
+            {
+              criterionActive[c] = 0;
+              --numberOfActiveCriteria;
+            }
+          }
+          if (numberOfActiveCriteria == 0)
+          {
+            break;
+          }
+          int ni = i + offset.Offset[0];
+          int nj = j + offset.Offset[1];
+          int nk = static_cast<int>(k) + offset.Offset[2];
+          if ( ni < 0 || ni >= this->Dimensions[0] || nj < 0 || nj >= this->Dimensions[1]
+            || nk < 0 || nk >= this->Dimensions[2] )
+          {
+            continue;
+          }
+          double doseDifference = this->Compare[voxelIndex + offset.LinearOffset] - referenceValue;
+          double doseDifferenceSquared = doseDifference * doseDifference;
+          for (int c = 0; c < numberOfCriteria; ++c)
+          {
+            if (!criterionActive[c])
+            {
+              continue;
+            }
+            double gammaSquared = offset.DistanceSquared * this->Criteria[c].InverseDtaSquared
+              + doseDifferenceSquared * inverseDoseToleranceSquared[c];
+            if (gammaSquared < bestGammaSquared[c])
+            {
+              bestGammaSquared[c] = gammaSquared;
+              bestOffsetIndex[c] = offsetIndex;
+            }
+          }
+        }
+
+        for (int c = 0; c < numberOfCriteria; ++c)
+        {
+          if (this->InterpolatedSearch && bestOffsetIndex[c] >= 0 && bestGammaSquared[c] > 0.0)
+          {
+            bestGammaSquared[c] = this->RefineOnNeighborSegments(i, j, static_cast<int>(k), voxelIndex, referenceValue,
+              this->Offsets[bestOffsetIndex[c]], this->Criteria[c].InverseDtaSquared, inverseDoseToleranceSquared[c], bestGammaSquared[c]);
+          }
+
+          double gamma = std::sqrt(bestGammaSquared[c]);
+          if (this->Criteria[c].Gamma)
+          {
+            this->Criteria[c].Gamma[voxelIndex] = static_cast<float>(std::min(gamma, this->MaximumGamma));
+          }
+          if (gamma <= 1.0)
+          {
+            ++passingVoxels[c];
+          }
+        }
+      }
+    }
+
+    this->ReportProgress(endRow - beginRow);
+  }
+
+  /// Find the minimum gamma on the segments between the best compare voxel and its face neighbors,
+  /// assuming the compare dose changes linearly along the segments
+  double RefineOnNeighborSegments(int i, int j, int k, vtkIdType voxelIndex, double referenceValue, const GammaSearchOffset& bestOffset,
+    double inverseDtaSquared, double inverseDoseToleranceSquared, double bestVoxelGammaSquared)
+  {
+    static const int faceNeighbors[6][3] = { {-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1} };
+    const vtkIdType strides[3] = { 1, this->Dimensions[0], (vtkIdType)this->Dimensions[0] * this->Dimensions[1] };
+
+    double bestGammaSquared = bestVoxelGammaSquared;
+    vtkIdType bestIndex = voxelIndex + bestOffset.LinearOffset;
+    double bestDoseDifference = this->Compare[bestIndex] - referenceValue;
+    double bestPosition[3] = { bestOffset.Offset[0] * this->Spacing[0], bestOffset.Offset[1] * this->Spacing[1], bestOffset.Offset[2] * this->Spacing[2] };
+    for (int neighbor = 0; neighbor < 6; ++neighbor)
+    {
+      int neighborIjk[3] = { i + bestOffset.Offset[0] + faceNeighbors[neighbor][0],
+        j + bestOffset.Offset[1] + faceNeighbors[neighbor][1], k + bestOffset.Offset[2] + faceNeighbors[neighbor][2] };
+      if ( neighborIjk[0] < 0 || neighborIjk[0] >= this->Dimensions[0] || neighborIjk[1] < 0 || neighborIjk[1] >= this->Dimensions[1]
+        || neighborIjk[2] < 0 || neighborIjk[2] >= this->Dimensions[2] )
+      {
+        continue;
+      }
+      vtkIdType neighborIndex = bestIndex
+        + faceNeighbors[neighbor][0] * strides[0] + faceNeighbors[neighbor][1] * strides[1] + faceNeighbors[neighbor][2] * strides[2];
+
+      // Gamma squared along the segment is a quadratic function a*t^2 + b*t + c of the segment parameter t in [0,1],
+      // where c is the gamma squared at the best voxel
+      double doseChange = this->Compare[neighborIndex] - this->Compare[bestIndex];
+      double positionDotDirection = 0.0;
+      double directionLengthSquared = 0.0;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        double direction = faceNeighbors[neighbor][axis] * this->Spacing[axis];
+        positionDotDirection += bestPosition[axis] * direction;
+        directionLengthSquared += direction * direction;
+      }
+      double a = directionLengthSquared * inverseDtaSquared + doseChange * doseChange * inverseDoseToleranceSquared;
+      double b = 2.0 * (positionDotDirection * inverseDtaSquared + bestDoseDifference * doseChange * inverseDoseToleranceSquared);
+      if (a <= 0.0)
+      {
+        continue;
+      }
+      double t = std::max(0.0, std::min(1.0, -b / (2.0 * a)));
+      double gammaSquared = bestVoxelGammaSquared + t * (a * t + b);
+      if (gammaSquared < bestGammaSquared)
+      {
+        bestGammaSquared = std::max(0.0, gammaSquared);
+      }
+    }
+    return bestGammaSquared;
+  }
+};
+
+} // namespace
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparison::vtkGammaDoseComparison()
+{
+  this->ReferenceImage = nullptr;
+  this->CompareImage = nullptr;
+  this->MaskImage = nullptr;
+  this->DtaDistanceToleranceMm = 3.0;
+  this->DoseDifferenceTolerance = 0.03;
+  this->ReferenceDose = 0.0;
+  this->AnalysisThreshold = 0.1;
+  this->MaximumGamma = 2.0;
+  this->LocalGamma = false;
+  this->ThresholdOnReferenceOnly = false;
+  this->InterpolatedSearch = false;
+  this->ComputeGammaImages = true;
+
+  this->NumberOfAnalyzedVoxels = 0;
+  this->UsedReferenceDose = 0.0;
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparison::~vtkGammaDoseComparison()
+{
+  this->SetReferenceImage(nullptr);
+  this->SetCompareImage(nullptr);
+  this->SetMaskImage(nullptr);
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "DtaDistanceToleranceMm: " << this->DtaDistanceToleranceMm << "\n";
+  os << indent << "DoseDifferenceTolerance: " << this->DoseDifferenceTolerance << "\n";
+  os << indent << "ReferenceDose: " << this->ReferenceDose << "\n";
+  os << indent << "AnalysisThreshold: " << this->AnalysisThreshold << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "LocalGamma: " << (this->LocalGamma ? "true" : "false") << "\n";
+  os << indent << "ThresholdOnReferenceOnly: " << (this->ThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "InterpolatedSearch: " << (this->InterpolatedSearch ? "true" : "false") << "\n";
+  os << indent << "ComputeGammaImages: " << (this->ComputeGammaImages ? "true" : "false") << "\n";
+  os << indent << "NumberOfCriteria: " << this->Criteria.size() << "\n";
+  os << indent << "NumberOfAnalyzedVoxels: " << this->NumberOfAnalyzedVoxels << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkGammaDoseComparison::AddCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerance, bool localGamma)
+{
+  Criterion criterion;
+  criterion.DtaDistanceToleranceMm = dtaDistanceToleranceMm;
+  criterion.DoseDifferenceTolerance = doseDifferenceTolerance;
+  criterion.LocalGamma = localGamma;
+  this->Criteria.push_back(criterion);
+  this->Modified();
+  return static_cast<int>(this->Criteria.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::RemoveAllCriteria()
+{
+  this->Criteria.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkGammaDoseComparison::GetNumberOfCriteria()
+{
+  return static_cast<int>(this->Criteria.size());
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparison::Update()
+{
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassingVoxels.clear();
+  this->GammaImages.clear();
+
+  if (!this->ReferenceImage || !this->CompareImage)
+  {
+    vtkErrorMacro("Update: Invalid reference or compare image");
+    return false;
+  }
+
+  // Use the single criterion given by the properties if no criteria were added
+  std::vector<Criterion> criteria(this->Criteria);
+  if (criteria.empty())
+  {
+    Criterion criterion;
+    criterion.DtaDistanceToleranceMm = this->DtaDistanceToleranceMm;
+    criterion.DoseDifferenceTolerance = this->DoseDifferenceTolerance;
+    criterion.LocalGamma = this->LocalGamma;
+    criteria.push_back(criterion);
+  }
+  if (this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("Update: Maximum gamma must be positive");
+    return false;
+  }
+  double maximumDtaDistanceToleranceMm = 0.0;
+  for (std::vector<Criterion>::iterator criterionIt = criteria.begin(); criterionIt != criteria.end(); ++criterionIt)
+  {
+    if (criterionIt->DtaDistanceToleranceMm <= 0.0 || criterionIt->DoseDifferenceTolerance <= 0.0)
+    {
+      vtkErrorMacro("Update: Tolerances must be positive");
+      return false;
+    }
+    maximumDtaDistanceToleranceMm = std::max(maximumDtaDistanceToleranceMm, criterionIt->DtaDistanceToleranceMm);
+  }
+
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  this->ReferenceImage->GetExtent(referenceExtent);
+  int compareExtent[6] = {0,-1,0,-1,0,-1};
+  this->CompareImage->GetExtent(compareExtent);
+  for (int i = 0; i < 6; ++i)
+  {
+    if (referenceExtent[i] != compareExtent[i])
+    {
+      vtkErrorMacro("Update: Compare image extent differs from reference image extent");
+      return false;
+    }
+  }
+  if (this->MaskImage)
+  {
+    int maskExtent[6] = {0,-1,0,-1,0,-1};
+    this->MaskImage->GetExtent(maskExtent);
+    for (int i = 0; i < 6; ++i)
+    {
+      if (referenceExtent[i] != maskExtent[i])
+      {
+        vtkErrorMacro("Update: Mask image extent differs from reference image extent");
+        return false;
+      }
+    }
+  }
+
+  // Allocate outputs in the reference geometry
+  this->NumberOfPassingVoxels.resize(criteria.size(), 0);
+  this->GammaImages.resize(criteria.size());
+  if (this->ComputeGammaImages)
+  {
+    for (size_t criterionIndex = 0; criterionIndex < criteria.size(); ++criterionIndex)
+    {
+      vtkSmartPointer<vtkImageData> gammaImage = vtkSmartPointer<vtkImageData>::New();
+      gammaImage->SetExtent(referenceExtent);
+      gammaImage->SetOrigin(this->ReferenceImage->GetOrigin());
+      gammaImage->SetSpacing(this->ReferenceImage->GetSpacing());
+      gammaImage->AllocateScalars(VTK_FLOAT, 1);
+      this->GammaImages[criterionIndex] = gammaImage;
+    }
+  }
+  int dimensions[3] = {0, 0, 0};
+  this->ReferenceImage->GetDimensions(dimensions);
+  if (dimensions[0] <= 0 || dimensions[1] <= 0 || dimensions[2] <= 0)
+  {
+    return true;
+  }
+
+  // Get contiguous float buffers of the inputs
+  std::vector<float> referenceValues;
+  vtkGammaDoseComparisonCopyToFloat(this->ReferenceImage, referenceValues);
+  std::vector<float> compareValues;
+  vtkGammaDoseComparisonCopyToFloat(this->CompareImage, compareValues);
+  std::vector<float> maskValues;
+  if (this->MaskImage)
+  {
+    vtkGammaDoseComparisonCopyToFloat(this->MaskImage, maskValues);
+  }
+
+  // Determine reference dose
+  this->UsedReferenceDose = this->ReferenceDose;
+  if (this->UsedReferenceDose <= 0.0)
+  {
+    this->UsedReferenceDose = *std::max_element(referenceValues.begin(), referenceValues.end());
+  }
+  if (this->UsedReferenceDose <= 0.0)
+  {
+    vtkErrorMacro("Update: Reference dose must be positive");
+    return false;
+  }
+
+  std::vector<GammaSearchCriterion> searchCriteria;
+  for (size_t criterionIndex = 0; criterionIndex < criteria.size(); ++criterionIndex)
+  {
+    GammaSearchCriterion searchCriterion;
+    searchCriterion.DtaDistanceTolerance = criteria[criterionIndex].DtaDistanceToleranceMm;
+    searchCriterion.InverseDtaSquared = 1.0 / (searchCriterion.DtaDistanceTolerance * searchCriterion.DtaDistanceTolerance);
+    searchCriterion.DoseDifferenceTolerance = criteria[criterionIndex].DoseDifferenceTolerance;
+    searchCriterion.GlobalDoseTolerance = searchCriterion.DoseDifferenceTolerance * this->UsedReferenceDose;
+    searchCriterion.LocalGamma = criteria[criterionIndex].LocalGamma;
+    searchCriterion.Gamma = ( this->GammaImages[criterionIndex].GetPointer()
+      ? static_cast<float*>(this->GammaImages[criterionIndex]->GetScalarPointer()) : nullptr );
+    searchCriteria.push_back(searchCriterion);
+  }
+
+  // Build neighbor offset table sorted by distance. Neighbors farther than MaximumGamma*DTA cannot improve gamma,
+  // so the search region is determined by the largest DTA
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceImage->GetSpacing(spacing);
+  double searchRadius = this->MaximumGamma * maximumDtaDistanceToleranceMm;
+  double searchRadiusSquared = searchRadius * searchRadius;
+  int searchRange[3] = {0, 0, 0};
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    searchRange[axis] = std::min(dimensions[axis] - 1, static_cast<int>(std::floor(searchRadius / std::fabs(spacing[axis]))));
+  }
+  std::vector<GammaSearchOffset> offsets;
+  for (int dk = -searchRange[2]; dk <= searchRange[2]; ++dk)
+  {
+    for (int dj = -searchRange[1]; dj <= searchRange[1]; ++dj)
+    {
+      for (int di = -searchRange[0]; di <= searchRange[0]; ++di)
+      {
+        double distanceSquared = di*spacing[0]*di*spacing[0] + dj*spacing[1]*dj*spacing[1] + dk*spacing[2]*dk*spacing[2];
+        if (distanceSquared > searchRadiusSquared)
+        {
+          continue;
+        }
+        GammaSearchOffset offset;
+        offset.Offset[0] = di;
+        offset.Offset[1] = dj;
+        offset.Offset[2] = dk;
+        offset.LinearOffset = di + (vtkIdType)dj * dimensions[0] + (vtkIdType)dk * dimensions[0] * dimensions[1];
+        offset.DistanceSquared = distanceSquared;
+        offsets.push_back(offset);
+      }
+    }
+  }
+  std::stable_sort(offsets.begin(), offsets.end(), [](const GammaSearchOffset& a, const GammaSearchOffset& b)
+    { return a.DistanceSquared < b.DistanceSquared; } );
+
+  vtkGammaDoseComparisonFunctor functor(referenceValues, compareValues, (this->MaskImage ? &maskValues : nullptr), offsets, searchCriteria);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    functor.Dimensions[axis] = dimensions[axis];
+    functor.Spacing[axis] = std::fabs(spacing[axis]);
+  }
+  functor.ThresholdDose = this->AnalysisThreshold * this->UsedReferenceDose;
+  functor.MaximumGamma = this->MaximumGamma;
+  functor.ThresholdOnReferenceOnly = this->ThresholdOnReferenceOnly;
+  functor.InterpolatedSearch = this->InterpolatedSearch;
+
+  // Process all rows of the image in one parallel loop. Progress is reported by the functor whenever the calling thread
+  // finishes rows, and once when all rows are done
+  functor.ProgressObject = this;
+  functor.NumberOfRows = (vtkIdType)dimensions[1] * dimensions[2];
+  vtkSMPTools::For(0, functor.NumberOfRows, functor);
+  double progress = 1.0;
+  this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+
+  for (vtkSMPThreadLocal<vtkIdType>::iterator it = functor.AnalyzedVoxels.begin(); it != functor.AnalyzedVoxels.end(); ++it)
+  {
+    this->NumberOfAnalyzedVoxels += (*it);
+  }
+  for (vtkSMPThreadLocal<std::vector<vtkIdType> >::iterator it = functor.PassingVoxels.begin(); it != functor.PassingVoxels.end(); ++it)
+  {
+    for (size_t criterionIndex = 0; criterionIndex < criteria.size(); ++criterionIndex)
+    {
+      this->NumberOfPassingVoxels[criterionIndex] += (*it)[criterionIndex];
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkGammaDoseComparison::GetGammaImage(int criterionIndex/*=0*/)
+{
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(this->GammaImages.size()))
+  {
+    vtkErrorMacro("GetGammaImage: Invalid criterion index " << criterionIndex);
+    return nullptr;
+  }
+  return this->GammaImages[criterionIndex];
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkGammaDoseComparison::GetNumberOfPassingVoxels(int criterionIndex/*=0*/)
+{
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(this->NumberOfPassingVoxels.size()))
+  {
+    vtkErrorMacro("GetNumberOfPassingVoxels: Invalid criterion index " << criterionIndex);
+    return 0;
+  }
+  return this->NumberOfPassingVoxels[criterionIndex];
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparison::GetPassFraction(int criterionIndex/*=0*/)
+{
+  if (this->NumberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return (double)this->GetNumberOfPassingVoxels(criterionIndex) / this->NumberOfAnalyzedVoxels;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkGammaDoseComparison::GetReportString()
+{
+  std::stringstream report;
+  report << "Reference dose            :   " << this->UsedReferenceDose << "\n"
+         << "Analysis threshold        :   " << this->AnalysisThreshold * 100.0 << " %" << (this->ThresholdOnReferenceOnly ? " (reference only)" : "") << "\n"
+         << "Maximum gamma             :   " << this->MaximumGamma << "\n"
+         << "Interpolated search       :   " << (this->InterpolatedSearch ? "on" : "off") << "\n"
+         << "Number of voxels analyzed :   " << this->NumberOfAnalyzedVoxels << "\n";
+  if (this->Criteria.empty())
+  {
+    report << "Dose difference tolerance :   " << this->DoseDifferenceTolerance * 100.0 << " %" << (this->LocalGamma ? " (local)" : " (global)") << "\n"
+           << "DTA tolerance             :   " << this->DtaDistanceToleranceMm << " mm\n"
+           << "Number of voxels passed   :   " << (this->NumberOfPassingVoxels.empty() ? 0 : this->NumberOfPassingVoxels[0]) << "\n"
+           << "Pass rate                 :   " << (this->NumberOfPassingVoxels.empty() ? 0.0 : this->GetPassFraction(0) * 100.0) << " %\n";
+  }
+  for (size_t criterionIndex = 0; criterionIndex < this->Criteria.size() && criterionIndex < this->NumberOfPassingVoxels.size(); ++criterionIndex)
+  {
+    const Criterion& criterion = this->Criteria[criterionIndex];
+    report << "Criterion " << criterion.DoseDifferenceTolerance * 100.0 << "%/" << criterion.DtaDistanceToleranceMm << "mm"
+           << (criterion.LocalGamma ? " (local)" : " (global)") << " :   passed " << this->NumberOfPassingVoxels[criterionIndex]
+           << ", pass rate " << this->GetPassFraction(static_cast<int>(criterionIndex)) * 100.0 << " %\n";
+  }
+  return report.str();
+}
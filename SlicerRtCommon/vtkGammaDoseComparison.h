@@ -0,0 +1,180 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkGammaDoseComparison - Gamma index of two dose images
+// .SECTION Description
+
+#ifndef __vtkGammaDoseComparison_h
+#define __vtkGammaDoseComparison_h
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Compute gamma index of a compare dose image against a reference dose image directly on the VTK image buffers.
+///
+/// The compare image and the optional mask must have the same geometry (extent, origin, spacing and directions) as the reference.
+/// For each analyzed reference voxel the compare voxels are visited in increasing distance using a precomputed, distance sorted
+/// table of neighbor offsets within MaximumGamma * DtaDistanceToleranceMm. The search stops as soon as the distance term alone
+/// exceeds the smallest gamma found so far, so a voxel with agreeing dose at the same position only visits one neighbor.
+/// Voxels are processed on multiple threads using one vtkSMPTools::For loop over the image rows.
+///
+/// Voxels that are outside the mask or below the analysis threshold are not analyzed and get zero gamma.
+/// Gamma values are clamped to MaximumGamma.
+///
+/// Multiple criteria (DTA, dose difference, local or global) can be evaluated with one neighborhood search using
+/// \sa AddCriterion. Each neighbor is visited only once, and the search ends when no criterion can improve any more.
+class VTK_SLICERRTCOMMON_EXPORT vtkGammaDoseComparison : public vtkObject
+{
+public:
+  static vtkGammaDoseComparison *New();
+  vtkTypeMacro(vtkGammaDoseComparison, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  /// Compute gamma image and pass fraction.
+  /// Invokes vtkCommand::ProgressEvent with the progress (between 0 and 1) as call data.
+  /// \return Success flag
+  virtual bool Update();
+
+  /// Reference dose image. The gamma image has the same geometry
+  vtkSetObjectMacro(ReferenceImage, vtkImageData);
+  vtkGetObjectMacro(ReferenceImage, vtkImageData);
+
+  /// Compare dose image. Must be in the same geometry as the reference image
+  vtkSetObjectMacro(CompareImage, vtkImageData);
+  vtkGetObjectMacro(CompareImage, vtkImageData);
+
+  /// Optional mask image. Only voxels with nonzero mask value are analyzed. Must be in the same geometry as the reference image
+  vtkSetObjectMacro(MaskImage, vtkImageData);
+  vtkGetObjectMacro(MaskImage, vtkImageData);
+
+  /// Distance to agreement (DTA) tolerance, in mm
+  vtkSetMacro(DtaDistanceToleranceMm, double);
+  vtkGetMacro(DtaDistanceToleranceMm, double);
+
+  /// Dose difference tolerance as a fraction of the reference dose (global) or the local reference dose (local)
+  vtkSetMacro(DoseDifferenceTolerance, double);
+  vtkGetMacro(DoseDifferenceTolerance, double);
+
+  /// Reference (prescription) dose. If not positive, then the maximum of the reference image is used
+  vtkSetMacro(ReferenceDose, double);
+  vtkGetMacro(ReferenceDose, double);
+
+  /// Analysis threshold as a fraction of the reference dose. Voxels with lower dose are not analyzed
+  vtkSetMacro(AnalysisThreshold, double);
+  vtkGetMacro(AnalysisThreshold, double);
+
+  /// Maximum gamma. Limits the search distance and the output values
+  vtkSetMacro(MaximumGamma, double);
+  vtkGetMacro(MaximumGamma, double);
+
+  /// If on, then the dose difference tolerance is relative to the reference dose at the analyzed voxel
+  vtkSetMacro(LocalGamma, bool);
+  vtkGetMacro(LocalGamma, bool);
+  vtkBooleanMacro(LocalGamma, bool);
+
+  /// If on, then only the reference dose is compared to the analysis threshold, otherwise a voxel is analyzed
+  /// if either the reference or the compare dose reaches the threshold
+  vtkSetMacro(ThresholdOnReferenceOnly, bool);
+  vtkGetMacro(ThresholdOnReferenceOnly, bool);
+  vtkBooleanMacro(ThresholdOnReferenceOnly, bool);
+
+  /// If on, then the closest point is also searched on the segments between the best compare voxel and its face
+  /// neighbors, assuming linear dose change along them (geometric gamma). Otherwise only voxel centers are considered
+  vtkSetMacro(InterpolatedSearch, bool);
+  vtkGetMacro(InterpolatedSearch, bool);
+  vtkBooleanMacro(InterpolatedSearch, bool);
+
+  /// Add a gamma criterion. If any criteria are added, then gamma is computed for all of them in one pass,
+  /// and \sa DtaDistanceToleranceMm, \sa DoseDifferenceTolerance and \sa LocalGamma are not used.
+  /// \param doseDifferenceTolerance Dose difference tolerance as a fraction (see \sa DoseDifferenceTolerance)
+  /// \return Index of the criterion, used for getting its results
+  int AddCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerance, bool localGamma);
+  /// Remove all criteria added by \sa AddCriterion
+  void RemoveAllCriteria();
+  /// Get number of criteria added by \sa AddCriterion
+  int GetNumberOfCriteria();
+
+  /// If off, then only the pass counts are computed, and no gamma images are created. On by default
+  vtkSetMacro(ComputeGammaImages, bool);
+  vtkGetMacro(ComputeGammaImages, bool);
+  vtkBooleanMacro(ComputeGammaImages, bool);
+
+  /// Output gamma image (float) of a criterion computed by the last update.
+  /// Criterion index is 0 if no criteria were added. Null if gamma images are not computed
+  vtkImageData* GetGammaImage(int criterionIndex=0);
+
+  /// Number of voxels analyzed in the last update (same for all criteria)
+  vtkGetMacro(NumberOfAnalyzedVoxels, vtkIdType);
+  /// Number of analyzed voxels with gamma not greater than 1 for a criterion in the last update
+  vtkIdType GetNumberOfPassingVoxels(int criterionIndex=0);
+  /// Fraction of analyzed voxels that passed a criterion (between 0 and 1)
+  double GetPassFraction(int criterionIndex=0);
+
+  /// Get report string listing the parameters and results of the last update
+  std::string GetReportString();
+
+protected:
+  vtkImageData* ReferenceImage;
+  vtkImageData* CompareImage;
+  vtkImageData* MaskImage;
+  double DtaDistanceToleranceMm;
+  double DoseDifferenceTolerance;
+  double ReferenceDose;
+  double AnalysisThreshold;
+  double MaximumGamma;
+  bool LocalGamma;
+  bool ThresholdOnReferenceOnly;
+  bool InterpolatedSearch;
+  bool ComputeGammaImages;
+
+  /// Gamma criterion added by \sa AddCriterion
+  struct Criterion
+  {
+    double DtaDistanceToleranceMm;
+    double DoseDifferenceTolerance;
+    bool LocalGamma;
+  };
+  std::vector<Criterion> Criteria;
+
+  /// Results of the last update, one item for each criterion
+  std::vector<vtkSmartPointer<vtkImageData> > GammaImages;
+  std::vector<vtkIdType> NumberOfPassingVoxels;
+  vtkIdType NumberOfAnalyzedVoxels;
+  /// Reference dose used in the last update (the maximum reference dose if \sa ReferenceDose is not positive)
+  double UsedReferenceDose;
+
+protected:
+  vtkGammaDoseComparison();
+  ~vtkGammaDoseComparison() override;
+
+private:
+  vtkGammaDoseComparison(const vtkGammaDoseComparison&) = delete;
+  void operator=(const vtkGammaDoseComparison&) = delete;
+};
+
+#endif
@@ -0,0 +1,354 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkMultiStructureImageAccumulate.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkType.h>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkMultiStructureImageAccumulate);
+
+//----------------------------------------------------------------------------
+vtkMultiStructureImageAccumulate::vtkMultiStructureImageAccumulate()
+{
+  this->InputImage = nullptr;
+  this->StructureMask = nullptr;
+  this->MaskType = MaskTypeLabelmap;
+  this->NumberOfStructures = 0;
+  this->BinStart = 0.0;
+  this->BinSpacing = 1.0;
+  this->NumberOfBins = 256;
+  this->Accumulate = false;
+}
+
+//----------------------------------------------------------------------------
+vtkMultiStructureImageAccumulate::~vtkMultiStructureImageAccumulate()
+{
+  this->SetInputImage(nullptr);
+  this->SetStructureMask(nullptr);
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "MaskType: " << (this->MaskType == MaskTypeBitset ? "Bitset" : "Labelmap") << "\n";
+  os << indent << "NumberOfStructures: " << this->NumberOfStructures << "\n";
+  os << indent << "BinStart: " << this->BinStart << "\n";
+  os << indent << "BinSpacing: " << this->BinSpacing << "\n";
+  os << indent << "NumberOfBins: " << this->NumberOfBins << "\n";
+  os << indent << "Accumulate: " << (this->Accumulate ? "true" : "false") << "\n";
+}
+
+//----------------------------------------------------------------------------
+template <class HistogramType>
+inline void vtkMultiStructureImageAccumulateAddValue(HistogramType& histogram, double value, bool belowBinStart, int binIndex, int numberOfBins)
+{
+  ++histogram.VoxelCount;
+  histogram.Sum += value;
+  if (value < histogram.Minimum)
+  {
+    histogram.Minimum = value;
+  }
+  if (value > histogram.Maximum)
+  {
+    histogram.Maximum = value;
+  }
+  if (belowBinStart)
+  {
+    ++histogram.VoxelCountBelowBinStart;
+  }
+  if (binIndex >= 0 && binIndex < numberOfBins)
+  {
+    ++histogram.Bins[binIndex];
+  }
+}
+
+//----------------------------------------------------------------------------
+template <class InputScalarType, class MaskScalarType, class HistogramType>
+void vtkMultiStructureImageAccumulateExecute2(
+  InputScalarType* inputPtr, MaskScalarType* maskPtr, vtkIdType numberOfVoxels,
+  bool bitset, double binStart, double binSpacing, int numberOfBins,
+  std::vector<HistogramType>& histograms )
+{
+  int numberOfStructures = static_cast<int>(histograms.size());
+  for (vtkIdType voxelIndex = 0; voxelIndex < numberOfVoxels; ++voxelIndex)
+  {
+    MaskScalarType maskValue = maskPtr[voxelIndex];
+    if (maskValue == 0)
+    {
+      // Background
+      continue;
+    }
+
+    // Bin index is determined only once for all the structures containing the voxel
+    double value = static_cast<double>(inputPtr[voxelIndex]);
+    bool belowBinStart = (value < binStart);
+    int binIndex = vtkMath::Floor((value - binStart) / binSpacing);
+
+    if (bitset)
+    {
+      vtkTypeUInt64 bits = static_cast<vtkTypeUInt64>(maskValue);
+      for (int structureIndex = 0; bits != 0 && structureIndex < numberOfStructures; ++structureIndex, bits >>= 1)
+      {
+        if (bits & 1)
+        {
+          vtkMultiStructureImageAccumulateAddValue(histograms[structureIndex], value, belowBinStart, binIndex, numberOfBins);
+        }
+      }
+    }
+    else
+    {
+      int structureIndex = static_cast<int>(maskValue) - 1;
+      if (structureIndex >= 0 && structureIndex < numberOfStructures)
+      {
+        vtkMultiStructureImageAccumulateAddValue(histograms[structureIndex], value, belowBinStart, binIndex, numberOfBins);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Process the image row by row, as the mask may have a larger extent than the input image
+template <class InputScalarType, class MaskScalarType, class HistogramType>
+void vtkMultiStructureImageAccumulateExecuteRows(
+  vtkImageData* input, InputScalarType*, vtkImageData* mask, MaskScalarType*, int extent[6],
+  bool bitset, double binStart, double binSpacing, int numberOfBins,
+  std::vector<HistogramType>& histograms )
+{
+  vtkIdType rowLength = extent[1] - extent[0] + 1;
+  for (int k = extent[4]; k <= extent[5]; ++k)
+  {
+    for (int j = extent[2]; j <= extent[3]; ++j)
+    {
+      vtkMultiStructureImageAccumulateExecute2(
+        static_cast<InputScalarType*>(input->GetScalarPointer(extent[0], j, k)),
+        static_cast<MaskScalarType*>(mask->GetScalarPointer(extent[0], j, k)), rowLength,
+        bitset, binStart, binSpacing, numberOfBins, histograms );
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+template <class InputScalarType, class HistogramType>
+void vtkMultiStructureImageAccumulateExecute(
+  vtkImageData* input, InputScalarType* inputTypePtr, vtkImageData* mask, int extent[6],
+  bool bitset, double binStart, double binSpacing, int numberOfBins,
+  std::vector<HistogramType>& histograms )
+{
+  switch (mask->GetScalarType())
+  {
+    vtkTemplateMacro( vtkMultiStructureImageAccumulateExecuteRows( input, inputTypePtr, mask, static_cast<VTK_TT*>(nullptr), extent,
+      bitset, binStart, binSpacing, numberOfBins, histograms ) );
+    default:
+      break;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::Update()
+{
+  if ( !this->Accumulate || static_cast<int>(this->Histograms.size()) != this->NumberOfStructures
+    || (!this->Histograms.empty() && static_cast<int>(this->Histograms[0].Bins.size()) != this->NumberOfBins) )
+  {
+    this->Histograms.clear();
+  }
+
+  if (!this->InputImage || !this->StructureMask)
+  {
+    vtkErrorMacro("Update: Input image and structure mask have to be set");
+    return;
+  }
+  if (this->NumberOfStructures <= 0 || this->NumberOfBins <= 0 || this->BinSpacing <= 0.0)
+  {
+    vtkErrorMacro("Update: Invalid number of structures, number of bins, or bin spacing");
+    return;
+  }
+  if (!this->InputImage->GetPointData()->GetScalars() || !this->StructureMask->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Input image or structure mask contains no scalars");
+    return;
+  }
+  if (this->InputImage->GetNumberOfScalarComponents() != 1 || this->StructureMask->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Update: Input image and structure mask need to have one scalar component");
+    return;
+  }
+
+  int inputExtent[6] = {0,-1,0,-1,0,-1};
+  this->InputImage->GetExtent(inputExtent);
+  int maskExtent[6] = {0,-1,0,-1,0,-1};
+  this->StructureMask->GetExtent(maskExtent);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (inputExtent[axis*2] < maskExtent[axis*2] || inputExtent[axis*2+1] > maskExtent[axis*2+1])
+    {
+      vtkErrorMacro("Update: Structure mask extent does not contain the input image extent");
+      return;
+    }
+  }
+
+  bool bitset = (this->MaskType == MaskTypeBitset);
+  if (bitset)
+  {
+    int scalarType = this->StructureMask->GetScalarType();
+    if ( scalarType != VTK_UNSIGNED_CHAR && scalarType != VTK_UNSIGNED_SHORT
+      && scalarType != VTK_UNSIGNED_INT && scalarType != VTK_UNSIGNED_LONG_LONG
+      && scalarType != VTK_UNSIGNED_LONG )
+    {
+      vtkErrorMacro("Update: Bitset structure mask needs to have unsigned integer scalar type");
+      return;
+    }
+    if (this->NumberOfStructures > this->StructureMask->GetScalarSize() * 8)
+    {
+      vtkErrorMacro("Update: Bitset structure mask of type " << this->StructureMask->GetScalarTypeAsString()
+        << " cannot hold " << this->NumberOfStructures << " structures");
+      return;
+    }
+  }
+
+  // Histograms are kept if accumulating (resize only initializes new structures)
+  this->Histograms.resize(this->NumberOfStructures);
+  for (std::vector<StructureHistogram>::iterator histogramIt = this->Histograms.begin(); histogramIt != this->Histograms.end(); ++histogramIt)
+  {
+    histogramIt->Bins.resize(this->NumberOfBins, 0);
+  }
+  if (inputExtent[0] > inputExtent[1] || inputExtent[2] > inputExtent[3] || inputExtent[4] > inputExtent[5])
+  {
+    // Empty input, nothing to add to the histograms
+    return;
+  }
+
+  switch (this->InputImage->GetScalarType())
+  {
+    vtkTemplateMacro( vtkMultiStructureImageAccumulateExecute( this->InputImage, static_cast<VTK_TT*>(nullptr),
+      this->StructureMask, inputExtent, bitset, this->BinStart, this->BinSpacing, this->NumberOfBins, this->Histograms ) );
+    default:
+      vtkErrorMacro("Update: Unknown scalar type");
+      return;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkMultiStructureImageAccumulate::GetVoxelCount(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetVoxelCount: Invalid structure index " << structureIndex);
+    return 0;
+  }
+  return this->Histograms[structureIndex].VoxelCount;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMinimum(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetMinimum: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  return this->Histograms[structureIndex].Minimum;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMaximum(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetMaximum: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  return this->Histograms[structureIndex].Maximum;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiStructureImageAccumulate::GetMean(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetMean: Invalid structure index " << structureIndex);
+    return 0.0;
+  }
+  const StructureHistogram& histogram = this->Histograms[structureIndex];
+  return (histogram.VoxelCount > 0 ? histogram.Sum / static_cast<double>(histogram.VoxelCount) : 0.0);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkMultiStructureImageAccumulate::GetNumberOfVoxelsBelowBinStart(int structureIndex)
+{
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetNumberOfVoxelsBelowBinStart: Invalid structure index " << structureIndex);
+    return 0;
+  }
+  return this->Histograms[structureIndex].VoxelCountBelowBinStart;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkMultiStructureImageAccumulate::GetBinCount(int structureIndex, int binIndex)
+{
+  if ( structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size())
+    || binIndex < 0 || binIndex >= static_cast<int>(this->Histograms[structureIndex].Bins.size()) )
+  {
+    vtkErrorMacro("GetBinCount: Invalid structure index " << structureIndex << " or bin index " << binIndex);
+    return 0;
+  }
+  return this->Histograms[structureIndex].Bins[binIndex];
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiStructureImageAccumulate::GetCumulativeHistogram(int structureIndex, vtkDoubleArray* cumulativeHistogram)
+{
+  if (!cumulativeHistogram)
+  {
+    vtkErrorMacro("GetCumulativeHistogram: Invalid output array");
+    return;
+  }
+  if (structureIndex < 0 || structureIndex >= static_cast<int>(this->Histograms.size()))
+  {
+    vtkErrorMacro("GetCumulativeHistogram: Invalid structure index " << structureIndex);
+    return;
+  }
+
+  const StructureHistogram& histogram = this->Histograms[structureIndex];
+  int numberOfBins = static_cast<int>(histogram.Bins.size());
+  cumulativeHistogram->SetNumberOfComponents(1);
+  cumulativeHistogram->SetNumberOfTuples(numberOfBins);
+  if (histogram.VoxelCount == 0)
+  {
+    cumulativeHistogram->FillComponent(0, 0.0);
+    return;
+  }
+
+  double totalVoxels = static_cast<double>(histogram.VoxelCount);
+  double voxelsBelowValue = static_cast<double>(histogram.VoxelCountBelowBinStart);
+  for (int binIndex = 0; binIndex < numberOfBins; ++binIndex)
+  {
+    cumulativeHistogram->SetValue(binIndex, 1.0 - voxelsBelowValue / totalVoxels);
+    voxelsBelowValue += static_cast<double>(histogram.Bins[binIndex]);
+  }
+}
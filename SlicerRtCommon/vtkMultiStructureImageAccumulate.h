@@ -0,0 +1,146 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkMultiStructureImageAccumulate - Histogram of an image for multiple structures in one pass
+// .SECTION Description
+
+#ifndef __vtkMultiStructureImageAccumulate_h
+#define __vtkMultiStructureImageAccumulate_h
+
+// VTK includes
+#include <vtkImageData.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+class vtkDoubleArray;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Compute histogram and statistics of an image (typically dose) for multiple structures in one pass.
+///
+/// The structures are defined by a mask image whose extent contains the extent of the input image. The mask can be either
+///   - a labelmap, in which structure i is represented by label value i+1 (0 is background), or
+///   - a bitset, in which bit i of the (unsigned integer) voxel value is set if the voxel is in structure i.
+///     Using a bitset allows the structures to overlap. Number of structures is limited by the number of bits of the scalar type.
+/// The input image is read only once, and for each voxel the bin index is determined once for all the structures it belongs to.
+/// The bins are uniform, starting at \sa BinStart with size \sa BinSpacing. Voxels with values below BinStart are counted
+/// separately so that cumulative (dose volume) histograms can be assembled.
+class VTK_SLICERRTCOMMON_EXPORT vtkMultiStructureImageAccumulate : public vtkObject
+{
+public:
+  enum
+  {
+    MaskTypeLabelmap = 0,
+    MaskTypeBitset
+  };
+
+public:
+  static vtkMultiStructureImageAccumulate *New();
+  vtkTypeMacro(vtkMultiStructureImageAccumulate, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  /// Compute histograms and statistics for all structures
+  virtual void Update();
+
+  /// Get number of voxels in the given structure
+  vtkIdType GetVoxelCount(int structureIndex);
+  /// Get minimum value in the given structure
+  double GetMinimum(int structureIndex);
+  /// Get maximum value in the given structure
+  double GetMaximum(int structureIndex);
+  /// Get mean value in the given structure
+  double GetMean(int structureIndex);
+  /// Get number of voxels in the given structure with a value smaller than \sa BinStart
+  vtkIdType GetNumberOfVoxelsBelowBinStart(int structureIndex);
+  /// Get number of voxels in a bin of the histogram of the given structure
+  vtkIdType GetBinCount(int structureIndex, int binIndex);
+
+  /// Get cumulative histogram of the given structure.
+  /// Value i is the fraction of the structure voxels with a value that is at least BinStart + i*BinSpacing
+  void GetCumulativeHistogram(int structureIndex, vtkDoubleArray* cumulativeHistogram);
+
+  /// Image the histograms are computed of
+  vtkSetObjectMacro(InputImage, vtkImageData);
+  vtkGetObjectMacro(InputImage, vtkImageData);
+
+  /// Mask image defining the structures. Its extent must contain the extent of the input image
+  vtkSetObjectMacro(StructureMask, vtkImageData);
+  vtkGetObjectMacro(StructureMask, vtkImageData);
+
+  vtkSetMacro(MaskType, int);
+  vtkGetMacro(MaskType, int);
+  void SetMaskTypeToLabelmap() { this->SetMaskType(MaskTypeLabelmap); };
+  void SetMaskTypeToBitset() { this->SetMaskType(MaskTypeBitset); };
+
+  vtkSetMacro(NumberOfStructures, int);
+  vtkGetMacro(NumberOfStructures, int);
+
+  vtkSetMacro(BinStart, double);
+  vtkGetMacro(BinStart, double);
+
+  vtkSetMacro(BinSpacing, double);
+  vtkGetMacro(BinSpacing, double);
+
+  vtkSetMacro(NumberOfBins, int);
+  vtkGetMacro(NumberOfBins, int);
+
+  /// If on, then the voxels of the input image are added to the results of the previous update instead of
+  /// starting over. This allows computing the histograms of an image that is processed in pieces (e.g. slabs)
+  /// against the same mask. Off by default
+  vtkSetMacro(Accumulate, bool);
+  vtkGetMacro(Accumulate, bool);
+  vtkBooleanMacro(Accumulate, bool);
+
+protected:
+  /// Statistics and histogram of one structure
+  struct StructureHistogram
+  {
+    vtkIdType VoxelCount{0};
+    vtkIdType VoxelCountBelowBinStart{0};
+    double Sum{0.0};
+    double Minimum{VTK_DOUBLE_MAX};
+    double Maximum{VTK_DOUBLE_MIN};
+    std::vector<vtkIdType> Bins;
+  };
+
+  vtkImageData* InputImage;
+  vtkImageData* StructureMask;
+  int MaskType;
+  int NumberOfStructures;
+  double BinStart;
+  double BinSpacing;
+  int NumberOfBins;
+  bool Accumulate;
+
+  /// Results of the last update, one item for each structure
+  std::vector<StructureHistogram> Histograms;
+
+protected:
+  vtkMultiStructureImageAccumulate();
+  ~vtkMultiStructureImageAccumulate() override;
+
+private:
+  vtkMultiStructureImageAccumulate(const vtkMultiStructureImageAccumulate&) = delete;
+  void operator=(const vtkMultiStructureImageAccumulate&) = delete;
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkResampledDoseCache.h"
+#include "vtkSlicerRtCommon.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverter.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+
+// STD includes
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkResampledDoseCache);
+
+//----------------------------------------------------------------------------
+vtkResampledDoseCache::vtkResampledDoseCache()
+{
+  this->MemoryBudgetKB = 256 * 1024; // 256 MiB
+  this->MemorySizeKB = 0;
+
+  this->SceneCallbackCommand = vtkSmartPointer<vtkCallbackCommand>::New();
+  this->SceneCallbackCommand->SetClientData(this);
+  this->SceneCallbackCommand->SetCallback(vtkResampledDoseCache::OnSceneEndClose);
+}
+
+//----------------------------------------------------------------------------
+vtkResampledDoseCache::~vtkResampledDoseCache()
+{
+  for (vtkMRMLScene* scene : this->ObservedScenes)
+  {
+    if (scene)
+    {
+      scene->RemoveObserver(this->SceneCallbackCommand);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkResampledDoseCache* vtkResampledDoseCache::GetInstance()
+{
+  static vtkSmartPointer<vtkResampledDoseCache> instance = vtkSmartPointer<vtkResampledDoseCache>::New();
+  return instance;
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  os << indent << "MemoryBudgetKB: " << this->MemoryBudgetKB << "\n";
+  os << indent << "MemorySizeKB: " << this->MemorySizeKB << "\n";
+  os << indent << "NumberOfImages: " << this->Entries.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+std::string vtkResampledDoseCache::GetVolumeKey(vtkMRMLScalarVolumeNode* volumeNode)
+{
+  if (!volumeNode || !volumeNode->GetID() || !volumeNode->GetImageData())
+  {
+    return "";
+  }
+
+  // Images resampled from volumes of a scene are of no use after the scene is closed
+  vtkResampledDoseCache::GetInstance()->ObserveScene(volumeNode->GetScene());
+
+  std::stringstream keyStream;
+  keyStream << volumeNode->GetID() << ";" << volumeNode->GetImageData()->GetMTime() << ";" << GetVolumeGeometryKey(volumeNode);
+  return keyStream.str();
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::GetVolumeGeometry(vtkMRMLScalarVolumeNode* volumeNode, vtkOrientedImageData* geometry)
+{
+  if (!volumeNode || !volumeNode->GetImageData() || !geometry)
+  {
+    return;
+  }
+
+  vtkNew<vtkMatrix4x4> ijkToRasMatrix;
+  volumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  geometry->SetExtent(volumeNode->GetImageData()->GetExtent());
+  geometry->SetGeometryFromImageToWorldMatrix(ijkToRasMatrix);
+}
+
+//----------------------------------------------------------------------------
+bool vtkResampledDoseCache::GetVolumeWorldGeometry(vtkMRMLScalarVolumeNode* volumeNode, vtkOrientedImageData* geometry)
+{
+  if (!volumeNode || !volumeNode->GetImageData() || !geometry)
+  {
+    return false;
+  }
+
+  vtkNew<vtkMatrix4x4> ijkToWorldMatrix;
+  volumeNode->GetIJKToRASMatrix(ijkToWorldMatrix);
+  vtkMRMLTransformNode* parentTransformNode = volumeNode->GetParentTransformNode();
+  if (parentTransformNode)
+  {
+    if (!parentTransformNode->IsTransformToWorldLinear())
+    {
+      return false;
+    }
+    vtkNew<vtkMatrix4x4> rasToWorldMatrix;
+    parentTransformNode->GetMatrixTransformToWorld(rasToWorldMatrix);
+    vtkMatrix4x4::Multiply4x4(rasToWorldMatrix, ijkToWorldMatrix, ijkToWorldMatrix);
+  }
+  geometry->SetExtent(volumeNode->GetImageData()->GetExtent());
+  geometry->SetGeometryFromImageToWorldMatrix(ijkToWorldMatrix);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkResampledDoseCache::GetVolumeGeometryKey(vtkMRMLScalarVolumeNode* volumeNode)
+{
+  if (!volumeNode || !volumeNode->GetImageData())
+  {
+    return "";
+  }
+
+  vtkNew<vtkMatrix4x4> ijkToWorldMatrix;
+  volumeNode->GetIJKToRASMatrix(ijkToWorldMatrix);
+  std::stringstream keyStream;
+  vtkMRMLTransformNode* parentTransformNode = volumeNode->GetParentTransformNode();
+  if (parentTransformNode)
+  {
+    if (parentTransformNode->IsTransformToWorldLinear())
+    {
+      vtkNew<vtkMatrix4x4> rasToWorldMatrix;
+      parentTransformNode->GetMatrixTransformToWorld(rasToWorldMatrix);
+      vtkMatrix4x4::Multiply4x4(rasToWorldMatrix, ijkToWorldMatrix, ijkToWorldMatrix);
+    }
+    else
+    {
+      // Non-linear transforms cannot be described by a matrix, so identify them by the state of the transform nodes
+      keyStream << vtkSlicerRtCommon::GetTransformToWorldSignature(parentTransformNode) << ";";
+    }
+  }
+
+  keyStream.precision(12);
+  for (int row = 0; row < 3; ++row)
+  {
+    for (int column = 0; column < 4; ++column)
+    {
+      keyStream << ijkToWorldMatrix->GetElement(row, column) << " ";
+    }
+  }
+  int extent[6] = {0,-1,0,-1,0,-1};
+  volumeNode->GetImageData()->GetExtent(extent);
+  keyStream << ";" << extent[0] << " " << extent[1] << " " << extent[2] << " " << extent[3] << " " << extent[4] << " " << extent[5];
+  return keyStream.str();
+}
+
+//----------------------------------------------------------------------------
+std::string vtkResampledDoseCache::GetImageKey(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation)
+{
+  std::stringstream keyStream;
+  keyStream << sourceKey << "|" << vtkSegmentationConverter::SerializeImageGeometry(referenceGeometry) << "|" << interpolation;
+  return keyStream.str();
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkOrientedImageData> vtkResampledDoseCache::GetImage(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation)
+{
+  if (sourceKey.empty() || !referenceGeometry)
+  {
+    return nullptr;
+  }
+
+  std::string key = vtkResampledDoseCache::GetImageKey(sourceKey, referenceGeometry, interpolation);
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  std::map<std::string, CacheEntryList::iterator>::iterator entryIt = this->EntriesByKey.find(key);
+  if (entryIt == this->EntriesByKey.end())
+  {
+    return nullptr;
+  }
+
+  // Move to the front of the list as most recently used
+  this->Entries.splice(this->Entries.begin(), this->Entries, entryIt->second);
+  return entryIt->second->Image;
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::AddImage(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation, vtkOrientedImageData* image)
+{
+  if (sourceKey.empty() || !referenceGeometry || !image)
+  {
+    return;
+  }
+
+  std::string key = vtkResampledDoseCache::GetImageKey(sourceKey, referenceGeometry, interpolation);
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  unsigned long memorySizeKB = image->GetActualMemorySize();
+  if (memorySizeKB > this->MemoryBudgetKB)
+  {
+    vtkDebugMacro("AddImage: Image of size " << memorySizeKB << " KB does not fit in the memory budget of the cache");
+    return;
+  }
+
+  // Replace existing image with the same key
+  std::map<std::string, CacheEntryList::iterator>::iterator entryIt = this->EntriesByKey.find(key);
+  if (entryIt != this->EntriesByKey.end())
+  {
+    this->MemorySizeKB -= entryIt->second->MemorySizeKB;
+    this->Entries.erase(entryIt->second);
+    this->EntriesByKey.erase(entryIt);
+  }
+
+  CacheEntry entry;
+  entry.Key = key;
+  entry.SourceKey = sourceKey;
+  entry.Image = image;
+  entry.MemorySizeKB = memorySizeKB;
+  this->Entries.push_front(entry);
+  this->EntriesByKey[key] = this->Entries.begin();
+  this->MemorySizeKB += memorySizeKB;
+
+  this->EvictImages(this->MemoryBudgetKB);
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::RemoveImagesOfSource(const std::string& sourceKey)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  std::map<std::string, CacheEntryList::iterator>::iterator entryIt = this->EntriesByKey.begin();
+  while (entryIt != this->EntriesByKey.end())
+  {
+    if (entryIt->second->SourceKey == sourceKey)
+    {
+      this->MemorySizeKB -= entryIt->second->MemorySizeKB;
+      this->Entries.erase(entryIt->second);
+      entryIt = this->EntriesByKey.erase(entryIt);
+    }
+    else
+    {
+      ++entryIt;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::RemoveAllImages()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Entries.clear();
+  this->EntriesByKey.clear();
+  this->MemorySizeKB = 0;
+}
+
+//----------------------------------------------------------------------------
+unsigned long vtkResampledDoseCache::GetMemorySizeKB()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->MemorySizeKB;
+}
+
+//----------------------------------------------------------------------------
+int vtkResampledDoseCache::GetNumberOfImages()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return static_cast<int>(this->Entries.size());
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::SetMemoryBudgetKB(unsigned long memoryBudgetKB)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (this->MemoryBudgetKB == memoryBudgetKB)
+    {
+      return;
+    }
+    this->MemoryBudgetKB = memoryBudgetKB;
+    this->EvictImages(this->MemoryBudgetKB);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::ReduceMemorySizeKB(unsigned long maximumMemorySizeKB)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->EvictImages(maximumMemorySizeKB);
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::EvictImages(unsigned long maximumMemorySizeKB)
+{
+  while (!this->Entries.empty() && this->MemorySizeKB > maximumMemorySizeKB)
+  {
+    // Least recently used entry is at the end of the list
+    CacheEntryList::iterator lastEntryIt = std::prev(this->Entries.end());
+    this->EntriesByKey.erase(lastEntryIt->Key);
+    this->MemorySizeKB -= lastEntryIt->MemorySizeKB;
+    this->Entries.erase(lastEntryIt);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::ObserveScene(vtkMRMLScene* scene)
+{
+  if (!scene)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  // Forget deleted scenes
+  this->ObservedScenes.erase(std::remove_if(this->ObservedScenes.begin(), this->ObservedScenes.end(),
+    [](const vtkWeakPointer<vtkMRMLScene>& observedScene) { return observedScene.GetPointer() == nullptr; }),
+    this->ObservedScenes.end());
+  for (vtkMRMLScene* observedScene : this->ObservedScenes)
+  {
+    if (observedScene == scene)
+    {
+      return;
+    }
+  }
+  scene->AddObserver(vtkMRMLScene::EndCloseEvent, this->SceneCallbackCommand);
+  this->ObservedScenes.push_back(scene);
+}
+
+//----------------------------------------------------------------------------
+void vtkResampledDoseCache::OnSceneEndClose(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* vtkNotUsed(callData))
+{
+  vtkResampledDoseCache* self = reinterpret_cast<vtkResampledDoseCache*>(clientData);
+  if (self)
+  {
+    self->RemoveAllImages();
+  }
+}
@@ -0,0 +1,167 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// .NAME vtkResampledDoseCache - Process-wide cache of resampled dose volumes
+// .SECTION Description
+
+#ifndef __vtkResampledDoseCache_h
+#define __vtkResampledDoseCache_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+// STD includes
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+class vtkCallbackCommand;
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLScene;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Cache of resampled (or otherwise derived) copies of dose volumes shared by the SlicerRT modules.
+///
+/// Several modules (DVH, isodose, dose accumulation) resample the same dose volume to the same reference geometry.
+/// The cache stores the results keyed on the source volume (node ID, image data modified time, world geometry),
+/// the reference geometry and the interpolation mode, so that the resampling is done only once. If the resampling
+/// depends on the parent transform of the reference volume, then the reference geometry needs to be the world
+/// geometry (see \sa GetVolumeWorldGeometry).
+/// The key is built by the cache from these, so the modules can share each other's resampled volumes.
+/// The images handed out by the cache are shared, and must be treated as read-only by the callers.
+/// The least recently used images are evicted when the total size exceeds the memory budget, and all images are
+/// removed when the scene of a cached volume is closed.
+class VTK_SLICERRTCOMMON_EXPORT vtkResampledDoseCache : public vtkObject
+{
+public:
+  static vtkResampledDoseCache *New();
+  vtkTypeMacro(vtkResampledDoseCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  /// Get the process-wide cache instance
+  static vtkResampledDoseCache* GetInstance();
+
+  /// Get key identifying the current content of a volume node: node ID, modified time of the image data
+  /// and the world geometry (including parent transform). Empty string if the volume has no image data.
+  /// Must be called on the main thread. The cached images are released when the scene of the volume is closed.
+  static std::string GetVolumeKey(vtkMRMLScalarVolumeNode* volumeNode);
+
+  /// Get the lattice of a volume node (IJK to RAS matrix without parent transform, and extent) as image geometry
+  /// without scalars, to be used as reference geometry of the resampling
+  static void GetVolumeGeometry(vtkMRMLScalarVolumeNode* volumeNode, vtkOrientedImageData* geometry);
+
+  /// Get the world lattice of a volume node (IJK to RAS matrix including parent transform, and extent) as image geometry
+  /// without scalars. To be used as reference geometry of the resampling if the resampled image depends on where the
+  /// reference volume is in the world (for example if it is resampled in the world coordinate system of the reference volume).
+  /// eturn False if the volume has no image data or the transform to world is not linear (then the geometry is not set)
+  static bool GetVolumeWorldGeometry(vtkMRMLScalarVolumeNode* volumeNode, vtkOrientedImageData* geometry);
+
+  /// Get cached source volume resampled to a reference geometry
+  /// \param sourceKey Key of the source volume, see \sa GetVolumeKey
+  /// \param referenceGeometry Image defining the geometry (image to world matrix and extent) of the resampled volume
+  /// \param interpolation Interpolation mode (VTK_NEAREST_INTERPOLATION, VTK_LINEAR_INTERPOLATION etc.)
+  /// \return The cached image (must not be modified), nullptr if not found
+  vtkSmartPointer<vtkOrientedImageData> GetImage(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation);
+
+  /// Add source volume resampled to a reference geometry to the cache. The image must have the reference geometry.
+  /// The cache keeps a reference to the image, so it must not be modified afterwards. Images larger than the memory
+  /// budget are not cached.
+  void AddImage(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation, vtkOrientedImageData* image);
+
+  /// Remove all images derived from the given source volume
+  void RemoveImagesOfSource(const std::string& sourceKey);
+
+  /// Remove all images from the cache
+  void RemoveAllImages();
+
+  /// Total size of the cached images in kibibytes
+  unsigned long GetMemorySizeKB();
+
+  /// Get number of cached images
+  int GetNumberOfImages();
+
+  /// Set memory budget in kibibytes. Least recently used images are removed if the cache is larger. 0 disables the cache.
+  /// 256 MiB by default
+  void SetMemoryBudgetKB(unsigned long memoryBudgetKB);
+  vtkGetMacro(MemoryBudgetKB, unsigned long);
+
+  /// Remove least recently used images until the total size is at most the given size. The memory budget is not changed.
+  /// Used by computations with their own memory limit, so that the cached images count against that limit
+  void ReduceMemorySizeKB(unsigned long maximumMemorySizeKB);
+
+protected:
+  /// Get key identifying the world geometry (IJK to RAS matrix including parent transform, and extent) of a volume node
+  static std::string GetVolumeGeometryKey(vtkMRMLScalarVolumeNode* volumeNode);
+
+  /// Get key of a cached image from the source key, the reference geometry and the interpolation mode
+  static std::string GetImageKey(const std::string& sourceKey, vtkOrientedImageData* referenceGeometry, int interpolation);
+
+  /// Remove least recently used images until the cache is at most the given size. Must be called with the mutex locked
+  void EvictImages(unsigned long maximumMemorySizeKB);
+
+  /// Remove all images when the given scene is closed
+  void ObserveScene(vtkMRMLScene* scene);
+
+  /// Callback function removing the images when an observed scene is closed
+  static void OnSceneEndClose(vtkObject* caller, unsigned long eid, void* clientData, void* callData);
+
+protected:
+  struct CacheEntry
+  {
+    /// Full key (source key, target geometry, interpolation)
+    std::string Key;
+    std::string SourceKey;
+    vtkSmartPointer<vtkOrientedImageData> Image;
+    unsigned long MemorySizeKB{0};
+  };
+  typedef std::list<CacheEntry> CacheEntryList;
+
+  /// Cached images, most recently used first
+  CacheEntryList Entries;
+  /// Entries by full key (source key, target geometry, interpolation)
+  std::map<std::string, CacheEntryList::iterator> EntriesByKey;
+
+  /// Scenes whose closing releases the cached images
+  std::vector<vtkWeakPointer<vtkMRMLScene> > ObservedScenes;
+  vtkSmartPointer<vtkCallbackCommand> SceneCallbackCommand;
+
+  unsigned long MemoryBudgetKB;
+  unsigned long MemorySizeKB;
+
+  /// The cache may be accessed from worker threads
+  std::mutex Mutex;
+
+protected:
+  vtkResampledDoseCache();
+  ~vtkResampledDoseCache() override;
+
+private:
+  vtkResampledDoseCache(const vtkResampledDoseCache&) = delete;
+  void operator=(const vtkResampledDoseCache&) = delete;
+};
+
+#endif
@@ -35,7 +35,9 @@
 #include <vtkGeneralTransform.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
+#include <vtkVersionMacros.h>
 
 // SegmentationCore includes
 #include "vtkOrientedImageData.h"
@@ -44,6 +46,15 @@
 // VTK sys tools
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 //----------------------------------------------------------------------------
 // Constant strings
 //----------------------------------------------------------------------------
@@ -73,6 +84,8 @@ const std::string vtkSlicerRtCommon::DICOMRTIMPORT_BEAM_JAW_POSITIONS_ATTRIBUTE_
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_BEAM_NUMBER_ATTRIBUTE_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "BeamNumber";
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_ROI_REFERENCED_SERIES_UID_ATTRIBUTE_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RoiReferencedSeriesUid"; // DICOM connection
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_ROI_NUMBER_SEGMENT_TAG_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RoiNumber";
+const std::string vtkSlicerRtCommon::DICOMRTIMPORT_ROI_NUMBER_OF_CONTOURS_SEGMENT_TAG_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RoiNumberOfContours";
+const std::string vtkSlicerRtCommon::DICOMRTIMPORT_ROI_BOUNDS_SEGMENT_TAG_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RoiBounds";
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_RTIMAGE_IDENTIFIER_ATTRIBUTE_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RtImage"; // Identifier
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_RTIMAGE_SID_ATTRIBUTE_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RtImageSid";
 const std::string vtkSlicerRtCommon::DICOMRTIMPORT_RTIMAGE_POSITION_ATTRIBUTE_NAME = vtkSlicerRtCommon::DICOMRTIMPORT_ATTRIBUTE_PREFIX + "RtImagePosition";
@@ -258,6 +271,40 @@ bool vtkSlicerRtCommon::DoVolumeLatticesMatch(vtkMRMLScalarVolumeNode* volume1,
   return true;
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerRtCommon::GetTransformToWorldSignature(vtkMRMLTransformNode* transformNode)
+{
+  if (!transformNode)
+  {
+    return "";
+  }
+
+  std::stringstream signatureStream;
+  if (transformNode->IsTransformToWorldLinear())
+  {
+    vtkSmartPointer<vtkMatrix4x4> transformToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    transformNode->GetMatrixTransformToWorld(transformToWorldMatrix);
+    signatureStream.precision(12);
+    for (int row = 0; row < 3; ++row)
+    {
+      for (int column = 0; column < 4; ++column)
+      {
+        signatureStream << transformToWorldMatrix->GetElement(row, column) << " ";
+      }
+    }
+  }
+  else
+  {
+    // Non-linear transforms cannot be described by a matrix, so identify them by the state of the whole chain
+    for (vtkMRMLTransformNode* currentTransformNode = transformNode; currentTransformNode;
+      currentTransformNode = currentTransformNode->GetParentTransformNode())
+    {
+      signatureStream << (currentTransformNode->GetID() ? currentTransformNode->GetID() : "") << ":" << currentTransformNode->GetMTime() << ";";
+    }
+  }
+  return signatureStream.str();
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerRtCommon::AreEqualWithTolerance(double a, double b)
 {
@@ -276,6 +323,109 @@ bool vtkSlicerRtCommon::AreExtentsEqual(int extentA[6], int extentB[6])
     extentA[5] == extentB [5];
 }
 
+//---------------------------------------------------------------------------
+namespace
+{
+/// Functor processing the items of vtkSlicerRtCommon::RunOnWorkerThreads in vtkSMPTools::For.
+/// Progress is reported whenever an item finishes on the calling thread. An exception thrown while processing
+/// an item is kept (instead of terminating the worker thread) and the remaining items are skipped.
+class WorkerItemsFunctor
+{
+public:
+  WorkerItemsFunctor(const std::function<void(size_t)>& processItem, const std::function<void(size_t)>& itemsFinished)
+    : ProcessItem(processItem)
+    , ItemsFinished(itemsFinished)
+    , CallingThreadId(std::this_thread::get_id())
+    , NumberOfFinishedItems(0)
+    , NumberOfReportedItems(0)
+    , Failed(false)
+  {
+  }
+
+  void operator()(vtkIdType beginItemIndex, vtkIdType endItemIndex)
+  {
+    for (vtkIdType itemIndex = beginItemIndex; itemIndex < endItemIndex && !this->Failed; ++itemIndex)
+    {
+      try
+      {
+        this->ProcessItem(static_cast<size_t>(itemIndex));
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(this->ExceptionMutex);
+        if (!this->Failed)
+        {
+          this->Exception = std::current_exception();
+          this->Failed = true;
+        }
+        return;
+      }
+      size_t numberOfFinishedItems = ++this->NumberOfFinishedItems;
+      if (std::this_thread::get_id() == this->CallingThreadId)
+      {
+        this->NumberOfReportedItems = numberOfFinishedItems;
+        this->ItemsFinished(numberOfFinishedItems);
+      }
+    }
+  }
+
+  const std::function<void(size_t)>& ProcessItem;
+  const std::function<void(size_t)>& ItemsFinished;
+  std::thread::id CallingThreadId;
+  std::atomic<size_t> NumberOfFinishedItems;
+  /// Only accessed on the calling thread
+  size_t NumberOfReportedItems;
+  std::atomic<bool> Failed;
+  std::mutex ExceptionMutex;
+  std::exception_ptr Exception;
+};
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerRtCommon::RunOnWorkerThreads(size_t numberOfItems, unsigned int numberOfThreads,
+  const std::function<void(size_t)>& processItem, const std::function<void(size_t)>& itemsFinished)
+{
+  if (numberOfThreads <= 1 || numberOfItems <= 1)
+  {
+    for (size_t itemIndex = 0; itemIndex < numberOfItems; ++itemIndex)
+    {
+      processItem(itemIndex);
+      itemsFinished(itemIndex + 1);
+    }
+    return;
+  }
+
+  // Items are expensive (segments, plane pairs, isodose levels), so they are handed out one by one
+  WorkerItemsFunctor functor(processItem, itemsFinished);
+#if VTK_MAJOR_VERSION > 9 || (VTK_MAJOR_VERSION == 9 && VTK_MINOR_VERSION >= 2)
+  vtkSMPTools::LocalScope(vtkSMPTools::Config(static_cast<int>(numberOfThreads), vtkSMPTools::GetBackend(), false),
+    [&]() { vtkSMPTools::For(0, static_cast<vtkIdType>(numberOfItems), 1, functor); });
+#else
+  vtkSMPTools::For(0, static_cast<vtkIdType>(numberOfItems), 1, functor);
+#endif
+
+  if (functor.Exception)
+  {
+    std::rethrow_exception(functor.Exception);
+  }
+  if (functor.NumberOfReportedItems < numberOfItems)
+  {
+    itemsFinished(numberOfItems);
+  }
+}
+
+//---------------------------------------------------------------------------
+unsigned int vtkSlicerRtCommon::GetNumberOfWorkerThreads(int requestedNumberOfThreads, size_t numberOfItems)
+{
+  unsigned int numberOfThreads = (requestedNumberOfThreads > 0 ? static_cast<unsigned int>(requestedNumberOfThreads)
+    : static_cast<unsigned int>(std::max(1, vtkSMPTools::GetEstimatedNumberOfThreads())));
+  if (numberOfItems > 0 && numberOfThreads > numberOfItems)
+  {
+    numberOfThreads = static_cast<unsigned int>(numberOfItems);
+  }
+  return std::max(1u, numberOfThreads);
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerRtCommon::GenerateRandomColor(vtkMRMLColorTableNode* colorNode, double* newColor)
 {
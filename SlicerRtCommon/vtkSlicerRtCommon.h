@@ -23,6 +23,7 @@
 
 // STD includes
 #include <cstdlib>
+#include <functional>
 #include <string>
 
 // ITK includes
@@ -36,6 +37,7 @@ class vtkMRMLNode;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLScene;
 class vtkMRMLTransformableNode;
+class vtkMRMLTransformNode;
 
 class vtkImageData;
 class vtkOrientedImageData;
@@ -102,6 +104,8 @@ public:
   static const std::string DICOMRTIMPORT_BEAM_NUMBER_ATTRIBUTE_NAME;
   static const std::string DICOMRTIMPORT_ROI_REFERENCED_SERIES_UID_ATTRIBUTE_NAME;
   static const std::string DICOMRTIMPORT_ROI_NUMBER_SEGMENT_TAG_NAME;
+  static const std::string DICOMRTIMPORT_ROI_NUMBER_OF_CONTOURS_SEGMENT_TAG_NAME;
+  static const std::string DICOMRTIMPORT_ROI_BOUNDS_SEGMENT_TAG_NAME;
   static const std::string DICOMRTIMPORT_RTIMAGE_IDENTIFIER_ATTRIBUTE_NAME;
   static const std::string DICOMRTIMPORT_RTIMAGE_SID_ATTRIBUTE_NAME;
   static const std::string DICOMRTIMPORT_RTIMAGE_POSITION_ATTRIBUTE_NAME;
@@ -140,12 +144,32 @@ public:
   /// Check if the lattice (grid, geometry) of two volumes are the same
   static bool DoVolumeLatticesMatch(vtkMRMLScalarVolumeNode* volume1, vtkMRMLScalarVolumeNode* volume2);
 
+  /// Get string identifying the current transform to world of a transform node, to be used in cache keys and
+  /// input signatures. Linear transforms are identified by the transform to world matrix, non-linear ones by the
+  /// ID and modified time of every transform node up to the world, so that edits of any ancestor are detected.
+  /// \return Signature string, empty if the transform node is null
+  static std::string GetTransformToWorldSignature(vtkMRMLTransformNode* transformNode);
+
   /// Determine if two numbers are equal within a small tolerance (0.0001)
   static bool AreEqualWithTolerance(double a, double b);
 
   /// Determine if two bounds are equal
   static bool AreExtentsEqual(int boundsA[6], int boundsB[6]);
 
+  /// Call processItem for each item index using vtkSMPTools::For, on at most the given number of threads.
+  /// itemsFinished is only called on the calling thread with the number of items finished so far (so that progress
+  /// events are never invoked from worker threads): after each item it processes, and once all items are done.
+  /// An exception thrown by processItem stops processing the remaining items and is rethrown on the calling thread.
+  /// If there is only one thread then the items are processed in order on the calling thread.
+  static void RunOnWorkerThreads(size_t numberOfItems, unsigned int numberOfThreads,
+    const std::function<void(size_t)>& processItem, const std::function<void(size_t)>& itemsFinished);
+
+  /// Get the number of worker threads to use for processing the given number of items.
+  /// The NumberOfThreads properties of the classes running on worker threads all follow this convention.
+  /// \param requestedNumberOfThreads Requested number of threads. 0 means the number of threads of the vtkSMPTools backend
+  /// \return Number of threads, at least 1 and at most the number of items (if there are any)
+  static unsigned int GetNumberOfWorkerThreads(int requestedNumberOfThreads, size_t numberOfItems);
+
   /// Generate a new color that is not already in use in a color table node
   /// \param colorNode Color table node to validate against
   static void GenerateRandomColor(vtkMRMLColorTableNode* colorNode, double* newColor);